@@ -63,29 +63,29 @@ unsigned char inv_byte_sub[256];
 
 // this table needs Nb*(Nr+1)/Nk entries - up to 8*(15)/4 = 60
 // todo - remove table, note cycles every 17(?) elements
-unsigned long Rcon[60];
+unsigned int Rcon[60];
 
 // long tables for encryption stuff
-unsigned long T0[256];
-unsigned long T1[256];
-unsigned long T2[256];
-unsigned long T3[256];
+unsigned int T0[256];
+unsigned int T1[256];
+unsigned int T2[256];
+unsigned int T3[256];
 
 // long tables for decryption stuff
-unsigned long I0[256];
-unsigned long I1[256];
-unsigned long I2[256];
-unsigned long I3[256];
+unsigned int I0[256];
+unsigned int I1[256];
+unsigned int I2[256];
+unsigned int I3[256];
 
 // huge tables - todo - ifdef out
-unsigned long T4[256];
-unsigned long T5[256];
-unsigned long T6[256];
-unsigned long T7[256];
-unsigned long I4[256];
-unsigned long I5[256];
-unsigned long I6[256];
-unsigned long I7[256];
+unsigned int T4[256];
+unsigned int T5[256];
+unsigned int T6[256];
+unsigned int T7[256];
+unsigned int I4[256];
+unsigned int I5[256];
+unsigned int I6[256];
+unsigned int I7[256];
 
 // have the tables been initialized?
 bool tablesInitialized = false;
@@ -465,7 +465,7 @@ bool CheckRcon(bool create)
 						compute_one_final_inv(d,s,6,1,3,4,8); \
 						compute_one_final_inv(d,s,7,1,3,4,8); 
 
-unsigned long SubByte(unsigned long data)
+unsigned int SubByte(unsigned int data)
 	{ // does the SBox on this 4 byte data
 	unsigned result = 0;
 	result = byte_sub[data>>24];
@@ -495,7 +495,7 @@ void DumpCharTable(ostream & out, const char * name, const unsigned char * table
 	out << dec;
 	} // DumpCharTable
 
-void DumpLongTable(ostream & out, const char * name, const unsigned long * table, int length)
+void DumpLongTable(ostream & out, const char * name, const unsigned int * table, int length)
 	{ // dump te contents of a table to a file
 	int pos;
 	out << name << endl << hex;
@@ -600,7 +600,7 @@ void AES::KeyExpansion(const unsigned char * key)
 	{
 	assert(Nk > 0);
 	int i;
-	unsigned long temp, * Wb = reinterpret_cast<unsigned long*>(W); // todo not portable - Endian problems
+	unsigned int temp, * Wb = reinterpret_cast<unsigned int*>(W); // todo not portable - Endian problems
 	if (Nk <= 6)
 		{
 		// todo - memcpy
@@ -663,12 +663,12 @@ void AES::EncryptBlock(const unsigned char * datain1, unsigned char * dataout1)
 	  // todo - clean up - lots of repeated macros
 	  // we only encrypt one block from now on
 
-	unsigned long state[8*2]; // 2 buffers
-	unsigned long * r_ptr = reinterpret_cast<unsigned long*>(W);
-	unsigned long * dest  = state;
-	unsigned long * src   = state; 
-	const unsigned long * datain = reinterpret_cast<const unsigned long*>(datain1);
-	unsigned long * dataout = reinterpret_cast<unsigned long*>(dataout1);
+	unsigned int state[8*2]; // 2 buffers
+	unsigned int * r_ptr = reinterpret_cast<unsigned int*>(W);
+	unsigned int * dest  = state;
+	unsigned int * src   = state; 
+	const unsigned int * datain = reinterpret_cast<const unsigned int*>(datain1);
+	unsigned int * dataout = reinterpret_cast<unsigned int*>(dataout1);
 
 	if (Nb == 4)
 		{
@@ -813,7 +813,7 @@ void AES::StartDecryption(const unsigned char * key)
 		}
 
 	// we reverse the rounds to make decryption faster
-	unsigned long * WL = reinterpret_cast<unsigned long*>(W);
+	unsigned int * WL = reinterpret_cast<unsigned int*>(W);
 	for (int pos = 0; pos < Nr/2; pos++)
 		for (int col = 0; col < Nb; col++)
 			swap(WL[col+pos*Nb],WL[col+(Nr-pos)*Nb]);
@@ -821,13 +821,13 @@ void AES::StartDecryption(const unsigned char * key)
 
 void AES::DecryptBlock(const unsigned char * datain1, unsigned char * dataout1)
 	{
-	unsigned long state[8*2]; // 2 buffers
-	unsigned long * r_ptr = reinterpret_cast<unsigned long*>(W);
-	unsigned long * dest  = state;
-	unsigned long * src   = state; 
+	unsigned int state[8*2]; // 2 buffers
+	unsigned int * r_ptr = reinterpret_cast<unsigned int*>(W);
+	unsigned int * dest  = state;
+	unsigned int * src   = state; 
 
-	const unsigned long * datain = reinterpret_cast<const unsigned long*>(datain1);
-	unsigned long * dataout = reinterpret_cast<unsigned long*>(dataout1);
+	const unsigned int * datain = reinterpret_cast<const unsigned int*>(datain1);
+	unsigned int * dataout = reinterpret_cast<unsigned int*>(dataout1);
 
 	if (Nb == 4)
 		{
@@ -0,0 +1,532 @@
+#include "AESBackends.h"
+
+#include "AES.h"
+#include <chrono>
+#include "CpuFeatures.h"
+#include <string.h>
+#include <vector>
+
+#if defined(BOY_X86)
+	#include <immintrin.h>
+#endif
+
+using namespace Boy;
+
+#include "BoyLib/CrtDbgNew.h"
+
+std::atomic<int> AESBackends::gBackend(-1);
+
+/*
+ * shared definitions. aes-192 has 12 rounds and 13 round keys of 4
+ * words each. words hold 4 bytes of a column in memory order (the
+ * first byte in the low bits), whatever the cpu's byte order is.
+ */
+
+#define AES192_ROUNDS 12
+#define AES192_KEY_WORDS 6
+#define AES192_SCHEDULE_WORDS (4 * (AES192_ROUNDS + 1))
+
+static inline unsigned int load32(const unsigned char *p)
+{
+	return (unsigned int)p[0] | ((unsigned int)p[1] << 8) | ((unsigned int)p[2] << 16) | ((unsigned int)p[3] << 24);
+}
+
+static inline void store32(unsigned char *p, unsigned int x)
+{
+	p[0] = (unsigned char)x;
+	p[1] = (unsigned char)(x >> 8);
+	p[2] = (unsigned char)(x >> 16);
+	p[3] = (unsigned char)(x >> 24);
+}
+
+static inline unsigned int rotl8(unsigned int x, int n)
+{
+	return n == 0 ? x : (x << n) | (x >> (32 - n));
+}
+
+static inline unsigned char xtime(unsigned char x)
+{
+	return (unsigned char)((x << 1) ^ ((x & 0x80) ? 0x1b : 0));
+}
+
+static unsigned char gmul(unsigned char a, unsigned char b)
+{
+	unsigned char result = 0;
+	while (b != 0)
+	{
+		if (b & 1)
+		{
+			result ^= a;
+		}
+		a = xtime(a);
+		b >>= 1;
+	}
+	return result;
+}
+
+// the s-boxes and the round tables (built the first time they're used):
+struct AESTables
+{
+	unsigned char sbox[256];
+	unsigned char invSbox[256];
+	unsigned int te[4][256]; // sub bytes + mix columns, one table per row
+	unsigned int td[4][256]; // their inverses
+
+	AESTables()
+	{
+		// the s-box is the affine transform of the multiplicative inverse:
+		for (int x=0 ; x<256 ; x++)
+		{
+			unsigned char inv = 0;
+			for (int y=1 ; y<256 && x!=0 ; y++)
+			{
+				if (gmul((unsigned char)x, (unsigned char)y) == 1)
+				{
+					inv = (unsigned char)y;
+					break;
+				}
+			}
+			unsigned char s = inv;
+			for (int i=1 ; i<5 ; i++)
+			{
+				s ^= (unsigned char)((inv << i) | (inv >> (8 - i)));
+			}
+			s ^= 0x63;
+			sbox[x] = s;
+			invSbox[s] = (unsigned char)x;
+		}
+
+		for (int x=0 ; x<256 ; x++)
+		{
+			unsigned char s = sbox[x];
+			unsigned char i = invSbox[x];
+			unsigned int e = (unsigned int)gmul(s, 2) | ((unsigned int)s << 8) | ((unsigned int)s << 16) | ((unsigned int)gmul(s, 3) << 24);
+			unsigned int d = (unsigned int)gmul(i, 14) | ((unsigned int)gmul(i, 9) << 8) | ((unsigned int)gmul(i, 13) << 16) | ((unsigned int)gmul(i, 11) << 24);
+			for (int row=0 ; row<4 ; row++)
+			{
+				te[row][x] = rotl8(e, 8 * row);
+				td[row][x] = rotl8(d, 8 * row);
+			}
+		}
+	}
+};
+
+static const AESTables &getTables()
+{
+	static AESTables tables;
+	return tables;
+}
+
+static void expandKey(const unsigned char *key, unsigned int *rk)
+{
+	const AESTables &t = getTables();
+	for (int i=0 ; i<AES192_KEY_WORDS ; i++)
+	{
+		rk[i] = load32(key + 4 * i);
+	}
+
+	unsigned char rcon = 1;
+	for (int i=AES192_KEY_WORDS ; i<AES192_SCHEDULE_WORDS ; i++)
+	{
+		unsigned int w = rk[i-1];
+		if (i % AES192_KEY_WORDS == 0)
+		{
+			// rotate, substitute and add the round constant:
+			w = (w >> 8) | (w << 24);
+			w = (unsigned int)t.sbox[w & 0xff] | ((unsigned int)t.sbox[(w >> 8) & 0xff] << 8) |
+				((unsigned int)t.sbox[(w >> 16) & 0xff] << 16) | ((unsigned int)t.sbox[w >> 24] << 24);
+			w ^= rcon;
+			rcon = xtime(rcon);
+		}
+		rk[i] = rk[i-AES192_KEY_WORDS] ^ w;
+	}
+}
+
+// the round keys of the equivalent inverse cipher (the rounds in reverse
+// order, with inverse mix columns applied to all but the first and last):
+static void invertKey(const unsigned int *rk, unsigned int *dk)
+{
+	const AESTables &t = getTables();
+	for (int r=0 ; r<=AES192_ROUNDS ; r++)
+	{
+		for (int c=0 ; c<4 ; c++)
+		{
+			unsigned int w = rk[4 * (AES192_ROUNDS - r) + c];
+			if (r > 0 && r < AES192_ROUNDS)
+			{
+				// (the tables undo the s-box, so look the bytes up in it first):
+				w = t.td[0][t.sbox[w & 0xff]] ^ t.td[1][t.sbox[(w >> 8) & 0xff]] ^
+					t.td[2][t.sbox[(w >> 16) & 0xff]] ^ t.td[3][t.sbox[w >> 24]];
+			}
+			dk[4 * r + c] = w;
+		}
+	}
+}
+
+/*
+ * reference: the AES class
+ */
+
+static void encryptReference(const unsigned char *key, const unsigned char *in, unsigned char *out, int blockCount)
+{
+	AES crypt;
+	crypt.SetParameters(192);
+	crypt.StartEncryption(key);
+	crypt.Encrypt(in, out, blockCount);
+}
+
+static void decryptReference(const unsigned char *key, const unsigned char *in, unsigned char *out, int blockCount)
+{
+	// (it needs the previous block's cipher text after it's been decrypted):
+	std::vector<unsigned char> copy;
+	if (in == out)
+	{
+		copy.assign(in, in + blockCount * 16);
+		in = &copy[0];
+	}
+
+	AES crypt;
+	crypt.SetParameters(192);
+	crypt.StartDecryption(key);
+	crypt.Decrypt(in, out, blockCount);
+}
+
+/*
+ * ttable: four table lookups per column and round
+ */
+
+// one column of a round: a table per row, the rows shifted by the
+// column they're taken from:
+static inline unsigned int encColumn(const AESTables &t, unsigned int a, unsigned int b, unsigned int c, unsigned int d, unsigned int k)
+{
+	return t.te[0][a & 0xff] ^ t.te[1][(b >> 8) & 0xff] ^ t.te[2][(c >> 16) & 0xff] ^ t.te[3][d >> 24] ^ k;
+}
+
+static inline unsigned int encLastColumn(const AESTables &t, unsigned int a, unsigned int b, unsigned int c, unsigned int d, unsigned int k)
+{
+	return ((unsigned int)t.sbox[a & 0xff] | ((unsigned int)t.sbox[(b >> 8) & 0xff] << 8) |
+		((unsigned int)t.sbox[(c >> 16) & 0xff] << 16) | ((unsigned int)t.sbox[d >> 24] << 24)) ^ k;
+}
+
+static inline unsigned int decColumn(const AESTables &t, unsigned int a, unsigned int b, unsigned int c, unsigned int d, unsigned int k)
+{
+	return t.td[0][a & 0xff] ^ t.td[1][(b >> 8) & 0xff] ^ t.td[2][(c >> 16) & 0xff] ^ t.td[3][d >> 24] ^ k;
+}
+
+static inline unsigned int decLastColumn(const AESTables &t, unsigned int a, unsigned int b, unsigned int c, unsigned int d, unsigned int k)
+{
+	return ((unsigned int)t.invSbox[a & 0xff] | ((unsigned int)t.invSbox[(b >> 8) & 0xff] << 8) |
+		((unsigned int)t.invSbox[(c >> 16) & 0xff] << 16) | ((unsigned int)t.invSbox[d >> 24] << 24)) ^ k;
+}
+
+static void encryptTTable(const unsigned char *key, const unsigned char *in, unsigned char *out, int blockCount)
+{
+	const AESTables &t = getTables();
+	unsigned int rk[AES192_SCHEDULE_WORDS];
+	expandKey(key, rk);
+
+	unsigned int v0 = 0, v1 = 0, v2 = 0, v3 = 0;
+	for (int b=0 ; b<blockCount ; b++, in+=16, out+=16)
+	{
+		unsigned int s0 = load32(in) ^ v0 ^ rk[0];
+		unsigned int s1 = load32(in + 4) ^ v1 ^ rk[1];
+		unsigned int s2 = load32(in + 8) ^ v2 ^ rk[2];
+		unsigned int s3 = load32(in + 12) ^ v3 ^ rk[3];
+
+		const unsigned int *k = rk + 4;
+		for (int r=1 ; r<AES192_ROUNDS ; r++, k+=4)
+		{
+			unsigned int n0 = encColumn(t, s0, s1, s2, s3, k[0]);
+			unsigned int n1 = encColumn(t, s1, s2, s3, s0, k[1]);
+			unsigned int n2 = encColumn(t, s2, s3, s0, s1, k[2]);
+			unsigned int n3 = encColumn(t, s3, s0, s1, s2, k[3]);
+			s0 = n0; s1 = n1; s2 = n2; s3 = n3;
+		}
+
+		// the last round doesn't mix:
+		v0 = encLastColumn(t, s0, s1, s2, s3, k[0]);
+		v1 = encLastColumn(t, s1, s2, s3, s0, k[1]);
+		v2 = encLastColumn(t, s2, s3, s0, s1, k[2]);
+		v3 = encLastColumn(t, s3, s0, s1, s2, k[3]);
+		store32(out, v0);
+		store32(out + 4, v1);
+		store32(out + 8, v2);
+		store32(out + 12, v3);
+	}
+}
+
+static void decryptTTable(const unsigned char *key, const unsigned char *in, unsigned char *out, int blockCount)
+{
+	const AESTables &t = getTables();
+	unsigned int rk[AES192_SCHEDULE_WORDS];
+	unsigned int dk[AES192_SCHEDULE_WORDS];
+	expandKey(key, rk);
+	invertKey(rk, dk);
+
+	unsigned int v0 = 0, v1 = 0, v2 = 0, v3 = 0;
+	for (int b=0 ; b<blockCount ; b++, in+=16, out+=16)
+	{
+		unsigned int c0 = load32(in);
+		unsigned int c1 = load32(in + 4);
+		unsigned int c2 = load32(in + 8);
+		unsigned int c3 = load32(in + 12);
+		unsigned int s0 = c0 ^ dk[0];
+		unsigned int s1 = c1 ^ dk[1];
+		unsigned int s2 = c2 ^ dk[2];
+		unsigned int s3 = c3 ^ dk[3];
+
+		const unsigned int *k = dk + 4;
+		for (int r=1 ; r<AES192_ROUNDS ; r++, k+=4)
+		{
+			unsigned int n0 = decColumn(t, s0, s3, s2, s1, k[0]);
+			unsigned int n1 = decColumn(t, s1, s0, s3, s2, k[1]);
+			unsigned int n2 = decColumn(t, s2, s1, s0, s3, k[2]);
+			unsigned int n3 = decColumn(t, s3, s2, s1, s0, k[3]);
+			s0 = n0; s1 = n1; s2 = n2; s3 = n3;
+		}
+
+		store32(out, decLastColumn(t, s0, s3, s2, s1, k[0]) ^ v0);
+		store32(out + 4, decLastColumn(t, s1, s0, s3, s2, k[1]) ^ v1);
+		store32(out + 8, decLastColumn(t, s2, s1, s0, s3, k[2]) ^ v2);
+		store32(out + 12, decLastColumn(t, s3, s2, s1, s0, k[3]) ^ v3);
+		v0 = c0; v1 = c1; v2 = c2; v3 = c3;
+	}
+}
+
+/*
+ * aesni: a round per instruction. the round keys are the same bytes
+ * the ttable path uses.
+ */
+
+#if defined(BOY_X86)
+BOY_TARGET("aes,sse2") static void encryptAESNI(const unsigned char *key, const unsigned char *in, unsigned char *out, int blockCount)
+{
+	unsigned int rk[AES192_SCHEDULE_WORDS];
+	expandKey(key, rk);
+	__m128i k[AES192_ROUNDS + 1];
+	for (int r=0 ; r<=AES192_ROUNDS ; r++)
+	{
+		k[r] = _mm_loadu_si128((const __m128i*)(rk + 4 * r));
+	}
+
+	// (cbc encryption is serial, one block after the other):
+	__m128i x = _mm_setzero_si128();
+	for (int b=0 ; b<blockCount ; b++, in+=16, out+=16)
+	{
+		x = _mm_xor_si128(x, _mm_loadu_si128((const __m128i*)in));
+		x = _mm_xor_si128(x, k[0]);
+		for (int r=1 ; r<AES192_ROUNDS ; r++)
+		{
+			x = _mm_aesenc_si128(x, k[r]);
+		}
+		x = _mm_aesenclast_si128(x, k[AES192_ROUNDS]);
+		_mm_storeu_si128((__m128i*)out, x);
+	}
+}
+
+BOY_TARGET("aes,sse2") static void decryptAESNI(const unsigned char *key, const unsigned char *in, unsigned char *out, int blockCount)
+{
+	unsigned int rk[AES192_SCHEDULE_WORDS];
+	expandKey(key, rk);
+	__m128i k[AES192_ROUNDS + 1];
+	k[0] = _mm_loadu_si128((const __m128i*)(rk + 4 * AES192_ROUNDS));
+	for (int r=1 ; r<AES192_ROUNDS ; r++)
+	{
+		k[r] = _mm_aesimc_si128(_mm_loadu_si128((const __m128i*)(rk + 4 * (AES192_ROUNDS - r))));
+	}
+	k[AES192_ROUNDS] = _mm_loadu_si128((const __m128i*)rk);
+
+	// blocks don't depend on each other's decryption, so 4 go through
+	// the pipeline together:
+	__m128i iv = _mm_setzero_si128();
+	int b = 0;
+	for ( ; b+4<=blockCount ; b+=4, in+=64, out+=64)
+	{
+		__m128i c0 = _mm_loadu_si128((const __m128i*)in);
+		__m128i c1 = _mm_loadu_si128((const __m128i*)(in + 16));
+		__m128i c2 = _mm_loadu_si128((const __m128i*)(in + 32));
+		__m128i c3 = _mm_loadu_si128((const __m128i*)(in + 48));
+		__m128i x0 = _mm_xor_si128(c0, k[0]);
+		__m128i x1 = _mm_xor_si128(c1, k[0]);
+		__m128i x2 = _mm_xor_si128(c2, k[0]);
+		__m128i x3 = _mm_xor_si128(c3, k[0]);
+		for (int r=1 ; r<AES192_ROUNDS ; r++)
+		{
+			x0 = _mm_aesdec_si128(x0, k[r]);
+			x1 = _mm_aesdec_si128(x1, k[r]);
+			x2 = _mm_aesdec_si128(x2, k[r]);
+			x3 = _mm_aesdec_si128(x3, k[r]);
+		}
+		x0 = _mm_aesdeclast_si128(x0, k[AES192_ROUNDS]);
+		x1 = _mm_aesdeclast_si128(x1, k[AES192_ROUNDS]);
+		x2 = _mm_aesdeclast_si128(x2, k[AES192_ROUNDS]);
+		x3 = _mm_aesdeclast_si128(x3, k[AES192_ROUNDS]);
+		_mm_storeu_si128((__m128i*)out, _mm_xor_si128(x0, iv));
+		_mm_storeu_si128((__m128i*)(out + 16), _mm_xor_si128(x1, c0));
+		_mm_storeu_si128((__m128i*)(out + 32), _mm_xor_si128(x2, c1));
+		_mm_storeu_si128((__m128i*)(out + 48), _mm_xor_si128(x3, c2));
+		iv = c3;
+	}
+	for ( ; b<blockCount ; b++, in+=16, out+=16)
+	{
+		__m128i c = _mm_loadu_si128((const __m128i*)in);
+		__m128i x = _mm_xor_si128(c, k[0]);
+		for (int r=1 ; r<AES192_ROUNDS ; r++)
+		{
+			x = _mm_aesdec_si128(x, k[r]);
+		}
+		x = _mm_aesdeclast_si128(x, k[AES192_ROUNDS]);
+		_mm_storeu_si128((__m128i*)out, _mm_xor_si128(x, iv));
+		iv = c;
+	}
+}
+#endif
+
+/*
+ * dispatch
+ */
+
+AESBackends::Backend AESBackends::getBestBackend()
+{
+	if (isSupported(BACKEND_AESNI))
+	{
+		return BACKEND_AESNI;
+	}
+	return BACKEND_TTABLE;
+}
+
+bool AESBackends::isSupported(Backend backend)
+{
+	switch (backend)
+	{
+	case BACKEND_REFERENCE:
+	case BACKEND_TTABLE:
+		return true;
+#if defined(BOY_X86)
+	case BACKEND_AESNI:
+		return CpuFeatures::hasAESNI();
+#endif
+	default:
+		return false;
+	}
+}
+
+const char *AESBackends::getBackendName(Backend backend)
+{
+	switch (backend)
+	{
+	case BACKEND_REFERENCE:
+		return "reference";
+	case BACKEND_TTABLE:
+		return "ttable";
+	case BACKEND_AESNI:
+		return "aesni";
+	default:
+		return "unknown";
+	}
+}
+
+void AESBackends::setBackend(Backend backend)
+{
+	gBackend = isSupported(backend) ? backend : getBestBackend();
+}
+
+AESBackends::Backend AESBackends::getBackend()
+{
+	int backend = gBackend.load();
+	if (backend < 0)
+	{
+		// (threads that get here at once all pick the same one, and
+		// one picked with setBackend() in the meantime wins):
+		int best = getBestBackend();
+		gBackend.compare_exchange_strong(backend, best);
+		backend = gBackend.load();
+	}
+	return (Backend)backend;
+}
+
+void AESBackends::encrypt(Backend backend, const unsigned char *key, const unsigned char *in, unsigned char *out, int blockCount)
+{
+	if (blockCount <= 0)
+	{
+		return;
+	}
+
+	if (!isSupported(backend))
+	{
+		backend = getBestBackend();
+	}
+
+	switch (backend)
+	{
+#if defined(BOY_X86)
+	case BACKEND_AESNI:
+		encryptAESNI(key, in, out, blockCount);
+		break;
+#endif
+	case BACKEND_TTABLE:
+		encryptTTable(key, in, out, blockCount);
+		break;
+	default:
+		encryptReference(key, in, out, blockCount);
+		break;
+	}
+}
+
+void AESBackends::decrypt(Backend backend, const unsigned char *key, const unsigned char *in, unsigned char *out, int blockCount)
+{
+	if (blockCount <= 0)
+	{
+		return;
+	}
+
+	if (!isSupported(backend))
+	{
+		backend = getBestBackend();
+	}
+
+	switch (backend)
+	{
+#if defined(BOY_X86)
+	case BACKEND_AESNI:
+		decryptAESNI(key, in, out, blockCount);
+		break;
+#endif
+	case BACKEND_TTABLE:
+		decryptTTable(key, in, out, blockCount);
+		break;
+	default:
+		decryptReference(key, in, out, blockCount);
+		break;
+	}
+}
+
+double AESBackends::benchmark(Backend backend, int sizeBytes, int repeats)
+{
+	int blockCount = (sizeBytes + 15) / 16;
+	if (blockCount <= 0 || repeats <= 0)
+	{
+		return 0;
+	}
+
+	unsigned char key[KEY_SIZE];
+	for (int i=0 ; i<KEY_SIZE ; i++)
+	{
+		key[i] = (unsigned char)(i * 7 + 1);
+	}
+	std::vector<unsigned char> data(blockCount * 16);
+	for (size_t i=0 ; i<data.size() ; i++)
+	{
+		data[i] = (unsigned char)(i * 31 + (i >> 8));
+	}
+
+	// (in place, over and over, like a file that's read once):
+	std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+	for (int i=0 ; i<repeats ; i++)
+	{
+		decrypt(backend, key, &data[0], &data[0], blockCount);
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+	return seconds > 0 ? (double)data.size() * repeats / seconds / 1000000.0 : 0;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "BoyLib/CrtDbgInc.h"
+
+#include <atomic>
+
+namespace Boy
+{
+	/*
+	 * the block cipher behind aesEncrypt() and aesDecrypt(): aes-192 in
+	 * cbc mode with a zero iv, on 16 byte blocks. every backend produces
+	 * exactly the same bytes; the ones other than the reference (the
+	 * AES class) are just faster:
+	 *
+	 *   reference - the AES class
+	 *   ttable    - 32 bit lookup tables, specialized for aes-192
+	 *   aesni     - the x86 aes instructions (decrypts 4 blocks at once)
+	 *
+	 * input and output may be the same buffer.
+	 */
+	class AESBackends
+	{
+	public:
+
+		enum Backend
+		{
+			BACKEND_REFERENCE,
+			BACKEND_TTABLE,
+			BACKEND_AESNI,
+			BACKEND_COUNT
+		};
+
+		// key size in bytes:
+		enum { KEY_SIZE = 24 };
+
+		// the fastest backend the cpu supports:
+		static Backend getBestBackend();
+
+		// whether a backend can run on this cpu:
+		static bool isSupported(Backend backend);
+
+		static const char *getBackendName(Backend backend);
+
+		// the backend aesEncrypt() and aesDecrypt() use (the best
+		// one unless another one is picked, safe from any thread):
+		static void setBackend(Backend backend);
+		static Backend getBackend();
+
+		static void encrypt(Backend backend, const unsigned char *key, const unsigned char *in, unsigned char *out, int blockCount);
+		static void decrypt(Backend backend, const unsigned char *key, const unsigned char *in, unsigned char *out, int blockCount);
+
+		// decrypts a buffer of this size a number of times and returns
+		// the throughput (in MB/s):
+		static double benchmark(Backend backend, int sizeBytes, int repeats);
+
+	private:
+
+		AESBackends() {}
+
+	private:
+
+		// (any thread can pick it, -1 until one does):
+		static std::atomic<int> gBackend;
+	};
+}
@@ -0,0 +1,130 @@
+#include "AtlasPacker.h"
+
+#include <assert.h>
+
+using namespace Boy;
+
+#include "BoyLib/CrtDbgNew.h"
+
+AtlasPacker::AtlasPacker(int width, int height)
+{
+	assert(width>0 && height>0);
+	mWidth = width;
+	mHeight = height;
+	mUsedArea = 0;
+
+	// the skyline starts out as the bottom of the page:
+	Segment s = {0, 0, width};
+	mSkyline.push_back(s);
+}
+
+AtlasPacker::~AtlasPacker()
+{
+}
+
+int AtlasPacker::fit(int i, int width, int height)
+{
+	int x = mSkyline[i].x;
+	if (x + width > mWidth)
+	{
+		return -1;
+	}
+
+	// the rect rests on the highest segment it spans:
+	int y = 0;
+	int remaining = width;
+	while (remaining>0)
+	{
+		if (mSkyline[i].y > y)
+		{
+			y = mSkyline[i].y;
+		}
+		if (y + height > mHeight)
+		{
+			return -1;
+		}
+		remaining -= mSkyline[i].width;
+		i++;
+	}
+	return y;
+}
+
+bool AtlasPacker::insert(int width, int height, int *x, int *y)
+{
+	assert(width>0 && height>0);
+
+	// find the spot where the rect's bottom is lowest
+	// (ties go to the narrower segment):
+	int bestIndex = -1;
+	int bestBottom = 0;
+	int bestWidth = 0;
+	int bestY = 0;
+	for (int i=0 ; i<(int)mSkyline.size() ; i++)
+	{
+		int fy = fit(i, width, height);
+		if (fy<0)
+		{
+			continue;
+		}
+		int bottom = fy + height;
+		if (bestIndex<0 || bottom<bestBottom || (bottom==bestBottom && mSkyline[i].width<bestWidth))
+		{
+			bestIndex = i;
+			bestBottom = bottom;
+			bestWidth = mSkyline[i].width;
+			bestY = fy;
+		}
+	}
+	if (bestIndex<0)
+	{
+		return false;
+	}
+
+	*x = mSkyline[bestIndex].x;
+	*y = bestY;
+
+	// the rect becomes a new piece of the skyline:
+	Segment s = {*x, bestBottom, width};
+	mSkyline.insert(mSkyline.begin() + bestIndex, s);
+
+	// and hides (parts of) the segments under it:
+	int right = *x + width;
+	for (int i=bestIndex+1 ; i<(int)mSkyline.size() ; )
+	{
+		Segment &seg = mSkyline[i];
+		if (seg.x >= right)
+		{
+			break;
+		}
+		int shrink = right - seg.x;
+		if (shrink < seg.width)
+		{
+			seg.x += shrink;
+			seg.width -= shrink;
+			break;
+		}
+		mSkyline.erase(mSkyline.begin() + i);
+	}
+
+	// join neighbors at the same height:
+	for (int i=0 ; i+1<(int)mSkyline.size() ; )
+	{
+		if (mSkyline[i].y == mSkyline[i+1].y)
+		{
+			mSkyline[i].width += mSkyline[i+1].width;
+			mSkyline.erase(mSkyline.begin() + i + 1);
+		}
+		else
+		{
+			i++;
+		}
+	}
+
+	mUsedArea += (long long)width * height;
+	return true;
+}
+
+float AtlasPacker::getOccupancy()
+{
+	return (float)((double)mUsedArea / ((double)mWidth * mHeight));
+}
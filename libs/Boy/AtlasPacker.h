@@ -0,0 +1,52 @@
+#pragma once
+
+#include "BoyLib/CrtDbgInc.h"
+
+#include <vector>
+
+namespace Boy
+{
+	/*
+	 * places rectangles on a page with the skyline bottom-left method:
+	 * the page keeps track of the top edge of what's been placed so far,
+	 * and every new rect goes where its bottom ends up lowest. it packs
+	 * best when rects are inserted tallest first.
+	 */
+	class AtlasPacker
+	{
+	public:
+
+		AtlasPacker(int width, int height);
+		virtual ~AtlasPacker();
+
+		// finds room for a rect, returns false if the page is too full:
+		bool insert(int width, int height, int *x, int *y);
+
+		inline int getWidth() { return mWidth; }
+		inline int getHeight() { return mHeight; }
+
+		// fraction of the page that's covered by rects:
+		float getOccupancy();
+
+	private:
+
+		// a horizontal piece of the skyline:
+		struct Segment
+		{
+			int x;
+			int y;
+			int width;
+		};
+
+		// the y a rect would end up at if its left edge was at
+		// segment i, or -1 if it doesn't fit there:
+		int fit(int i, int width, int height);
+
+	private:
+
+		int mWidth;
+		int mHeight;
+		std::vector<Segment> mSkyline;
+		long long mUsedArea;
+	};
+}
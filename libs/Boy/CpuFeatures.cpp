@@ -0,0 +1,89 @@
+#include "CpuFeatures.h"
+
+#if defined(BOY_X86)
+	#if defined(_MSC_VER)
+		#include <intrin.h>
+	#else
+		#include <cpuid.h>
+	#endif
+#endif
+#include <mutex>
+
+using namespace Boy;
+
+#include "BoyLib/CrtDbgNew.h"
+
+static std::once_flag gDetectOnce;
+bool CpuFeatures::gSSE2 = false;
+bool CpuFeatures::gAVX2 = false;
+bool CpuFeatures::gAESNI = false;
+
+#if defined(BOY_X86)
+static void cpuid(int leaf, int subleaf, unsigned int regs[4])
+{
+#if defined(_MSC_VER)
+	int r[4];
+	__cpuidex(r, leaf, subleaf);
+	for (int i=0 ; i<4 ; i++)
+	{
+		regs[i] = (unsigned int)r[i];
+	}
+#else
+	__cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+static unsigned long long xgetbv0()
+{
+#if defined(_MSC_VER)
+	return _xgetbv(0);
+#else
+	unsigned int lo, hi;
+	__asm__ __volatile__ ("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+	return ((unsigned long long)hi << 32) | lo;
+#endif
+}
+#endif
+
+void CpuFeatures::detect()
+{
+#if defined(BOY_X86)
+	unsigned int regs[4];
+	cpuid(0, 0, regs);
+	int maxLeaf = (int)regs[0];
+
+	if (maxLeaf >= 1)
+	{
+		cpuid(1, 0, regs);
+		gSSE2 = (regs[3] & (1<<26)) != 0;
+		gAESNI = gSSE2 && (regs[2] & (1<<25)) != 0;
+
+		// avx2 also needs the os to save the ymm registers:
+		bool osxsave = (regs[2] & (1<<27)) != 0;
+		bool avx = (regs[2] & (1<<28)) != 0;
+		if (maxLeaf >= 7 && osxsave && avx && (xgetbv0() & 0x6) == 0x6)
+		{
+			cpuid(7, 0, regs);
+			gAVX2 = (regs[1] & (1<<5)) != 0;
+		}
+	}
+#endif
+}
+
+bool CpuFeatures::hasSSE2()
+{
+	std::call_once(gDetectOnce, detect);
+	return gSSE2;
+}
+
+bool CpuFeatures::hasAVX2()
+{
+	std::call_once(gDetectOnce, detect);
+	return gAVX2;
+}
+
+bool CpuFeatures::hasAESNI()
+{
+	std::call_once(gDetectOnce, detect);
+	return gAESNI;
+}
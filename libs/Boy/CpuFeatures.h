@@ -0,0 +1,45 @@
+#pragma once
+
+#include "BoyLib/CrtDbgInc.h"
+
+namespace Boy
+{
+	/*
+	 * runtime detection of the instruction set extensions that the
+	 * optimized code paths can use (the answers are computed once,
+	 * by whichever thread asks first)
+	 */
+	class CpuFeatures
+	{
+	public:
+
+		static bool hasSSE2();
+		static bool hasAVX2();
+		static bool hasAESNI();
+
+	private:
+
+		CpuFeatures() {}
+
+		static void detect();
+
+	private:
+
+		static bool gSSE2;
+		static bool gAVX2;
+		static bool gAESNI;
+	};
+}
+
+// lets a single function be compiled for an instruction set that the
+// rest of the file isn't built for (msvc doesn't need anything):
+#if defined(__GNUC__) || defined(__clang__)
+	#define BOY_TARGET(isa) __attribute__((target(isa)))
+#else
+	#define BOY_TARGET(isa)
+#endif
+
+// whether the x86 intrinsics headers are usable at all:
+#if defined(_M_X64) || defined(_M_AMD64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+	#define BOY_X86
+#endif
@@ -1,42 +1,54 @@
 #include "Crypto.h"
 
-#include "AES.h"
+#include <algorithm>
+#include "AESBackends.h"
 #include <assert.h>
+#include "Environment.h"
+#include <mutex>
 #include <string.h>  /* memset(), memcpy() */
 #include <string>
+#include "Storage.h"
+#include <vector>
+#include "WorkerPool.h"
+
+using namespace Boy;
 
 #include "BoyLib/CrtDbgNew.h"
 
+// buffers are decrypted on several cores in chunks of this size:
+#define DECRYPT_CHUNK_SIZE (256*1024)
+
+// the threads that decrypt big buffers (started with the first one, and
+// one decrypt at a time gets them):
+static std::mutex gDecryptPoolMutex;
+
+static WorkerPool *getDecryptPool()
+{
+	static WorkerPool pool(0);
+	return &pool;
+}
+
 void Boy::aesEncrypt(const unsigned char *key, const char *inData, int inDataSize, char **outData, int *outDataSize)
 {
 	// allocate output data buffer:
 	*outDataSize = (inDataSize+15)&(~15); // round up
 	*outData = new char[*outDataSize];
 
-	// if there's no key, we don't need to decrypt anything, simply copy:
+	// copy the input data, zero padded to a whole number of blocks:
+	memset(*outData,0,*outDataSize); // zero out the memory
+	memcpy(*outData,inData,inDataSize); // copy input data to output buffer
+
+	// if there's no key, we don't need to encrypt anything:
 	if (key==NULL)
 	{
-		memset(*outData,0,*outDataSize); // zero out the memory
-		memcpy(*outData,inData,inDataSize); // copy input data to output buffer
 		return;
 	}
 
-	// put input data in temporary buffer:
-	unsigned char *buf = new unsigned char[*outDataSize];
-	memset(buf,0,*outDataSize); // zero out the memory
-	memcpy(buf,inData,inDataSize); // copy input data to temp buffer
-
-	// encrypt temporary buffer into output data:
-	AES crypt;
-	crypt.SetParameters(192);
-	crypt.StartEncryption(key); // set encryption key
-	crypt.Encrypt(
-		reinterpret_cast<const unsigned char*>(inData),
-		reinterpret_cast<unsigned char*>(*outData), 
-		*outDataSize/16); // encrypt
-
-	// deallocate temporary buffer:
-	delete buf;
+	// encrypt the output buffer in place:
+	AESBackends::encrypt(AESBackends::getBackend(), key,
+		reinterpret_cast<const unsigned char*>(*outData),
+		reinterpret_cast<unsigned char*>(*outData),
+		*outDataSize/16);
 }
 
 void Boy::aesDecrypt(const unsigned char *key, const char *inData, int inDataSize, char **outData, int *outDataSize)
@@ -46,65 +58,124 @@ void Boy::aesDecrypt(const unsigned char *key, const char *inData, int inDataSiz
 	assert(*outDataSize==inDataSize);
 	*outData = new char[*outDataSize];
 
-	// if there's no key, we don't need to encrypt anything, simply copy:
+	// decrypt into it (or copy, if there's no key):
+	Boy::aesDecrypt(key, inData, *outData, inDataSize);
+}
+
+// a buffer that's decrypted in chunks:
+struct DecryptJob
+{
+	AESBackends::Backend backend;
+	const unsigned char *key;
+	const unsigned char *in;
+	unsigned char *out;
+	int blockCount;
+	int chunkBlocks;
+	std::vector<unsigned char> ivs; // the cipher text block before each chunk
+};
+
+static void decryptChunk(void *context, int index, int)
+{
+	DecryptJob *job = (DecryptJob*)context;
+	int first = index * job->chunkBlocks;
+	int count = std::min(job->chunkBlocks, job->blockCount - first);
+	unsigned char *out = job->out + first * 16;
+	AESBackends::decrypt(job->backend, job->key, job->in + first * 16, out, count);
+
+	// the chunk was decrypted as if it started the buffer, its first
+	// block still needs the cipher text that really came before it:
+	if (index > 0)
+	{
+		const unsigned char *iv = &job->ivs[index * 16];
+		for (int i=0 ; i<16 ; i++)
+		{
+			out[i] ^= iv[i];
+		}
+	}
+}
+
+void Boy::aesDecrypt(const unsigned char *key, const char *inData, char *outData, int dataSize)
+{
+	// if there's no key, we don't need to decrypt anything, simply copy:
 	if (key==NULL)
 	{
-		memset(*outData,0,*outDataSize); // zero out the memory
-		memcpy(*outData,inData,inDataSize); // copy input data to output buffer
+		if (outData!=inData)
+		{
+			memcpy(outData,inData,dataSize);
+		}
 		return;
 	}
 
-	// put input data in temporary buffer:
-	unsigned char *buf = new unsigned char[*outDataSize];
-	memset(buf,0,*outDataSize); // zero out the memory
-	memcpy(buf,inData,inDataSize); // copy input data to temp buffer
-
-	// encrypt temporary buffer into output data:
-	AES crypt;
-	crypt.SetParameters(192);
-	crypt.StartDecryption(key); // set encryption key
-	crypt.Decrypt(
-		reinterpret_cast<const unsigned char*>(inData),
-		reinterpret_cast<unsigned char*>(*outData), 
-		*outDataSize/16); // encrypt
-
-	// deallocate temporary buffer:
-	delete buf;
-}
+	// (anything after the last whole block isn't encrypted):
+	assert((dataSize&15)==0);
+	int blockCount = dataSize/16;
+	if (outData!=inData && (dataSize&15)!=0)
+	{
+		memcpy(outData+blockCount*16,inData+blockCount*16,dataSize&15);
+	}
 
-bool Boy::loadDecrypt(const unsigned char *key, const char *filename, char **outData, int *outDataSize)
-{
-	// open the input file:
-	FILE *file = fopen(filename,"rb");
-	if (file==NULL)
+	DecryptJob job;
+	job.backend = AESBackends::getBackend();
+	job.key = key;
+	job.in = reinterpret_cast<const unsigned char*>(inData);
+	job.out = reinterpret_cast<unsigned char*>(outData);
+	job.blockCount = blockCount;
+	job.chunkBlocks = DECRYPT_CHUNK_SIZE/16;
+
+	// small buffers aren't worth waking up other threads for, and
+	// while another decrypt has the threads this one runs on its own
+	// (its thread is one of several busy ones then anyway):
+	int chunkCount = (blockCount + job.chunkBlocks - 1) / job.chunkBlocks;
+	std::unique_lock<std::mutex> lock(gDecryptPoolMutex, std::defer_lock);
+	if (chunkCount<=1 || WorkerPool::getHardwareThreadCount()<=1 || !lock.try_lock())
 	{
-		return false;
+		AESBackends::decrypt(job.backend, key, job.in, job.out, blockCount);
+		return;
 	}
 
-	// figure out how big it is:
-	fseek(file, 0, SEEK_END);
-	int size = ftell(file);
+	// cbc only chains a block to the cipher text before it, so the chunks
+	// can be decrypted all at once as long as that's kept (decrypting in
+	// place overwrites it):
+	job.ivs.resize(chunkCount * 16);
+	for (int c=1 ; c<chunkCount ; c++)
+	{
+		memcpy(&job.ivs[c * 16], job.in + (c * job.chunkBlocks - 1) * 16, 16);
+	}
 
-	// allocate mem:
-	char *inData = new char[size];
+	getDecryptPool()->run(chunkCount, decryptChunk, &job);
+}
 
-	// read the entire file:
-	fseek(file, 0, SEEK_SET);
-	fread(inData, 1, size, file);
+bool Boy::loadDecrypt(const unsigned char *key, const char *filename, char **outData, int *outDataSize)
+{
+	Storage *storage = Environment::instance()->getStorage();
 
-	if (key!=NULL)
+	// decrypt straight out of the mapped file (it might be in a resource pack):
+	BoyFileHandle hMap;
+	const void *mapped;
+	int size;
+	if (storage->FileMap(filename, &hMap, &mapped, &size)==Storage::STORAGE_OK)
 	{
-		// decrypt it:
-		Boy::aesDecrypt(key, inData, size, outData, outDataSize);
-
-		// delete the input data buffer:
-		delete[] inData;
+		*outData = new char[size+1];
+		*outDataSize = size;
+		Boy::aesDecrypt(key, (const char*)mapped, *outData, size);
+		(*outData)[size] = 0;
+		storage->FileUnmap(hMap);
+		return true;
 	}
-	else
+
+	// or read it and decrypt it in place:
+	BoyFileHandle hFile;
+	if (storage->FileOpen(filename, Storage::STORAGE_MODE_READ | Storage::STORAGE_MUST_EXIST, &hFile)!=Storage::STORAGE_OK)
 	{
-		*outData = inData;
-		*outDataSize = size;
+		return false;
 	}
+	size = storage->FileGetSize(hFile);
+	*outData = new char[size+1];
+	*outDataSize = size;
+	storage->FileRead(hFile, *outData, size);
+	storage->FileClose(hFile);
+	Boy::aesDecrypt(key, *outData, *outData, size);
+	(*outData)[size] = 0;
 
 	return true;
 }
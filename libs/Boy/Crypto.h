@@ -12,6 +12,15 @@ namespace Boy
 		const char *inData, int inDataSize, 
 		char **outData, int *outDataSize);
 
+	// decrypts into the caller's buffer, which can be the input buffer
+	// (decrypting in place) or one that doesn't overlap it at all. big
+	// buffers are split into chunks that are decrypted on several cores:
+	void aesDecrypt(const unsigned char *key, 
+		const char *inData, char *outData, int dataSize);
+
+	// the data is decrypted straight out of the mapped file, and it's
+	// followed by a 0 (not counted in the size) so it can be parsed as
+	// it is:
 	bool loadDecrypt(const unsigned char *key, 
 		const char *filename, 
 		char **outData, int *outDataSize);
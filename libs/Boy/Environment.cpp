@@ -18,7 +18,7 @@
 #elif defined(GOO_PLATFORM_OSX)
 	#include "OSXEnvironment.h"
 #elif defined(GOO_PLATFORM_LINUX)
-	#include "LinuxEnvironment.h"
+	#include "HeadlessEnvironment.h"
 #endif
 
 using namespace Boy;
@@ -32,7 +32,7 @@ using namespace Boy;
 #elif defined(GOO_PLATFORM_OSX)
 	static OSXEnvironment sEnvObj;
 #elif defined(GOO_PLATFORM_LINUX)
-	static LinuxEnvironment sEnvObj;
+	static HeadlessEnvironment sEnvObj;
 #else
 	#error "unknown platform"
 #endif
@@ -60,6 +60,12 @@ void Environment::playSound(const char *id, bool loop, float volume)
 	playSound(snd,loop,volume);
 }
 
+void Environment::playSound(ResourceHandle id, bool loop, float volume)
+{
+	Sound *snd = instance()->getResourceManager()->getSound(id);
+	playSound(snd,loop,volume);
+}
+
 void Environment::playSound(Sound *sound, bool loop, float volume)
 {
 	instance()->getSoundPlayer()->playSound(sound,volume,loop);
@@ -72,6 +78,12 @@ void Environment::stopSound(const char *id)
 	stopSound(snd);
 }
 
+void Environment::stopSound(ResourceHandle id)
+{
+	Sound *snd = instance()->getResourceManager()->getSound(id);
+	stopSound(snd);
+}
+
 void Environment::stopSound(Sound *sound)
 {
 	assert(sound!=NULL);
@@ -101,6 +113,19 @@ Image *Environment::getImage(const std::string &id, Image *defaultImg)
 	return img==NULL ? defaultImg : img;
 }
 
+Image *Environment::getImage(ResourceHandle id)
+{
+	Image *img = instance()->getResourceManager()->getImage(id);
+	assert(img!=NULL);
+	return img;
+}
+
+Image *Environment::getImage(ResourceHandle id, Image *defaultImg)
+{
+	Image *img = instance()->getResourceManager()->getImage(id);
+	return img==NULL ? defaultImg : img;
+}
+
 int Environment::screenWidth()
 {
 	assert(gInstance!=NULL);
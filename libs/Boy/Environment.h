@@ -5,6 +5,7 @@
 #include <string>
 #include <stdio.h>
 #include "BoyLib/UString.h"
+#include "ResourceHandle.h"
 
 #define MOUSE_COUNT_MAX 4
 #define GAMEPAD_COUNT_MAX 4
@@ -117,9 +118,13 @@ namespace Boy
 		static Image				*getImage(const std::string &id);
 		static Image				*getImage(const std::string &id, Image *defaultImg);
 		static Image				*getImage(const char *id, Image *defaultImg);
+		static Image				*getImage(ResourceHandle id);
+		static Image				*getImage(ResourceHandle id, Image *defaultImg);
 		static void					playSound(const char *id, bool loop=false, float volume=1.0f);
+		static void					playSound(ResourceHandle id, bool loop=false, float volume=1.0f);
 		static void					playSound(Sound *sound, bool loop=false, float volume=1.0f);
 		static void					stopSound(const char *id);
+		static void					stopSound(ResourceHandle id);
 		static void					stopSound(Sound *sound);
 		static int					screenWidth();
 		static int					screenHeight();
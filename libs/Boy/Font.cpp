@@ -3,6 +3,7 @@
 #include <assert.h>
 #include "Boy/Util.h"
 #include "BoyLib/BoyUtil.h"
+#include "BoyLib/md5.h"
 #include "BoyLib/UStringStream.h"
 #include <iostream>
 #include <sstream>
@@ -10,11 +11,59 @@
 #include "Image.h"
 #include "ResourceLoader.h"
 #include "Storage.h"
+#include <string.h>
 
 using namespace Boy;
 
 #include "BoyLib/CrtDbgNew.h"
 
+// characters that are at most this far apart share a glyph range
+// (so the index tables stay small when a font has a few stray chars):
+#define FONT_RANGE_MAX_GAP 64
+
+// number of laid out strings that are remembered:
+#define FONT_LAYOUT_CACHE_SIZE 128
+
+#define KERNING_EMPTY_KEY 0xffffffff
+
+// the binary font cache file starts with this:
+#define FONT_CACHE_MAGIC "BFNT"
+#define FONT_CACHE_VERSION 1
+struct FontCacheHeader
+{
+	char magic[4];
+	int version;
+	unsigned char sourceHash[16]; // md5 of the font description
+	int totalSize; // of the whole file
+
+	float height;
+	float spacing;
+	float lineSpacing;
+	float scale;
+
+	// table sizes (in entries) and offsets (in bytes from the start of the file):
+	int glyphCount;
+	int rangeCount;
+	int indexCount;
+	int kerningSize;
+	int glyphOffset;
+	int rangeOffset;
+	int indexOffset;
+	int kerningKeyOffset;
+	int kerningValueOffset;
+};
+
+static inline unsigned int kerningKey(int glyph1, int glyph2)
+{
+	return ((unsigned int)glyph1 << 16) | (unsigned int)glyph2;
+}
+
+static inline unsigned int kerningHash(unsigned int key)
+{
+	unsigned int h = key * 2654435761u;
+	return h ^ (h >> 15);
+}
+
 Font::Font(ResourceLoader *loader, const std::string &path) : Resource(loader,path)
 {
 	assert(loader!=NULL);
@@ -23,10 +72,23 @@ Font::Font(ResourceLoader *loader, const std::string &path) : Resource(loader,pa
 	mSpacing = 0;
 	mLineSpacing = -1;
 	mScale = 1;
+	mCompiled = false;
+	mGlyphs = NULL;
+	mGlyphCount = 0;
+	mGlyphRanges = NULL;
+	mGlyphRangeCount = 0;
+	mGlyphIndices = NULL;
+	mKerningKeys = NULL;
+	mKerningValues = NULL;
+	mKerningSize = 0;
+	mCacheMapped = false;
+	mCacheMap = 0;
 }
 
 Font::~Font()
 {
+	unmapCache();
+
 	std::map<wchar_t,FontChar*>::iterator iter;
 	for (iter=mChars.begin() ; iter!=mChars.end() ; iter++)
 	{
@@ -39,6 +101,10 @@ Font::~Font()
 
 bool Font::hasChar(wchar_t ch)
 {
+	if (mCacheMapped)
+	{
+		return getGlyph(ch)>=0;
+	}
 	return mChars.find(ch)!=mChars.end();
 }
 
@@ -53,6 +119,7 @@ void Font::addChar(wchar_t ch)
 
 	// remember it:
 	mChars[ch] = fchar;
+	invalidate();
 }
 
 void Font::setWidth(wchar_t ch, int width)
@@ -62,6 +129,7 @@ void Font::setWidth(wchar_t ch, int width)
 
 	// set its width:
 	mChars[ch]->width = width;
+	invalidate();
 }
 
 void Font::setSubrect(wchar_t ch, const BoyLib::Rect &subrect)
@@ -69,8 +137,9 @@ void Font::setSubrect(wchar_t ch, const BoyLib::Rect &subrect)
 	// make sure this character has been added:
 	assert(mChars.find(ch)!=mChars.end());
 
-	// set its width:
+	// set its subrect:
 	mChars[ch]->subrect = subrect;
+	invalidate();
 
 	// update the height:
 	mHeight = std::max(mHeight, subrect.getHeight());
@@ -81,8 +150,9 @@ void Font::setOffset(wchar_t ch, const BoyLib::Vector2 &offset)
 	// make sure this character has been added:
 	assert(mChars.find(ch)!=mChars.end());
 
-	// set its width:
+	// set its offset:
 	mChars[ch]->offset = offset;
+	invalidate();
 }
 
 int Font::getHeight()
@@ -93,112 +163,519 @@ int Font::getHeight()
 
 int Font::getStringWidth(const Boy::UString &str)
 {
-	int width = 0;
-	FontChar *fcCurr = NULL;
-	FontChar *fcPrev = NULL;
+	return (int)(getLayout(str, mScale).unscaledWidth * mScale);
+}
+
+int Font::getLineSpacing()
+{
+	return (mLineSpacing>=0 ? mLineSpacing : mHeight) * mScale;
+}
+
+float Font::drawString(Graphics *g, const Boy::UString &str, float scale)
+{
+	scale *= mScale;
+	Layout &layout = getLayout(str, scale);
+
+	// the whole string is one mesh:
+	const QuadMesh &mesh = getMesh(layout);
+	if (mesh.getQuadCount()>0)
+	{
+		g->drawQuadMesh(mImage, &mesh);
+	}
+
+	return layout.width;
+}
+
+float Font::drawParagraph(Graphics *g, const Boy::UString &str, float maxWidth, float scale)
+{
+	assert(maxWidth>0);
+	scale *= mScale;
+	Layout &layout = getLayout(str, scale, maxWidth);
 
-	int size = str.length();
-	for (int i=0 ; i<size ; i++)
+	const QuadMesh &mesh = getMesh(layout);
+	if (mesh.getQuadCount()>0)
 	{
-		wchar_t currChar = str[i];
+		g->drawQuadMesh(mImage, &mesh);
+	}
 
-		// get the font character:
-		fcCurr = mChars[currChar];
+	return layout.height;
+}
 
+float Font::getParagraphHeight(const Boy::UString &str, float maxWidth, float scale)
+{
+	assert(maxWidth>0);
+	return getLayout(str, scale * mScale, maxWidth).height;
+}
+
+Font::Layout &Font::getLayout(const Boy::UString &str, float scale, float wrapWidth)
+{
+	compile();
+
+	// if we've laid out this string recently:
+	LayoutKey key;
+	key.scale = scale;
+	key.wrapWidth = wrapWidth;
+	key.str = str;
+	std::map<LayoutKey,std::list<Layout>::iterator>::iterator iter = mLayoutIndex.find(key);
+	if (iter!=mLayoutIndex.end())
+	{
+		// make it the most recently used one:
+		mLayouts.splice(mLayouts.begin(), mLayouts, iter->second);
+		return mLayouts.front();
+	}
+
+	// make room for it:
+	if ((int)mLayouts.size()>=FONT_LAYOUT_CACHE_SIZE)
+	{
+		mLayoutIndex.erase(mLayouts.back().key);
+		mLayouts.pop_back();
+	}
+	mLayouts.push_front(Layout());
+	Layout &layout = mLayouts.front();
+	layout.key = key;
+	layout.hasMesh = false;
+	mLayoutIndex[key] = mLayouts.begin();
+
+	layout.glyphs.reserve(str.length());
+	float lineHeight = (mLineSpacing>=0 ? mLineSpacing : mHeight) * scale;
+	if (wrapWidth<=0)
+	{
+		// a single line:
+		layoutLine(str, 0, str.length(), scale, 0, layout, &layout.width, &layout.unscaledWidth);
+		layout.height = lineHeight;
+		return layout;
+	}
+
+	// a paragraph, one line at a time:
+	layout.width = 0;
+	layout.unscaledWidth = 0;
+	int numLines = 0;
+	int start = 0;
+	int length = str.length();
+	do
+	{
+		int next;
+		int end = findLineEnd(str, start, scale, wrapWidth, &next);
+
+		float width, unscaledWidth;
+		layoutLine(str, start, end, scale, numLines * lineHeight, layout, &width, &unscaledWidth);
+		layout.width = std::max(layout.width, width);
+		layout.unscaledWidth = std::max(layout.unscaledWidth, unscaledWidth);
+
+		numLines++;
+		start = next;
+	}
+	while (start<length);
+	layout.height = numLines * lineHeight;
+
+	return layout;
+}
+
+void Font::layoutLine(const Boy::UString &str, int start, int end, float scale, float y, Layout &layout, float *width, float *unscaledWidth)
+{
+	int prevGlyph = -1;
+	float prevCharWidth = 0;
+	float x = 0;
+	*unscaledWidth = 0;
+	for (int i=start ; i<end ; i++)
+	{
 		// skip this char if we have no data for it:
-		if (fcCurr==NULL)
+		int glyph = getGlyph(str[i]);
+		if (glyph<0)
 		{
 			continue;
 		}
+		const Glyph &g = mGlyphs[glyph];
 
 		// if this is not the first char:
-		if (fcPrev!=NULL)
+		float kerning = 0;
+		if (prevGlyph>=0)
 		{
-			std::map<wchar_t,int>::iterator kernIter = fcPrev->kearningValues.find(currChar);
-			if (kernIter != fcPrev->kearningValues.end())
+			kerning = (float)getKerning(prevGlyph, glyph);
+		}
+
+		// kearning value + half character width + prev char width:
+		x += kerning + g.width/2.0f*scale + prevCharWidth;
+
+		LayoutGlyph lg;
+		lg.glyph = glyph;
+		lg.x = x;
+		lg.y = y;
+		layout.glyphs.push_back(lg);
+
+		// remember the width we should increment by:
+		prevCharWidth = (g.width - g.width/2.0f + mSpacing) * scale;
+
+		*unscaledWidth += kerning + g.width + mSpacing;
+		prevGlyph = glyph;
+	}
+
+	*width = x + prevCharWidth;
+}
+
+int Font::findLineEnd(const Boy::UString &str, int start, float scale, float wrapWidth, int *next)
+{
+	// measure the line the same way layoutLine does until it gets too wide:
+	int prevGlyph = -1;
+	float prevCharWidth = 0;
+	float x = 0;
+	int lastSpace = -1;
+	int length = str.length();
+	for (int i=start ; i<length ; i++)
+	{
+		wchar_t ch = str[i];
+		if (ch=='\n')
+		{
+			*next = i+1;
+			return i;
+		}
+
+		int glyph = getGlyph(ch);
+		if (glyph>=0)
+		{
+			const Glyph &g = mGlyphs[glyph];
+			float kerning = prevGlyph>=0 ? (float)getKerning(prevGlyph, glyph) : 0;
+			float newX = x + kerning + g.width/2.0f*scale + prevCharWidth;
+			float newCharWidth = (g.width - g.width/2.0f + mSpacing) * scale;
+
+			// if this char doesn't fit anymore (a line gets at least one):
+			if (prevGlyph>=0 && newX + newCharWidth > wrapWidth && ch!=' ')
 			{
-				// add the kearning:
-				width += kernIter->second;
+				// break at the last space, or in the middle of the word
+				// if it's too long for a line of its own:
+				if (lastSpace>=0)
+				{
+					*next = lastSpace+1;
+					return lastSpace;
+				}
+				*next = i;
+				return i;
 			}
+
+			x = newX;
+			prevCharWidth = newCharWidth;
+			prevGlyph = glyph;
+		}
+
+		if (ch==' ')
+		{
+			lastSpace = i;
+		}
+	}
+
+	*next = length;
+	return length;
+}
+
+const QuadMesh &Font::getMesh(Layout &layout)
+{
+	if (layout.hasMesh)
+	{
+		return layout.mesh;
+	}
+
+	// each glyph's quad is centered on its position (like drawImage does):
+	float scale = layout.key.scale;
+	int numGlyphs = (int)layout.glyphs.size();
+	layout.mesh.reserve(numGlyphs);
+	for (int i=0 ; i<numGlyphs ; i++)
+	{
+		const LayoutGlyph &lg = layout.glyphs[i];
+		const Glyph &glyph = mGlyphs[lg.glyph];
+
+		// spaces have nothing to draw:
+		if (glyph.subrectW<=0 || glyph.subrectH<=0)
+		{
+			continue;
 		}
 
-		// add the width of the character:
-		width += fcCurr->width + mSpacing;
+		float halfW = glyph.subrectW / 2.0f * scale;
+		float halfH = glyph.subrectH / 2.0f * scale;
+		layout.mesh.addQuad(lg.x - halfW, lg.y - halfH, lg.x + halfW, lg.y + halfH, 
+			glyph.subrectX, glyph.subrectY, glyph.subrectW, glyph.subrectH);
+	}
+	layout.hasMesh = true;
+
+	return layout.mesh;
+}
+
+void Font::clearLayouts()
+{
+	mLayouts.clear();
+	mLayoutIndex.clear();
+}
 
-		// the current char is the new previous char:
-		fcPrev = fcCurr;
+int Font::getGlyph(wchar_t ch)
+{
+	unsigned int code = (unsigned int)ch;
+	for (int i=0 ; i<mGlyphRangeCount ; i++)
+	{
+		const GlyphRange &range = mGlyphRanges[i];
+		if (code - range.first < range.count)
+		{
+			return mGlyphIndices[range.indexBase + code - range.first];
+		}
+	}
+	return -1;
+}
+
+int Font::getKerning(int glyph1, int glyph2)
+{
+	if (mKerningSize==0)
+	{
+		return 0;
 	}
 
-	return width * mScale;
+	unsigned int key = kerningKey(glyph1, glyph2);
+	unsigned int mask = (unsigned int)mKerningSize - 1;
+	for (unsigned int slot = kerningHash(key) & mask ; ; slot = (slot + 1) & mask)
+	{
+		if (mKerningKeys[slot]==key)
+		{
+			return mKerningValues[slot];
+		}
+		if (mKerningKeys[slot]==KERNING_EMPTY_KEY)
+		{
+			return 0;
+		}
+	}
 }
 
-int Font::getLineSpacing()
+void Font::addKerning(int glyph1, int glyph2, int kvalue)
 {
-	return (mLineSpacing>=0 ? mLineSpacing : mHeight) * mScale;
+	unsigned int key = kerningKey(glyph1, glyph2);
+	unsigned int mask = (unsigned int)mKerningKeyStore.size() - 1;
+	unsigned int slot = kerningHash(key) & mask;
+	while (mKerningKeyStore[slot]!=KERNING_EMPTY_KEY && mKerningKeyStore[slot]!=key)
+	{
+		slot = (slot + 1) & mask;
+	}
+	mKerningKeyStore[slot] = key;
+	mKerningValueStore[slot] = kvalue;
 }
 
-float Font::drawString(Graphics *g, const Boy::UString &str, float scale)
+void Font::invalidate()
 {
-	scale *= mScale;
-	g->pushTransform();
+	// fonts that come from the cache file can't be changed:
+	assert(!mCacheMapped);
+	mCompiled = false;
+}
 
-	// iterate over all characters of the string:
-	FontChar *fcCurr = NULL;
-	FontChar *fcPrev = NULL;
-	float prevCharWidth = 0;
-	int numChars = str.length();
-	float totalWidth = 0;
-	for (int i=0 ; i<numChars ; i++)
+void Font::compile()
+{
+	if (mCompiled)
 	{
-		wchar_t currChar = str[i];
+		return;
+	}
+	mCompiled = true;
 
-		// get the font character:
-		fcCurr = mChars[currChar];
+	mGlyphStore.clear();
+	mGlyphRangeStore.clear();
+	mGlyphIndexStore.clear();
+	mKerningKeyStore.clear();
+	mKerningValueStore.clear();
+	clearLayouts();
 
-		// skip this char if we have no data for it:
-		if (fcCurr==NULL)
+	// glyph indices are packed into 16 bits in the kerning keys:
+	assert(mChars.size() < 0xffff);
+
+	// build the glyph table and the ranges (mChars is sorted by code):
+	std::map<wchar_t,int> glyphsByChar;
+	int kerningCount = 0;
+	std::map<wchar_t,FontChar*>::iterator iter;
+	for (iter=mChars.begin() ; iter!=mChars.end() ; iter++)
+	{
+		unsigned int code = (unsigned int)iter->first;
+		FontChar *fc = iter->second;
+
+		// start a new range if this char is too far from the last one:
+		if (mGlyphRangeStore.empty() || code - mGlyphRangeStore.back().first >= mGlyphRangeStore.back().count + FONT_RANGE_MAX_GAP)
 		{
-			continue;
+			GlyphRange range;
+			range.first = code;
+			range.count = 0;
+			range.indexBase = (int)mGlyphIndexStore.size();
+			mGlyphRangeStore.push_back(range);
+		}
+		GlyphRange &range = mGlyphRangeStore.back();
+		while (range.first + range.count <= code)
+		{
+			mGlyphIndexStore.push_back(-1);
+			range.count++;
 		}
 
-		// if this is not the first char:
-		float kerning = 0;
-		if (fcPrev!=NULL)
+		Glyph glyph;
+		glyph.width = fc->width;
+		glyph.subrectX = (int)fc->subrect.getX();
+		glyph.subrectY = (int)fc->subrect.getY();
+		glyph.subrectW = (int)fc->subrect.getWidth();
+		glyph.subrectH = (int)fc->subrect.getHeight();
+		mGlyphIndexStore[range.indexBase + code - range.first] = (int)mGlyphStore.size();
+		glyphsByChar[iter->first] = (int)mGlyphStore.size();
+		mGlyphStore.push_back(glyph);
+
+		kerningCount += (int)fc->kearningValues.size();
+	}
+
+	// build the kerning table (kept at most half full):
+	if (kerningCount>0)
+	{
+		int size = 16;
+		while (size < kerningCount*2)
+		{
+			size <<= 1;
+		}
+		mKerningKeyStore.resize(size, KERNING_EMPTY_KEY);
+		mKerningValueStore.resize(size, 0);
+
+		for (iter=mChars.begin() ; iter!=mChars.end() ; iter++)
 		{
-			std::map<wchar_t,int>::iterator kernIter = fcPrev->kearningValues.find(currChar);
-			if (kernIter != fcPrev->kearningValues.end())
+			int glyph1 = glyphsByChar[iter->first];
+			std::map<wchar_t,int> &kv = iter->second->kearningValues;
+			std::map<wchar_t,int>::iterator kernIter;
+			for (kernIter=kv.begin() ; kernIter!=kv.end() ; kernIter++)
 			{
-				// remember the kearning:
-				kerning = kernIter->second;
+				// kerning against a char the font doesn't have never applies:
+				std::map<wchar_t,int>::iterator g2 = glyphsByChar.find(kernIter->first);
+				if (g2!=glyphsByChar.end())
+				{
+					addKerning(glyph1, g2->second, kernIter->second);
+				}
 			}
 		}
+	}
 
-		// kearning value + half character width + prev char width:
-		float dx = kerning + fcCurr->width/2.0f*scale + prevCharWidth;
-		g->preTranslate(dx, 0);
+	bindTables();
+}
 
-		// keep track of total width:
-		totalWidth += dx;
+void Font::bindTables()
+{
+	mGlyphCount = (int)mGlyphStore.size();
+	mGlyphs = mGlyphCount>0 ? &mGlyphStore[0] : NULL;
+	mGlyphRangeCount = (int)mGlyphRangeStore.size();
+	mGlyphRanges = mGlyphRangeCount>0 ? &mGlyphRangeStore[0] : NULL;
+	mGlyphIndices = mGlyphIndexStore.empty() ? NULL : &mGlyphIndexStore[0];
+	mKerningSize = (int)mKerningKeyStore.size();
+	mKerningKeys = mKerningSize>0 ? &mKerningKeyStore[0] : NULL;
+	mKerningValues = mKerningSize>0 ? &mKerningValueStore[0] : NULL;
+}
 
-		// scale the char:
-		g->pushTransform();
-			// scale:
-			g->preScale(scale,scale);
-			// draw the character:
-			g->drawImage(mImage, fcCurr->subrect);
-		g->popTransform();
+std::string Font::getCachePath()
+{
+	return mPath + ".fontcache";
+}
 
-		// remember the width we should increment by:
-		prevCharWidth = (fcCurr->width - fcCurr->width/2.0f + mSpacing) * scale;
+bool Font::loadCache(const unsigned char *sourceHash)
+{
+	Storage *pStorage = Environment::instance()->getStorage();
+	BoyFileHandle hMap;
+	const void *pData;
+	int size;
+	if (pStorage->FileMap(getCachePath().c_str(), &hMap, &pData, &size) != Storage::STORAGE_OK)
+	{
+		return false;
+	}
 
-		// the current char is the new previous char:
-		fcPrev = fcCurr;
+	// make sure it's a cache of this very description:
+	const FontCacheHeader *header = (const FontCacheHeader*)pData;
+	if (size < (int)sizeof(FontCacheHeader) ||
+		memcmp(header->magic, FONT_CACHE_MAGIC, 4)!=0 ||
+		header->version!=FONT_CACHE_VERSION ||
+		memcmp(header->sourceHash, sourceHash, 16)!=0 ||
+		header->totalSize!=size)
+	{
+		pStorage->FileUnmap(hMap);
+		return false;
 	}
-	g->popTransform();
 
-	totalWidth += prevCharWidth;
+	// point the tables into the file:
+	const char *base = (const char*)pData;
+	mGlyphs = header->glyphCount>0 ? (const Glyph*)(base + header->glyphOffset) : NULL;
+	mGlyphCount = header->glyphCount;
+	mGlyphRanges = header->rangeCount>0 ? (const GlyphRange*)(base + header->rangeOffset) : NULL;
+	mGlyphRangeCount = header->rangeCount;
+	mGlyphIndices = header->indexCount>0 ? (const int*)(base + header->indexOffset) : NULL;
+	mKerningSize = header->kerningSize;
+	mKerningKeys = mKerningSize>0 ? (const unsigned int*)(base + header->kerningKeyOffset) : NULL;
+	mKerningValues = mKerningSize>0 ? (const int*)(base + header->kerningValueOffset) : NULL;
+
+	mHeight = header->height;
+	mSpacing = header->spacing;
+	mLineSpacing = header->lineSpacing;
+	mScale = header->scale;
+
+	mCacheMapped = true;
+	mCacheMap = hMap;
+	mCompiled = true;
+	clearLayouts();
+	return true;
+}
 
-	return totalWidth;
+void Font::saveCache(const unsigned char *sourceHash)
+{
+	compile();
+
+	// lay out the file (the tables follow the header, all 4 byte aligned):
+	FontCacheHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, FONT_CACHE_MAGIC, 4);
+	header.version = FONT_CACHE_VERSION;
+	memcpy(header.sourceHash, sourceHash, 16);
+	header.height = mHeight;
+	header.spacing = mSpacing;
+	header.lineSpacing = mLineSpacing;
+	header.scale = mScale;
+	header.glyphCount = (int)mGlyphStore.size();
+	header.rangeCount = (int)mGlyphRangeStore.size();
+	header.indexCount = (int)mGlyphIndexStore.size();
+	header.kerningSize = (int)mKerningKeyStore.size();
+	header.glyphOffset = sizeof(FontCacheHeader);
+	header.rangeOffset = header.glyphOffset + header.glyphCount * sizeof(Glyph);
+	header.indexOffset = header.rangeOffset + header.rangeCount * sizeof(GlyphRange);
+	header.kerningKeyOffset = header.indexOffset + header.indexCount * sizeof(int);
+	header.kerningValueOffset = header.kerningKeyOffset + header.kerningSize * sizeof(unsigned int);
+	header.totalSize = header.kerningValueOffset + header.kerningSize * sizeof(int);
+
+	BoyFileHandle hFile;
+	Storage *pStorage = Environment::instance()->getStorage();
+	if (pStorage->FileOpen(getCachePath().c_str(), Storage::STORAGE_MODE_WRITE | Storage::STORAGE_OPEN_ALWAYS, &hFile) != Storage::STORAGE_OK)
+	{
+		envDebugLog("WARNING: could not write font cache '%s'\n", getCachePath().c_str());
+		return;
+	}
+
+	bool ok = pStorage->FileWrite(hFile, &header, sizeof(header)) == Storage::STORAGE_OK;
+	if (ok && header.glyphCount>0) ok = pStorage->FileWrite(hFile, &mGlyphStore[0], header.glyphCount * sizeof(Glyph)) == Storage::STORAGE_OK;
+	if (ok && header.rangeCount>0) ok = pStorage->FileWrite(hFile, &mGlyphRangeStore[0], header.rangeCount * sizeof(GlyphRange)) == Storage::STORAGE_OK;
+	if (ok && header.indexCount>0) ok = pStorage->FileWrite(hFile, &mGlyphIndexStore[0], header.indexCount * sizeof(int)) == Storage::STORAGE_OK;
+	if (ok && header.kerningSize>0) ok = pStorage->FileWrite(hFile, &mKerningKeyStore[0], header.kerningSize * sizeof(unsigned int)) == Storage::STORAGE_OK;
+	if (ok && header.kerningSize>0) ok = pStorage->FileWrite(hFile, &mKerningValueStore[0], header.kerningSize * sizeof(int)) == Storage::STORAGE_OK;
+	pStorage->FileClose(hFile);
+
+	if (!ok)
+	{
+		// (a partial file fails the size check when it's loaded)
+		envDebugLog("WARNING: could not write font cache '%s'\n", getCachePath().c_str());
+	}
+}
+
+void Font::unmapCache()
+{
+	if (mCacheMapped)
+	{
+		Environment::instance()->getStorage()->FileUnmap(mCacheMap);
+		mCacheMapped = false;
+		mCompiled = false;
+		mGlyphs = NULL;
+		mGlyphCount = 0;
+		mGlyphRanges = NULL;
+		mGlyphRangeCount = 0;
+		mGlyphIndices = NULL;
+		mKerningKeys = NULL;
+		mKerningValues = NULL;
+		mKerningSize = 0;
+		clearLayouts();
+	}
 }
 
 void Font::loadCharList(Boy::UStringStream &fontStream, std::vector<wchar_t> &charList)
@@ -420,7 +897,7 @@ bool Font::init(bool includeSounds)
 	}
 
 	// if we've already loaded the chars:
-	if (mChars.size()>0)
+	if (mChars.size()>0 || mCacheMapped)
 	{
 		// we're done:
 		return true;
@@ -438,6 +915,18 @@ bool Font::init(bool includeSounds)
 	assert( result == Storage::STORAGE_OK );
 	pStorage->FileClose( hFile );
 
+	// use the compiled font if there is one for this description:
+	md5_state_t state;
+	md5_byte_t sourceHash[16];
+	md5_init(&state);
+	md5_append(&state, (const md5_byte_t *)pFileData, fsize);
+	md5_finish(&state, sourceHash);
+	if (loadCache(sourceHash))
+	{
+		delete [] pFileData;
+		return true;
+	}
+
 	// convert to unicode string stream:
 	Boy::UStringStream fontStream( pFileData );
 	delete [] pFileData;
@@ -591,6 +1080,9 @@ bool Font::init(bool includeSounds)
 		setKerning(pair[0],pair[1],kerningValues[i]);
 	}
 
+	// so the next load doesn't have to parse:
+	saveCache(sourceHash);
+
 	// success
 	return true;
 }
@@ -602,6 +1094,10 @@ void Font::destroy(bool includeSounds)
 
 void Font::setKerning(wchar_t ch1, wchar_t ch2, int kvalue)
 {
+	// make sure this character has been added:
+	assert(mChars.find(ch1)!=mChars.end());
+
 	FontChar *fc = mChars[ch1];
 	fc->kearningValues[ch2] = kvalue;
+	invalidate();
 }
@@ -3,7 +3,11 @@
 #include "BoyLib/Rect.h"
 #include "BoyLib/UStringStream.h"
 #include "BoyLib/Vector2.h"
+#include "QuadMesh.h"
 #include "Resource.h"
+#include "Storage.h"
+#include <list>
+#include <map>
 #include <string>
 #include <vector>
 
@@ -42,6 +46,13 @@ namespace Boy
 
 		float drawString(Graphics *g, const Boy::UString &str, float scale=1);
 
+		// paragraphs: the string is broken into lines at spaces (and
+		// newlines) so that no line is wider than maxWidth (in pixels,
+		// at the given scale). the first line is drawn where drawString
+		// would draw it and the rest below it. returns the height:
+		float drawParagraph(Graphics *g, const Boy::UString &str, float maxWidth, float scale=1);
+		float getParagraphHeight(const Boy::UString &str, float maxWidth, float scale=1);
+
 	protected:
 
 		// implementation of Resource:
@@ -58,6 +69,81 @@ namespace Boy
 		void loadKerningPairs(Boy::UStringStream &fontStream, std::vector<Boy::UString> &kerningPairs);
 		void loadKerningValues(Boy::UStringStream &fontStream, std::vector<int> &kerningValues);
 
+		// a glyph of the compiled font:
+		struct Glyph
+		{
+			int width;
+			int subrectX;
+			int subrectY;
+			int subrectW;
+			int subrectH;
+		};
+
+		// a run of consecutive character codes, mapped to glyphs
+		// through mGlyphIndices[indexBase + ch - first] (-1 if the
+		// character is missing):
+		struct GlyphRange
+		{
+			unsigned int first;
+			unsigned int count;
+			int indexBase;
+		};
+
+		// a glyph of a laid out string (x,y is the glyph's center):
+		struct LayoutGlyph
+		{
+			int glyph;
+			float x;
+			float y;
+		};
+
+		// a laid out string (wrapWidth is 0 for single lines):
+		struct LayoutKey
+		{
+			float scale;
+			float wrapWidth;
+			Boy::UString str;
+
+			inline bool operator < (const LayoutKey &k) const
+			{
+				if (scale!=k.scale) return scale < k.scale;
+				if (wrapWidth!=k.wrapWidth) return wrapWidth < k.wrapWidth;
+				return str < k.str;
+			}
+		};
+		struct Layout
+		{
+			LayoutKey key;
+			std::vector<LayoutGlyph> glyphs;
+			float width; // width as drawn at the key's scale (of the widest line)
+			float height; // height of all lines at the key's scale
+			float unscaledWidth; // width in font units (for getStringWidth)
+			QuadMesh mesh; // the glyphs' quads (built when first drawn)
+			bool hasMesh;
+		};
+
+		// compiled font:
+		void compile();
+		void invalidate();
+		void bindTables();
+		int getGlyph(wchar_t ch);
+		int getKerning(int glyph1, int glyph2);
+		void addKerning(int glyph1, int glyph2, int kvalue);
+
+		// layout cache:
+		Layout &getLayout(const Boy::UString &str, float scale, float wrapWidth=0);
+		void layoutLine(const Boy::UString &str, int start, int end, float scale, float y, Layout &layout, float *width, float *unscaledWidth);
+		int findLineEnd(const Boy::UString &str, int start, float scale, float wrapWidth, int *next);
+		const QuadMesh &getMesh(Layout &layout);
+		void clearLayouts();
+
+		// binary cache of the compiled font (next to the description),
+		// only used if it was made from a description with the same hash:
+		std::string getCachePath();
+		bool loadCache(const unsigned char *sourceHash);
+		void saveCache(const unsigned char *sourceHash);
+		void unmapCache();
+
 	private:
 
 		Image *mImage;
@@ -68,7 +154,33 @@ namespace Boy
 		float mScale;
 
 		std::map<wchar_t,FontChar*> mChars;
-		
+
+		// compiled font (built from mChars on first use or mapped
+		// straight from the cache file):
+		bool mCompiled;
+		const Glyph *mGlyphs;
+		int mGlyphCount;
+		const GlyphRange *mGlyphRanges;
+		int mGlyphRangeCount;
+		const int *mGlyphIndices;
+		const unsigned int *mKerningKeys; // open addressed, keyed by glyph pair
+		const int *mKerningValues;
+		int mKerningSize; // a power of 2 (or 0 if there's no kerning)
+
+		// the tables when they're built from mChars:
+		std::vector<Glyph> mGlyphStore;
+		std::vector<GlyphRange> mGlyphRangeStore;
+		std::vector<int> mGlyphIndexStore;
+		std::vector<unsigned int> mKerningKeyStore;
+		std::vector<int> mKerningValueStore;
+
+		// the cache file when the tables come from it:
+		bool mCacheMapped;
+		BoyFileHandle mCacheMap;
+
+		// recently laid out strings, most recently used first:
+		std::list<Layout> mLayouts;
+		std::map<LayoutKey,std::list<Layout>::iterator> mLayoutIndex;
 	};
 }
 
@@ -9,6 +9,7 @@ namespace Boy
 	typedef unsigned long Color;
 
 	class Image;
+	class QuadMesh;
 	class TriStrip;
 
 	class Graphics
@@ -43,6 +44,12 @@ namespace Boy
 		virtual void drawImage(Image *img, const BoyLib::Rect &subrect) { drawImage(img, (int)subrect.getX(), (int)subrect.getY(), (int)subrect.getWidth(), (int)subrect.getHeight()); }
 		virtual void drawImage(Image *img, int subrectX, int subrectY, int subrectW, int subrectH) = 0;
 
+		/*
+		 * draws all quads of a mesh (parts of the given image) with
+		 * the current transform, color and z, as a single draw:
+		 */
+		virtual void drawQuadMesh(Image *img, const QuadMesh *mesh) = 0;
+
 		/*
 		 * geometric primitive drawing methods
 		 */
@@ -50,6 +57,26 @@ namespace Boy
 		virtual void fillRect(int x0, int y0, int w, int h) = 0;
 		virtual void drawTriStrip(TriStrip *strip) = 0;
 
+		/*
+		 * debug primitives: outlines in screen space (like drawLine)
+		 * that are cheap to draw by the thousands. lines and outlines
+		 * may be held back until the end of the frame (or the next
+		 * clip rect change) and drawn after everything else, grouped
+		 * by render state. filled rects are always drawn in order.
+		 */
+		virtual void drawRect(int x0, int y0, int w, int h) = 0;
+		virtual void drawCircle(int x, int y, int radius) = 0;
+
+		/*
+		 * number of line segments that make up a circle (about
+		 * one for every 6 pixels of circumference)
+		 */
+		static int getCircleSegmentCount(float radius)
+		{
+			int segments = (int)(radius + 0.5f);
+			return segments < 8 ? 8 : (segments > 128 ? 128 : segments);
+		}
+
 		/*
 		 * rendering transform modification methods:
 		 */
@@ -123,6 +150,19 @@ namespace Boy
 		 */
 		virtual void setDrawMode(DrawMode mode) = 0;
 
+		/*
+		 * optional image sorting: while it's enabled, images may be
+		 * held back and drawn ordered by layer, then draw mode, then
+		 * texture, to save state and texture switches. images in the
+		 * same layer can end up in any order, so only use it for images
+		 * that don't overlap or that the z buffer sorts out. sorted
+		 * images are drawn by the time sorting is disabled, any other
+		 * render state changes or the frame ends. backends that don't
+		 * gain anything from it just draw everything in order.
+		 */
+		virtual void setSortingEnabled(bool enabled) {}
+		virtual void setSortLayer(int layer) {}
+
 		/*
 		 * sets the clip rectangle for rendering:
 		 */ 
@@ -0,0 +1,789 @@
+#include "HeadlessEnvironment.h"
+
+#include "AESBackends.h"
+#include <assert.h>
+#include <chrono>
+#include <fstream>
+#include "Game.h"
+#include "GamePad.h"
+#include "HeadlessGraphics.h"
+#include "HeadlessPersistenceLayer.h"
+#include "HeadlessResourceLoader.h"
+#include "HeadlessSoundPlayer.h"
+#include "HeadlessTriStrip.h"
+#include "Keyboard.h"
+#include "Mouse.h"
+#include "PackStorage.h"
+#include "PosixStorage.h"
+#include "ResourceManager.h"
+#include "SoftGraphics.h"
+#include "SoftResourceLoader.h"
+#include "SoftTriStrip.h"
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include "tinyxml.h"
+#include "Util.h"
+#include "WorkerPool.h"
+
+#if !defined(GOO_PLATFORM_WIN32)
+	#include <strings.h>
+#endif
+
+#define DEFAULT_FRAME_RATE 60
+
+// time per frame for finishing background loads (in milliseconds):
+#define DEFAULT_LOAD_BUDGET_MS 4
+
+// memory for resident (loaded and warm) resources (in megabytes):
+#define DEFAULT_RESOURCE_BUDGET_MB 128
+
+using namespace Boy;
+
+#include "BoyLib/CrtDbgNew.h"
+
+typedef std::chrono::steady_clock WallClock;
+
+static double secondsSince(const WallClock::time_point &t0)
+{
+	return std::chrono::duration<double>(WallClock::now() - t0).count();
+}
+
+// an environment is a static object now so ctor/dtor stuff should be done in init/destroy
+HeadlessEnvironment::HeadlessEnvironment() {}
+HeadlessEnvironment::~HeadlessEnvironment() {}
+
+void HeadlessEnvironment::init(Game *game,
+							   int screenWidth,
+							   int screenHeight,
+							   bool fullscreen,
+							   const char *windowTitle,
+							   const UString &persFile,
+							   unsigned char *persFileKey)
+{
+	// call superclass:
+	Environment::init(game, screenWidth, screenHeight, fullscreen, windowTitle, persFile, persFileKey);
+
+	// init libs
+	InitTinyXML();
+
+	// encryption
+	mpCryptoKey = persFileKey;
+
+	// storage
+	mStorage = new PosixStorage();
+
+	// persistence layer (memory only):
+	mPersistenceLayer = new HeadlessPersistenceLayer();
+
+	// create mice:
+	for (int i = 0; i < MOUSE_COUNT_MAX; i++)
+	{
+		mMice[i] = new Mouse(i);
+		mMice[i]->setConnected(false);
+	}
+	mMice[0]->setConnected(true);
+
+	// create game pads (none of them ever get connected):
+	for (int i = 0; i < GAMEPAD_COUNT_MAX; i++)
+	{
+		mGamePads[i] = new GamePad(i);
+		mGamePads[i]->setConnected(false);
+	}
+
+	// create keyboard:
+	mKeyboard = new Keyboard();
+	mKeyboard->setConnected(true);
+
+	// log file:
+	mLogFile = NULL;
+
+	// timing (needed by debugLog, so set it up early):
+	mSimTime = 0;
+	mFrameCount = 0;
+	mPauseCount = 0;
+	setMaxFrameRate(DEFAULT_FRAME_RATE);
+
+	// load config:
+	loadConfig();
+	mFrameLimit = atoi(mConfig["headless_frames"].c_str());
+	mWaitForLoading = atoi(mConfig["headless_wait_load"].c_str()) != 0;
+
+	// decryption (the best backend there is, unless the config picks one):
+	std::string &aesBackend = mConfig["aes_backend"];
+	for (int i = 0; i < AESBackends::BACKEND_COUNT; i++)
+	{
+		AESBackends::Backend backend = (AESBackends::Backend)i;
+		if (aesBackend == AESBackends::getBackendName(backend))
+		{
+			AESBackends::setBackend(backend);
+		}
+	}
+
+	// resources can come from a pack (with the files on disk winning
+	// if the config asks for it, which is the default in debug builds):
+	std::string &packPath = mConfig["resource_pack"];
+	if (packPath.size() > 0)
+	{
+#ifdef _DEBUG
+		bool looseFiles = mConfig["pack_loose_files"] != "0";
+#else
+		bool looseFiles = mConfig["pack_loose_files"] == "1";
+#endif
+		PackStorage *pack = new PackStorage(mStorage, looseFiles);
+		mStorage = pack;
+		if (pack->Open(packPath.c_str()))
+		{
+			debugLog("resource pack '%s': %d files\n", packPath.c_str(), pack->GetPackFileCount());
+		}
+		else
+		{
+			debugLog("WARNING: could not open resource pack '%s'\n", packPath.c_str());
+		}
+	}
+	std::map<std::string, std::string>::iterator budgetStr = mConfig.find("load_budget_ms");
+	mLoadBudget = (budgetStr != mConfig.end() ? (float)atof(budgetStr->second.c_str()) : DEFAULT_LOAD_BUDGET_MS) / 1000.0f;
+	bool soft = mConfig["headless_renderer"] == "soft";
+
+	// sound:
+	mSoundPlayer = new HeadlessSoundPlayer();
+	mLastVolume = -1;
+
+	// resource loader:
+	std::vector<std::string> langs;
+	tokenize(mConfig["language"], ", ", langs);
+	if (langs.size() == 0)
+	{
+		langs.push_back("en");
+	}
+	if (soft)
+	{
+		mResourceLoader = new SoftResourceLoader(langs[0], langs.size() > 1 ? langs[1] : "");
+	}
+	else
+	{
+		mResourceLoader = new HeadlessResourceLoader(langs[0], langs.size() > 1 ? langs[1] : "");
+	}
+
+	// resource manager:
+	mResourceManager = new ResourceManager(mResourceLoader, mpCryptoKey, langs[0],
+										   langs.size() > 1 ? langs[1] : "");
+
+	// released resources stay warm while they fit in this (0 turns it off):
+	std::map<std::string, std::string>::iterator residencyStr = mConfig.find("resource_budget_mb");
+	long long residencyBudget = residencyStr != mConfig.end() ? atoi(residencyStr->second.c_str()) : DEFAULT_RESOURCE_BUDGET_MB;
+	mResourceManager->getResidencyManager()->setBudget(residencyBudget * 1024 * 1024);
+
+	// resources that aren't loaded get loaded when they're first used:
+	std::map<std::string, std::string>::iterator demandStr = mConfig.find("demand_loading");
+	mResourceManager->setDemandLoading(demandStr != mConfig.end() && atoi(demandStr->second.c_str())!=0);
+
+	// graphics:
+	if (soft)
+	{
+		mSoftGraphics = new SoftGraphics(screenWidth, screenHeight);
+		std::string &spans = mConfig["soft_spans"];
+		for (int i = 0; i < SoftSpanKernels::PATH_COUNT; i++)
+		{
+			SoftSpanKernels::Path path = (SoftSpanKernels::Path)i;
+			if (spans == SoftSpanKernels::getPathName(path))
+			{
+				mSoftGraphics->setSpanPath(path);
+			}
+		}
+		mSoftGraphics->setThreadCount(atoi(mConfig["soft_threads"].c_str()));
+		envDebugLog("software renderer: %s spans, %d threads\n",
+			SoftSpanKernels::getPathName(mSoftGraphics->getSpanPath()), mSoftGraphics->getThreadCount());
+		mGraphics = mSoftGraphics;
+	}
+	else
+	{
+		mSoftGraphics = NULL;
+		mGraphics = new HeadlessGraphics(screenWidth, screenHeight);
+	}
+
+	// we don't want to shut down right away:
+	mShutdownRequested = false;
+
+	// remember the game:
+	mGame = game;
+
+	// debug:
+#ifdef _DEBUG
+	mIsDebugEnabled = true;
+#else
+	mIsDebugEnabled = false;
+#endif
+
+	// fullscreen:
+	mFullScreenToggleDisableCount = 0;
+
+	// stats:
+	mUpdateSeconds = 0;
+	mDrawSeconds = 0;
+	mRunSeconds = 0;
+	mDrawCallCount = 0;
+}
+
+void HeadlessEnvironment::destroy()
+{
+	Environment::destroy();
+
+	delete mPersistenceLayer;
+	mPersistenceLayer = NULL;
+	for (int i = 0; i < MOUSE_COUNT_MAX; i++)
+	{
+		delete mMice[i];
+		mMice[i] = NULL;
+	}
+	for (int i = 0; i < GAMEPAD_COUNT_MAX; i++)
+	{
+		delete mGamePads[i];
+		mGamePads[i] = NULL;
+	}
+	delete mResourceManager;
+	mResourceManager = NULL;
+	delete mKeyboard;
+	mKeyboard = NULL;
+	delete mResourceLoader;
+	mResourceLoader = NULL;
+	delete mGraphics;
+	mGraphics = NULL;
+	mSoftGraphics = NULL;
+	delete mSoundPlayer;
+	mSoundPlayer = NULL;
+	delete mStorage;
+	mStorage = NULL;
+
+	mConfig.clear();
+}
+
+Graphics *HeadlessEnvironment::getGraphics()
+{
+	return mGraphics;
+}
+
+ResourceManager *HeadlessEnvironment::getResourceManager()
+{
+	return mResourceManager;
+}
+
+PersistenceLayer *HeadlessEnvironment::getPersistenceLayer()
+{
+	return mPersistenceLayer;
+}
+
+SoundPlayer *HeadlessEnvironment::getSoundPlayer()
+{
+	return mSoundPlayer;
+}
+
+Mouse *HeadlessEnvironment::getFirstMouse()
+{
+	return mMice[0];
+}
+
+int HeadlessEnvironment::getMouseCount()
+{
+	return MOUSE_COUNT_MAX;
+}
+
+Mouse *HeadlessEnvironment::getMouse(int mouseId)
+{
+	assert(mouseId < MOUSE_COUNT_MAX);
+
+	return mMice[mouseId];
+}
+
+int HeadlessEnvironment::getGamePadCount()
+{
+	return GAMEPAD_COUNT_MAX;
+}
+
+GamePad *HeadlessEnvironment::getGamePad(int i)
+{
+	assert(i < GAMEPAD_COUNT_MAX);
+
+	return mGamePads[i];
+}
+
+void HeadlessEnvironment::showSystemMouse(bool show)
+{
+}
+
+int HeadlessEnvironment::getKeyboardCount()
+{
+	return 1;
+}
+
+Keyboard *HeadlessEnvironment::getKeyboard(int i)
+{
+	return mKeyboard;
+}
+
+int HeadlessEnvironment::getWiimoteCount()
+{
+	return 0;
+}
+
+Wiimote *HeadlessEnvironment::getWiimote(int i)
+{
+	assert(false);
+	return NULL;
+}
+
+TriStrip *HeadlessEnvironment::createTriStrip(int numVerts)
+{
+	if (mSoftGraphics != NULL)
+	{
+		return new SoftTriStrip(numVerts);
+	}
+	return new HeadlessTriStrip(numVerts);
+}
+
+void HeadlessEnvironment::loadingProc(HeadlessEnvironment *env)
+{
+	// load the game:
+	env->mGame->load();
+
+	// let the main loop know:
+	env->mLoadingDone = true;
+}
+
+void HeadlessEnvironment::startMainLoop()
+{
+	WallClock::time_point runStart = WallClock::now();
+
+	// bootstrap load
+	mGame->preInitLoad();
+
+	// draw the splash screen:
+	mGraphics->beginFrame();
+	mGame->preInitDraw(mGraphics);
+	mGraphics->endFrame();
+
+	// initialize the game:
+	mGame->init();
+
+	// start loading thread:
+	mLoadingDone = false;
+	mLoadingThread = std::thread(loadingProc, this);
+	bool loading = true;
+
+	// main loop:
+	while (!mShutdownRequested)
+	{
+		// the first update can be held back until loading is done, so
+		// that loadComplete() always happens on the same frame:
+		if (loading && mWaitForLoading)
+		{
+			mLoadingThread.join();
+		}
+
+		// if the loading thread is done:
+		if (loading && mLoadingDone)
+		{
+			if (mLoadingThread.joinable())
+			{
+				mLoadingThread.join();
+			}
+			loading = false;
+
+			// handle loading completion:
+			mGame->loadComplete();
+		}
+
+		// finish some of the groups that are loading in the background
+		// (all of them if every frame should come out the same):
+		if (mWaitForLoading)
+		{
+			mResourceManager->finishLoading();
+		}
+		else
+		{
+			mResourceManager->updateLoading(mLoadBudget);
+		}
+
+		// if we're not paused, update:
+		if (mPauseCount == 0)
+		{
+			update();
+		}
+
+		// let's draw:
+		draw();
+
+		// advance the clock (paused time doesn't count, just
+		// like the real environment subtracts pause durations):
+		mFrameCount++;
+		if (mPauseCount == 0)
+		{
+			mSimFrames++;
+			mSimTime = mSimBase + mSimFrames * 1000000 / mMaxFrameRate;
+		}
+
+		// stop after the requested number of frames:
+		if (mFrameLimit > 0 && (int)mFrameCount >= mFrameLimit)
+		{
+			stopMainLoop();
+		}
+	}
+
+	// the loading thread has to be done before the game shuts down:
+	if (mLoadingThread.joinable())
+	{
+		mLoadingThread.join();
+	}
+
+	mRunSeconds = secondsSince(runStart);
+
+	// time the last frame against the number of threads (while its
+	// images are still around):
+	int benchmarkFrames = atoi(mConfig["soft_benchmark"].c_str());
+	if (mSoftGraphics != NULL && benchmarkFrames > 0)
+	{
+		runSoftBenchmark(benchmarkFrames);
+	}
+	int aesMegabytes = atoi(mConfig["aes_benchmark"].c_str());
+	if (aesMegabytes > 0)
+	{
+		runAESBenchmark(aesMegabytes);
+	}
+
+	mGame->preShutdown();
+
+	printRunStats();
+}
+
+void HeadlessEnvironment::update()
+{
+	WallClock::time_point t0 = WallClock::now();
+
+	// tick the sound player:
+	getSoundPlayer()->tick();
+
+	// update (always exactly one frame's worth of time):
+	mGame->update(1.0f / mMaxFrameRate);
+
+	mUpdateSeconds += secondsSince(t0);
+}
+
+void HeadlessEnvironment::draw()
+{
+	WallClock::time_point t0 = WallClock::now();
+
+	// draw:
+	mGraphics->beginFrame();
+	int s0 = mGraphics->getTransformStackSize();
+	mGame->draw(mGraphics);
+	int s1 = mGraphics->getTransformStackSize();
+	assert(s0 == s1);
+	mGraphics->endFrame();
+	mDrawCallCount += mGraphics->getDrawCallCount();
+
+	mDrawSeconds += secondsSince(t0);
+}
+
+void HeadlessEnvironment::printRunStats()
+{
+	if (mFrameCount == 0)
+	{
+		return;
+	}
+
+	double frames = (double)mFrameCount;
+	envDebugLog("headless run: frames=%u simulated=%0.2fs wall=%0.3fs (%0.0f frames/s)\n",
+		mFrameCount, getTime(), mRunSeconds, mRunSeconds > 0 ? frames / mRunSeconds : 0);
+	envDebugLog("  update=%0.4fms/frame draw=%0.4fms/frame draw calls=%0.1f/frame\n",
+		mUpdateSeconds * 1000.0 / frames, mDrawSeconds * 1000.0 / frames, mDrawCallCount / frames);
+	if (mSoftGraphics != NULL)
+	{
+		double pixels = (double)mSoftGraphics->getTotalPixelCount();
+		envDebugLog("  fill (%s spans): pixels=%0.0f/frame fill rate=%0.1f Mpixels/s\n",
+			SoftSpanKernels::getPathName(mSoftGraphics->getSpanPath()), pixels / frames,
+			mDrawSeconds > 0 ? pixels / mDrawSeconds / 1000000.0 : 0);
+	}
+}
+
+void HeadlessEnvironment::runSoftBenchmark(int frames)
+{
+	int maxThreads = WorkerPool::getHardwareThreadCount();
+	if (mSoftGraphics->getThreadCount() > maxThreads)
+	{
+		maxThreads = mSoftGraphics->getThreadCount();
+	}
+
+	envDebugLog("soft benchmark: last frame rendered %d times, %d tiles of %dx%d\n", frames,
+		((mGraphics->getWidth() + SoftGraphics::TILE_SIZE - 1) / SoftGraphics::TILE_SIZE) *
+		((mGraphics->getHeight() + SoftGraphics::TILE_SIZE - 1) / SoftGraphics::TILE_SIZE),
+		(int)SoftGraphics::TILE_SIZE, (int)SoftGraphics::TILE_SIZE);
+
+	double baseMs = 0;
+	for (int threads = 1; threads <= maxThreads; threads++)
+	{
+		double ms = mSoftGraphics->benchmark(threads, frames);
+		if (threads == 1)
+		{
+			baseMs = ms;
+		}
+		envDebugLog("  threads=%d frame=%0.3fms speedup=%0.2fx\n", threads, ms, ms > 0 ? baseMs / ms : 0);
+	}
+}
+
+void HeadlessEnvironment::runAESBenchmark(int megabytes)
+{
+	envDebugLog("aes benchmark: %d MB decrypted in 1 MB buffers (aes-192 cbc), files use %s\n", megabytes,
+		AESBackends::getBackendName(AESBackends::getBackend()));
+
+	double baseRate = 0;
+	for (int i = 0; i < AESBackends::BACKEND_COUNT; i++)
+	{
+		AESBackends::Backend backend = (AESBackends::Backend)i;
+		if (!AESBackends::isSupported(backend))
+		{
+			envDebugLog("  %s: not supported\n", AESBackends::getBackendName(backend));
+			continue;
+		}
+		double rate = AESBackends::benchmark(backend, 1024 * 1024, megabytes);
+		if (backend == AESBackends::BACKEND_REFERENCE)
+		{
+			baseRate = rate;
+		}
+		envDebugLog("  %s: %0.1f MB/s speedup=%0.2fx\n", AESBackends::getBackendName(backend), rate,
+			baseRate > 0 ? rate / baseRate : 0);
+	}
+}
+
+void HeadlessEnvironment::stopMainLoop()
+{
+	mShutdownRequested = true;
+}
+
+bool HeadlessEnvironment::isShuttingDown()
+{
+	return mShutdownRequested;
+}
+
+void HeadlessEnvironment::showError(const std::string &message)
+{
+	fprintf(stderr, "ERROR: %s\n", message.c_str());
+}
+
+float HeadlessEnvironment::getTime()
+{
+	return (float)(mSimTime / 1000000.0);
+}
+
+void HeadlessEnvironment::pauseTime()
+{
+	mPauseCount++;
+}
+
+void HeadlessEnvironment::resumeTime()
+{
+	assert(mPauseCount > 0);
+	mPauseCount--;
+}
+
+int HeadlessEnvironment::getMaxFrameRate()
+{
+	return mMaxFrameRate;
+}
+
+void HeadlessEnvironment::setMaxFrameRate(int fps)
+{
+	assert(fps > 0);
+	mMaxFrameRate = fps;
+	mSimBase = mSimTime;
+	mSimFrames = 0;
+}
+
+void HeadlessEnvironment::setFrameLimit(int frames)
+{
+	mFrameLimit = frames;
+}
+
+void HeadlessEnvironment::debugLog(const char *fmt, ...)
+{
+	// write to console:
+	printf("[t=%0.2f] ", getTime());
+	va_list ap;
+	va_start(ap, fmt);
+	vprintf(fmt, ap);
+	va_end(ap);
+
+	if (mLogFile != NULL)
+	{
+		fprintf(mLogFile, "[t=%0.2f] ", getTime());
+		va_list ap2;
+		va_start(ap2, fmt);
+		vfprintf(mLogFile, fmt, ap2);
+		va_end(ap2);
+		fflush(mLogFile);
+	}
+}
+
+void HeadlessEnvironment::setLogFile(FILE *f)
+{
+	mLogFile = f;
+}
+
+void HeadlessEnvironment::screenshot(const char *filename)
+{
+	// only the software renderer has pixels:
+	if (mSoftGraphics != NULL)
+	{
+		mSoftGraphics->saveScreenshot(filename);
+	}
+}
+
+void HeadlessEnvironment::setMute(bool mute)
+{
+	assert(mSoundPlayer != NULL);
+
+	if (mute)
+	{
+		mLastVolume = mSoundPlayer->getMasterVolume();
+		mSoundPlayer->setMasterVolume(0);
+	}
+	else
+	{
+		if (mLastVolume <= 0)
+		{
+			mLastVolume = 1;
+		}
+		mSoundPlayer->setMasterVolume(mLastVolume);
+	}
+}
+
+bool HeadlessEnvironment::isMute()
+{
+	return mSoundPlayer->getMasterVolume() == 0;
+}
+
+void HeadlessEnvironment::setDebugEnabled(bool enabled)
+{
+	mIsDebugEnabled = enabled;
+}
+
+bool HeadlessEnvironment::isDebugEnabled()
+{
+	return mIsDebugEnabled;
+}
+
+bool HeadlessEnvironment::isFullScreen()
+{
+	return false;
+}
+
+void HeadlessEnvironment::toggleFullScreen()
+{
+}
+
+void HeadlessEnvironment::enableFullScreenToggle()
+{
+	assert(mFullScreenToggleDisableCount > 0);
+	mFullScreenToggleDisableCount--;
+}
+
+void HeadlessEnvironment::disableFullScreenToggle()
+{
+	mFullScreenToggleDisableCount++;
+}
+
+void HeadlessEnvironment::sleep(int milliseconds)
+{
+	// run as fast as possible, sleeping would only skew the profile
+}
+
+void HeadlessEnvironment::dumpEnvironmentInfo(const char *filename)
+{
+	std::ofstream file;
+	file.open(filename, std::ofstream::out | std::ofstream::app);
+	file << "headless environment: " << mGraphics->getWidth() << "x" << mGraphics->getHeight()
+		 << " at " << mMaxFrameRate << " frames per simulated second\n";
+	file.close();
+}
+
+std::string HeadlessEnvironment::getHardwareId()
+{
+	// stable across machines so runs stay comparable:
+	return std::string("headless");
+}
+
+unsigned char *HeadlessEnvironment::getCryptoKey()
+{
+	return mpCryptoKey;
+}
+
+int HeadlessEnvironment::sprintf(char *pBuffer, int bufferLenChars, const char *pFormat, ...)
+{
+	va_list ap;
+	va_start(ap, pFormat);
+	int retVal = vsnprintf(pBuffer, bufferLenChars, pFormat, ap);
+	va_end(ap);
+
+	return retVal;
+}
+
+int HeadlessEnvironment::stricmp(const char *pStr1, const char *pStr2)
+{
+#if defined(GOO_PLATFORM_WIN32)
+	return _stricmp(pStr1, pStr2);
+#else
+	return strcasecmp(pStr1, pStr2);
+#endif
+}
+
+Storage *HeadlessEnvironment::getStorage()
+{
+	assert(mStorage);
+	return mStorage;
+}
+
+void HeadlessEnvironment::loadConfig()
+{
+	BoyFileHandle hFile;
+	Storage *pStorage = getStorage();
+	Storage::StorageResult result = pStorage->FileOpen("config.txt", Storage::STORAGE_MODE_READ | Storage::STORAGE_MUST_EXIST, &hFile);
+	if (result == Storage::STORAGE_OK)
+	{
+		int size = pStorage->FileGetSize(hFile);
+		char *data = new char[size + 1];
+		result = pStorage->FileRead(hFile, data, size);
+		assert(result == Storage::STORAGE_OK);
+		pStorage->FileClose(hFile);
+		data[size] = 0;
+
+		// load the file:
+		TiXmlDocument doc;
+		doc.Parse(data);
+
+		// deallocate buffer:
+		delete[] data;
+
+		// get the root element:
+		TiXmlElement *root = doc.RootElement();
+		if (root == NULL || strcmp(root->Value(), "config") != 0)
+		{
+			envDebugLog("WARNING: ignoring malformed config.txt\n");
+			return;
+		}
+
+		// iterate over all values:
+		for (TiXmlElement *e = root->FirstChildElement(); e != NULL; e = e->NextSiblingElement())
+		{
+			const char *name = e->Attribute("name");
+			const char *value = e->Attribute("value");
+			if (name != NULL && value != NULL)
+			{
+				mConfig[name] = value;
+			}
+		}
+	}
+}
+
+int HeadlessEnvironment::getSafeZoneInset()
+{
+	return atoi(mConfig["ui_inset"].c_str());
+}
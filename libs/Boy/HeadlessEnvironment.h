@@ -0,0 +1,172 @@
+#pragma once
+
+#include "BoyLib/UString.h"
+#include "Environment.h"
+#include <atomic>
+#include <map>
+#include <thread>
+
+namespace Boy
+{
+	class Game;
+	class HeadlessGraphics;
+	class Keyboard;
+	class Mouse;
+	class ResourceLoader;
+	class SoftGraphics;
+
+	/*
+	 * an environment without a window, a gpu or a sound device. the main
+	 * loop runs the regular game lifecycle as fast as it can on a fixed
+	 * simulated clock: every update advances time by exactly one frame
+	 * (1/max frame rate), so runs are repeatable and can be profiled or
+	 * compared against each other.
+	 *
+	 * config.txt values that only apply here:
+	 *   headless_frames     - stop after this many frames (0 runs until
+	 *                         the game stops the main loop)
+	 *   headless_wait_load  - 1 to block the first update until the
+	 *                         loading thread is done
+	 *   headless_renderer   - "soft" to rasterize frames in software
+	 *                         (images get decoded and screenshots work)
+	 *   soft_spans          - scalar, sse2 or avx2 to force the span
+	 *                         kernels of the software renderer
+	 *   soft_threads        - rasterizer threads (0 is one per core)
+	 *   soft_benchmark      - at the end of the run, render the last
+	 *                         frame this many times with 1..N threads
+	 *                         and log the frame times
+	 *   aes_backend         - reference, ttable or aesni to force the
+	 *                         backend that decrypts files
+	 *   aes_benchmark       - at the end of the run, decrypt this many
+	 *                         MB with every aes backend and log the
+	 *                         throughput
+	 */
+	class HeadlessEnvironment : public Environment
+	{
+	public:
+
+		HeadlessEnvironment();
+		virtual ~HeadlessEnvironment();
+
+		// implementation of Environment:
+		virtual void				init(Game *game, int screenWidth, int screenHeight, bool fullscreen,
+										 const char *windowTitle, const UString &persFile, unsigned char *persFileKey);
+		virtual void				destroy();
+		virtual Graphics			*getGraphics();
+		virtual int					getMouseCount();
+		virtual Mouse				*getFirstMouse();
+		virtual Mouse				*getMouse(int mouseId);
+		virtual int					getGamePadCount();
+		virtual GamePad				*getGamePad(int i);
+		virtual void				showSystemMouse(bool show);
+		virtual int					getKeyboardCount();
+		virtual Keyboard			*getKeyboard(int i);
+		virtual int					getWiimoteCount();
+		virtual Wiimote				*getWiimote(int i);
+		virtual ResourceManager		*getResourceManager();
+		virtual PersistenceLayer	*getPersistenceLayer();
+		virtual SoundPlayer			*getSoundPlayer();
+		virtual TriStrip			*createTriStrip(int numVerts);
+		virtual void				startMainLoop();
+		virtual void				stopMainLoop();
+		virtual bool				isShuttingDown();
+		virtual void				showError(const std::string &message);
+		virtual float				getTime();
+		virtual void				pauseTime();
+		virtual void				resumeTime();
+		virtual int					getMaxFrameRate();
+		virtual void				setMaxFrameRate(int fps);
+		virtual void				debugLog(const char *fmt, ...);
+		virtual void				screenshot(const char *filename);
+		virtual void				setMute(bool mute);
+		virtual bool				isMute();
+		virtual void				setDebugEnabled(bool enabled);
+		virtual bool				isDebugEnabled();
+		virtual bool				isFullScreen();
+		virtual void				toggleFullScreen();
+		virtual void				enableFullScreenToggle();
+		virtual void				disableFullScreenToggle();
+		virtual void				sleep(int milliseconds);
+		virtual void				dumpEnvironmentInfo(const char *filename);
+		virtual std::string			getHardwareId();
+		virtual unsigned char		*getCryptoKey();
+		virtual int					sprintf( char *pBuffer, int bufferLenChars, const char *pFormat, ... );
+		virtual int					stricmp( const char *pStr1, const char *pStr2 );
+		virtual Storage				*getStorage();
+		virtual int					getSafeZoneInset();
+		virtual bool				isWindowResizable() { return false; }
+		virtual void				setLogFile(FILE *f);
+
+		// headless run control:
+		void						setFrameLimit(int frames);
+		inline int					getFrameLimit() { return mFrameLimit; }
+		inline void					setWaitForLoading(bool wait) { mWaitForLoading = wait; }
+		inline unsigned int			getFrameCount() { return mFrameCount; }
+
+	protected:
+
+		void						update();
+		void						draw();
+		void						loadConfig();
+		void						printRunStats();
+		void						runSoftBenchmark(int frames);
+		void						runAESBenchmark(int megabytes);
+		static void					loadingProc(HeadlessEnvironment *env);
+
+	protected:
+
+		// subsystems:
+		PersistenceLayer			*mPersistenceLayer;
+		ResourceManager				*mResourceManager;
+		ResourceLoader				*mResourceLoader;
+		HeadlessGraphics			*mGraphics;
+		SoftGraphics				*mSoftGraphics;
+		SoundPlayer					*mSoundPlayer;
+		Storage						*mStorage;
+		std::map<std::string,std::string> mConfig;
+
+		// controllers:
+		Mouse						*mMice[MOUSE_COUNT_MAX];
+		GamePad						*mGamePads[GAMEPAD_COUNT_MAX];
+		Keyboard					*mKeyboard;
+
+		// sound related:
+		float						mLastVolume;
+
+		// shutdown flag:
+		bool						mShutdownRequested;
+
+		// runtime debug flag:
+		bool						mIsDebugEnabled;
+
+		// log file:
+		FILE						*mLogFile;
+
+		// fullscreen toggle (only counted, there's no window):
+		int							mFullScreenToggleDisableCount;
+
+		// simulated clock (in microseconds, worked out from the frames
+		// since the frame rate was set so it never drifts):
+		unsigned long long			mSimTime;
+		unsigned long long			mSimBase; // the time when the frame rate was set
+		unsigned long long			mSimFrames; // unpaused frames since then
+		int							mMaxFrameRate;
+		int							mPauseCount;
+		unsigned int				mFrameCount;
+		int							mFrameLimit;
+
+		// loading thread:
+		std::thread					mLoadingThread;
+		std::atomic<bool>			mLoadingDone;
+		bool						mWaitForLoading;
+		float						mLoadBudget; // time per frame for finishing background loads (in seconds)
+
+		// wall clock totals (in seconds) for the stats printed at shutdown:
+		double						mUpdateSeconds;
+		double						mDrawSeconds;
+		double						mRunSeconds;
+		unsigned long long			mDrawCallCount;
+
+		unsigned char				*mpCryptoKey;
+	};
+}
@@ -0,0 +1,273 @@
+#include "HeadlessGraphics.h"
+
+#include <assert.h>
+#include "BoyLib/BoyUtil.h"
+
+using namespace Boy;
+
+#include "BoyLib/CrtDbgNew.h"
+
+HeadlessGraphics::HeadlessGraphics(int width, int height)
+{
+	mWidth = width;
+	mHeight = height;
+	mColor = 0xffffffff;
+	mColorizationEnabled = false;
+	mZ = 0;
+
+	// same defaults that WinD3DInterface sets up every frame:
+	mZTestEnabled = false;
+	mZWriteEnabled = false;
+	mZFunction = CMP_LEQUAL;
+	mAlphaTestEnabled = true;
+	mAlphaReferenceValue = 1;
+	mAlphaFunction = CMP_ALWAYS;
+	mDrawMode = DRAWMODE_NORMAL;
+
+	mClipX = 0;
+	mClipY = 0;
+	mClipWidth = width;
+	mClipHeight = height;
+
+	mClearZ = 1;
+	mClearColor = 0x00000000;
+
+	mDrawCallCount = 0;
+}
+
+HeadlessGraphics::~HeadlessGraphics()
+{
+}
+
+void HeadlessGraphics::drawImage(Image *img)
+{
+	assert(img!=NULL);
+	mDrawCallCount++;
+}
+
+void HeadlessGraphics::drawImage(Image *img, int subrectX, int subrectY, int subrectW, int subrectH)
+{
+	assert(img!=NULL);
+	mDrawCallCount++;
+}
+
+void HeadlessGraphics::drawQuadMesh(Image *img, const QuadMesh *mesh)
+{
+	assert(img!=NULL && mesh!=NULL);
+	mDrawCallCount++;
+}
+
+void HeadlessGraphics::drawLine(int x0, int y0, int x1, int y1)
+{
+	mDrawCallCount++;
+}
+
+void HeadlessGraphics::fillRect(int x0, int y0, int w, int h)
+{
+	mDrawCallCount++;
+}
+
+void HeadlessGraphics::drawRect(int x0, int y0, int w, int h)
+{
+	mDrawCallCount++;
+}
+
+void HeadlessGraphics::drawCircle(int x, int y, int radius)
+{
+	mDrawCallCount++;
+}
+
+void HeadlessGraphics::drawTriStrip(TriStrip *strip)
+{
+	assert(strip!=NULL);
+	mDrawCallCount++;
+}
+
+void HeadlessGraphics::scale(float x, float y)
+{
+	Transform2D xform;
+	xform.setScaling(x, y);
+	mTransformStack.top().multiply(xform);
+}
+
+void HeadlessGraphics::rotateDeg(float angle)
+{
+	Transform2D xform;
+	xform.setRotation(deg2rad(-angle));
+	mTransformStack.top().multiply(xform);
+}
+
+void HeadlessGraphics::rotateRad(float angle)
+{
+	Transform2D xform;
+	xform.setRotation(-angle);
+	mTransformStack.top().multiply(xform);
+}
+
+void HeadlessGraphics::translate(float x, float y)
+{
+	Transform2D xform;
+	xform.setTranslation(x, y);
+	mTransformStack.top().multiply(xform);
+}
+
+void HeadlessGraphics::preScale(float x, float y)
+{
+	Transform2D xform;
+	xform.setScaling(x, y);
+	mTransformStack.top().preMultiply(xform);
+}
+
+void HeadlessGraphics::preRotateDeg(float angle)
+{
+	Transform2D xform;
+	xform.setRotation(deg2rad(angle));
+	mTransformStack.top().preMultiply(xform);
+}
+
+void HeadlessGraphics::preRotateRad(float angle)
+{
+	Transform2D xform;
+	xform.setRotation(angle);
+	mTransformStack.top().preMultiply(xform);
+}
+
+void HeadlessGraphics::preTranslate(float x, float y)
+{
+	Transform2D xform;
+	xform.setTranslation(x, y);
+	mTransformStack.top().preMultiply(xform);
+}
+
+void HeadlessGraphics::pushTransform()
+{
+	mTransformStack.push();
+}
+
+void HeadlessGraphics::popTransform()
+{
+	mTransformStack.pop();
+}
+
+int HeadlessGraphics::getTransformStackSize()
+{
+	return mTransformStack.size();
+}
+
+void HeadlessGraphics::setColor(Color color)
+{
+	mColor = color;
+}
+
+void HeadlessGraphics::setAlpha(float alpha)
+{
+	mColor &= 0x00ffffff;
+	mColor |= ((int)(255.0f * alpha)) << 24;
+}
+
+void HeadlessGraphics::setColorizationEnabled(bool enabled)
+{
+	mColorizationEnabled = enabled;
+}
+
+void HeadlessGraphics::setZTestEnabled(bool enabled)
+{
+	mZTestEnabled = enabled;
+}
+
+bool HeadlessGraphics::isZTestEnabled()
+{
+	return mZTestEnabled;
+}
+
+void HeadlessGraphics::setZWriteEnabled(bool enabled)
+{
+	mZWriteEnabled = enabled;
+}
+
+bool HeadlessGraphics::isZWriteEnabled()
+{
+	return mZWriteEnabled;
+}
+
+void HeadlessGraphics::setZ(float z)
+{
+	assert(z>=0 && z<=1);
+	mZ = z;
+}
+
+float HeadlessGraphics::getZ()
+{
+	return mZ;
+}
+
+void HeadlessGraphics::setZFunction(CompareFunc func)
+{
+	mZFunction = func;
+}
+
+void HeadlessGraphics::setDrawMode(DrawMode mode)
+{
+	mDrawMode = mode;
+}
+
+void HeadlessGraphics::setAlphaTestEnabled(bool enabled)
+{
+	mAlphaTestEnabled = enabled;
+}
+
+bool HeadlessGraphics::isAlphaTestEnabled()
+{
+	return mAlphaTestEnabled;
+}
+
+void HeadlessGraphics::setAlphaReferenceValue(int val)
+{
+	mAlphaReferenceValue = val;
+}
+
+void HeadlessGraphics::setAlphaFunction(CompareFunc func)
+{
+	mAlphaFunction = func;
+}
+
+void HeadlessGraphics::setClipRect(int x, int y, int width, int height)
+{
+	mClipX = x;
+	mClipY = y;
+	mClipWidth = width;
+	mClipHeight = height;
+}
+
+int HeadlessGraphics::getWidth()
+{
+	return mWidth;
+}
+
+int HeadlessGraphics::getHeight()
+{
+	return mHeight;
+}
+
+void HeadlessGraphics::setClearZ(float z)
+{
+	mClearZ = z;
+}
+
+void HeadlessGraphics::setClearColor(Color color)
+{
+	mClearColor = color;
+}
+
+void HeadlessGraphics::beginFrame()
+{
+	mAlphaTestEnabled = true;
+	mAlphaReferenceValue = 1;
+	mDrawMode = DRAWMODE_NORMAL;
+
+	mDrawCallCount = 0;
+}
+
+void HeadlessGraphics::endFrame()
+{
+}
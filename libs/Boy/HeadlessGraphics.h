@@ -0,0 +1,113 @@
+#pragma once
+
+#include "BoyLib/CrtDbgInc.h"
+
+#include "Graphics.h"
+#include "TransformStack.h"
+
+namespace Boy
+{
+	/*
+	 * a graphics object that draws nothing. it keeps track of the
+	 * transform stack and render state so that games behave exactly
+	 * like they do on a real backend, and counts draw calls.
+	 */
+	class HeadlessGraphics : public Graphics
+	{
+	public:
+
+		HeadlessGraphics(int width, int height);
+		virtual ~HeadlessGraphics();
+
+		virtual void drawImage(Image *img);
+		virtual void drawImage(Image *img, int subrectX, int subrectY, int subrectW, int subrectH);
+		virtual void drawQuadMesh(Image *img, const QuadMesh *mesh);
+
+		virtual void drawLine(int x0, int y0, int x1, int y1);
+		virtual void fillRect(int x0, int y0, int w, int h);
+		virtual void drawRect(int x0, int y0, int w, int h);
+		virtual void drawCircle(int x, int y, int radius);
+		virtual void drawTriStrip(TriStrip *strip);
+
+		virtual void scale(float x, float y);
+		virtual void rotateDeg(float angle);
+		virtual void rotateRad(float angle);
+		virtual void translate(float x, float y);
+		virtual void preScale(float x, float y);
+		virtual void preRotateDeg(float angle);
+		virtual void preRotateRad(float angle);
+		virtual void preTranslate(float x, float y);
+
+		virtual void pushTransform();
+		virtual void popTransform();
+		virtual int getTransformStackSize();
+
+		virtual void setAlpha(float alpha);
+		virtual void setColor(Color color);
+		virtual void setColorizationEnabled(bool enabled);
+
+		virtual void setZTestEnabled(bool enabled);
+		virtual bool isZTestEnabled();
+		virtual void setZWriteEnabled(bool enabled);
+		virtual bool isZWriteEnabled();
+		virtual void setZFunction(CompareFunc func);
+		virtual void setZ(float z);
+		virtual float getZ();
+
+		virtual void setAlphaTestEnabled(bool enabled);
+		virtual bool isAlphaTestEnabled();
+		virtual void setAlphaReferenceValue(int val);
+		virtual void setAlphaFunction(CompareFunc func);
+
+		virtual void setDrawMode(DrawMode mode);
+
+		virtual void setClipRect(int x, int y, int width, int height);
+
+		virtual int getWidth();
+		virtual int getHeight();
+
+		virtual void setClearZ(float z);
+		virtual void setClearColor(Color color);
+
+		// frame bracketing (resets the per frame state the same
+		// way WinD3DInterface::beginScene does):
+		virtual void beginFrame();
+		virtual void endFrame();
+
+		// draw call counting:
+		inline int getDrawCallCount() { return mDrawCallCount; }
+		inline void resetDrawCallCount() { mDrawCallCount = 0; }
+
+	protected:
+
+		int mWidth;
+		int mHeight;
+
+		Color mColor;
+		bool mColorizationEnabled;
+
+		float mZ;
+		bool mZTestEnabled;
+		bool mZWriteEnabled;
+		CompareFunc mZFunction;
+
+		bool mAlphaTestEnabled;
+		int mAlphaReferenceValue;
+		CompareFunc mAlphaFunction;
+
+		DrawMode mDrawMode;
+
+		int mClipX;
+		int mClipY;
+		int mClipWidth;
+		int mClipHeight;
+
+		float mClearZ;
+		Color mClearColor;
+
+		TransformStack mTransformStack;
+
+		int mDrawCallCount;
+
+	};
+};
@@ -0,0 +1,42 @@
+#include "HeadlessImage.h"
+
+#include "ResourceLoader.h"
+
+using namespace Boy;
+
+#include "BoyLib/CrtDbgNew.h"
+
+HeadlessImage::HeadlessImage(ResourceLoader *loader, const std::string &path) : Image(loader,path)
+{
+	mWidth = -1;
+	mHeight = -1;
+}
+
+HeadlessImage::~HeadlessImage()
+{
+}
+
+int HeadlessImage::getWidth()
+{
+	return mWidth;
+}
+
+int HeadlessImage::getHeight()
+{
+	return mHeight;
+}
+
+bool HeadlessImage::init(bool includeSounds)
+{
+	return mLoader->load(this);
+}
+
+void HeadlessImage::destroy(bool includeSounds)
+{
+}
+
+void HeadlessImage::setSize(int width, int height)
+{
+	mWidth = width;
+	mHeight = height;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "Image.h"
+
+namespace Boy
+{
+	/*
+	 * an image without any pixels, it only knows its size
+	 */
+	class HeadlessImage : public Image
+	{
+	public:
+
+		HeadlessImage(ResourceLoader *loader, const std::string &path);
+		virtual ~HeadlessImage();
+
+		void setSize(int width, int height);
+
+		const std::string &getPath() { return mPath; }
+
+		// implementation of Image:
+		virtual int getWidth();
+		virtual int getHeight();
+
+	private:
+
+		// implementation of Resource:
+		virtual bool init(bool includeSounds);
+		virtual void destroy(bool includeSounds);
+
+	private:
+
+		int mWidth;
+		int mHeight;
+	};
+};
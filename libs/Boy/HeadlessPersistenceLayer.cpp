@@ -0,0 +1,68 @@
+#include "HeadlessPersistenceLayer.h"
+
+#include <assert.h>
+
+using namespace Boy;
+
+#include "BoyLib/CrtDbgNew.h"
+
+HeadlessPersistenceLayer::HeadlessPersistenceLayer()
+{
+}
+
+HeadlessPersistenceLayer::~HeadlessPersistenceLayer()
+{
+}
+
+bool HeadlessPersistenceLayer::remove(const std::string &name, bool persist)
+{
+	std::map<std::string,std::string>::iterator iter = mValues.find(name);
+	if (iter==mValues.end())
+	{
+		return false;
+	}
+
+	mValues.erase(iter);
+
+	return true;
+}
+
+void HeadlessPersistenceLayer::putString(const std::string &name, const std::string &value, bool persist)
+{
+	assert(name.size()>0);
+	mValues[name] = value;
+}
+
+const std::string HeadlessPersistenceLayer::getString(const std::string &name)
+{
+	std::map<std::string,std::string>::iterator iter = mValues.find(name);
+	if (iter!=mValues.end())
+	{
+		return iter->second;
+	}
+	else
+	{
+		return std::string("");
+	}
+}
+
+int HeadlessPersistenceLayer::getKeyCount()
+{
+	return (int)mValues.size();
+}
+
+const std::string HeadlessPersistenceLayer::getKey(int i)
+{
+	assert(i>=0 && i<(int)mValues.size());
+	std::map<std::string,std::string>::iterator iter = mValues.begin();
+	for (int x=0 ; x<i ; x++)
+	{
+		iter++;
+	}
+	return iter->first;
+}
+
+void HeadlessPersistenceLayer::persist()
+{
+	// nothing to write to
+}
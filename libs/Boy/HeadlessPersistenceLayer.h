@@ -0,0 +1,36 @@
+#pragma once
+
+#include "BoyLib/CrtDbgInc.h"
+
+#include "PersistenceLayer.h"
+#include <map>
+#include <string>
+
+namespace Boy
+{
+	/*
+	 * keeps values in memory only, so headless runs always start
+	 * from the same (empty) state and never touch the user's saves
+	 */
+	class HeadlessPersistenceLayer : public PersistenceLayer
+	{
+	public:
+
+		HeadlessPersistenceLayer();
+		virtual ~HeadlessPersistenceLayer();
+
+		virtual void putString(const std::string &name, const std::string &value, bool persist=false);
+		virtual const std::string getString(const std::string &name);
+		virtual bool remove(const std::string &name, bool persist=false);
+
+		virtual int getKeyCount();
+		virtual const std::string getKey(int i);
+
+		virtual void persist();
+
+	private:
+
+		std::map<std::string,std::string> mValues;
+
+	};
+}
@@ -0,0 +1,111 @@
+#include "HeadlessResourceLoader.h"
+
+#include "Environment.h"
+#include "HeadlessImage.h"
+#include "HeadlessSound.h"
+#include <string.h>
+#include "Storage.h"
+
+using namespace Boy;
+
+#include "BoyLib/CrtDbgNew.h"
+
+HeadlessResourceLoader::HeadlessResourceLoader(const std::string &language1, 
+											   const std::string &language2) 
+											   : ResourceLoader(language1,language2)
+{
+}
+
+HeadlessResourceLoader::~HeadlessResourceLoader()
+{
+}
+
+Image *HeadlessResourceLoader::createImage(const std::string &filename)
+{
+	return new HeadlessImage(this,filename);
+}
+
+Sound *HeadlessResourceLoader::createSound(const std::string &filename)
+{
+	return new HeadlessSound(this,filename);
+}
+
+bool HeadlessResourceLoader::load(Image *image)
+{
+	HeadlessImage *img = dynamic_cast<HeadlessImage*>(image);
+
+	std::string fname;
+	int width, height;
+	if (!findLocalized(img->getPath(), ".png", fname) || !readPngSize(fname, &width, &height))
+	{
+		envDebugLog("could not load texture: %s.png\n",img->getPath().c_str());
+		return false;
+	}
+
+	// remember the original image size:
+	img->setSize(width,height);
+
+	return true;
+}
+
+bool HeadlessResourceLoader::load(Sound *sound)
+{
+	HeadlessSound *snd = dynamic_cast<HeadlessSound*>(sound);
+
+	std::string fname;
+	if (!findLocalized(snd->getPath(), ".ogg", fname))
+	{
+		envDebugLog("error loading sound '%s'\n",snd->getPath().c_str());
+		return false;
+	}
+
+	return true;
+}
+
+bool HeadlessResourceLoader::findLocalized(const std::string &path, const char *ext, std::string &filename)
+{
+	Storage *storage = Environment::instance()->getStorage();
+	int size;
+
+	// try the primary language, then the backup language, then the default:
+	filename = path+"."+mLanguage1+ext;
+	if (storage->FileGetSize(filename.c_str(), &size)==Storage::STORAGE_OK)
+	{
+		return true;
+	}
+	if (mLanguage2.size()>0)
+	{
+		filename = path+"."+mLanguage2+ext;
+		if (storage->FileGetSize(filename.c_str(), &size)==Storage::STORAGE_OK)
+		{
+			return true;
+		}
+	}
+	filename = path+ext;
+	return storage->FileGetSize(filename.c_str(), &size)==Storage::STORAGE_OK;
+}
+
+bool HeadlessResourceLoader::readPngSize(const std::string &filename, int *width, int *height)
+{
+	Storage *storage = Environment::instance()->getStorage();
+
+	// the png signature is followed by the IHDR chunk, which
+	// starts with the image width and height (big endian):
+	unsigned char header[24];
+	BoyFileHandle hFile;
+	if (storage->FileOpen(filename.c_str(), Storage::STORAGE_MODE_READ | Storage::STORAGE_MUST_EXIST, &hFile)!=Storage::STORAGE_OK)
+	{
+		return false;
+	}
+	Storage::StorageResult result = storage->FileRead(hFile, header, sizeof(header));
+	storage->FileClose(hFile);
+	if (result!=Storage::STORAGE_OK || memcmp(header+12, "IHDR", 4)!=0)
+	{
+		return false;
+	}
+
+	*width = (header[16]<<24) | (header[17]<<16) | (header[18]<<8) | header[19];
+	*height = (header[20]<<24) | (header[21]<<16) | (header[22]<<8) | header[23];
+
+	return true;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "BoyLib/CrtDbgInc.h"
+
+#include "ResourceLoader.h"
+
+namespace Boy
+{
+	/*
+	 * resolves resources the same way WinResourceLoader does (including
+	 * the localized variants) but only reads image headers for their
+	 * size and only checks that sounds exist
+	 */
+	class HeadlessResourceLoader : public ResourceLoader
+	{
+	public:
+
+		HeadlessResourceLoader(const std::string &language1, const std::string &language2);
+		virtual ~HeadlessResourceLoader();
+
+		virtual bool load(Image *image);
+		virtual bool load(Sound *sound);
+		virtual Image *createImage(const std::string &filename);
+		virtual Sound *createSound(const std::string &filename);
+
+	protected:
+
+		bool findLocalized(const std::string &path, const char *ext, std::string &filename);
+		bool readPngSize(const std::string &filename, int *width, int *height);
+
+	};
+};
@@ -0,0 +1,31 @@
+#include "HeadlessSound.h"
+
+#include "ResourceLoader.h"
+
+using namespace Boy;
+
+#include "BoyLib/CrtDbgNew.h"
+
+HeadlessSound::HeadlessSound(ResourceLoader *loader, const std::string &path) : Sound(loader,path)
+{
+}
+
+HeadlessSound::~HeadlessSound()
+{
+}
+
+bool HeadlessSound::init(bool includeSounds)
+{
+	if (includeSounds)
+	{
+		return mLoader->load(this);
+	}
+	else
+	{
+		return true;
+	}
+}
+
+void HeadlessSound::destroy(bool includeSounds)
+{
+}
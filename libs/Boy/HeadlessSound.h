@@ -0,0 +1,24 @@
+#pragma once
+
+#include "Sound.h"
+
+namespace Boy
+{
+	/*
+	 * a sound without any samples
+	 */
+	class HeadlessSound : public Sound
+	{
+	public:
+
+		HeadlessSound(ResourceLoader *loader, const std::string &path);
+		virtual ~HeadlessSound();
+
+		const std::string &getPath() { return mPath; }
+
+	protected:
+
+		virtual bool init(bool includeSounds);
+		virtual void destroy(bool includeSounds);
+	};
+};
@@ -0,0 +1,61 @@
+#include "HeadlessSoundPlayer.h"
+
+using namespace Boy;
+
+#include "BoyLib/CrtDbgNew.h"
+
+HeadlessSoundPlayer::HeadlessSoundPlayer()
+{
+	mMasterVolume = 1;
+}
+
+HeadlessSoundPlayer::~HeadlessSoundPlayer()
+{
+}
+
+void HeadlessSoundPlayer::playSound(Sound *sound, float volume, bool loop)
+{
+}
+
+void HeadlessSoundPlayer::playSoundChain(std::vector<Sound*> &sounds, bool loopLastSound)
+{
+}
+
+void HeadlessSoundPlayer::stopSound(Sound *sound)
+{
+}
+
+void HeadlessSoundPlayer::stopAllSounds()
+{
+}
+
+void HeadlessSoundPlayer::setVolume(Sound *sound, float volume)
+{
+}
+
+void HeadlessSoundPlayer::setMasterVolume(float volume)
+{
+	mMasterVolume = volume;
+}
+
+float HeadlessSoundPlayer::getMasterVolume()
+{
+	return mMasterVolume;
+}
+
+void HeadlessSoundPlayer::fadeIn(Sound *sound, float duration, bool loop)
+{
+}
+
+void HeadlessSoundPlayer::fadeOut(Sound *sound, float duration)
+{
+}
+
+void HeadlessSoundPlayer::tick()
+{
+}
+
+bool HeadlessSoundPlayer::isPlaying(Sound *sound)
+{
+	return false;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "BoyLib/CrtDbgInc.h"
+
+#include "SoundPlayer.h"
+
+namespace Boy
+{
+	/*
+	 * a sound player that plays nothing (it only keeps track
+	 * of the master volume so muting works as expected)
+	 */
+	class HeadlessSoundPlayer : public SoundPlayer
+	{
+	public:
+
+		HeadlessSoundPlayer();
+		virtual ~HeadlessSoundPlayer();
+
+		// implementation of SoundPlayer:
+		virtual void playSound(Sound *sound, float volume=1, bool loop=false);
+		virtual void playSoundChain(std::vector<Sound*> &soundss, bool loopLastSound=false);
+		virtual void stopSound(Sound *sound);
+		virtual void stopAllSounds();
+		virtual void setVolume(Sound *sound, float volume);
+		virtual void setMasterVolume(float volume);
+		virtual float getMasterVolume();
+		virtual void fadeIn(Sound *sound, float duration, bool loop);
+		virtual void fadeOut(Sound *sound, float duration);
+		virtual void tick();
+		virtual bool isPlaying(Sound *sound);
+
+	private:
+
+		float mMasterVolume;
+
+	};
+}
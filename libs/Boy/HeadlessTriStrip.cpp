@@ -0,0 +1,35 @@
+#include "HeadlessTriStrip.h"
+
+#include <assert.h>
+
+using namespace Boy;
+
+#include "BoyLib/CrtDbgNew.h"
+
+HeadlessTriStrip::HeadlessTriStrip(int numVerts)
+{
+	mVertexCount = numVerts;
+}
+
+HeadlessTriStrip::~HeadlessTriStrip()
+{
+}
+
+void HeadlessTriStrip::setVertPos(int i, float x, float y, float z)
+{
+	assert(i>=0 && i<mVertexCount);
+}
+
+void HeadlessTriStrip::setVertTex(int i, float u, float v)
+{
+	assert(i>=0 && i<mVertexCount);
+}
+
+void HeadlessTriStrip::setVertColor(int i, Color color)
+{
+	assert(i>=0 && i<mVertexCount);
+}
+
+void HeadlessTriStrip::setColor(Color color)
+{
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include "TriStrip.h"
+
+namespace Boy
+{
+	/*
+	 * a tri strip that keeps its vertex count and nothing else
+	 */
+	class HeadlessTriStrip : public TriStrip
+	{
+	public:
+
+		HeadlessTriStrip(int numVerts);
+		virtual ~HeadlessTriStrip();
+
+		virtual void setColor(Color color);
+
+		virtual void setVertPos(int i, float x, float y, float z);
+		virtual void setVertTex(int i, float u, float v);
+		virtual void setVertColor(int i, Color color);
+
+		inline int getVertexCount() { return mVertexCount; }
+
+	private:
+
+		int mVertexCount;
+
+	};
+};
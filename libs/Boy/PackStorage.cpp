@@ -0,0 +1,330 @@
+#include "PackStorage.h"
+
+#include <string.h>
+
+using namespace Boy;
+
+#include "BoyLib/CrtDbgNew.h"
+
+PackStorage::PackStorage( Storage *pBaseStorage, bool looseFiles ) :
+	mpBase( pBaseStorage ),
+	mLooseFiles( looseFiles ),
+	mPackMapped( false ),
+	mhPackMap( 0 ),
+	mFileKey( 0 )
+{
+}
+
+PackStorage::~PackStorage()
+{
+	// (the io threads read through this storage):
+	StopReads();
+
+	// close anything that was left open:
+	for( std::map<int,OpenFile>::iterator i = mOpenFiles.begin(); i != mOpenFiles.end(); ++i )
+	{
+		if( i->second.packed )
+		{
+			delete [] i->second.pBuffer;
+		}
+		else
+		{
+			mpBase->FileClose( i->second.hBase );
+		}
+	}
+	mOpenFiles.clear();
+
+	for( std::map<int,OpenFile>::iterator i = mMappings.begin(); i != mMappings.end(); ++i )
+	{
+		if( i->second.packed )
+		{
+			delete [] i->second.pBuffer;
+		}
+		else
+		{
+			mpBase->FileUnmap( i->second.hBase );
+		}
+	}
+	mMappings.clear();
+
+	if( mPackMapped )
+	{
+		mpBase->FileUnmap( mhPackMap );
+	}
+
+	delete mpBase;
+}
+
+bool PackStorage::Open( const char *pPackPathUtf8 )
+{
+	const void *pData;
+	int sizeBytes;
+	if( mPackMapped || mpBase->FileMap( pPackPathUtf8, &mhPackMap, &pData, &sizeBytes ) != STORAGE_OK )
+	{
+		return false;
+	}
+
+	if( !mPack.attach( pData, sizeBytes ) )
+	{
+		mpBase->FileUnmap( mhPackMap );
+		return false;
+	}
+
+	mPackMapped = true;
+	return true;
+}
+
+bool PackStorage::FindPacked( const char *pFilePathUtf8, ResourcePack::File &file )
+{
+	if( !mPackMapped )
+	{
+		return false;
+	}
+
+	// files on disk win:
+	int sizeBytes;
+	if( mLooseFiles && mpBase->FileGetSize( pFilePathUtf8, &sizeBytes ) == STORAGE_OK )
+	{
+		return false;
+	}
+
+	return mPack.find( pFilePathUtf8, file );
+}
+
+bool PackStorage::OpenPacked( const ResourcePack::File &file, OpenFile &openFile )
+{
+	openFile.packed = true;
+	openFile.hBase = 0;
+	openFile.pData = file.data;
+	openFile.pBuffer = NULL;
+	openFile.sizeBytes = file.size;
+	openFile.pos = 0;
+
+	// compressed files are unpacked into memory of their own:
+	if( file.compressed )
+	{
+		openFile.pBuffer = new unsigned char[ file.size > 0 ? file.size : 1 ];
+		if( !ResourcePack::decompress( file, openFile.pBuffer ) )
+		{
+			delete [] openFile.pBuffer;
+			return false;
+		}
+		openFile.pData = openFile.pBuffer;
+	}
+
+	return true;
+}
+
+Storage::StorageResult PackStorage::FileOpen( const char *pFilePathUtf8, int modeFlags, BoyFileHandle *pFileHandleOut )
+{
+	if( !pFileHandleOut )
+	{
+		return STORAGE_FAIL;
+	}
+
+	OpenFile openFile;
+	ResourcePack::File file;
+	if( (modeFlags & STORAGE_MODE_MASK) == STORAGE_MODE_READ && FindPacked( pFilePathUtf8, file ) )
+	{
+		if( !OpenPacked( file, openFile ) )
+		{
+			return STORAGE_FAIL;
+		}
+	}
+	else
+	{
+		// everything else is the storage underneath's business:
+		if( mpBase->FileOpen( pFilePathUtf8, modeFlags, &openFile.hBase ) != STORAGE_OK )
+		{
+			return STORAGE_FAIL;
+		}
+		openFile.packed = false;
+		openFile.pData = NULL;
+		openFile.pBuffer = NULL;
+		openFile.sizeBytes = 0;
+		openFile.pos = 0;
+	}
+
+	std::lock_guard<std::mutex> lock( mMutex );
+	++mFileKey;
+	mOpenFiles[ mFileKey ] = openFile;
+	*pFileHandleOut = (BoyFileHandle)mFileKey;
+	return STORAGE_OK;
+}
+
+Storage::StorageResult PackStorage::FileRead( BoyFileHandle fileHandle, void *pBuffer, int readSizeBytes )
+{
+	OpenFile *pFile = GetOpenFile( fileHandle );
+	if( !pFile || !pBuffer )
+	{
+		return STORAGE_FAIL;
+	}
+	if( !pFile->packed )
+	{
+		return mpBase->FileRead( pFile->hBase, pBuffer, readSizeBytes );
+	}
+
+	// same rules as the other storages: a short read is a failed read
+	int available = pFile->sizeBytes - pFile->pos;
+	int bytesRead = readSizeBytes < available ? readSizeBytes : available;
+	if( bytesRead > 0 )
+	{
+		memcpy( pBuffer, pFile->pData + pFile->pos, bytesRead );
+		pFile->pos += bytesRead;
+	}
+	return bytesRead == readSizeBytes ? STORAGE_OK : STORAGE_FAIL;
+}
+
+Storage::StorageResult PackStorage::FileWrite( BoyFileHandle fileHandle, const void *pBuffer, int writeSizeBytes )
+{
+	// (files in the pack are only ever open for reading)
+	OpenFile *pFile = GetOpenFile( fileHandle );
+	if( !pFile || pFile->packed )
+	{
+		return STORAGE_FAIL;
+	}
+	return mpBase->FileWrite( pFile->hBase, pBuffer, writeSizeBytes );
+}
+
+Storage::StorageResult PackStorage::FileClose( BoyFileHandle fileHandle )
+{
+	OpenFile file;
+	{
+		std::lock_guard<std::mutex> lock( mMutex );
+		std::map<int,OpenFile>::iterator i = mOpenFiles.find( (int)fileHandle );
+		if( i == mOpenFiles.end() )
+		{
+			return STORAGE_FAIL;
+		}
+		file = i->second;
+		mOpenFiles.erase( i );
+	}
+
+	if( !file.packed )
+	{
+		return mpBase->FileClose( file.hBase );
+	}
+	delete [] file.pBuffer;
+	return STORAGE_OK;
+}
+
+int PackStorage::FileGetSize( BoyFileHandle openFileHandle )
+{
+	OpenFile *pFile = GetOpenFile( openFileHandle );
+	if( !pFile )
+	{
+		return -1;
+	}
+	return pFile->packed ? pFile->sizeBytes : mpBase->FileGetSize( pFile->hBase );
+}
+
+Storage::StorageResult PackStorage::FileSeek( BoyFileHandle fileHandle, int offset )
+{
+	OpenFile *pFile = GetOpenFile( fileHandle );
+	if( !pFile )
+	{
+		return STORAGE_FAIL;
+	}
+	if( !pFile->packed )
+	{
+		return mpBase->FileSeek( pFile->hBase, offset );
+	}
+
+	if( offset < 0 || offset > pFile->sizeBytes )
+	{
+		return STORAGE_FAIL;
+	}
+	pFile->pos = offset;
+	return STORAGE_OK;
+}
+
+Storage::StorageResult PackStorage::FileMap( const char *pFilePathUtf8, BoyFileHandle *pMapHandleOut, const void **ppDataOut, int *pSizeBytesOut )
+{
+	if( !pMapHandleOut || !ppDataOut || !pSizeBytesOut )
+	{
+		return STORAGE_FAIL;
+	}
+
+	OpenFile mapping;
+	ResourcePack::File file;
+	if( FindPacked( pFilePathUtf8, file ) )
+	{
+		// (uncompressed files are handed out right from the pack)
+		if( !OpenPacked( file, mapping ) )
+		{
+			return STORAGE_FAIL;
+		}
+	}
+	else
+	{
+		const void *pData;
+		if( mpBase->FileMap( pFilePathUtf8, &mapping.hBase, &pData, &mapping.sizeBytes ) != STORAGE_OK )
+		{
+			return STORAGE_FAIL;
+		}
+		mapping.packed = false;
+		mapping.pData = (const unsigned char*)pData;
+		mapping.pBuffer = NULL;
+		mapping.pos = 0;
+	}
+
+	std::lock_guard<std::mutex> lock( mMutex );
+	++mMapKey;
+	mMappings[ mMapKey ] = mapping;
+	*pMapHandleOut = (BoyFileHandle)mMapKey;
+	*ppDataOut = mapping.pData;
+	*pSizeBytesOut = mapping.sizeBytes;
+	return STORAGE_OK;
+}
+
+Storage::StorageResult PackStorage::FileUnmap( BoyFileHandle mapHandle )
+{
+	OpenFile mapping;
+	{
+		std::lock_guard<std::mutex> lock( mMutex );
+		std::map<int,OpenFile>::iterator i = mMappings.find( (int)mapHandle );
+		if( i == mMappings.end() )
+		{
+			return STORAGE_FAIL;
+		}
+		mapping = i->second;
+		mMappings.erase( i );
+	}
+
+	if( !mapping.packed )
+	{
+		return mpBase->FileUnmap( mapping.hBase );
+	}
+	delete [] mapping.pBuffer;
+	return STORAGE_OK;
+}
+
+Storage::StorageResult PackStorage::FileRename( const char *pFromPathUtf8, const char *pToPathUtf8 )
+{
+	// (files in the pack can't be written, so this is always about the storage underneath)
+	return mpBase->FileRename( pFromPathUtf8, pToPathUtf8 );
+}
+
+Storage::StorageResult PackStorage::FileReadAt( const char *pFilePathUtf8, int offset, int sizeBytes, void *pBuffer, int *pBytesReadOut )
+{
+	// (packed files are read out of the pack like any open file)
+	ResourcePack::File file;
+	if( FindPacked( pFilePathUtf8, file ) )
+	{
+		return Storage::FileReadAt( pFilePathUtf8, offset, sizeBytes, pBuffer, pBytesReadOut );
+	}
+	return mpBase->FileReadAt( pFilePathUtf8, offset, sizeBytes, pBuffer, pBytesReadOut );
+}
+
+PackStorage::OpenFile *PackStorage::GetOpenFile( BoyFileHandle hFile )
+{
+	// (the entry stays put until the file is closed, and
+	// only the thread that owns the handle closes it)
+	std::lock_guard<std::mutex> lock( mMutex );
+	std::map<int,OpenFile>::iterator i = mOpenFiles.find( (int)hFile );
+	if( i == mOpenFiles.end() )
+	{
+		return NULL;
+	}
+	return &i->second;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "ResourcePack.h"
+#include "Storage.h"
+
+namespace Boy
+{
+	/*
+	 * storage that reads files out of a memory mapped resource pack
+	 * and passes everything else (writes, files that aren't in the
+	 * pack) on to another storage. with loose files enabled, files
+	 * on disk win over the pack, which is handy during development
+	 * but costs a file system lookup per open again.
+	 * files that are stored uncompressed are mapped without a copy.
+	 */
+	class PackStorage : public Storage
+	{
+
+		public:
+
+			// takes ownership of the storage underneath:
+			PackStorage( Storage *pBaseStorage, bool looseFiles );
+			virtual ~PackStorage();
+
+			// maps the pack (through the storage underneath):
+			bool Open( const char *pPackPathUtf8 );
+
+			// storage implementation
+			virtual StorageResult FileOpen( const char *pFilePathUtf8, int modeFlags, BoyFileHandle *pFileHandleOut );
+			virtual StorageResult FileRead( BoyFileHandle fileHandle, void *pBuffer, int readSizeBytes );
+			virtual StorageResult FileWrite( BoyFileHandle fileHandle, const void *pBuffer, int writeSizeBytes );
+			virtual StorageResult FileClose( BoyFileHandle fileHandle );
+			virtual int FileGetSize( BoyFileHandle openFileHandle );
+			virtual StorageResult FileSeek( BoyFileHandle fileHandle, int offset );
+			virtual StorageResult FileMap( const char *pFilePathUtf8, BoyFileHandle *pMapHandleOut, const void **ppDataOut, int *pSizeBytesOut );
+			virtual StorageResult FileUnmap( BoyFileHandle mapHandle );
+			virtual StorageResult FileRename( const char *pFromPathUtf8, const char *pToPathUtf8 );
+			virtual StorageResult FileReadAt( const char *pFilePathUtf8, int offset, int sizeBytes, void *pBuffer, int *pBytesReadOut );
+
+			inline int GetPackFileCount() { return mPack.getFileCount(); }
+
+		private:
+
+			// finds a file the pack should serve:
+			bool FindPacked( const char *pFilePathUtf8, ResourcePack::File &file );
+
+			// a file that's open (or mapped) through this storage:
+			struct OpenFile
+			{
+				bool packed;
+				BoyFileHandle hBase; // when it comes from the storage underneath
+				const unsigned char *pData; // when it comes from the pack
+				unsigned char *pBuffer; // decompressed data (owned)
+				int sizeBytes;
+				int pos;
+			};
+
+			bool OpenPacked( const ResourcePack::File &file, OpenFile &openFile );
+			OpenFile *GetOpenFile( BoyFileHandle hFile );
+
+			Storage *mpBase;
+			bool mLooseFiles;
+
+			bool mPackMapped;
+			BoyFileHandle mhPackMap;
+			ResourcePack mPack;
+
+			int mFileKey;
+			std::map<int,OpenFile> mOpenFiles;
+			std::map<int,OpenFile> mMappings;
+
+	};
+
+}
@@ -23,5 +23,10 @@ namespace Boy
 
 		virtual void persist() = 0;
 
+		// waits until everything persist() was asked to write is written
+		// (for layers that write in the background). false if the last
+		// write failed:
+		virtual bool flush() { return true; }
+
 	};
 }
\ No newline at end of file
@@ -0,0 +1,842 @@
+#include "Png.h"
+
+#include <string.h>
+
+using namespace Boy;
+
+#include "BoyLib/CrtDbgNew.h"
+
+namespace
+{
+	/*
+	 * inflate (rfc 1951), written for clarity rather than speed
+	 */
+
+	struct BitReader
+	{
+		const unsigned char *data;
+		int size;
+		int pos;
+		unsigned int bitBuf;
+		int bitCount;
+		bool overrun;
+	};
+
+	unsigned int readBits(BitReader &br, int need)
+	{
+		unsigned int val = br.bitBuf;
+		while (br.bitCount < need)
+		{
+			if (br.pos >= br.size)
+			{
+				br.overrun = true;
+				return 0;
+			}
+			val |= (unsigned int)br.data[br.pos++] << br.bitCount;
+			br.bitCount += 8;
+		}
+		br.bitBuf = val >> need;
+		br.bitCount -= need;
+		return val & ((1u << need) - 1);
+	}
+
+	#define MAX_BITS 15
+	#define MAX_LCODES 286
+	#define MAX_DCODES 30
+	#define FIXLCODES 288 // (the fixed code has two more that are never used)
+
+	struct Huffman
+	{
+		short count[MAX_BITS+1]; // number of symbols of each length
+		short symbol[FIXLCODES]; // symbols ordered by code
+	};
+
+	// returns 0 for a complete code, >0 for an incomplete one and <0 on error:
+	int buildHuffman(Huffman &h, const short *lengths, int n)
+	{
+		memset(h.count, 0, sizeof(h.count));
+		for (int i=0 ; i<n ; i++)
+		{
+			h.count[lengths[i]]++;
+		}
+		if (h.count[0] == n)
+		{
+			return 0;
+		}
+
+		int left = 1;
+		for (int len=1 ; len<=MAX_BITS ; len++)
+		{
+			left <<= 1;
+			left -= h.count[len];
+			if (left < 0)
+			{
+				return left;
+			}
+		}
+
+		short offs[MAX_BITS+1];
+		offs[1] = 0;
+		for (int len=1 ; len<MAX_BITS ; len++)
+		{
+			offs[len+1] = offs[len] + h.count[len];
+		}
+		for (int i=0 ; i<n ; i++)
+		{
+			if (lengths[i] != 0)
+			{
+				h.symbol[offs[lengths[i]]++] = (short)i;
+			}
+		}
+
+		return left;
+	}
+
+	int decodeSymbol(BitReader &br, const Huffman &h)
+	{
+		int code = 0;
+		int first = 0;
+		int index = 0;
+		for (int len=1 ; len<=MAX_BITS ; len++)
+		{
+			code |= (int)readBits(br, 1);
+			int count = h.count[len];
+			if (code - count < first)
+			{
+				return h.symbol[index + (code - first)];
+			}
+			index += count;
+			first += count;
+			first <<= 1;
+			code <<= 1;
+		}
+		return -1;
+	}
+
+	const short LENGTH_BASE[29] = {
+		3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+		35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+	const short LENGTH_EXTRA[29] = {
+		0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+		3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+	const short DIST_BASE[30] = {
+		1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+		257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+		8193, 12289, 16385, 24577};
+	const short DIST_EXTRA[30] = {
+		0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+		7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+	bool inflateCodes(BitReader &br, const Huffman &lencode, const Huffman &distcode,
+		unsigned char *out, int outSize, int &outPos)
+	{
+		for (;;)
+		{
+			int symbol = decodeSymbol(br, lencode);
+			if (symbol < 0 || br.overrun)
+			{
+				return false;
+			}
+
+			if (symbol < 256)
+			{
+				// literal:
+				if (outPos >= outSize)
+				{
+					return false;
+				}
+				out[outPos++] = (unsigned char)symbol;
+			}
+			else if (symbol == 256)
+			{
+				// end of block:
+				return true;
+			}
+			else
+			{
+				// length/distance pair:
+				symbol -= 257;
+				if (symbol >= 29)
+				{
+					return false;
+				}
+				int len = LENGTH_BASE[symbol] + (int)readBits(br, LENGTH_EXTRA[symbol]);
+
+				symbol = decodeSymbol(br, distcode);
+				if (symbol < 0 || symbol >= 30)
+				{
+					return false;
+				}
+				int dist = DIST_BASE[symbol] + (int)readBits(br, DIST_EXTRA[symbol]);
+				if (dist > outPos || outPos + len > outSize || br.overrun)
+				{
+					return false;
+				}
+
+				// copy (the ranges may overlap, so byte by byte):
+				unsigned char *dst = out + outPos;
+				const unsigned char *src = dst - dist;
+				for (int i=0 ; i<len ; i++)
+				{
+					dst[i] = src[i];
+				}
+				outPos += len;
+			}
+		}
+	}
+
+	bool inflateStored(BitReader &br, unsigned char *out, int outSize, int &outPos)
+	{
+		// discard leftover bits from the current byte:
+		br.bitBuf = 0;
+		br.bitCount = 0;
+
+		if (br.pos + 4 > br.size)
+		{
+			return false;
+		}
+		int len = br.data[br.pos] | (br.data[br.pos+1] << 8);
+		int nlen = br.data[br.pos+2] | (br.data[br.pos+3] << 8);
+		br.pos += 4;
+		if (len != (~nlen & 0xffff) || br.pos + len > br.size || outPos + len > outSize)
+		{
+			return false;
+		}
+
+		memcpy(out + outPos, br.data + br.pos, len);
+		br.pos += len;
+		outPos += len;
+		return true;
+	}
+
+	// the fixed huffman codes (built on first use, which is
+	// thread safe because they're a function level static):
+	struct FixedCodes
+	{
+		Huffman lencode;
+		Huffman distcode;
+
+		FixedCodes()
+		{
+			short lengths[FIXLCODES];
+			int i;
+			for (i=0 ; i<144 ; i++) lengths[i] = 8;
+			for ( ; i<256 ; i++) lengths[i] = 9;
+			for ( ; i<280 ; i++) lengths[i] = 7;
+			for ( ; i<FIXLCODES ; i++) lengths[i] = 8;
+			buildHuffman(lencode, lengths, FIXLCODES);
+			for (i=0 ; i<MAX_DCODES ; i++) lengths[i] = 5;
+			buildHuffman(distcode, lengths, MAX_DCODES);
+		}
+	};
+
+	bool inflateFixed(BitReader &br, unsigned char *out, int outSize, int &outPos)
+	{
+		static const FixedCodes codes;
+		return inflateCodes(br, codes.lencode, codes.distcode, out, outSize, outPos);
+	}
+
+	bool inflateDynamic(BitReader &br, unsigned char *out, int outSize, int &outPos)
+	{
+		static const short ORDER[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+
+		int nlen = (int)readBits(br, 5) + 257;
+		int ndist = (int)readBits(br, 5) + 1;
+		int ncode = (int)readBits(br, 4) + 4;
+		if (nlen > MAX_LCODES || ndist > MAX_DCODES)
+		{
+			return false;
+		}
+
+		// code length code lengths:
+		short lengths[MAX_LCODES+MAX_DCODES];
+		int index;
+		for (index=0 ; index<ncode ; index++)
+		{
+			lengths[ORDER[index]] = (short)readBits(br, 3);
+		}
+		for ( ; index<19 ; index++)
+		{
+			lengths[ORDER[index]] = 0;
+		}
+		Huffman lencode, distcode;
+		if (buildHuffman(lencode, lengths, 19) != 0)
+		{
+			return false;
+		}
+
+		// literal/length and distance code lengths:
+		index = 0;
+		while (index < nlen + ndist)
+		{
+			int symbol = decodeSymbol(br, lencode);
+			if (symbol < 0 || br.overrun)
+			{
+				return false;
+			}
+			if (symbol < 16)
+			{
+				lengths[index++] = (short)symbol;
+			}
+			else
+			{
+				short len = 0;
+				int repeat;
+				if (symbol == 16)
+				{
+					if (index == 0)
+					{
+						return false;
+					}
+					len = lengths[index-1];
+					repeat = 3 + (int)readBits(br, 2);
+				}
+				else if (symbol == 17)
+				{
+					repeat = 3 + (int)readBits(br, 3);
+				}
+				else
+				{
+					repeat = 11 + (int)readBits(br, 7);
+				}
+				if (index + repeat > nlen + ndist)
+				{
+					return false;
+				}
+				while (repeat--)
+				{
+					lengths[index++] = len;
+				}
+			}
+		}
+
+		// there has to be an end of block code:
+		if (lengths[256] == 0)
+		{
+			return false;
+		}
+
+		// incomplete codes are only allowed for a single length 1 code:
+		int err = buildHuffman(lencode, lengths, nlen);
+		if (err < 0 || (err > 0 && nlen - lencode.count[0] != 1))
+		{
+			return false;
+		}
+		err = buildHuffman(distcode, lengths + nlen, ndist);
+		if (err < 0 || (err > 0 && ndist - distcode.count[0] != 1))
+		{
+			return false;
+		}
+
+		return inflateCodes(br, lencode, distcode, out, outSize, outPos);
+	}
+
+	// inflates a zlib stream into a buffer of known size:
+	bool zlibInflate(const unsigned char *data, int size, unsigned char *out, int outSize)
+	{
+		if (size < 2 || (data[0] & 0x0f) != 8 || ((data[0] << 8) | data[1]) % 31 != 0 || (data[1] & 0x20))
+		{
+			return false;
+		}
+
+		BitReader br;
+		br.data = data;
+		br.size = size;
+		br.pos = 2;
+		br.bitBuf = 0;
+		br.bitCount = 0;
+		br.overrun = false;
+
+		int outPos = 0;
+		int last;
+		do
+		{
+			last = (int)readBits(br, 1);
+			int type = (int)readBits(br, 2);
+			bool ok;
+			switch (type)
+			{
+			case 0:
+				ok = inflateStored(br, out, outSize, outPos);
+				break;
+			case 1:
+				ok = inflateFixed(br, out, outSize, outPos);
+				break;
+			case 2:
+				ok = inflateDynamic(br, out, outSize, outPos);
+				break;
+			default:
+				ok = false;
+				break;
+			}
+			if (!ok || br.overrun)
+			{
+				return false;
+			}
+		} while (!last);
+
+		return outPos == outSize;
+	}
+
+	/*
+	 * png helpers
+	 */
+
+	unsigned int readU32(const unsigned char *p)
+	{
+		return ((unsigned int)p[0] << 24) | ((unsigned int)p[1] << 16) | ((unsigned int)p[2] << 8) | p[3];
+	}
+
+	void writeU32(unsigned char *p, unsigned int v)
+	{
+		p[0] = (unsigned char)(v >> 24);
+		p[1] = (unsigned char)(v >> 16);
+		p[2] = (unsigned char)(v >> 8);
+		p[3] = (unsigned char)v;
+	}
+
+	const unsigned char PNG_SIGNATURE[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+
+	// (built on first use like FixedCodes):
+	struct CrcTable
+	{
+		unsigned int entries[256];
+
+		CrcTable()
+		{
+			for (unsigned int n=0 ; n<256 ; n++)
+			{
+				unsigned int c = n;
+				for (int k=0 ; k<8 ; k++)
+				{
+					c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+				}
+				entries[n] = c;
+			}
+		}
+	};
+
+	unsigned int crc32(unsigned int crc, const unsigned char *data, int size)
+	{
+		static const CrcTable table;
+
+		crc = ~crc;
+		for (int i=0 ; i<size ; i++)
+		{
+			crc = table.entries[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+		}
+		return ~crc;
+	}
+
+	int paeth(int a, int b, int c)
+	{
+		int p = a + b - c;
+		int pa = p > a ? p - a : a - p;
+		int pb = p > b ? p - b : b - p;
+		int pc = p > c ? p - c : c - p;
+		if (pa <= pb && pa <= pc) return a;
+		if (pb <= pc) return b;
+		return c;
+	}
+
+	// undoes the per row filters in place (rows are 1 filter byte + rowBytes):
+	bool unfilter(unsigned char *data, int rowBytes, int rows, int bpp)
+	{
+		unsigned char *prev = NULL;
+		for (int y=0 ; y<rows ; y++)
+		{
+			unsigned char *row = data + y * (rowBytes + 1);
+			int filter = row[0];
+			row++;
+			switch (filter)
+			{
+			case 0:
+				break;
+			case 1:
+				for (int i=bpp ; i<rowBytes ; i++) row[i] += row[i-bpp];
+				break;
+			case 2:
+				if (prev) for (int i=0 ; i<rowBytes ; i++) row[i] += prev[i];
+				break;
+			case 3:
+				for (int i=0 ; i<rowBytes ; i++)
+				{
+					int a = i >= bpp ? row[i-bpp] : 0;
+					int b = prev ? prev[i] : 0;
+					row[i] += (unsigned char)((a + b) >> 1);
+				}
+				break;
+			case 4:
+				for (int i=0 ; i<rowBytes ; i++)
+				{
+					int a = i >= bpp ? row[i-bpp] : 0;
+					int b = prev ? prev[i] : 0;
+					int c = (prev && i >= bpp) ? prev[i-bpp] : 0;
+					row[i] += (unsigned char)paeth(a, b, c);
+				}
+				break;
+			default:
+				return false;
+			}
+			prev = row;
+		}
+		return true;
+	}
+
+	struct PngInfo
+	{
+		int width;
+		int height;
+		int bitDepth;
+		int colorType;
+		int channels;
+		bool interlaced;
+		unsigned int palette[256];
+		bool hasColorKey;
+		int colorKey[3];
+	};
+
+	// reads sample i (in units of bitDepth) from a row:
+	int readSample(const unsigned char *row, int i, int bitDepth)
+	{
+		switch (bitDepth)
+		{
+		case 8:
+			return row[i];
+		case 16:
+			return (row[i*2] << 8) | row[i*2+1];
+		default:
+			{
+				int bitPos = i * bitDepth;
+				int shift = 8 - bitDepth - (bitPos & 7);
+				return (row[bitPos >> 3] >> shift) & ((1 << bitDepth) - 1);
+			}
+		}
+	}
+
+	unsigned int toArgb(const PngInfo &info, const unsigned char *row, int x)
+	{
+		int depth = info.bitDepth;
+		int maxVal = (1 << depth) - 1;
+		int c = x * info.channels;
+
+		// scales a sample to 8 bits:
+		#define TO8(v) (depth == 16 ? ((v) >> 8) : depth == 8 ? (v) : ((v) * 255 / maxVal))
+
+		switch (info.colorType)
+		{
+		case 0: // grey
+			{
+				int g = readSample(row, c, depth);
+				unsigned int a = (info.hasColorKey && g == info.colorKey[0]) ? 0 : 0xff;
+				unsigned int v = TO8(g);
+				return (a << 24) | (v << 16) | (v << 8) | v;
+			}
+		case 2: // rgb
+			{
+				int r = readSample(row, c, depth);
+				int g = readSample(row, c+1, depth);
+				int b = readSample(row, c+2, depth);
+				unsigned int a = (info.hasColorKey && r == info.colorKey[0] && g == info.colorKey[1] && b == info.colorKey[2]) ? 0 : 0xff;
+				return (a << 24) | ((unsigned int)TO8(r) << 16) | ((unsigned int)TO8(g) << 8) | (unsigned int)TO8(b);
+			}
+		case 3: // palette
+			return info.palette[readSample(row, c, depth)];
+		case 4: // grey + alpha
+			{
+				unsigned int v = TO8(readSample(row, c, depth));
+				unsigned int a = TO8(readSample(row, c+1, depth));
+				return (a << 24) | (v << 16) | (v << 8) | v;
+			}
+		default: // rgba
+			{
+				unsigned int r = TO8(readSample(row, c, depth));
+				unsigned int g = TO8(readSample(row, c+1, depth));
+				unsigned int b = TO8(readSample(row, c+2, depth));
+				unsigned int a = TO8(readSample(row, c+3, depth));
+				return (a << 24) | (r << 16) | (g << 8) | b;
+			}
+		}
+
+		#undef TO8
+	}
+}
+
+bool Boy::pngReadSize(const unsigned char *data, int size, int *width, int *height)
+{
+	if (size < 24 || memcmp(data, PNG_SIGNATURE, 8) != 0 || memcmp(data+12, "IHDR", 4) != 0)
+	{
+		return false;
+	}
+
+	*width = (int)readU32(data+16);
+	*height = (int)readU32(data+20);
+	return true;
+}
+
+bool Boy::pngDecode(const unsigned char *data, int size, int *width, int *height, unsigned int **pixels)
+{
+	PngInfo info;
+	if (!pngReadSize(data, size, &info.width, &info.height) || size < 33)
+	{
+		return false;
+	}
+	info.bitDepth = data[24];
+	info.colorType = data[25];
+	info.interlaced = data[28] == 1;
+	info.hasColorKey = false;
+	for (int i=0 ; i<256 ; i++)
+	{
+		info.palette[i] = 0xff000000;
+	}
+
+	switch (info.colorType)
+	{
+	case 0: info.channels = 1; break;
+	case 2: info.channels = 3; break;
+	case 3: info.channels = 1; break;
+	case 4: info.channels = 2; break;
+	case 6: info.channels = 4; break;
+	default: return false;
+	}
+	if (info.width <= 0 || info.height <= 0 || info.width > 0x4000 || info.height > 0x4000 ||
+		(info.bitDepth != 1 && info.bitDepth != 2 && info.bitDepth != 4 && info.bitDepth != 8 && info.bitDepth != 16))
+	{
+		return false;
+	}
+
+	// gather the palette, transparency and compressed image data:
+	int idatSize = 0;
+	for (int pos=8 ; pos+12<=size ; )
+	{
+		int len = (int)readU32(data+pos);
+		if (len < 0 || pos + 12 + len > size)
+		{
+			return false;
+		}
+		const unsigned char *type = data+pos+4;
+		const unsigned char *chunk = data+pos+8;
+		if (memcmp(type, "IDAT", 4) == 0)
+		{
+			idatSize += len;
+		}
+		else if (memcmp(type, "PLTE", 4) == 0)
+		{
+			for (int i=0 ; i<len/3 && i<256 ; i++)
+			{
+				info.palette[i] = 0xff000000 | (chunk[i*3] << 16) | (chunk[i*3+1] << 8) | chunk[i*3+2];
+			}
+		}
+		else if (memcmp(type, "tRNS", 4) == 0)
+		{
+			if (info.colorType == 3)
+			{
+				for (int i=0 ; i<len && i<256 ; i++)
+				{
+					info.palette[i] = (info.palette[i] & 0x00ffffff) | ((unsigned int)chunk[i] << 24);
+				}
+			}
+			else if (info.colorType == 0 && len >= 2)
+			{
+				info.hasColorKey = true;
+				info.colorKey[0] = (chunk[0] << 8) | chunk[1];
+			}
+			else if (info.colorType == 2 && len >= 6)
+			{
+				info.hasColorKey = true;
+				for (int i=0 ; i<3 ; i++)
+				{
+					info.colorKey[i] = (chunk[i*2] << 8) | chunk[i*2+1];
+				}
+			}
+		}
+		else if (memcmp(type, "IEND", 4) == 0)
+		{
+			break;
+		}
+		pos += 12 + len;
+	}
+
+	unsigned char *idat = new unsigned char[idatSize > 0 ? idatSize : 1];
+	int idatPos = 0;
+	for (int pos=8 ; pos+12<=size ; )
+	{
+		int len = (int)readU32(data+pos);
+		if (memcmp(data+pos+4, "IDAT", 4) == 0)
+		{
+			memcpy(idat + idatPos, data+pos+8, len);
+			idatPos += len;
+		}
+		else if (memcmp(data+pos+4, "IEND", 4) == 0)
+		{
+			break;
+		}
+		pos += 12 + len;
+	}
+
+	// the passes that make up the image (a single one if not interlaced):
+	static const int PASS_X0[7] = {0, 4, 0, 2, 0, 1, 0};
+	static const int PASS_Y0[7] = {0, 0, 4, 0, 2, 0, 1};
+	static const int PASS_DX[7] = {8, 8, 4, 4, 2, 2, 1};
+	static const int PASS_DY[7] = {8, 8, 8, 4, 4, 2, 2};
+	int passCount = info.interlaced ? 7 : 1;
+	int bitsPerPixel = info.channels * info.bitDepth;
+	int bpp = (bitsPerPixel + 7) / 8;
+
+	int passW[7], passH[7], rawSize = 0;
+	for (int p=0 ; p<passCount ; p++)
+	{
+		int x0 = info.interlaced ? PASS_X0[p] : 0;
+		int y0 = info.interlaced ? PASS_Y0[p] : 0;
+		int dx = info.interlaced ? PASS_DX[p] : 1;
+		int dy = info.interlaced ? PASS_DY[p] : 1;
+		passW[p] = (info.width - x0 + dx - 1) / dx;
+		passH[p] = (info.height - y0 + dy - 1) / dy;
+		if (passW[p] > 0 && passH[p] > 0)
+		{
+			rawSize += passH[p] * (1 + (passW[p] * bitsPerPixel + 7) / 8);
+		}
+	}
+
+	unsigned char *raw = new unsigned char[rawSize];
+	bool ok = zlibInflate(idat, idatSize, raw, rawSize);
+	delete[] idat;
+
+	unsigned int *out = NULL;
+	if (ok)
+	{
+		out = new unsigned int[info.width * info.height];
+		unsigned char *passData = raw;
+		for (int p=0 ; p<passCount && ok ; p++)
+		{
+			if (passW[p] <= 0 || passH[p] <= 0)
+			{
+				continue;
+			}
+			int x0 = info.interlaced ? PASS_X0[p] : 0;
+			int y0 = info.interlaced ? PASS_Y0[p] : 0;
+			int dx = info.interlaced ? PASS_DX[p] : 1;
+			int dy = info.interlaced ? PASS_DY[p] : 1;
+			int rowBytes = (passW[p] * bitsPerPixel + 7) / 8;
+
+			ok = unfilter(passData, rowBytes, passH[p], bpp);
+			for (int y=0 ; y<passH[p] && ok ; y++)
+			{
+				const unsigned char *row = passData + y * (rowBytes + 1) + 1;
+				unsigned int *dst = out + (y0 + y * dy) * info.width;
+				for (int x=0 ; x<passW[p] ; x++)
+				{
+					dst[x0 + x * dx] = toArgb(info, row, x);
+				}
+			}
+			passData += passH[p] * (rowBytes + 1);
+		}
+	}
+	delete[] raw;
+
+	if (!ok)
+	{
+		delete[] out;
+		return false;
+	}
+
+	*width = info.width;
+	*height = info.height;
+	*pixels = out;
+	return true;
+}
+
+void Boy::pngEncode(const unsigned int *pixels, int width, int height, bool includeAlpha,
+	unsigned char **outData, int *outDataSize)
+{
+	int channels = includeAlpha ? 4 : 3;
+	int rowBytes = 1 + width * channels;
+	int rawSize = rowBytes * height;
+
+	// zlib stream made of stored blocks:
+	int blockCount = (rawSize + 65534) / 65535;
+	if (blockCount == 0)
+	{
+		blockCount = 1;
+	}
+	int zlibSize = 2 + blockCount * 5 + rawSize + 4;
+	int totalSize = 8 + (12 + 13) + (12 + zlibSize) + 12;
+
+	unsigned char *buf = new unsigned char[totalSize];
+	unsigned char *p = buf;
+	memcpy(p, PNG_SIGNATURE, 8);
+	p += 8;
+
+	// header:
+	writeU32(p, 13);
+	memcpy(p+4, "IHDR", 4);
+	writeU32(p+8, (unsigned int)width);
+	writeU32(p+12, (unsigned int)height);
+	p[16] = 8; // bit depth
+	p[17] = includeAlpha ? 6 : 2; // color type
+	p[18] = 0; // compression
+	p[19] = 0; // filter
+	p[20] = 0; // interlace
+	writeU32(p+21, crc32(0, p+4, 17));
+	p += 25;
+
+	// image data:
+	writeU32(p, (unsigned int)zlibSize);
+	memcpy(p+4, "IDAT", 4);
+	unsigned char *chunkStart = p+4;
+	unsigned char *z = p+8;
+	z[0] = 0x78;
+	z[1] = 0x01;
+	z += 2;
+
+	unsigned int adlerA = 1, adlerB = 0;
+	int remaining = rawSize;
+	int rawPos = 0;
+	for (int b=0 ; b<blockCount ; b++)
+	{
+		int len = remaining > 65535 ? 65535 : remaining;
+		z[0] = (b == blockCount-1) ? 1 : 0;
+		z[1] = (unsigned char)(len & 0xff);
+		z[2] = (unsigned char)(len >> 8);
+		z[3] = (unsigned char)(~len & 0xff);
+		z[4] = (unsigned char)((~len >> 8) & 0xff);
+		z += 5;
+
+		// serialize the rows straight into the block:
+		for (int i=0 ; i<len ; i++, rawPos++)
+		{
+			int y = rawPos / rowBytes;
+			int xb = rawPos % rowBytes;
+			unsigned char v;
+			if (xb == 0)
+			{
+				v = 0; // no filter
+			}
+			else
+			{
+				int x = (xb - 1) / channels;
+				int c = (xb - 1) % channels;
+				unsigned int argb = pixels[y * width + x];
+				static const int SHIFTS[4] = {16, 8, 0, 24};
+				v = (unsigned char)(argb >> SHIFTS[c]);
+			}
+			*z++ = v;
+			adlerA = (adlerA + v) % 65521;
+			adlerB = (adlerB + adlerA) % 65521;
+		}
+		remaining -= len;
+	}
+	writeU32(z, (adlerB << 16) | adlerA);
+	z += 4;
+	writeU32(z, crc32(0, chunkStart, (int)(z - chunkStart)));
+	p = z + 4;
+
+	// end:
+	writeU32(p, 0);
+	memcpy(p+4, "IEND", 4);
+	writeU32(p+8, crc32(0, p+4, 4));
+	p += 12;
+
+	*outData = buf;
+	*outDataSize = (int)(p - buf);
+}
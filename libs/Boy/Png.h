@@ -0,0 +1,28 @@
+#pragma once
+
+#include "BoyLib/CrtDbgInc.h"
+
+namespace Boy
+{
+	/*
+	 * decodes a png file that's held in memory into 32 bit pixels
+	 * (0xAARRGGBB, same layout as Color). all standard color types,
+	 * bit depths and interlacing are supported. on success *pixels
+	 * is allocated with new[] and belongs to the caller.
+	 */
+	bool pngDecode(const unsigned char *data, int size,
+		int *width, int *height, unsigned int **pixels);
+
+	/*
+	 * reads just the image size from a png header
+	 */
+	bool pngReadSize(const unsigned char *data, int size, int *width, int *height);
+
+	/*
+	 * encodes 32 bit pixels (0xAARRGGBB) as a png file. the image data
+	 * is stored without compression, which keeps this fast and simple
+	 * (it's meant for screenshots). *outData is allocated with new[].
+	 */
+	void pngEncode(const unsigned int *pixels, int width, int height, bool includeAlpha,
+		unsigned char **outData, int *outDataSize);
+}
@@ -0,0 +1,284 @@
+#include "PosixStorage.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace Boy;
+
+#include "BoyLib/CrtDbgNew.h"
+
+PosixStorage::PosixStorage() :
+	mFileKey( 0 )
+{
+}
+
+PosixStorage::~PosixStorage()
+{
+	// (the io threads read through this storage):
+	StopReads();
+
+	// close anything that was left open:
+	for( std::map<int,FILE*>::iterator i = mOpenFiles.begin(); i != mOpenFiles.end(); ++i )
+	{
+		fclose( i->second );
+	}
+	mOpenFiles.clear();
+
+	for( std::map<int,Mapping>::iterator i = mMappings.begin(); i != mMappings.end(); ++i )
+	{
+		munmap( i->second.pData, i->second.sizeBytes );
+	}
+	mMappings.clear();
+}
+
+Storage::StorageResult PosixStorage::FileOpen( const char *pFilePathUtf8, int modeFlags, BoyFileHandle *pFileHandleOut )
+{
+	StorageResult result = STORAGE_FAIL;
+
+	// must specify a read/write and a create/open flag
+	// must specify a handle to set
+	if( (modeFlags & STORAGE_MODE_MASK) && (modeFlags & STORAGE_DISPO_MASK) && pFileHandleOut )
+	{
+		const char *pModeStr = NULL;
+		switch( modeFlags )
+		{
+			case STORAGE_MODE_READ | STORAGE_MUST_EXIST:
+				pModeStr = "rb";
+				break;
+
+			case STORAGE_MODE_WRITE | STORAGE_MUST_EXIST:
+				pModeStr = "r+b";
+				break;
+
+			case STORAGE_MODE_WRITE | STORAGE_OPEN_ALWAYS:
+				pModeStr = "w+b";
+				break;
+
+			case STORAGE_MODE_WRITE | STORAGE_APPEND:
+				pModeStr = "ab";
+				break;
+		}
+
+		// check for bad flag combo
+		if( pModeStr )
+		{
+			FILE *f = fopen( pFilePathUtf8, pModeStr );
+			if( f != NULL )
+			{
+				std::lock_guard<std::mutex> lock( mMutex );
+				++mFileKey;
+				mOpenFiles[ mFileKey ] = f;
+				*pFileHandleOut = (BoyFileHandle)mFileKey;
+				result = STORAGE_OK;
+			}
+		}
+	}
+	
+	return result;
+}
+
+Storage::StorageResult PosixStorage::FileRead( BoyFileHandle fileHandle, void *pBuffer, int readSizeBytes )
+{
+	StorageResult result = STORAGE_FAIL;
+
+	// validate file handle and dest buffer
+	FILE *f = GetFilePtr( fileHandle );
+	if( f && pBuffer )
+	{
+		int bytesRead = (int)fread( pBuffer, 1, readSizeBytes, f );
+		if( bytesRead == readSizeBytes )
+		{
+			// same rules as WinStorage: a short read is a failed read
+			result = STORAGE_OK;
+		}
+	}
+
+	return result;
+}
+
+Storage::StorageResult PosixStorage::FileWrite( BoyFileHandle fileHandle, const void *pBuffer, int writeSizeBytes )
+{
+	StorageResult result = STORAGE_FAIL;
+
+	// validate file handle and src buffer
+	FILE *f = GetFilePtr( fileHandle );
+	if( f && pBuffer )
+	{
+		int bytesWritten = (int)fwrite( pBuffer, 1, writeSizeBytes, f );
+		if( bytesWritten == writeSizeBytes )
+		{
+			result = STORAGE_OK;
+		}
+	}
+
+	return result;
+}
+
+Storage::StorageResult PosixStorage::FileClose( BoyFileHandle fileHandle )
+{
+	StorageResult result = STORAGE_FAIL;
+
+	// validate file handle
+	FILE *f = GetFilePtr( fileHandle );
+	if( f )
+	{
+		int closeResult = fclose( f );
+		{
+			std::lock_guard<std::mutex> lock( mMutex );
+			mOpenFiles.erase( (int)fileHandle );
+		}
+		if( closeResult != EOF )
+		{
+			result = STORAGE_OK;
+		}
+	}
+
+	return result;
+}
+
+int PosixStorage::FileGetSize( BoyFileHandle openFileHandle )
+{
+	int sizeBytes = -1;
+
+	// validate file handle
+	FILE *f = GetFilePtr( openFileHandle );
+	if( f )
+	{
+		long int origPos = ftell( f );
+		fseek( f, 0, SEEK_END );
+		sizeBytes = (int)ftell( f );
+		fseek( f, origPos, SEEK_SET );
+	}
+
+	return sizeBytes;
+}
+
+Storage::StorageResult PosixStorage::FileSeek( BoyFileHandle fileHandle, int offset )
+{
+	StorageResult result = STORAGE_FAIL;
+
+	// validate file handle
+	FILE *f = GetFilePtr( fileHandle );
+	if( f && offset >= 0 && fseek( f, offset, SEEK_SET ) == 0 )
+	{
+		result = STORAGE_OK;
+	}
+
+	return result;
+}
+
+Storage::StorageResult PosixStorage::FileMap( const char *pFilePathUtf8, BoyFileHandle *pMapHandleOut, const void **ppDataOut, int *pSizeBytesOut )
+{
+	StorageResult result = STORAGE_FAIL;
+
+	if( pMapHandleOut && ppDataOut && pSizeBytesOut )
+	{
+		int fd = open( pFilePathUtf8, O_RDONLY );
+		if( fd >= 0 )
+		{
+			// (empty files can't be mapped)
+			struct stat st;
+			if( fstat( fd, &st ) == 0 && st.st_size > 0 && st.st_size <= 0x7fffffff )
+			{
+				void *pData = mmap( NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+				if( pData != MAP_FAILED )
+				{
+					Mapping m = { pData, (size_t)st.st_size };
+					std::lock_guard<std::mutex> lock( mMutex );
+					++mMapKey;
+					mMappings[ mMapKey ] = m;
+					*pMapHandleOut = (BoyFileHandle)mMapKey;
+					*ppDataOut = pData;
+					*pSizeBytesOut = (int)st.st_size;
+					result = STORAGE_OK;
+				}
+			}
+
+			// the mapping stays valid without the descriptor:
+			close( fd );
+		}
+	}
+
+	return result;
+}
+
+Storage::StorageResult PosixStorage::FileUnmap( BoyFileHandle mapHandle )
+{
+	std::lock_guard<std::mutex> lock( mMutex );
+	std::map<int,Mapping>::iterator i = mMappings.find( (int)mapHandle );
+	if( i == mMappings.end() )
+	{
+		return STORAGE_FAIL;
+	}
+
+	munmap( i->second.pData, i->second.sizeBytes );
+	mMappings.erase( i );
+	return STORAGE_OK;
+}
+
+Storage::StorageResult PosixStorage::FileRename( const char *pFromPathUtf8, const char *pToPathUtf8 )
+{
+	// (rename() replaces the destination atomically)
+	if( pFromPathUtf8 && pToPathUtf8 && rename( pFromPathUtf8, pToPathUtf8 ) == 0 )
+	{
+		return STORAGE_OK;
+	}
+	return STORAGE_FAIL;
+}
+
+Storage::StorageResult PosixStorage::FileReadAt( const char *pFilePathUtf8, int offset, int sizeBytes, void *pBuffer, int *pBytesReadOut )
+{
+	StorageResult result = STORAGE_FAIL;
+
+	// (pread() doesn't move a file position, so nothing is shared between reads)
+	if( pFilePathUtf8 && offset >= 0 && sizeBytes >= 0 && pBytesReadOut )
+	{
+		int fd = open( pFilePathUtf8, O_RDONLY );
+		if( fd >= 0 )
+		{
+			int bytesRead = 0;
+			result = STORAGE_OK;
+			while( bytesRead < sizeBytes )
+			{
+				ssize_t n = pread( fd, (char *)pBuffer + bytesRead, sizeBytes - bytesRead, (off_t)offset + bytesRead );
+				if( n < 0 )
+				{
+					if( errno == EINTR )
+					{
+						continue;
+					}
+					result = STORAGE_FAIL;
+					break;
+				}
+				if( n == 0 )
+				{
+					// end of file
+					break;
+				}
+				bytesRead += (int)n;
+			}
+			*pBytesReadOut = bytesRead;
+			close( fd );
+		}
+	}
+
+	return result;
+}
+
+FILE *PosixStorage::GetFilePtr( BoyFileHandle hFile )
+{
+	FILE *pRet = NULL;
+
+	std::lock_guard<std::mutex> lock( mMutex );
+	std::map<int,FILE*>::iterator i = mOpenFiles.find( (int)hFile );
+	if( i != mOpenFiles.end() )
+	{
+		pRet = i->second;
+	}
+
+	return pRet;
+}
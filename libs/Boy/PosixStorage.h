@@ -0,0 +1,49 @@
+#pragma once
+
+#include "Storage.h"
+#include <map>
+#include <stdio.h>
+
+namespace Boy
+{
+	/*
+	 * storage implementation on top of plain stdio (utf8 paths are
+	 * passed straight through to the file system)
+	 */
+	class PosixStorage : public Storage
+	{
+	
+		public:
+
+			PosixStorage();
+			virtual ~PosixStorage();
+
+			// storage implementation
+			virtual StorageResult FileOpen( const char *pFilePathUtf8, int modeFlags, BoyFileHandle *pFileHandleOut );
+			virtual StorageResult FileRead( BoyFileHandle fileHandle, void *pBuffer, int readSizeBytes );
+			virtual StorageResult FileWrite( BoyFileHandle fileHandle, const void *pBuffer, int writeSizeBytes );
+			virtual StorageResult FileClose( BoyFileHandle fileHandle );
+			virtual int FileGetSize( BoyFileHandle openFileHandle );
+			virtual StorageResult FileSeek( BoyFileHandle fileHandle, int offset );
+			virtual StorageResult FileMap( const char *pFilePathUtf8, BoyFileHandle *pMapHandleOut, const void **ppDataOut, int *pSizeBytesOut );
+			virtual StorageResult FileUnmap( BoyFileHandle mapHandle );
+			virtual StorageResult FileRename( const char *pFromPathUtf8, const char *pToPathUtf8 );
+			virtual StorageResult FileReadAt( const char *pFilePathUtf8, int offset, int sizeBytes, void *pBuffer, int *pBytesReadOut );
+
+		private:
+
+			FILE *GetFilePtr( BoyFileHandle hFile );
+
+			struct Mapping
+			{
+				void *pData;
+				size_t sizeBytes;
+			};
+
+			int mFileKey;
+			std::map<int,FILE*> mOpenFiles;
+			std::map<int,Mapping> mMappings;
+
+	};
+
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "BoyLib/CrtDbgInc.h"
+
+#include "Graphics.h"
+#include <vector>
+
+namespace Boy
+{
+	/*
+	 * a set of quads that all show parts of the same image, drawn
+	 * together with Graphics::drawQuadMesh. the quads are kept in
+	 * the mesh's own space (the current transform is applied when
+	 * it's drawn), so a mesh can be built once and drawn every frame.
+	 * quads refer to their part of the image in pixels; the backend
+	 * turns that into texture coordinates.
+	 */
+	class QuadMesh
+	{
+	public:
+
+		struct Quad
+		{
+			// corners in mesh space:
+			float minX;
+			float minY;
+			float maxX;
+			float maxY;
+
+			// part of the image to show:
+			int subrectX;
+			int subrectY;
+			int subrectW;
+			int subrectH;
+
+			// multiplied with the graphics color:
+			Color color;
+		};
+
+		QuadMesh() {}
+		virtual ~QuadMesh() {}
+
+		inline void clear() { mQuads.clear(); }
+		inline void reserve(int count) { mQuads.reserve(count); }
+
+		inline void addQuad(float minX, float minY, float maxX, float maxY, int subrectX, int subrectY, int subrectW, int subrectH, Color color=0xffffffff)
+		{
+			Quad q = {minX, minY, maxX, maxY, subrectX, subrectY, subrectW, subrectH, color};
+			mQuads.push_back(q);
+		}
+
+		inline int getQuadCount() const { return (int)mQuads.size(); }
+		inline const Quad *getQuads() const { return mQuads.empty() ? NULL : &mQuads[0]; }
+
+		// multiplies two ARGB colors channel by channel:
+		static inline Color modulate(Color a, Color b)
+		{
+			if (b==0xffffffff) return a;
+			if (a==0xffffffff) return b;
+			Color result = 0;
+			for (int shift=0 ; shift<32 ; shift+=8)
+			{
+				Color c = (((a >> shift) & 0xff) * ((b >> shift) & 0xff) + 127) / 255;
+				result |= c << shift;
+			}
+			return result;
+		}
+
+	private:
+
+		std::vector<Quad> mQuads;
+	};
+}
@@ -0,0 +1,173 @@
+#include "ResidencyManager.h"
+
+#include <assert.h>
+#include <stddef.h>
+#include "Resource.h"
+
+using namespace Boy;
+
+#include "BoyLib/CrtDbgNew.h"
+
+ResidencyManager::ResidencyManager()
+{
+	mBudget = 0;
+	mResidentBytes = 0;
+	mWarmBytes = 0;
+	mWarmCount = 0;
+	mHitCount = 0;
+	mMissCount = 0;
+	mHead = NULL;
+	mTail = NULL;
+}
+
+ResidencyManager::~ResidencyManager()
+{
+	// (whoever owns the resources has to evict them before they go):
+	assert(mHead==NULL);
+}
+
+void ResidencyManager::setBudget(long long bytes)
+{
+	mBudget = bytes<0 ? 0 : bytes;
+	enforceBudget();
+
+	// (0 keeps nothing warm, even resources that take no memory):
+	if (mBudget==0)
+	{
+		evictAll();
+	}
+}
+
+void ResidencyManager::loaded(Resource *res, bool warm)
+{
+	if (warm)
+	{
+		// it's in use again:
+		unlink(res);
+		res->mWarm = false;
+		mWarmBytes -= res->mResidentBytes;
+		mWarmCount--;
+		mHitCount++;
+	}
+	else
+	{
+		res->mResidentBytes = res->getMemoryUsage();
+		mResidentBytes += res->mResidentBytes;
+		mMissCount++;
+		enforceBudget();
+	}
+}
+
+void ResidencyManager::released(Resource *res)
+{
+	// measure it again, it might have changed since it was loaded:
+	int bytes = res->getMemoryUsage();
+	mResidentBytes += bytes - res->mResidentBytes;
+	res->mResidentBytes = bytes;
+
+	// no room for it:
+	if (mBudget==0 || res->mResidentBytes > mBudget - (mResidentBytes - res->mResidentBytes - mWarmBytes))
+	{
+		mResidentBytes -= res->mResidentBytes;
+		res->mResidentBytes = 0;
+		res->destroy(true);
+		return;
+	}
+
+	res->mWarm = true;
+	link(res);
+	mWarmBytes += res->mResidentBytes;
+	mWarmCount++;
+	enforceBudget();
+}
+
+void ResidencyManager::removed(Resource *res)
+{
+	if (res->mWarm)
+	{
+		unlink(res);
+		res->mWarm = false;
+		mWarmBytes -= res->mResidentBytes;
+		mWarmCount--;
+	}
+	mResidentBytes -= res->mResidentBytes;
+	res->mResidentBytes = 0;
+}
+
+void ResidencyManager::measure(Resource *res)
+{
+	if (!res->isResident())
+	{
+		return;
+	}
+
+	int bytes = res->getMemoryUsage();
+	mResidentBytes += bytes - res->mResidentBytes;
+	if (res->mWarm)
+	{
+		mWarmBytes += bytes - res->mResidentBytes;
+	}
+	res->mResidentBytes = bytes;
+}
+
+void ResidencyManager::trim(long long warmBytes)
+{
+	// (with 0, resources that take no memory go too):
+	while (mTail!=NULL && (mWarmBytes > warmBytes || warmBytes<=0))
+	{
+		evict(mTail);
+	}
+}
+
+void ResidencyManager::enforceBudget()
+{
+	// oldest first, until everything fits:
+	while (mTail!=NULL && mResidentBytes > mBudget)
+	{
+		evict(mTail);
+	}
+}
+
+void ResidencyManager::evict(Resource *res)
+{
+	assert(res->mWarm);
+	removed(res);
+	res->destroy(true);
+}
+
+void ResidencyManager::link(Resource *res)
+{
+	res->mLruPrev = NULL;
+	res->mLruNext = mHead;
+	if (mHead!=NULL)
+	{
+		mHead->mLruPrev = res;
+	}
+	mHead = res;
+	if (mTail==NULL)
+	{
+		mTail = res;
+	}
+}
+
+void ResidencyManager::unlink(Resource *res)
+{
+	if (res->mLruPrev!=NULL)
+	{
+		res->mLruPrev->mLruNext = res->mLruNext;
+	}
+	else
+	{
+		mHead = res->mLruNext;
+	}
+	if (res->mLruNext!=NULL)
+	{
+		res->mLruNext->mLruPrev = res->mLruPrev;
+	}
+	else
+	{
+		mTail = res->mLruPrev;
+	}
+	res->mLruPrev = NULL;
+	res->mLruNext = NULL;
+}
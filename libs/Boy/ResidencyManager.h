@@ -0,0 +1,76 @@
+#pragma once
+
+#include "BoyLib/CrtDbgInc.h"
+
+namespace Boy
+{
+	class Resource;
+
+	/*
+	 * keeps released resources warm: when a resource's last reference
+	 * goes away it stays initialized (texture, sound data and all) in a
+	 * least recently used list, and loading it again costs nothing.
+	 * warm resources are only destroyed when everything that's resident
+	 * (loaded or warm) takes more memory than the budget, oldest first.
+	 * resources that are loaded are never touched.
+	 *
+	 * a budget of 0 turns this off: released resources are destroyed
+	 * right away, like they would be without a residency manager, and
+	 * setting it evicts everything that was warm (whatever its size).
+	 */
+	class ResidencyManager
+	{
+	public:
+
+		ResidencyManager();
+		virtual ~ResidencyManager();
+
+		// the budget for everything that's resident (in bytes):
+		void setBudget(long long bytes);
+		inline long long getBudget() { return mBudget; }
+
+		// memory use (in bytes, as reported by Resource::getMemoryUsage()):
+		inline long long getResidentBytes() { return mResidentBytes; }
+		inline long long getWarmBytes() { return mWarmBytes; }
+		inline int getWarmCount() { return mWarmCount; }
+
+		// loads that found the resource warm vs. loads that had to init it:
+		inline int getHitCount() { return mHitCount; }
+		inline int getMissCount() { return mMissCount; }
+
+		// counts the memory of a resident resource again (for resources
+		// whose data shows up after they're loaded, like atlas images):
+		void measure(Resource *res);
+
+		// destroys warm resources until the warm ones take at most
+		// this much memory:
+		void trim(long long warmBytes);
+		inline void evictAll() { trim(0); }
+
+	private:
+
+		// Resource lets us know about these:
+		friend class Resource;
+		void loaded(Resource *res, bool warm);
+		void released(Resource *res);
+		void removed(Resource *res);
+
+		void link(Resource *res);
+		void unlink(Resource *res);
+		void evict(Resource *res);
+		void enforceBudget();
+
+	private:
+
+		long long mBudget;
+		long long mResidentBytes;
+		long long mWarmBytes;
+		int mWarmCount;
+		int mHitCount;
+		int mMissCount;
+
+		// warm resources, most recently released first:
+		Resource *mHead;
+		Resource *mTail;
+	};
+}
@@ -1,6 +1,8 @@
 #include "Resource.h"
 
 #include <assert.h>
+#include <stddef.h>
+#include "ResidencyManager.h"
 
 using namespace Boy;
 
@@ -11,10 +13,21 @@ Resource::Resource(ResourceLoader *loader, const std::string &path)
 	mLoader = loader;
 	mPath = path;
 	mRefCount = 0;
+	mResidency = NULL;
+	mWarm = false;
+	mResidentBytes = 0;
+	mLruPrev = NULL;
+	mLruNext = NULL;
 }
 
 Resource::~Resource()
 {
+	// (warm resources should have been evicted by now):
+	assert(!mWarm);
+	if (mResidency!=NULL)
+	{
+		mResidency->removed(this);
+	}
 }
 
 bool Resource::load()
@@ -22,7 +35,19 @@ bool Resource::load()
 	bool success = true;
 	if (mRefCount==0)
 	{
-		success = init(true);
+		if (mWarm)
+		{
+			// still there from last time:
+			mResidency->loaded(this, true);
+		}
+		else
+		{
+			success = init(true);
+			if (mResidency!=NULL)
+			{
+				mResidency->loaded(this, false);
+			}
+		}
 	}
 
 	mRefCount++;
@@ -32,10 +57,14 @@ bool Resource::load()
 
 void Resource::reload()
 {
-	if (mRefCount!=0)
+	if (isResident())
 	{
 		destroy(true);
 		init(true);
+		if (mResidency!=NULL)
+		{
+			mResidency->measure(this);
+		}
 	}
 }
 
@@ -52,7 +81,15 @@ void Resource::release()
 
 	if (mRefCount==0)
 	{
-		destroy(true);
+		if (mResidency!=NULL)
+		{
+			// keep it around while there's room:
+			mResidency->released(this);
+		}
+		else
+		{
+			destroy(true);
+		}
 	}
 }
 
@@ -61,4 +98,9 @@ bool Resource::isLoaded()
 	return mRefCount>0;
 }
 
+bool Resource::isResident()
+{
+	return mRefCount>0 || mWarm;
+}
+
 
@@ -4,6 +4,7 @@
 
 namespace Boy
 {
+	class ResidencyManager;
 	class ResourceLoader;
 
 	class Resource
@@ -18,6 +19,18 @@ namespace Boy
 		virtual void release();
 
 		bool isLoaded();
+		inline const std::string &getPath() { return mPath; }
+
+		// true while the resource holds its data (it's loaded, or it
+		// was released and a residency manager keeps it warm):
+		bool isResident();
+
+		// bytes of texture or sound memory the resource holds while
+		// it's resident:
+		virtual int getMemoryUsage() { return 0; }
+
+		// released resources are kept warm by this (if there is one):
+		inline void setResidencyManager(ResidencyManager *residency) { mResidency = residency; }
 
 //	protected:
 
@@ -33,5 +46,13 @@ namespace Boy
 
 		int mRefCount;
 
+		// residency (see ResidencyManager):
+		friend class ResidencyManager;
+		ResidencyManager *mResidency;
+		bool mWarm;
+		int mResidentBytes;
+		Resource *mLruPrev;
+		Resource *mLruNext;
+
 	};
 }
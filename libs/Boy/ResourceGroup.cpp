@@ -1,7 +1,7 @@
 #include "ResourceGroup.h"
 
-#include <algorithm>
 #include <assert.h>
+#include <stddef.h>
 
 using namespace Boy;
 
@@ -9,44 +9,22 @@ using namespace Boy;
 
 ResourceGroup::ResourceGroup()
 {
-	mPathIterator = mResourcePaths.end();
 }
 
 ResourceGroup::~ResourceGroup()
 {
-	mResourcePaths.clear();
+	mResources.clear();
+	mMembers.clear();
 }
 
-void ResourceGroup::addResourcePath(const std::string &path)
+void ResourceGroup::addResource(Resource *resource)
 {
-	// if this path is NOT already in the group:
-	if (find(mResourcePaths.begin(),mResourcePaths.end(),path) == mResourcePaths.end())
-	{
-		// add it:
-		mResourcePaths.push_back(path);
-	}
-}
-
-const std::string *ResourceGroup::getFirstPath()
-{
-	if (mResourcePaths.size()==0)
-	{
-		return NULL;
-	}
-
-	mPathIterator = mResourcePaths.begin();
-	std::string *path = &(*mPathIterator);
-
-	return path;
-}
+	assert(resource!=NULL);
 
-const std::string *ResourceGroup::getNextPath()
-{
-	mPathIterator++;
-	if (mPathIterator == mResourcePaths.end())
+	// if this resource is NOT already in the group:
+	if (mMembers.insert(resource).second)
 	{
-		return NULL;
+		// add it:
+		mResources.push_back(resource);
 	}
-	return &(*mPathIterator);
 }
-
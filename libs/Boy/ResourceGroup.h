@@ -2,11 +2,13 @@
 
 #include "BoyLib/CrtDbgInc.h"
 
-#include <string>
+#include <set>
 #include <vector>
 
 namespace Boy
 {
+	class Resource;
+
 	class ResourceGroup
 	{
 	public:
@@ -14,19 +16,20 @@ namespace Boy
 		ResourceGroup();
 		virtual ~ResourceGroup();
 
-		bool isEmpty() { return mResourcePaths.size()==0; }
-		void addResourcePath(const std::string &path);
+		bool isEmpty() { return mResources.size()==0; }
 
-		// path iteration:
-		const std::string *getFirstPath();
-		const std::string *getNextPath();
+		// adds a resource (a resource is only in a group once, no matter
+		// how many ids map to it):
+		void addResource(Resource *resource);
+		bool contains(Resource *resource) { return mMembers.find(resource)!=mMembers.end(); }
 
-	private:
+		// the resources, in the order they were added:
+		inline int getResourceCount() { return (int)mResources.size(); }
+		inline Resource *getResource(int i) { return mResources[i]; }
 
-		// maps resouce ids to resource paths:
-		std::vector<std::string> mResourcePaths;
+	private:
 
-		// iterator:
-		std::vector<std::string>::iterator mPathIterator;
+		std::vector<Resource*> mResources;
+		std::set<Resource*> mMembers;
 	};
 }
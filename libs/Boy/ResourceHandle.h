@@ -0,0 +1,78 @@
+#pragma once
+
+#include "BoyLib/CrtDbgInc.h"
+
+#include <stddef.h>
+#include <string>
+
+namespace Boy
+{
+	/*
+	 * an interned resource id: a 32 bit hash of the id string that
+	 * ResourceManager resolves with a single table lookup (no string
+	 * compares, no dynamic_cast). handles can be made at compile time:
+	 *
+	 *   static constexpr Boy::ResourceHandle IMAGE_BALL("IMAGE_BALL");
+	 *   ...
+	 *   Boy::Environment::getImage(IMAGE_BALL);
+	 *
+	 * debug builds keep the id string around too, so a handle that
+	 * only matches a resource because its hash collides is caught.
+	 */
+	class ResourceHandle
+	{
+	public:
+
+		constexpr ResourceHandle() : mId(0)
+#ifdef _DEBUG
+			, mName(NULL)
+#endif
+		{
+		}
+
+		// (the string has to outlive the handle in debug builds, which
+		// is why there's no std::string version of this one):
+		constexpr explicit ResourceHandle(const char *id) : mId(hash(id))
+#ifdef _DEBUG
+			, mName(id)
+#endif
+		{
+		}
+
+		constexpr unsigned int getId() const { return mId; }
+		constexpr bool isValid() const { return mId!=0; }
+
+		// the id string (debug builds only, NULL otherwise):
+		const char *getName() const
+		{
+#ifdef _DEBUG
+			return mName;
+#else
+			return NULL;
+#endif
+		}
+
+		// 32 bit fnv-1a of the id (never 0, that's the empty handle):
+		static constexpr unsigned int hash(const char *id)
+		{
+			unsigned int h = 0x811c9dc5u;
+			for ( ; *id!=0 ; id++)
+			{
+				h ^= (unsigned char)*id;
+				h *= 0x01000193u;
+			}
+			return h!=0 ? h : 1;
+		}
+		static unsigned int hash(const std::string &id) { return hash(id.c_str()); }
+
+		constexpr bool operator==(const ResourceHandle &other) const { return mId==other.mId; }
+		constexpr bool operator!=(const ResourceHandle &other) const { return mId!=other.mId; }
+
+	private:
+
+		unsigned int mId;
+#ifdef _DEBUG
+		const char *mName;
+#endif
+	};
+}
@@ -7,13 +7,22 @@
 namespace Boy
 {
 	class Image;
+	class Resource;
 	class Sound;
 
+	// whatever a loader can work out for a resource off the main
+	// thread (like decoded pixels), handed to load() later:
+	class PreparedResource
+	{
+	public:
+		virtual ~PreparedResource() {}
+	};
+
 	class ResourceLoader
 	{
 	public:
 		
-		ResourceLoader(const std::string &language1, const std::string &language2) { mLanguage1 = language1; mLanguage2 = language2; }
+		ResourceLoader(const std::string &language1, const std::string &language2) { mLanguage1 = language1; mLanguage2 = language2; mPreparedResource = NULL; mPrepared = NULL; }
 		virtual ~ResourceLoader() {}
 
 		virtual bool load(Image *image) = 0;
@@ -21,6 +30,41 @@ namespace Boy
 		virtual Image *createImage(const std::string &filename) = 0;
 		virtual Sound *createSound(const std::string &filename) = 0;
 
+		// called around loading the resources of a group, so that
+		// loaders can do work that's shared between them:
+		virtual void beginGroup(const std::string &groupName) {}
+		virtual void endGroup() {}
+
+		// called on a worker thread when a group loads in the background,
+		// so that reading and decoding files stays off the main thread.
+		// has to be safe to call for several resources at once:
+		virtual PreparedResource *prepare(Image *image) { return NULL; }
+		virtual PreparedResource *prepare(Sound *sound) { return NULL; }
+
+		// the file prepare() would read for an image ("" if there's none).
+		// background loads read it ahead and pass it to the other prepare():
+		virtual std::string getPrepareFile(Image *image) { return ""; }
+		virtual PreparedResource *prepare(Image *image, const unsigned char *data, int size) { return prepare(image); }
+
+		// stands in for a resource that's loading on demand until it's
+		// there (an image should at least know its size). init() has to
+		// drop whatever this leaves behind:
+		virtual void loadPlaceholder(Image *image) {}
+		virtual void loadPlaceholder(Sound *sound) {}
+
+		// hands prepared data to the next load() of a resource. load()
+		// picks it up with takePrepared(), which gives the caller
+		// ownership (it returns NULL if there's nothing for the resource):
+		inline void setPrepared(Resource *res, PreparedResource *prepared) { mPreparedResource = res; mPrepared = prepared; }
+		inline PreparedResource *takePrepared(Resource *res)
+		{
+			if (res!=mPreparedResource) return NULL;
+			PreparedResource *prepared = mPrepared;
+			mPreparedResource = NULL;
+			mPrepared = NULL;
+			return prepared;
+		}
+
 		std::string &getLanguage1() { return mLanguage1; }
 		std::string &getLanguage2() { return mLanguage2; }
 
@@ -29,6 +73,11 @@ namespace Boy
 		std::string mLanguage1;
 		std::string mLanguage2;
 
+	private:
+
+		Resource *mPreparedResource;
+		PreparedResource *mPrepared;
+
 	};
 }
 
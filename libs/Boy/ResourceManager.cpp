@@ -3,15 +3,20 @@
 #include <algorithm>
 #include "Boy/Crypto.h"
 #include "BoyLib/BoyUtil.h"
+#include <chrono>
 #include "Environment.h"
 #include "Font.h"
 #include <fstream>
 #include "Image.h"
 #include "Resource.h"
+#include "ResidencyManager.h"
 #include "ResourceGroup.h"
 #include "ResourceLoader.h"
+#include "ResourceManifest.h"
 #include "Sound.h"
+#include "Storage.h"
 #include <string>
+#include "WorkerPool.h"
 
 using namespace Boy;
 
@@ -21,6 +26,7 @@ ResourceManager::ResourceManager(ResourceLoader *loader, unsigned char *key, con
 {
 	mLanguage1 = language1;
 	mLanguage2 = language2;
+	mIdCount = 0;
 
 	// load string resources (currently in separate file):
 	loadStrings("properties/text.xml","properties/text.xml.bin",key);
@@ -39,10 +45,25 @@ ResourceManager::ResourceManager(ResourceLoader *loader, unsigned char *key, con
 
 	assert(loader!=NULL);
 	mResourceLoader = loader;
+
+	// background loading (the thread starts with the first group):
+	mLoadItemCount = 0;
+	mLoadedItemCount = 0;
+	mLoadingQuit = false;
+	mDemandLoading = false;
 }
 
 ResourceManager::~ResourceManager()
 {
+	// drop whatever is still loading in the background:
+	stopLoading();
+
+	// resources that were loaded on demand:
+	releaseFaulted(NULL);
+
+	// nothing stays warm from here on:
+	mResidency.setBudget(0);
+
 	// unload all resource groups:
 	std::map<std::string,ResourceGroup*>::iterator groupIter;
 	for (groupIter=mResourceGroups.begin() ; groupIter!=mResourceGroups.end() ; groupIter++)
@@ -52,6 +73,9 @@ ResourceManager::~ResourceManager()
 	}
 	mResourceGroups.clear();
 
+	// (warm resources that take no memory aren't over any budget):
+	mResidency.evictAll();
+
 	// delete all resources:
 	std::map<std::string,Resource*>::iterator resIter;
 	for (resIter=mResourcesByPath.begin() ; resIter!=mResourcesByPath.end() ; resIter++)
@@ -73,11 +97,63 @@ ResourceManager::~ResourceManager()
 	// clear the rest of the data
 	mParsedResourceFiles.clear();
 	mResourcesById.clear();
-	mText.clear();
+	mIdSlots.clear();
+	mIdCount = 0;
+	for (size_t i=0 ; i<mStringManifests.size() ; i++)
+	{
+		delete mStringManifests[i];
+	}
+	mStringManifests.clear();
 
 }
 
+bool ResourceManager::hashSource(const char *filename, unsigned char *hashOut)
+{
+	Storage *storage = Environment::instance()->getStorage();
+	BoyFileHandle hMap;
+	const void *data;
+	int size;
+	if (storage->FileMap(filename, &hMap, &data, &size)!=Storage::STORAGE_OK)
+	{
+		return false;
+	}
+	ResourceManifest::hashSource(data, size, mLanguage1, mLanguage2, hashOut);
+	storage->FileUnmap(hMap);
+	return true;
+}
+
 void ResourceManager::loadStrings(const char *filename, const char *filenamebin, unsigned char *key)
+{
+	// use the compiled strings if they're up to date (encrypted strings
+	// are checked against the encrypted file, and their compiled copy is
+	// encrypted with the same key):
+	unsigned char sourceHash[16];
+	if (!hashSource(key==NULL ? filename : filenamebin, sourceHash))
+	{
+		return;
+	}
+	ResourceManifest *manifest = new ResourceManifest();
+	std::string manifestPath = std::string(filename) + RESOURCE_MANIFEST_EXTENSION;
+	if (!manifest->load(manifestPath.c_str(), sourceHash, key))
+	{
+		// compile them otherwise:
+		if (!compileStrings(manifest, filename, filenamebin, key))
+		{
+			delete manifest;
+			return;
+		}
+		manifest->build(sourceHash);
+		if (!manifest->save(manifestPath.c_str(), key))
+		{
+			envDebugLog("WARNING: could not write '%s'\n", manifestPath.c_str());
+		}
+	}
+
+	// (files loaded later win):
+	mStringManifests.push_back(manifest);
+}
+
+bool ResourceManager::compileStrings(ResourceManifest *manifest, const char *filename, const char *filenamebin, unsigned char *key)
 {
 	TiXmlDocument doc;
 
@@ -86,7 +162,7 @@ void ResourceManager::loadStrings(const char *filename, const char *filenamebin,
 		// load the clear text strings directly
 		if (doc.LoadFile(filename)==false)
 		{
-			return;
+			return false;
 		}
 	}
 	else
@@ -96,7 +172,7 @@ void ResourceManager::loadStrings(const char *filename, const char *filenamebin,
 		int dataSize;
 		if (Boy::loadDecrypt(key, filenamebin, &data, &dataSize)==false)
 		{
-			return;
+			return false;
 		}
 
 		doc.Parse( data );
@@ -171,7 +247,7 @@ void ResourceManager::loadStrings(const char *filename, const char *filenamebin,
 		}
 
 		// store the text:
-		mText[id] = text;
+		manifest->addString(id, text);
 	}
 
 #ifdef _DEBUG
@@ -180,6 +256,7 @@ void ResourceManager::loadStrings(const char *filename, const char *filenamebin,
 #endif
 
 	doc.Clear();
+	return true;
 }
 
 bool ResourceManager::parseResourceFile(const std::string &fileName, unsigned char *key)
@@ -191,6 +268,68 @@ bool ResourceManager::parseResourceFile(const std::string &fileName, unsigned ch
 		return true;
 	}
 
+	// use the compiled resource file if it's up to date (an encrypted one
+	// is checked against the encrypted file, and its compiled copy is
+	// encrypted with the same key):
+	ResourceManifest manifest;
+	unsigned char sourceHash[16];
+	std::string sourceName = key==NULL ? fileName : fileName + ".bin";
+	if (!hashSource(sourceName.c_str(), sourceHash))
+	{
+		return false;
+	}
+	std::string manifestPath = fileName + RESOURCE_MANIFEST_EXTENSION;
+	if (!manifest.load(manifestPath.c_str(), sourceHash, key))
+	{
+		// compile it otherwise:
+		if (!compileResourceFile(&manifest, fileName, key))
+		{
+			return false;
+		}
+		manifest.build(sourceHash);
+		if (!manifest.save(manifestPath.c_str(), key))
+		{
+			envDebugLog("WARNING: could not write '%s'\n", manifestPath.c_str());
+		}
+	}
+	if (key!=NULL)
+	{
+		mParsedResourceFiles.push_back(fileName);
+	}
+
+	// create the groups and resources:
+	for (int i=0 ; i<manifest.getGroupCount() ; i++)
+	{
+		const ResourceManifest::Group &g = manifest.getGroup(i);
+		ResourceGroup *group = new ResourceGroup();
+		mResourceGroups[manifest.getChars(g.nameOffset)] = group;
+
+		for (unsigned int r=g.firstResource ; r<g.firstResource+g.resourceCount ; r++)
+		{
+			const ResourceManifest::Entry &entry = manifest.getResource(r);
+			std::string id = manifest.getChars(entry.idOffset);
+			std::string path = manifest.getChars(entry.pathOffset);
+
+			// if this resource path already exists:
+			if (mResourcesByPath.find(path)!=mResourcesByPath.end())
+			{
+				// just create a mapping:
+				mapResource(id, path, group);
+			}
+			else
+			{
+				// create and add the resource:
+				Boy::Resource *res = createResource(manifest.getChars(entry.typeOffset),path);
+				addResource(id, path, group, res);
+			}
+		}
+	}
+
+	return true;
+}
+
+bool ResourceManager::compileResourceFile(ResourceManifest *manifest, const std::string &fileName, unsigned char *key)
+{
 	TiXmlDocument doc;
 
 	if (key==NULL)
@@ -221,7 +360,6 @@ bool ResourceManager::parseResourceFile(const std::string &fileName, unsigned ch
 
 		// parse it:
 		doc.Parse(data);
-		mParsedResourceFiles.push_back(fileName);
 
 		// deallocate the mem:
 		delete[] data;
@@ -234,7 +372,7 @@ bool ResourceManager::parseResourceFile(const std::string &fileName, unsigned ch
 	{
 		if (Boy::Environment::instance()->stricmp(e->Value(),"resources")==0)
 		{
-			parseResourceGroup(e);
+			parseResourceGroup(e, manifest);
 		}
 		else
 		{
@@ -247,11 +385,9 @@ bool ResourceManager::parseResourceFile(const std::string &fileName, unsigned ch
 	return true;
 }
 
-void ResourceManager::parseResourceGroup(TiXmlElement *elem)
+void ResourceManager::parseResourceGroup(TiXmlElement *elem, ResourceManifest *manifest)
 {
-	std::string groupId = elem->Attribute("id");
-	ResourceGroup *group = new ResourceGroup();
-	mResourceGroups[groupId] = group;
+	manifest->addGroup(elem->Attribute("id"));
 
 	std::string basePath;
 	std::string idPrefix;
@@ -292,18 +428,7 @@ void ResourceManager::parseResourceGroup(TiXmlElement *elem)
 				fullPath.append(child->Attribute("path"));
 			}
 
-			// if this resource path already exists:
-			if (mResourcesByPath.find(fullPath)!=mResourcesByPath.end())
-			{
-				// just create a mapping:
-				mapResource(id, fullPath, group);
-			}
-			else
-			{
-				// create and add the resource:
-				Boy::Resource *res = createResource(val,fullPath);
-				addResource(id, fullPath, group, res);
-			}
+			manifest->addResource(val, id, fullPath);
 		}
 	}
 }
@@ -338,78 +463,179 @@ void ResourceManager::addResource(const std::string &id,
 	assert(resource!=NULL);
 
 	// add it to the group:
-	group->addResourcePath(path);
+	group->addResource(resource);
 
 	// create a path->resource mapping:
 	mResourcesByPath[path] = resource;
+	resource->setResidencyManager(&mResidency);
 //	printf("[%p] %s\n",resource,path.c_str());
 
 	// create an id->resource mapping:
 	mResourcesById[id] = resource; 
+	setIdSlot(id, resource);
 }
 
 void ResourceManager::mapResource(const std::string &id, 
 								  const std::string &path, 
 								  ResourceGroup *group)
 {
-	group->addResourcePath(path);
-
 	// get the resource pointed to by this resource path:
 	Resource *res = mResourcesByPath[path];
+	group->addResource(res);
 
 	// map new id to existing resource:
 	mResourcesById[id] = res;
+	setIdSlot(id, res);
+}
+
+void ResourceManager::setIdSlot(const std::string &id, Resource *resource)
+{
+	// keep the table at most half full:
+	if ((mIdCount+1)*2 > (int)mIdSlots.size())
+	{
+		std::vector<IdSlot> old;
+		old.swap(mIdSlots);
+		IdSlot empty = IdSlot();
+		mIdSlots.resize(old.empty() ? 64 : old.size()*2, empty);
+		unsigned int mask = (unsigned int)mIdSlots.size() - 1;
+		for (size_t i=0 ; i<old.size() ; i++)
+		{
+			if (old[i].id!=0)
+			{
+				unsigned int s = old[i].id & mask;
+				while (mIdSlots[s].id!=0)
+				{
+					s = (s+1) & mask;
+				}
+				mIdSlots[s] = old[i];
+			}
+		}
+	}
+
+	unsigned int hash = ResourceHandle::hash(id);
+	unsigned int mask = (unsigned int)mIdSlots.size() - 1;
+	unsigned int s = hash & mask;
+	while (mIdSlots[s].id!=0 && mIdSlots[s].id!=hash)
+	{
+		s = (s+1) & mask;
+	}
+
+	IdSlot &slot = mIdSlots[s];
+	if (slot.id==0)
+	{
+		mIdCount++;
+	}
+#ifdef _DEBUG
+	else if (slot.name!=id)
+	{
+		// two ids hash the same, one of them needs renaming:
+		envDebugLog("[ERROR: ResourceManager] resource ids %s and %s have the same handle\n",slot.name.c_str(),id.c_str());
+		assert(false);
+	}
+	slot.name = id;
+#endif
+
+	// (ids that are mapped again just point somewhere else):
+	slot.id = hash;
+	slot.resource = resource;
+	slot.image = dynamic_cast<Image*>(resource);
+	slot.sound = dynamic_cast<Sound*>(resource);
+	slot.font = dynamic_cast<Font*>(resource);
+}
+
+const ResourceManager::IdSlot *ResourceManager::findIdSlot(ResourceHandle id)
+{
+	if (mIdSlots.empty() || !id.isValid())
+	{
+		return NULL;
+	}
+
+	unsigned int mask = (unsigned int)mIdSlots.size() - 1;
+	for (unsigned int s = id.getId() & mask ; mIdSlots[s].id!=0 ; s = (s+1) & mask)
+	{
+		if (mIdSlots[s].id==id.getId())
+		{
+#ifdef _DEBUG
+			// a different id that happens to have the same hash:
+			if (id.getName()!=NULL && mIdSlots[s].name!=id.getName())
+			{
+				envDebugLog("[ERROR: ResourceManager] handle for %s collides with resource id %s\n",id.getName(),mIdSlots[s].name.c_str());
+				assert(false);
+				return NULL;
+			}
+#endif
+			return &mIdSlots[s];
+		}
+	}
+	return NULL;
 }
 
 bool ResourceManager::loadResourceGroup(const std::string &groupName)
 {
+	// groups that are loading in the background come first (the
+	// loader only works on one group at a time):
+	std::vector<LoadJob*> done;
+	std::unique_lock<std::mutex> finishLock(mFinishMutex);
+	while (finishNext(true, done)) {}
+
 	// note: it's ok to load a group more than once as long as it's
 	// released more than once too.  different parts of the code
 	// can use the same resource group and each of them should load
 	// it when they need it and unload it when they done with it
+	bool success = false;
 	if (mResourceGroups.find(groupName) != mResourceGroups.end())
 	{
 		// disable full screen toggle while resource load/unload:
 		Environment::instance()->disableFullScreenToggle();
 
 		ResourceGroup *g = mResourceGroups[groupName];
-		bool success = true;
+		success = true;
 		if (!g->isEmpty())
 		{
-			for (const std::string *path = g->getFirstPath() ; path!=NULL ; path = g->getNextPath())
+			mResourceLoader->beginGroup(groupName);
+			for (int i=0 ; i<g->getResourceCount() ; i++)
 			{
-				assert(mResourcesByPath.find(*path) != mResourcesByPath.end());
-				Resource *res = mResourcesByPath[*path];
-				assert(res!=NULL);
-				success &= res->load();
+				success &= g->getResource(i)->load();
+			}
+			mResourceLoader->endGroup();
+
+			// (some resources only get their data when the group is done):
+			for (int i=0 ; i<g->getResourceCount() ; i++)
+			{
+				mResidency.measure(g->getResource(i));
 			}
 		}
 
 		Environment::instance()->enableFullScreenToggle();
-
-		return success;
 	}
 	else
 	{
 		assert(false);
-
-		return false;
 	}
+
+	finishLock.unlock();
+	notifyDone(done);
+
+	return success;
 }
 
 void ResourceManager::unloadResourceGroup(const std::string &groupName)
 {
+	// the group might still be loading in the background:
+	std::vector<LoadJob*> done;
+	std::unique_lock<std::mutex> finishLock(mFinishMutex);
+	while (finishNext(true, done)) {}
+
 	if (mResourceGroups.find(groupName) != mResourceGroups.end())
 	{
 		// disable full screen toggle while resource load/unload:
 		Environment::instance()->disableFullScreenToggle();
 
 		ResourceGroup *g = mResourceGroups[groupName];
-		for (const std::string *path=g->getFirstPath() ; path!=NULL ; path=g->getNextPath())
+		releaseFaulted(g);
+		for (int i=0 ; i<g->getResourceCount() ; i++)
 		{
-			Resource *res = mResourcesByPath[*path];
-			assert(res!=NULL);
-			res->release();
+			g->getResource(i)->release();
 		}
 
 		Environment::instance()->enableFullScreenToggle();
@@ -418,6 +644,472 @@ void ResourceManager::unloadResourceGroup(const std::string &groupName)
 	{
 		assert(false);
 	}
+
+	finishLock.unlock();
+	notifyDone(done);
+}
+
+bool ResourceManager::transitionGroups(const std::vector<std::string> &from, const std::vector<std::string> &to, TransitionStats *stats)
+{
+	// groups that are loading in the background come first:
+	std::vector<LoadJob*> done;
+	std::unique_lock<std::mutex> finishLock(mFinishMutex);
+	while (finishNext(true, done)) {}
+
+	// work out how many references each resource gains or loses
+	// (resources are their own ids, every path has one resource):
+	std::vector<Resource*> resources; // in group order, new groups first
+	std::map<Resource*,int> refs;
+	std::set<Resource*> inFrom;
+	std::set<Resource*> inTo;
+	std::string toNames;
+	bool success = true;
+	for (int pass=0 ; pass<2 ; pass++)
+	{
+		const std::vector<std::string> &names = pass==0 ? to : from;
+		for (size_t i=0 ; i<names.size() ; i++)
+		{
+			std::map<std::string,ResourceGroup*>::iterator iter = mResourceGroups.find(names[i]);
+			if (iter==mResourceGroups.end())
+			{
+				assert(false);
+				success = false;
+				continue;
+			}
+			if (pass==0)
+			{
+				toNames += (toNames.empty() ? "" : ",") + names[i];
+			}
+
+			ResourceGroup *g = iter->second;
+			for (int r=0 ; r<g->getResourceCount() ; r++)
+			{
+				Resource *res = g->getResource(r);
+				std::map<Resource*,int>::iterator ref = refs.find(res);
+				if (ref==refs.end())
+				{
+					ref = refs.insert(std::make_pair(res, 0)).first;
+					resources.push_back(res);
+				}
+				ref->second += pass==0 ? 1 : -1;
+				(pass==0 ? inTo : inFrom).insert(res);
+			}
+		}
+	}
+
+	// disable full screen toggle while resource load/unload:
+	Environment::instance()->disableFullScreenToggle();
+
+	// load first, so nothing that's still needed goes away in between:
+	bool begun = false;
+	for (size_t i=0 ; i<resources.size() ; i++)
+	{
+		Resource *res = resources[i];
+		for (int n=refs[res] ; n>0 ; n--)
+		{
+			if (!begun)
+			{
+				mResourceLoader->beginGroup(toNames);
+				begun = true;
+			}
+			success &= res->load();
+		}
+	}
+	if (begun)
+	{
+		mResourceLoader->endGroup();
+		for (size_t i=0 ; i<resources.size() ; i++)
+		{
+			if (refs[resources[i]]>0)
+			{
+				mResidency.measure(resources[i]);
+			}
+		}
+	}
+
+	// the delta (measured before anything is released):
+	TransitionStats s = {0, 0, 0, 0, 0, 0};
+	for (size_t i=0 ; i<resources.size() ; i++)
+	{
+		Resource *res = resources[i];
+		long long bytes = res->isResident() ? res->getMemoryUsage() : 0;
+		bool wasLoaded = inFrom.find(res)!=inFrom.end();
+		bool isNeeded = inTo.find(res)!=inTo.end();
+		if (wasLoaded && isNeeded)
+		{
+			s.kept++;
+			s.keptBytes += bytes;
+		}
+		else if (isNeeded)
+		{
+			s.added++;
+			s.addedBytes += bytes;
+		}
+		else
+		{
+			s.removed++;
+			s.removedBytes += bytes;
+		}
+	}
+
+	// then let go of what the old groups had:
+	for (size_t i=0 ; i<from.size() ; i++)
+	{
+		std::map<std::string,ResourceGroup*>::iterator iter = mResourceGroups.find(from[i]);
+		if (iter!=mResourceGroups.end())
+		{
+			releaseFaulted(iter->second);
+		}
+	}
+	for (size_t i=0 ; i<resources.size() ; i++)
+	{
+		Resource *res = resources[i];
+		for (int n=refs[res] ; n<0 ; n++)
+		{
+			res->release();
+		}
+	}
+
+	Environment::instance()->enableFullScreenToggle();
+
+	envDebugLog("[ResourceManager] transition to %s: %d added (%lld bytes), %d removed (%lld bytes), %d kept (%lld bytes)\n",
+		toNames.c_str(), s.added, s.addedBytes, s.removed, s.removedBytes, s.kept, s.keptBytes);
+	if (stats!=NULL)
+	{
+		*stats = s;
+	}
+
+	finishLock.unlock();
+	notifyDone(done);
+
+	return success;
+}
+
+void ResourceManager::loadResourceGroupAsync(const std::string &groupName, LoadCallback callback, void *context)
+{
+	std::map<std::string,ResourceGroup*>::iterator iter = mResourceGroups.find(groupName);
+	if (iter==mResourceGroups.end())
+	{
+		assert(false);
+		if (callback!=NULL)
+		{
+			callback(groupName, false, context);
+		}
+		return;
+	}
+
+	// look up the resources here so the workers don't touch the maps:
+	LoadJob *job = new LoadJob();
+	job->manager = this;
+	job->groupName = groupName;
+	job->callback = callback;
+	job->context = context;
+	job->next = 0;
+	job->begun = false;
+	job->grouped = true;
+	job->prepared = false;
+	job->success = true;
+	ResourceGroup *g = iter->second;
+	for (int i=0 ; i<g->getResourceCount() ; i++)
+	{
+		Resource *res = g->getResource(i);
+
+		// resources that are already loaded (or still warm) just get another
+		// reference when the group is finished, so there's nothing to prepare:
+		LoadItem item = {res, NULL, res->isResident(), NULL, 0, 0, false};
+		job->items.push_back(item);
+	}
+
+	queueLoadJob(job);
+}
+
+void ResourceManager::queueLoadJob(LoadJob *job)
+{
+	std::lock_guard<std::mutex> lock(mLoadMutex);
+	if (!mLoadingThread.joinable())
+	{
+		mLoadingThread = std::thread(loadingProc, this);
+	}
+	mLoadJobs.push_back(job);
+	mPrepareJobs.push_back(job);
+	mLoadItemCount += (int)job->items.size();
+	mPrepareCondition.notify_one();
+}
+
+void ResourceManager::updateLoading(float maxSeconds)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	std::vector<LoadJob*> done;
+	{
+		std::lock_guard<std::mutex> finishLock(mFinishMutex);
+
+		// finish prepared resources until we run out of time (at least
+		// one per call, so loading moves along even with a tiny budget):
+		while (finishNext(false, done))
+		{
+			std::chrono::duration<float> elapsed = std::chrono::steady_clock::now() - start;
+			if (elapsed.count() >= maxSeconds)
+			{
+				break;
+			}
+		}
+	}
+	notifyDone(done);
+}
+
+void ResourceManager::finishLoading()
+{
+	std::vector<LoadJob*> done;
+	{
+		std::lock_guard<std::mutex> finishLock(mFinishMutex);
+		while (finishNext(true, done)) {}
+	}
+	notifyDone(done);
+}
+
+bool ResourceManager::isLoading()
+{
+	std::lock_guard<std::mutex> lock(mLoadMutex);
+	return !mLoadJobs.empty();
+}
+
+float ResourceManager::getLoadingProgress()
+{
+	std::lock_guard<std::mutex> lock(mLoadMutex);
+	if (mLoadItemCount==0)
+	{
+		return mLoadJobs.empty() ? 1.0f : 0.0f;
+	}
+	return (float)mLoadedItemCount / mLoadItemCount;
+}
+
+bool ResourceManager::finishNext(bool wait, std::vector<LoadJob*> &done)
+{
+	LoadJob *job;
+	{
+		std::unique_lock<std::mutex> lock(mLoadMutex);
+		if (mLoadJobs.empty())
+		{
+			return false;
+		}
+		job = mLoadJobs.front();
+
+		// the next resource has to be prepared first, and the job can't
+		// be finished (and deleted) until the loading thread is done with
+		// it (resources that are loaded already are ready right away):
+		bool last = job->next >= (int)job->items.size()-1;
+		while ((job->next < (int)job->items.size() && !job->items[job->next].ready) || (last && !job->prepared))
+		{
+			if (!wait)
+			{
+				return false;
+			}
+			mReadyCondition.wait(lock);
+		}
+	}
+
+	// disable full screen toggle while resource load/unload:
+	Environment::instance()->disableFullScreenToggle();
+
+	if (!job->begun)
+	{
+		job->begun = true;
+		if (job->grouped && !job->items.empty())
+		{
+			mResourceLoader->beginGroup(job->groupName);
+		}
+	}
+
+	bool loaded = false;
+	if (job->next < (int)job->items.size())
+	{
+		LoadItem &item = job->items[job->next];
+		mResourceLoader->setPrepared(item.resource, item.prepared);
+		job->success &= item.resource->load();
+
+		// (the prepared data is still there if the resource
+		// didn't need it, because it was loaded already):
+		delete mResourceLoader->takePrepared(item.resource);
+		item.prepared = NULL;
+		job->next++;
+		loaded = true;
+	}
+
+	bool finished = job->next==(int)job->items.size();
+	if (finished && !job->items.empty())
+	{
+		if (job->grouped)
+		{
+			mResourceLoader->endGroup();
+		}
+		for (size_t i=0 ; i<job->items.size() ; i++)
+		{
+			mResidency.measure(job->items[i].resource);
+		}
+	}
+
+	Environment::instance()->enableFullScreenToggle();
+
+	std::lock_guard<std::mutex> lock(mLoadMutex);
+	if (loaded)
+	{
+		mLoadedItemCount++;
+	}
+	if (finished)
+	{
+		mLoadJobs.pop_front();
+		done.push_back(job);
+
+		// progress starts over with the next batch of groups:
+		if (mLoadJobs.empty())
+		{
+			mLoadItemCount = 0;
+			mLoadedItemCount = 0;
+		}
+	}
+	return true;
+}
+
+void ResourceManager::notifyDone(std::vector<LoadJob*> &done)
+{
+	for (size_t i=0 ; i<done.size() ; i++)
+	{
+		LoadJob *job = done[i];
+		if (job->callback!=NULL)
+		{
+			job->callback(job->groupName, job->success, job->context);
+		}
+		delete job;
+	}
+	done.clear();
+}
+
+void ResourceManager::loadingProc(ResourceManager *mgr)
+{
+	// this thread joins in as one of the workers:
+	WorkerPool pool(0);
+
+	while (true)
+	{
+		LoadJob *job;
+		{
+			std::unique_lock<std::mutex> lock(mgr->mLoadMutex);
+			while (!mgr->mLoadingQuit && mgr->mPrepareJobs.empty())
+			{
+				mgr->mPrepareCondition.wait(lock);
+			}
+			if (mgr->mLoadingQuit)
+			{
+				return;
+			}
+			job = mgr->mPrepareJobs.front();
+			mgr->mPrepareJobs.pop_front();
+		}
+
+		// the files of the group are read ahead on the storage's io
+		// threads, so the workers mostly just decode:
+		Storage *storage = Environment::instance()->getStorage();
+		for (size_t i=0 ; i<job->items.size() ; i++)
+		{
+			LoadItem &item = job->items[i];
+			Image *image = dynamic_cast<Image*>(item.resource);
+			std::string path = image!=NULL && !item.ready ? mgr->mResourceLoader->getPrepareFile(image) : "";
+			if (path.empty() || storage->FileGetSize(path.c_str(), &item.dataSize)!=Storage::STORAGE_OK || item.dataSize<=0)
+			{
+				continue;
+			}
+			item.data = new unsigned char[item.dataSize];
+			item.read = storage->ReadAsync(path.c_str(), 0, item.dataSize, item.data, readAheadDone, &item);
+			if (item.read==0)
+			{
+				delete[] item.data;
+				item.data = NULL;
+			}
+		}
+
+		// (every read is waited for before this returns):
+		pool.run((int)job->items.size(), prepareTask, job);
+
+		std::lock_guard<std::mutex> lock(mgr->mLoadMutex);
+		job->prepared = true;
+		mgr->mReadyCondition.notify_all();
+	}
+}
+
+void ResourceManager::readAheadDone(void *context, Storage::ReadRequest request, Storage::StorageResult result, int bytesRead)
+{
+	LoadItem *item = (LoadItem*)context;
+	item->readOk = result==Storage::STORAGE_OK && bytesRead==item->dataSize;
+}
+
+void ResourceManager::prepareTask(void *context, int index, int worker)
+{
+	LoadJob *job = (LoadJob*)context;
+	LoadItem &item = job->items[index];
+	if (item.ready)
+	{
+		return;
+	}
+
+	ResourceLoader *loader = job->manager->mResourceLoader;
+	PreparedResource *prepared = NULL;
+	Image *image = dynamic_cast<Image*>(item.resource);
+	Sound *sound = dynamic_cast<Sound*>(item.resource);
+	if (image!=NULL && item.read!=0)
+	{
+		// (the loader reads the file itself if the read ahead failed):
+		Environment::instance()->getStorage()->ReadWait(item.read);
+		prepared = item.readOk ? loader->prepare(image, item.data, item.dataSize) : loader->prepare(image);
+		delete[] item.data;
+		item.data = NULL;
+	}
+	else if (image!=NULL)
+	{
+		prepared = loader->prepare(image);
+	}
+	else if (sound!=NULL)
+	{
+		prepared = loader->prepare(sound);
+	}
+
+	std::lock_guard<std::mutex> lock(job->manager->mLoadMutex);
+	item.prepared = prepared;
+	item.ready = true;
+	job->manager->mReadyCondition.notify_all();
+}
+
+void ResourceManager::stopLoading()
+{
+	{
+		std::lock_guard<std::mutex> lock(mLoadMutex);
+		mLoadingQuit = true;
+		mPrepareCondition.notify_all();
+	}
+	if (mLoadingThread.joinable())
+	{
+		mLoadingThread.join();
+	}
+
+	// groups that didn't get finished are dropped (without callbacks):
+	for (size_t i=0 ; i<mLoadJobs.size() ; i++)
+	{
+		LoadJob *job = mLoadJobs[i];
+		for (size_t j=0 ; j<job->items.size() ; j++)
+		{
+			delete job->items[j].prepared;
+
+			// (so it doesn't look like it holds a reference):
+			if (!job->grouped)
+			{
+				mFaulted.erase(job->items[j].resource);
+			}
+		}
+		delete job;
+	}
+	mLoadJobs.clear();
+	mPrepareJobs.clear();
+	mLoadItemCount = 0;
+	mLoadedItemCount = 0;
 }
 
 void ResourceManager::reloadResources()
@@ -468,6 +1160,28 @@ void ResourceManager::initResources(bool includeSounds)
 	Environment::instance()->enableFullScreenToggle();
 }
 
+long long ResourceManager::getGroupMemoryUsage(const std::string &groupName)
+{
+	std::map<std::string,ResourceGroup*>::iterator iter = mResourceGroups.find(groupName);
+	if (iter==mResourceGroups.end())
+	{
+		return 0;
+	}
+
+	// (resources that aren't resident take nothing):
+	long long bytes = 0;
+	ResourceGroup *g = iter->second;
+	for (int i=0 ; i<g->getResourceCount() ; i++)
+	{
+		Resource *res = g->getResource(i);
+		if (res->isResident())
+		{
+			bytes += res->getMemoryUsage();
+		}
+	}
+	return bytes;
+}
+
 Font *ResourceManager::getFont(const std::string &id)
 {
 	assert(mResourcesById.find(id)!=mResourcesById.end());
@@ -485,19 +1199,84 @@ Image *ResourceManager::getImage(const std::string &id)
 		return NULL;
 	}
 	Image *image = dynamic_cast<Image*>(iter->second);
-	assert(image->isLoaded());
+	if (mDemandLoading && !image->isLoaded())
+	{
+		fault(image, id.c_str());
+	}
+	assert(mDemandLoading || image->isLoaded());
 	return image;
 }
 
+Font *ResourceManager::getFont(ResourceHandle id)
+{
+	const IdSlot *slot = findIdSlot(id);
+	assert(slot!=NULL && slot->font!=NULL);
+	Font *font = slot->font;
+	assert(font->isLoaded());
+	return font;
+}
+
+Image *ResourceManager::getImage(ResourceHandle id)
+{
+	const IdSlot *slot = findIdSlot(id);
+	if (slot==NULL)
+	{
+		envDebugLog("[WARNING: ResourceManager::getImage] image with id %s (%08x) not found\n",
+			id.getName()!=NULL ? id.getName() : "?",id.getId());
+		return NULL;
+	}
+	Image *image = slot->image;
+	assert(image!=NULL);
+	if (mDemandLoading && !image->isLoaded())
+	{
+		fault(image, id.getName());
+	}
+	assert(mDemandLoading || image->isLoaded());
+	return image;
+}
+
+Sound *ResourceManager::getSound(ResourceHandle id)
+{
+	const IdSlot *slot = findIdSlot(id);
+	if (slot==NULL)
+	{
+		return NULL;
+	}
+	Sound *sound = slot->sound;
+	assert(sound!=NULL);
+	if (mDemandLoading && !sound->isLoaded())
+	{
+		fault(sound, id.getName());
+	}
+	assert(mDemandLoading || sound->isLoaded());
+	return sound;
+}
+
 Boy::UString ResourceManager::getString(const std::string &id)
 {
-	assert(mText.find(id)!=mText.end());
-	return mText[id];
+	// (the last file that has it wins):
+	for (int i=(int)mStringManifests.size()-1 ; i>=0 ; i--)
+	{
+		const char *text = mStringManifests[i]->findString(id.c_str());
+		if (text!=NULL)
+		{
+			return Boy::UString(text);
+		}
+	}
+	assert(false);
+	return Boy::UString();
 }
 
 bool ResourceManager::hasString(const std::string &id)
 {
-	return mText.find(id) != mText.end();
+	for (size_t i=0 ; i<mStringManifests.size() ; i++)
+	{
+		if (mStringManifests[i]->findString(id.c_str())!=NULL)
+		{
+			return true;
+		}
+	}
+	return false;
 }
 
 Sound *ResourceManager::getSound(const std::string &id)
@@ -509,10 +1288,90 @@ Sound *ResourceManager::getSound(const std::string &id)
 	}
 
 	Sound *sound = dynamic_cast<Sound*>(iter->second);
-	assert(sound->isLoaded());
+	if (mDemandLoading && !sound->isLoaded())
+	{
+		fault(sound, id.c_str());
+	}
+	assert(mDemandLoading || sound->isLoaded());
 	return sound;
 }
 
+void ResourceManager::fault(Resource *resource, const char *id)
+{
+	// already on its way:
+	if (mFaulted.find(resource)!=mFaulted.end())
+	{
+		return;
+	}
+	mFaulted.insert(resource);
+
+	// still warm, that's as good as loaded:
+	if (resource->isResident())
+	{
+		resource->load();
+		return;
+	}
+
+	// say which groups should have had it loaded:
+	std::string groups;
+	std::map<std::string,ResourceGroup*>::iterator iter;
+	for (iter=mResourceGroups.begin() ; iter!=mResourceGroups.end() ; iter++)
+	{
+		if (iter->second->contains(resource))
+		{
+			groups += (groups.empty() ? "" : ",") + iter->first;
+		}
+	}
+	envDebugLog("[ResourceManager] demand load: %s (%s) from group %s\n",
+		id!=NULL ? id : "?", resource->getPath().c_str(), groups.empty() ? "-" : groups.c_str());
+
+	Image *image = dynamic_cast<Image*>(resource);
+	Sound *sound = dynamic_cast<Sound*>(resource);
+	if (image!=NULL)
+	{
+		mResourceLoader->loadPlaceholder(image);
+	}
+	else if (sound!=NULL)
+	{
+		mResourceLoader->loadPlaceholder(sound);
+	}
+
+	// the rest happens like it does for groups (one resource at a time,
+	// and not in a group, so images don't end up on an atlas page of
+	// their own):
+	LoadJob *job = new LoadJob();
+	job->manager = this;
+	job->groupName = id!=NULL ? id : resource->getPath();
+	job->callback = NULL;
+	job->context = NULL;
+	job->next = 0;
+	job->begun = false;
+	job->grouped = false;
+	job->prepared = false;
+	job->success = true;
+	LoadItem item = {resource, NULL, false, NULL, 0, 0, false};
+	job->items.push_back(item);
+	queueLoadJob(job);
+}
+
+void ResourceManager::releaseFaulted(ResourceGroup *group)
+{
+	// (all of them if there's no group):
+	std::set<Resource*>::iterator iter = mFaulted.begin();
+	while (iter!=mFaulted.end())
+	{
+		if (group==NULL || group->contains(*iter))
+		{
+			(*iter)->release();
+			mFaulted.erase(iter++);
+		}
+		else
+		{
+			iter++;
+		}
+	}
+}
+
 Image *ResourceManager::getImageFromPath(const std::string &path)
 {
 	std::map<std::string,Resource*>::iterator iter = mResourcesByPath.find(path);
@@ -539,6 +1398,8 @@ Image *ResourceManager::getImageFromPath(const std::string &path)
 		{
 			// keep track of it:
 			mResourcesByPath[path] = img;
+			img->setResidencyManager(&mResidency);
+			mResidency.measure(img);
 
 			// return it:
 			return img;
@@ -609,5 +1470,10 @@ void ResourceManager::dump()
 
 		printf("resource(%p): %s=%s\n",iter3->second,iter3->first.c_str(),path.c_str());
 	}
+	printf("------------------- ResourceManager: residency -----------------\n");
+	printf("resident: %lld bytes, warm: %d resources, %lld bytes (budget %lld)\n",
+		mResidency.getResidentBytes(),mResidency.getWarmCount(),mResidency.getWarmBytes(),mResidency.getBudget());
+	printf("loads: %d warm, %d cold\n",mResidency.getHitCount(),mResidency.getMissCount());
+	printf("loaded on demand: %d resources\n",(int)mFaulted.size());
 	printf("===============================================================\n");
 }
\ No newline at end of file
@@ -3,7 +3,15 @@
 #include "BoyLib/Rect.h"
 #include "BoyLib/UString.h"
 #include "BoyLib/Vector2.h"
+#include "ResidencyManager.h"
+#include "ResourceHandle.h"
+#include "Storage.h"
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <set>
 #include <string>
+#include <thread>
 #include "tinyxml/tinyxml.h"
 #include <vector>
 
@@ -12,14 +20,31 @@ namespace Boy
 
 	class Font;
 	class Image;
+	class PreparedResource;
 	class Resource;
 	class ResourceGroup;
 	class ResourceLoader;
+	class ResourceManifest;
 	class Sound;
 
 	class ResourceManager
 	{
 	public:
+
+		// called when a group that was loaded in the background is done
+		// (on the thread that finished it, usually the main thread):
+		typedef void (*LoadCallback)(const std::string &groupName, bool success, void *context);
+
+		// what transitionGroups() did (number of resources and their memory):
+		struct TransitionStats
+		{
+			int added; // only in the new groups (loaded)
+			int removed; // only in the old groups (released)
+			int kept; // in both (not touched)
+			long long addedBytes;
+			long long removedBytes;
+			long long keptBytes;
+		};
 		
 		ResourceManager(ResourceLoader *loader, unsigned char *key, const std::string &language1, const std::string &language2);
 		virtual ~ResourceManager();
@@ -30,10 +55,25 @@ namespace Boy
 		// resource loading/unloading:
 		virtual bool loadResourceGroup(const std::string &groupName);
 		virtual void unloadResourceGroup(const std::string &groupName);
+
+		// switches from one set of loaded groups to another (like going
+		// from one level to the next): resources only the new groups have
+		// are loaded before resources only the old groups have are
+		// released, and the resources they share aren't touched at all:
+		virtual bool transitionGroups(const std::vector<std::string> &from, const std::vector<std::string> &to, TransitionStats *stats=NULL);
 		virtual void reloadResources();
 		virtual void destroyResources(bool includeSounds);
 		virtual void initResources(bool includeSounds);
 
+		// background loading: the files of queued groups are read and
+		// decoded by a pool of worker threads, and updateLoading() hands
+		// the results to the device (in order) until its time is up:
+		virtual void loadResourceGroupAsync(const std::string &groupName, LoadCallback callback=NULL, void *context=NULL);
+		void updateLoading(float maxSeconds);
+		void finishLoading();
+		bool isLoading();
+		float getLoadingProgress();
+
 		// id based resource access:
 		virtual Image *getImage(const std::string &id);
 		virtual bool hasString(const std::string &id);
@@ -41,9 +81,27 @@ namespace Boy
 		virtual Sound *getSound(const std::string &id);
 		virtual Font *getFont(const std::string &id);
 
+		// handle based resource access (the fast path, see ResourceHandle):
+		Image *getImage(ResourceHandle id);
+		Sound *getSound(ResourceHandle id);
+		Font *getFont(ResourceHandle id);
+
 		// direct resource access:
 		virtual Image *getImageFromPath(const std::string &path);
 
+		// on demand loading: getImage() and getSound() don't insist on
+		// their resource being loaded, one that isn't is queued for
+		// background loading and shows a placeholder until it's there.
+		// every fault is logged, they're resources that belong in a
+		// group that's loaded up front:
+		void setDemandLoading(bool enabled) { mDemandLoading = enabled; }
+		bool isDemandLoading() { return mDemandLoading; }
+
+		// memory: released resources stay warm until the residency
+		// manager's budget runs out (see ResidencyManager):
+		ResidencyManager *getResidencyManager() { return &mResidency; }
+		long long getGroupMemoryUsage(const std::string &groupName);
+
 		// misc:
 		void getAllSounds(std::vector<Sound*> &sounds);
 		std::string &getLanguage1() { return mLanguage1; }
@@ -53,8 +111,11 @@ namespace Boy
 
 	private:
 
-		void parseResourceGroup(TiXmlElement *elem);
+		bool hashSource(const char *filename, unsigned char *hashOut);
+		bool compileResourceFile(ResourceManifest *manifest, const std::string &fileName, unsigned char *key);
+		void parseResourceGroup(TiXmlElement *elem, ResourceManifest *manifest);
 		void loadStrings(const char *filename, const char *filenamebin, unsigned char *key);
+		bool compileStrings(ResourceManifest *manifest, const char *filename, const char *filenamebin, unsigned char *key);
 		void addResource(
 			const std::string &id, 
 			const std::string &path, 
@@ -65,6 +126,62 @@ namespace Boy
 			ResourceGroup *group);
 		Resource *createResource(const char *type, const std::string &path);
 
+		// a resource id's entry in the handle table:
+		struct IdSlot
+		{
+			unsigned int id; // ResourceHandle::hash() of the id, 0 if empty
+			Resource *resource;
+			Image *image; // (resource cast to each type once, up front)
+			Sound *sound;
+			Font *font;
+#ifdef _DEBUG
+			std::string name;
+#endif
+		};
+
+		void setIdSlot(const std::string &id, Resource *resource);
+		const IdSlot *findIdSlot(ResourceHandle id);
+
+		void fault(Resource *resource, const char *id);
+		void releaseFaulted(ResourceGroup *group);
+
+	private:
+
+		// a resource of a group that's loading in the background:
+		struct LoadItem
+		{
+			Resource *resource;
+			PreparedResource *prepared; // made by a worker
+			bool ready; // true once the worker is done with it
+			unsigned char *data; // the file prepare() reads, read ahead
+			int dataSize;
+			Storage::ReadRequest read; // (0 if there's no read ahead)
+			bool readOk;
+		};
+
+		// a group that's loading in the background:
+		struct LoadJob
+		{
+			ResourceManager *manager;
+			std::string groupName;
+			std::vector<LoadItem> items;
+			LoadCallback callback;
+			void *context;
+			int next; // the next item to finish
+			bool begun;
+			bool grouped; // false for resources loaded on demand
+			bool prepared; // true once the loading thread is done with it
+			bool success;
+		};
+
+		void queueLoadJob(LoadJob *job);
+		static void loadingProc(ResourceManager *mgr);
+		static void prepareTask(void *context, int index, int worker);
+		static void readAheadDone(void *context, Storage::ReadRequest request, Storage::StorageResult result, int bytesRead);
+		bool finishNext(bool wait, std::vector<LoadJob*> &done);
+		void notifyDone(std::vector<LoadJob*> &done);
+		void stopLoading();
+
 	private:
 
 		// resource loader:
@@ -80,12 +197,38 @@ namespace Boy
 		std::map<std::string,Resource*> mResourcesByPath;
 		std::map<std::string,Resource*> mResourcesById;
 
-		// string resources:
-		std::map<std::string,Boy::UString> mText;
+		// id handle table (open addressing, at most half full):
+		std::vector<IdSlot> mIdSlots;
+		int mIdCount;
+
+		// keeps released resources warm:
+		ResidencyManager mResidency;
+
+		// on demand loading (resources that were faulted in hold a
+		// reference of their own until a group they're in is unloaded):
+		bool mDemandLoading;
+		std::set<Resource*> mFaulted;
+
+		// string resources (compiled, one per file):
+		std::vector<ResourceManifest*> mStringManifests;
 
 		// language:
 		std::string mLanguage1;
 		std::string mLanguage2;
+
+		// background loading (mLoadMutex guards the queues, the items'
+		// ready flags and the jobs' prepared flags, mFinishMutex is held
+		// while resources are loaded):
+		std::thread mLoadingThread;
+		std::mutex mLoadMutex;
+		std::mutex mFinishMutex;
+		std::condition_variable mPrepareCondition;
+		std::condition_variable mReadyCondition;
+		std::deque<LoadJob*> mLoadJobs; // not finished yet
+		std::deque<LoadJob*> mPrepareJobs; // not prepared yet
+		int mLoadItemCount;
+		int mLoadedItemCount;
+		bool mLoadingQuit;
 	};
 }
 
@@ -0,0 +1,345 @@
+#include "ResourceManifest.h"
+
+#include <assert.h>
+#include "BoyLib/md5.h"
+#include "Crypto.h"
+#include "Environment.h"
+#include "ResourceHandle.h"
+#include <string.h>
+
+using namespace Boy;
+
+#include "BoyLib/CrtDbgNew.h"
+
+ResourceManifest::ResourceManifest()
+{
+	mData = NULL;
+	mHeader = NULL;
+	mGroups = NULL;
+	mResources = NULL;
+	mStringSlots = NULL;
+	mChars = NULL;
+	mMapped = false;
+	mMap = 0;
+}
+
+ResourceManifest::~ResourceManifest()
+{
+	release();
+}
+
+void ResourceManifest::release()
+{
+	if (mMapped)
+	{
+		Environment::instance()->getStorage()->FileUnmap(mMap);
+		mMapped = false;
+	}
+	mBuffer.clear();
+	mData = NULL;
+	mHeader = NULL;
+}
+
+void ResourceManifest::hashSource(const void *data, int sizeBytes, const std::string &language1, const std::string &language2, unsigned char *hashOut)
+{
+	// (the languages decide what goes in, so they're part of the source):
+	md5_state_t state;
+	md5_init(&state);
+	md5_append(&state, (const md5_byte_t*)data, sizeBytes);
+	md5_append(&state, (const md5_byte_t*)language1.c_str(), (int)language1.size()+1);
+	md5_append(&state, (const md5_byte_t*)language2.c_str(), (int)language2.size()+1);
+	md5_finish(&state, hashOut);
+}
+
+bool ResourceManifest::load(const char *path, const unsigned char *sourceHash, const unsigned char *key)
+{
+	release();
+
+	Storage *storage = Environment::instance()->getStorage();
+	const void *data;
+	int size;
+	if (storage->FileMap(path, &mMap, &data, &size)!=Storage::STORAGE_OK)
+	{
+		return false;
+	}
+	mMapped = true;
+
+	if (key!=NULL)
+	{
+		// decrypt it (the blob is zero padded to whole blocks):
+		if (size < (int)sizeof(Header) || size%16!=0)
+		{
+			release();
+			return false;
+		}
+		mBuffer.resize(size);
+		aesDecrypt(key, (const char*)data, (char*)&mBuffer[0], size);
+		storage->FileUnmap(mMap);
+		mMapped = false;
+
+		unsigned int totalSize = ((const Header*)&mBuffer[0])->totalSize;
+		if (totalSize <= (unsigned int)size && (unsigned int)size - totalSize < 16)
+		{
+			mBuffer.resize(totalSize);
+		}
+		data = &mBuffer[0];
+		size = (int)mBuffer.size();
+	}
+
+	// make sure it was compiled from this very source:
+	if (!attach(data, size) || memcmp(mHeader->sourceHash, sourceHash, 16)!=0)
+	{
+		release();
+		return false;
+	}
+	return true;
+}
+
+bool ResourceManifest::attach(const void *data, int sizeBytes)
+{
+	mHeader = NULL;
+
+	const unsigned char *bytes = (const unsigned char*)data;
+	if (bytes==NULL || sizeBytes < (int)sizeof(Header))
+	{
+		return false;
+	}
+
+	const Header *header = (const Header*)bytes;
+	unsigned int size = (unsigned int)sizeBytes;
+	if (memcmp(header->magic, RESOURCE_MANIFEST_MAGIC, 4)!=0 ||
+		header->version!=RESOURCE_MANIFEST_VERSION ||
+		header->totalSize!=size)
+	{
+		return false;
+	}
+
+	// every table has to be in the file:
+	if (header->groupsOffset > size || header->groupCount > (size - header->groupsOffset) / sizeof(Group) ||
+		header->resourcesOffset > size || header->resourceCount > (size - header->resourcesOffset) / sizeof(Entry) ||
+		header->stringSlotsOffset > size || header->stringSlotCount > (size - header->stringSlotsOffset) / sizeof(StringSlot) ||
+		(header->stringSlotCount & (header->stringSlotCount-1))!=0 ||
+		header->charsOffset > size || header->charsSize==0 || header->charsSize > size - header->charsOffset ||
+		bytes[header->charsOffset + header->charsSize - 1]!=0)
+	{
+		return false;
+	}
+
+	// and point where it should (one pass, so nothing has to be checked later):
+	const Group *groups = (const Group*)(bytes + header->groupsOffset);
+	const Entry *resources = (const Entry*)(bytes + header->resourcesOffset);
+	const StringSlot *slots = (const StringSlot*)(bytes + header->stringSlotsOffset);
+	unsigned int charsSize = header->charsSize;
+	for (unsigned int i=0 ; i<header->groupCount ; i++)
+	{
+		if (groups[i].nameOffset >= charsSize ||
+			groups[i].firstResource > header->resourceCount ||
+			groups[i].resourceCount > header->resourceCount - groups[i].firstResource)
+		{
+			return false;
+		}
+	}
+	for (unsigned int i=0 ; i<header->resourceCount ; i++)
+	{
+		if (resources[i].typeOffset >= charsSize || resources[i].idOffset >= charsSize || resources[i].pathOffset >= charsSize)
+		{
+			return false;
+		}
+	}
+	for (unsigned int i=0 ; i<header->stringSlotCount ; i++)
+	{
+		if (slots[i].hash!=0 && (slots[i].idOffset >= charsSize || slots[i].textOffset >= charsSize))
+		{
+			return false;
+		}
+	}
+
+	mData = bytes;
+	mHeader = header;
+	mGroups = groups;
+	mResources = resources;
+	mStringSlots = slots;
+	mChars = (const char*)(bytes + header->charsOffset);
+	return true;
+}
+
+unsigned int ResourceManifest::addChars(const char *s)
+{
+	unsigned int offset = (unsigned int)mBuildChars.size();
+	mBuildChars.append(s);
+	mBuildChars += '\0';
+	return offset;
+}
+
+void ResourceManifest::addGroup(const char *name)
+{
+	Group group;
+	group.nameOffset = addChars(name);
+	group.firstResource = (unsigned int)mBuildResources.size();
+	group.resourceCount = 0;
+	mBuildGroups.push_back(group);
+}
+
+void ResourceManifest::addResource(const char *type, const std::string &id, const std::string &path)
+{
+	assert(!mBuildGroups.empty());
+
+	Entry entry;
+	entry.typeOffset = addChars(type);
+	entry.idOffset = addChars(id.c_str());
+	entry.pathOffset = addChars(path.c_str());
+	mBuildResources.push_back(entry);
+	mBuildGroups.back().resourceCount++;
+}
+
+void ResourceManifest::addString(const char *id, const char *text)
+{
+	StringSlot slot;
+	slot.hash = ResourceHandle::hash(id);
+	slot.idOffset = addChars(id);
+	slot.textOffset = addChars(text);
+	mBuildStrings.push_back(slot);
+}
+
+static unsigned int alignUp(unsigned int x)
+{
+	return (x + 3) & ~3u;
+}
+
+void ResourceManifest::build(const unsigned char *sourceHash)
+{
+	release();
+
+	// the string table is at most half full:
+	unsigned int slotCount = 0;
+	if (!mBuildStrings.empty())
+	{
+		slotCount = 1;
+		while (slotCount < mBuildStrings.size()*2)
+		{
+			slotCount *= 2;
+		}
+	}
+	std::vector<StringSlot> slots(slotCount);
+	if (slotCount>0)
+	{
+		memset(&slots[0], 0, slotCount * sizeof(StringSlot));
+	}
+
+	// (a string that's there twice keeps the last text, like it always has):
+	unsigned int stringCount = 0;
+	for (size_t i=0 ; i<mBuildStrings.size() ; i++)
+	{
+		const StringSlot &str = mBuildStrings[i];
+		unsigned int s = str.hash & (slotCount-1);
+		while (slots[s].hash!=0 &&
+			(slots[s].hash!=str.hash || strcmp(&mBuildChars[slots[s].idOffset], &mBuildChars[str.idOffset])!=0))
+		{
+			s = (s+1) & (slotCount-1);
+		}
+		if (slots[s].hash==0)
+		{
+			stringCount++;
+		}
+		slots[s] = str;
+	}
+
+	if (mBuildChars.empty())
+	{
+		mBuildChars += '\0';
+	}
+
+	Header header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, RESOURCE_MANIFEST_MAGIC, 4);
+	header.version = RESOURCE_MANIFEST_VERSION;
+	memcpy(header.sourceHash, sourceHash, 16);
+	header.groupCount = (unsigned int)mBuildGroups.size();
+	header.groupsOffset = sizeof(Header);
+	header.resourceCount = (unsigned int)mBuildResources.size();
+	header.resourcesOffset = header.groupsOffset + header.groupCount * sizeof(Group);
+	header.stringCount = stringCount;
+	header.stringSlotCount = slotCount;
+	header.stringSlotsOffset = header.resourcesOffset + header.resourceCount * sizeof(Entry);
+	header.charsOffset = header.stringSlotsOffset + slotCount * sizeof(StringSlot);
+	header.charsSize = (unsigned int)mBuildChars.size();
+	header.totalSize = alignUp(header.charsOffset + header.charsSize);
+
+	// lay it all out in one block:
+	std::vector<unsigned char> buffer(header.totalSize, 0);
+	memcpy(&buffer[0], &header, sizeof(header));
+	if (header.groupCount>0)
+	{
+		memcpy(&buffer[header.groupsOffset], &mBuildGroups[0], header.groupCount * sizeof(Group));
+	}
+	if (header.resourceCount>0)
+	{
+		memcpy(&buffer[header.resourcesOffset], &mBuildResources[0], header.resourceCount * sizeof(Entry));
+	}
+	if (slotCount>0)
+	{
+		memcpy(&buffer[header.stringSlotsOffset], &slots[0], slotCount * sizeof(StringSlot));
+	}
+	memcpy(&buffer[header.charsOffset], mBuildChars.data(), header.charsSize);
+
+	mBuildGroups.clear();
+	mBuildResources.clear();
+	mBuildStrings.clear();
+	mBuildChars.clear();
+
+	mBuffer.swap(buffer);
+	bool valid = attach(&mBuffer[0], (int)mBuffer.size());
+	assert(valid);
+}
+
+bool ResourceManifest::save(const char *path, const unsigned char *key)
+{
+	assert(mHeader!=NULL);
+
+	// (the blob goes out as it is without a key):
+	char *encrypted = NULL;
+	int writeSize = mHeader->totalSize;
+	if (key!=NULL)
+	{
+		aesEncrypt(key, (const char*)mData, mHeader->totalSize, &encrypted, &writeSize);
+	}
+
+	Storage *storage = Environment::instance()->getStorage();
+	BoyFileHandle hFile;
+	if (storage->FileOpen(path, Storage::STORAGE_MODE_WRITE | Storage::STORAGE_OPEN_ALWAYS, &hFile)!=Storage::STORAGE_OK)
+	{
+		delete[] encrypted;
+		return false;
+	}
+
+	// (a partial file fails the size check when it's loaded):
+	bool ok = storage->FileWrite(hFile, encrypted!=NULL ? encrypted : (const char*)mData, writeSize)==Storage::STORAGE_OK;
+	storage->FileClose(hFile);
+	delete[] encrypted;
+	return ok;
+}
+
+const char *ResourceManifest::findString(const char *id)
+{
+	if (mHeader==NULL || mHeader->stringSlotCount==0)
+	{
+		return NULL;
+	}
+
+	unsigned int hash = ResourceHandle::hash(id);
+	unsigned int mask = mHeader->stringSlotCount - 1;
+	unsigned int s = hash & mask;
+	for (unsigned int n=0 ; n<mHeader->stringSlotCount ; n++, s=(s+1)&mask)
+	{
+		const StringSlot &slot = mStringSlots[s];
+		if (slot.hash==0)
+		{
+			return NULL;
+		}
+		if (slot.hash==hash && strcmp(mChars + slot.idOffset, id)==0)
+		{
+			return mChars + slot.textOffset;
+		}
+	}
+	return NULL;
+}
@@ -0,0 +1,131 @@
+#pragma once
+
+#include "BoyLib/CrtDbgInc.h"
+
+#include <stddef.h>
+#include "Storage.h"
+#include <string>
+#include <vector>
+
+// manifest file identification:
+#define RESOURCE_MANIFEST_MAGIC "BMAN"
+#define RESOURCE_MANIFEST_VERSION 1
+
+// manifests are stored next to their source file with this appended:
+#define RESOURCE_MANIFEST_EXTENSION ".manifest"
+
+namespace Boy
+{
+	/*
+	 * a resource or string file (resources.xml, text.xml and friends)
+	 * compiled for a pair of languages: the paths are already resolved
+	 * and concatenated, the text already picked for the language. it's
+	 * a single relocatable blob (all offsets, no pointers) that's used
+	 * in place, usually straight out of a memory mapped file, and it
+	 * remembers the md5 of what it was compiled from so a changed
+	 * source file (or language) is noticed.
+	 *
+	 * layout:
+	 *   Header
+	 *   Group[groupCount] (resources of a group are a range of the table)
+	 *   Entry[resourceCount]
+	 *   StringSlot[stringSlotCount] (hash table by id, empty slots have hash 0)
+	 *   chars (zero terminated utf8 strings, the offsets point in here)
+	 */
+	class ResourceManifest
+	{
+	public:
+
+		struct Header
+		{
+			char magic[4]; // "BMAN"
+			unsigned int version;
+			unsigned char sourceHash[16];
+			unsigned int totalSize;
+			unsigned int groupCount;
+			unsigned int groupsOffset;
+			unsigned int resourceCount;
+			unsigned int resourcesOffset;
+			unsigned int stringCount;
+			unsigned int stringSlotCount; // 0 or a power of 2
+			unsigned int stringSlotsOffset;
+			unsigned int charsOffset;
+			unsigned int charsSize;
+		};
+
+		struct Group
+		{
+			unsigned int nameOffset;
+			unsigned int firstResource;
+			unsigned int resourceCount;
+		};
+
+		struct Entry
+		{
+			unsigned int typeOffset; // "image", "font" or "sound"
+			unsigned int idOffset; // with the id prefix
+			unsigned int pathOffset; // with the base path and language
+		};
+
+		struct StringSlot
+		{
+			unsigned int hash; // ResourceHandle::hash() of the id
+			unsigned int idOffset;
+			unsigned int textOffset;
+		};
+
+		ResourceManifest();
+		virtual ~ResourceManifest();
+
+		// the hash a manifest is checked against:
+		static void hashSource(const void *data, int sizeBytes, const std::string &language1, const std::string &language2, unsigned char *hashOut);
+
+		// maps a compiled manifest, returns false if there isn't one that
+		// was made from a source with this hash. with a key it's stored
+		// encrypted, and it's decrypted into memory instead:
+		bool load(const char *path, const unsigned char *sourceHash, const unsigned char *key = NULL);
+
+		// compiling: add everything, then build() (which makes the
+		// manifest usable) and save() it for next time:
+		void addGroup(const char *name);
+		void addResource(const char *type, const std::string &id, const std::string &path);
+		void addString(const char *id, const char *text);
+		void build(const unsigned char *sourceHash);
+		bool save(const char *path, const unsigned char *key = NULL);
+
+		// access:
+		inline bool isValid() { return mHeader!=NULL; }
+		inline int getGroupCount() { return mHeader==NULL ? 0 : (int)mHeader->groupCount; }
+		inline const Group &getGroup(int i) { return mGroups[i]; }
+		inline const Entry &getResource(int i) { return mResources[i]; }
+		inline const char *getChars(unsigned int offset) { return mChars + offset; }
+
+		// the text for a string id (NULL if there isn't one):
+		const char *findString(const char *id);
+
+	private:
+
+		bool attach(const void *data, int sizeBytes);
+		void release();
+		unsigned int addChars(const char *s);
+
+	private:
+
+		// the blob:
+		const unsigned char *mData;
+		const Header *mHeader;
+		const Group *mGroups;
+		const Entry *mResources;
+		const StringSlot *mStringSlots;
+		const char *mChars;
+		bool mMapped;
+		BoyFileHandle mMap;
+		std::vector<unsigned char> mBuffer; // when it was built here
+
+		// compiling:
+		std::vector<Group> mBuildGroups;
+		std::vector<Entry> mBuildResources;
+		std::vector<StringSlot> mBuildStrings;
+		std::string mBuildChars;
+	};
+}
@@ -0,0 +1,318 @@
+#include "ResourcePack.h"
+
+#include <string.h>
+#include <vector>
+
+using namespace Boy;
+
+#include "BoyLib/CrtDbgNew.h"
+
+// lz parameters (the format is a sequence of literal runs, each followed
+// by a match: a token byte with both lengths, the literals, a 16 bit
+// offset back into the output and extra length bytes where needed):
+#define LZ_MIN_MATCH 4
+#define LZ_MAX_OFFSET 0xffff
+#define LZ_HASH_BITS 14
+
+ResourcePack::ResourcePack()
+{
+	mData = NULL;
+	mSize = 0;
+	mHeader = NULL;
+	mSlots = NULL;
+	mNames = NULL;
+}
+
+ResourcePack::~ResourcePack()
+{
+}
+
+bool ResourcePack::attach(const void *data, int sizeBytes)
+{
+	mHeader = NULL;
+
+	const unsigned char *bytes = (const unsigned char*)data;
+	if (bytes==NULL || sizeBytes < (int)sizeof(Header))
+	{
+		return false;
+	}
+
+	const Header *header = (const Header*)bytes;
+	unsigned int size = (unsigned int)sizeBytes;
+	if (memcmp(header->magic, RESOURCE_PACK_MAGIC, 4)!=0 || header->version!=RESOURCE_PACK_VERSION)
+	{
+		return false;
+	}
+
+	// the table has to be a power of 2 and everything has to be in the file:
+	if (header->slotCount==0 || (header->slotCount & (header->slotCount-1))!=0 ||
+		header->slotsOffset > size ||
+		header->slotCount > (size - header->slotsOffset) / sizeof(Slot) ||
+		header->namesOffset > size ||
+		header->namesSize==0 || header->namesSize > size - header->namesOffset ||
+		bytes[header->namesOffset + header->namesSize - 1]!=0)
+	{
+		return false;
+	}
+
+	mData = bytes;
+	mSize = sizeBytes;
+	mHeader = header;
+	mSlots = (const Slot*)(bytes + header->slotsOffset);
+	mNames = (const char*)(bytes + header->namesOffset);
+	return true;
+}
+
+bool ResourcePack::find(const char *path, File &file)
+{
+	if (mHeader==NULL)
+	{
+		return false;
+	}
+
+	unsigned long long hash = hashPath(path);
+	unsigned int mask = mHeader->slotCount - 1;
+	unsigned int i = (unsigned int)hash & mask;
+	for (unsigned int n=0 ; n<mHeader->slotCount ; n++, i=(i+1)&mask)
+	{
+		const Slot &slot = mSlots[i];
+		if (slot.hash==0)
+		{
+			return false;
+		}
+		if (slot.hash!=hash || !matches(path, slot))
+		{
+			continue;
+		}
+
+		// don't trust the table with anything outside the file:
+		if (slot.dataOffset > (unsigned int)mSize || slot.storedSize > (unsigned int)mSize - slot.dataOffset ||
+			slot.size > 0x7fffffff)
+		{
+			return false;
+		}
+
+		file.data = mData + slot.dataOffset;
+		file.storedSize = (int)slot.storedSize;
+		file.size = (int)slot.size;
+		file.compressed = (slot.flags & SLOT_COMPRESSED)!=0;
+		return true;
+	}
+	return false;
+}
+
+bool ResourcePack::matches(const char *path, const Slot &slot)
+{
+	if (slot.nameOffset >= mHeader->namesSize)
+	{
+		return false;
+	}
+
+	// (the names are zero terminated, attach() made sure of the last one):
+	const char *name = mNames + slot.nameOffset;
+	path = skipPathPrefix(path);
+	while (*path!=0 && normalizePathChar(*path)==*name)
+	{
+		path++;
+		name++;
+	}
+	return *path==0 && *name==0;
+}
+
+char ResourcePack::normalizePathChar(char c)
+{
+	if (c=='\\') return '/';
+	if (c>='A' && c<='Z') return c - 'A' + 'a';
+	return c;
+}
+
+const char *ResourcePack::skipPathPrefix(const char *path)
+{
+	while ((path[0]=='.' && (path[1]=='/' || path[1]=='\\')))
+	{
+		path += 2;
+	}
+	return path;
+}
+
+unsigned long long ResourcePack::hashPath(const char *path)
+{
+	// 64 bit fnv-1a of the normalized path:
+	unsigned long long hash = 0xcbf29ce484222325ULL;
+	for (const char *c = skipPathPrefix(path) ; *c!=0 ; c++)
+	{
+		hash ^= (unsigned char)normalizePathChar(*c);
+		hash *= 0x100000001b3ULL;
+	}
+
+	// (0 marks empty slots):
+	return hash==0 ? 1 : hash;
+}
+
+bool ResourcePack::decompress(const File &file, unsigned char *dest)
+{
+	if (!file.compressed)
+	{
+		if (file.storedSize!=file.size)
+		{
+			return false;
+		}
+		memcpy(dest, file.data, file.size);
+		return true;
+	}
+	return decompress(file.data, file.storedSize, dest, file.size);
+}
+
+int ResourcePack::getMaxCompressedSize(int size)
+{
+	// all literals, plus the length bytes:
+	return size + size/255 + 16;
+}
+
+static inline unsigned int read32(const unsigned char *p)
+{
+	unsigned int v;
+	memcpy(&v, p, 4);
+	return v;
+}
+
+// writes a length that didn't fit in its 4 bits of the token:
+static bool writeLength(unsigned char *dest, int destCapacity, int &op, int length)
+{
+	for ( ; length>=255 ; length-=255)
+	{
+		if (op>=destCapacity) return false;
+		dest[op++] = 255;
+	}
+	if (op>=destCapacity) return false;
+	dest[op++] = (unsigned char)length;
+	return true;
+}
+
+// writes one sequence (a match length of 0 ends the data):
+static bool writeSequence(unsigned char *dest, int destCapacity, int &op,
+						  const unsigned char *literals, int literalCount, int offset, int matchLength)
+{
+	if (op>=destCapacity) return false;
+	int litToken = literalCount<15 ? literalCount : 15;
+	int matchToken = 0;
+	if (matchLength>0)
+	{
+		matchToken = matchLength-LZ_MIN_MATCH<15 ? matchLength-LZ_MIN_MATCH : 15;
+	}
+	dest[op++] = (unsigned char)((litToken<<4) | matchToken);
+
+	if (litToken==15 && !writeLength(dest, destCapacity, op, literalCount-15)) return false;
+	if (literalCount > destCapacity-op) return false;
+	memcpy(dest+op, literals, literalCount);
+	op += literalCount;
+
+	if (matchLength>0)
+	{
+		if (destCapacity-op < 2) return false;
+		dest[op++] = (unsigned char)(offset & 0xff);
+		dest[op++] = (unsigned char)(offset >> 8);
+		if (matchToken==15 && !writeLength(dest, destCapacity, op, matchLength-LZ_MIN_MATCH-15)) return false;
+	}
+	return true;
+}
+
+int ResourcePack::compress(const unsigned char *src, int size, unsigned char *dest, int destCapacity)
+{
+	// the last position every 4 byte sequence was seen at:
+	std::vector<int> table(1<<LZ_HASH_BITS, -1);
+
+	int ip = 0;
+	int anchor = 0;
+	int op = 0;
+	while (ip + LZ_MIN_MATCH <= size)
+	{
+		unsigned int seq = read32(src+ip);
+		unsigned int h = (seq * 2654435761u) >> (32-LZ_HASH_BITS);
+		int ref = table[h];
+		table[h] = ip;
+		if (ref<0 || ip-ref > LZ_MAX_OFFSET || read32(src+ref)!=seq)
+		{
+			ip++;
+			continue;
+		}
+
+		// take the whole match:
+		int length = LZ_MIN_MATCH;
+		while (ip+length<size && src[ref+length]==src[ip+length])
+		{
+			length++;
+		}
+
+		if (!writeSequence(dest, destCapacity, op, src+anchor, ip-anchor, ip-ref, length))
+		{
+			return 0;
+		}
+		ip += length;
+		anchor = ip;
+	}
+
+	// the rest goes out as literals:
+	if (!writeSequence(dest, destCapacity, op, src+anchor, size-anchor, 0, 0))
+	{
+		return 0;
+	}
+	return op;
+}
+
+// reads the extra bytes of a length:
+static bool readLength(const unsigned char *src, int srcSize, int &ip, int limit, int &length)
+{
+	unsigned char b;
+	do
+	{
+		if (ip>=srcSize) return false;
+		b = src[ip++];
+		length += b;
+		if (length>limit) return false;
+	} while (b==255);
+	return true;
+}
+
+bool ResourcePack::decompress(const unsigned char *src, int srcSize, unsigned char *dest, int destSize)
+{
+	int ip = 0;
+	int op = 0;
+	while (ip<srcSize)
+	{
+		int token = src[ip++];
+
+		// literals:
+		int literalCount = token >> 4;
+		if (literalCount==15 && !readLength(src, srcSize, ip, destSize, literalCount)) return false;
+		if (literalCount > srcSize-ip || literalCount > destSize-op) return false;
+		memcpy(dest+op, src+ip, literalCount);
+		ip += literalCount;
+		op += literalCount;
+
+		// the last sequence has no match:
+		if (ip==srcSize)
+		{
+			break;
+		}
+
+		// match:
+		if (srcSize-ip < 2) return false;
+		int offset = src[ip] | (src[ip+1]<<8);
+		ip += 2;
+		int length = token & 15;
+		if (length==15 && !readLength(src, srcSize, ip, destSize, length)) return false;
+		length += LZ_MIN_MATCH;
+		if (offset==0 || offset>op || length > destSize-op) return false;
+
+		// (byte by byte, a match can overlap what it copies):
+		const unsigned char *from = dest + op - offset;
+		unsigned char *to = dest + op;
+		for (int i=0 ; i<length ; i++)
+		{
+			to[i] = from[i];
+		}
+		op += length;
+	}
+	return op==destSize;
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+#include "BoyLib/CrtDbgInc.h"
+
+#include <stddef.h>
+
+// pack file identification:
+#define RESOURCE_PACK_MAGIC "BPAK"
+#define RESOURCE_PACK_VERSION 1
+
+// every file's data starts on a multiple of this:
+#define RESOURCE_PACK_ALIGNMENT 16
+
+namespace Boy
+{
+	/*
+	 * a read only view of a resource pack: a single file that holds
+	 * many resource files, found through a hash table of their paths
+	 * (so looking for a file that isn't there costs no disk access).
+	 * the pack's data is used in place, typically straight out of a
+	 * memory mapped file. packs are made by ResourcePackBuilder.
+	 *
+	 * layout (little endian):
+	 *   Header
+	 *   Slot[slotCount] (hash table, empty slots have a hash of 0)
+	 *   path names (zero terminated, normalized, see hashPath())
+	 *   file data (every file starts on a RESOURCE_PACK_ALIGNMENT boundary)
+	 */
+	class ResourcePack
+	{
+	public:
+
+		struct Header
+		{
+			char magic[4]; // "BPAK"
+			unsigned int version;
+			unsigned int slotCount; // a power of 2
+			unsigned int fileCount;
+			unsigned int slotsOffset;
+			unsigned int namesOffset;
+			unsigned int namesSize;
+			unsigned int dataOffset;
+		};
+
+		struct Slot
+		{
+			unsigned long long hash;
+			unsigned int nameOffset; // relative to namesOffset
+			unsigned int dataOffset; // relative to the start of the pack
+			unsigned int storedSize; // size in the pack
+			unsigned int size; // size once decompressed
+			unsigned int flags;
+			unsigned int reserved;
+		};
+
+		enum SlotFlags
+		{
+			SLOT_COMPRESSED = 0x0001,
+		};
+
+		// a file in the pack:
+		struct File
+		{
+			const unsigned char *data;
+			int storedSize;
+			int size;
+			bool compressed;
+		};
+
+		ResourcePack();
+		virtual ~ResourcePack();
+
+		// uses the given pack data (which has to stay around), returns
+		// false if it isn't a valid pack:
+		bool attach(const void *data, int sizeBytes);
+
+		// looks up a file (paths are compared case insensitively with
+		// either kind of slash, so "./Res/a.png" finds "res/a.png"):
+		bool find(const char *path, File &file);
+
+		inline int getFileCount() { return mHeader==NULL ? 0 : (int)mHeader->fileCount; }
+
+		// decompresses a file into a buffer of file.size bytes:
+		static bool decompress(const File &file, unsigned char *dest);
+
+		// the hash used for the table (never 0) and the path
+		// normalization it's based on:
+		static unsigned long long hashPath(const char *path);
+		static char normalizePathChar(char c);
+		static const char *skipPathPrefix(const char *path);
+
+		// lz compression for pack files. compress() returns the compressed
+		// size or 0 if it doesn't fit in destCapacity (getMaxCompressedSize()
+		// bytes are always enough):
+		static int getMaxCompressedSize(int size);
+		static int compress(const unsigned char *src, int size, unsigned char *dest, int destCapacity);
+		static bool decompress(const unsigned char *src, int srcSize, unsigned char *dest, int destSize);
+
+	private:
+
+		bool matches(const char *path, const Slot &slot);
+
+	private:
+
+		const unsigned char *mData;
+		int mSize;
+		const Header *mHeader;
+		const Slot *mSlots;
+		const char *mNames;
+	};
+}
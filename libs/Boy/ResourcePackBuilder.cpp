@@ -0,0 +1,255 @@
+#include "ResourcePackBuilder.h"
+
+#include <algorithm>
+#include "ResourcePack.h"
+#include <stdio.h>
+#include <string.h>
+
+using namespace Boy;
+
+#include "BoyLib/CrtDbgNew.h"
+
+ResourcePackBuilder::ResourcePackBuilder()
+{
+	mLocalizedExtensions.push_back("png");
+	mLocalizedExtensions.push_back("ogg");
+	mCompression = false;
+}
+
+ResourcePackBuilder::~ResourcePackBuilder()
+{
+}
+
+void ResourcePackBuilder::addFile(const std::string &name, const std::string &diskPath)
+{
+	Source s;
+	s.name = normalize(name);
+	s.diskPath = diskPath;
+	mSources[s.name] = s;
+}
+
+void ResourcePackBuilder::setLanguages(const std::string &language1, const std::string &language2)
+{
+	mLanguage1 = normalize(language1);
+	mLanguage2 = normalize(language2);
+}
+
+void ResourcePackBuilder::setLocalizedExtensions(const std::vector<std::string> &extensions)
+{
+	mLocalizedExtensions.clear();
+	for (size_t i=0 ; i<extensions.size() ; i++)
+	{
+		mLocalizedExtensions.push_back(normalize(extensions[i]));
+	}
+}
+
+std::string ResourcePackBuilder::normalize(const std::string &name)
+{
+	std::string result;
+	for (const char *c = ResourcePack::skipPathPrefix(name.c_str()) ; *c!=0 ; c++)
+	{
+		result += ResourcePack::normalizePathChar(*c);
+	}
+	return result;
+}
+
+bool ResourcePackBuilder::splitVariant(const std::string &name, std::string &baseName, std::string &language)
+{
+	// "name.xx.ext" with a localized extension:
+	size_t extDot = name.rfind('.');
+	if (extDot==std::string::npos || extDot==0)
+	{
+		return false;
+	}
+	std::string ext = name.substr(extDot+1);
+	if (std::find(mLocalizedExtensions.begin(), mLocalizedExtensions.end(), ext)==mLocalizedExtensions.end())
+	{
+		return false;
+	}
+	size_t langDot = name.rfind('.', extDot-1);
+	if (langDot==std::string::npos || langDot+1==extDot)
+	{
+		return false;
+	}
+	language = name.substr(langDot+1, extDot-langDot-1);
+	if (language.find('/')!=std::string::npos)
+	{
+		return false;
+	}
+
+	// (it's only a variant if there's something to be a variant of):
+	baseName = name.substr(0, langDot) + name.substr(extDot);
+	return mSources.find(baseName)!=mSources.end();
+}
+
+bool ResourcePackBuilder::readFile(const std::string &path, std::vector<unsigned char> &data)
+{
+	FILE *f = fopen(path.c_str(), "rb");
+	if (f==NULL)
+	{
+		return false;
+	}
+	fseek(f, 0, SEEK_END);
+	long size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	data.resize(size);
+	bool ok = size==0 || fread(&data[0], 1, size, f)==(size_t)size;
+	fclose(f);
+	return ok;
+}
+
+static unsigned int alignUp(unsigned int x)
+{
+	return (x + RESOURCE_PACK_ALIGNMENT-1) & ~(unsigned int)(RESOURCE_PACK_ALIGNMENT-1);
+}
+
+bool ResourcePackBuilder::build(const char *packPath, Stats &stats)
+{
+	memset(&stats, 0, sizeof(Stats));
+
+	// work out what goes in and where each file's data comes from:
+	std::map<std::string,std::string> entries; // name -> disk path
+	std::map<std::string,std::string> variants; // base name -> best variant's disk path
+	std::map<std::string,int> variantRank;
+	for (std::map<std::string,Source>::iterator i=mSources.begin() ; i!=mSources.end() ; i++)
+	{
+		std::string baseName, language;
+		if (!splitVariant(i->first, baseName, language))
+		{
+			entries[i->first] = i->second.diskPath;
+			continue;
+		}
+
+		int rank = language==mLanguage1 ? 1 : (language==mLanguage2 && mLanguage2.size()>0 ? 2 : 0);
+		if (rank==0)
+		{
+			stats.variantsDropped++;
+			continue;
+		}
+		entries[i->first] = i->second.diskPath;
+		if (variantRank.find(baseName)==variantRank.end() || rank<variantRank[baseName])
+		{
+			variantRank[baseName] = rank;
+			variants[baseName] = i->second.diskPath;
+		}
+	}
+	for (std::map<std::string,std::string>::iterator i=variants.begin() ; i!=variants.end() ; i++)
+	{
+		entries[i->first] = i->second;
+		stats.variantsResolved++;
+	}
+
+	// the hash table is at most half full:
+	unsigned int slotCount = 1;
+	while (slotCount < entries.size()*2)
+	{
+		slotCount *= 2;
+	}
+	std::vector<ResourcePack::Slot> slots(slotCount);
+	memset(&slots[0], 0, slotCount * sizeof(ResourcePack::Slot));
+
+	// names:
+	std::string names;
+	std::map<std::string,unsigned int> nameOffsets;
+	for (std::map<std::string,std::string>::iterator i=entries.begin() ; i!=entries.end() ; i++)
+	{
+		nameOffsets[i->first] = (unsigned int)names.size();
+		names.append(i->first);
+		names += '\0';
+	}
+	if (names.empty())
+	{
+		names += '\0';
+	}
+
+	ResourcePack::Header header;
+	memcpy(header.magic, RESOURCE_PACK_MAGIC, 4);
+	header.version = RESOURCE_PACK_VERSION;
+	header.slotCount = slotCount;
+	header.fileCount = (unsigned int)entries.size();
+	header.slotsOffset = sizeof(ResourcePack::Header);
+	header.namesOffset = header.slotsOffset + slotCount * sizeof(ResourcePack::Slot);
+	header.namesSize = (unsigned int)names.size();
+	header.dataOffset = alignUp(header.namesOffset + header.namesSize);
+
+	// file data (files that share a source share their data):
+	std::vector<unsigned char> data;
+	std::map<std::string,ResourcePack::Slot> blobs; // disk path -> where its data went
+	for (std::map<std::string,std::string>::iterator i=entries.begin() ; i!=entries.end() ; i++)
+	{
+		ResourcePack::Slot slot;
+		std::map<std::string,ResourcePack::Slot>::iterator b = blobs.find(i->second);
+		if (b!=blobs.end())
+		{
+			slot = b->second;
+		}
+		else
+		{
+			std::vector<unsigned char> file;
+			if (!readFile(i->second, file))
+			{
+				printf("ERROR: could not read '%s'\n", i->second.c_str());
+				return false;
+			}
+			stats.sourceBytes += file.size();
+
+			memset(&slot, 0, sizeof(slot));
+			slot.size = (unsigned int)file.size();
+
+			// only keep the compressed version if it's worth it:
+			std::vector<unsigned char> packed;
+			if (mCompression && !file.empty())
+			{
+				packed.resize(ResourcePack::getMaxCompressedSize((int)file.size()));
+				int packedSize = ResourcePack::compress(&file[0], (int)file.size(), &packed[0], (int)packed.size());
+				if (packedSize>0 && packedSize <= (int)(file.size() - file.size()/8))
+				{
+					packed.resize(packedSize);
+					file.swap(packed);
+					slot.flags |= ResourcePack::SLOT_COMPRESSED;
+					stats.compressed++;
+				}
+			}
+
+			slot.dataOffset = header.dataOffset + (unsigned int)data.size();
+			slot.storedSize = (unsigned int)file.size();
+			data.insert(data.end(), file.begin(), file.end());
+			data.resize(alignUp((unsigned int)data.size()), 0);
+			blobs[i->second] = slot;
+		}
+
+		// into the table:
+		slot.hash = ResourcePack::hashPath(i->first.c_str());
+		slot.nameOffset = nameOffsets[i->first];
+		unsigned int s = (unsigned int)slot.hash & (slotCount-1);
+		while (slots[s].hash!=0)
+		{
+			s = (s+1) & (slotCount-1);
+		}
+		slots[s] = slot;
+	}
+
+	// write it all:
+	FILE *f = fopen(packPath, "wb");
+	if (f==NULL)
+	{
+		printf("ERROR: could not create '%s'\n", packPath);
+		return false;
+	}
+	std::vector<unsigned char> padding(header.dataOffset - header.namesOffset - header.namesSize, 0);
+	bool ok = fwrite(&header, sizeof(header), 1, f)==1 &&
+		fwrite(&slots[0], sizeof(ResourcePack::Slot), slotCount, f)==slotCount &&
+		fwrite(names.data(), 1, names.size(), f)==names.size() &&
+		(padding.empty() || fwrite(&padding[0], 1, padding.size(), f)==padding.size()) &&
+		(data.empty() || fwrite(&data[0], 1, data.size(), f)==data.size());
+	fclose(f);
+	if (!ok)
+	{
+		printf("ERROR: could not write '%s'\n", packPath);
+		return false;
+	}
+
+	stats.files = (int)entries.size();
+	stats.packBytes = (long long)header.dataOffset + data.size();
+	return true;
+}
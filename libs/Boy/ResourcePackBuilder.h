@@ -0,0 +1,71 @@
+#pragma once
+
+#include "BoyLib/CrtDbgInc.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace Boy
+{
+	/*
+	 * writes a ResourcePack from a set of files on disk.
+	 *
+	 * language variants are picked at build time: for the extensions
+	 * the resource loaders look up by language (png and ogg unless
+	 * told otherwise), "name.xx.ext" is a variant of "name.ext" when
+	 * both are added. the pack's "name.ext" gets the best variant for
+	 * the pack's languages (which keep their own names too, sharing
+	 * the data), and variants for any other language are left out.
+	 */
+	class ResourcePackBuilder
+	{
+	public:
+
+		struct Stats
+		{
+			int files; // files in the pack
+			int variantsResolved; // "name.ext" entries that got a variant's data
+			int variantsDropped; // variants for other languages
+			int compressed; // files stored compressed
+			long long sourceBytes; // size of everything that went in
+			long long packBytes; // size of the pack
+		};
+
+		ResourcePackBuilder();
+		virtual ~ResourcePackBuilder();
+
+		// adds a file (name is the path the game asks for):
+		void addFile(const std::string &name, const std::string &diskPath);
+
+		// the pack's languages (in order of preference):
+		void setLanguages(const std::string &language1, const std::string &language2);
+		void setLocalizedExtensions(const std::vector<std::string> &extensions);
+
+		// stores files compressed when that saves enough:
+		inline void setCompression(bool enabled) { mCompression = enabled; }
+
+		// writes the pack, returns false (and logs why) if it can't:
+		bool build(const char *packPath, Stats &stats);
+
+	private:
+
+		struct Source
+		{
+			std::string name; // normalized
+			std::string diskPath;
+		};
+
+		static std::string normalize(const std::string &name);
+		bool splitVariant(const std::string &name, std::string &baseName, std::string &language);
+		bool readFile(const std::string &path, std::vector<unsigned char> &data);
+
+	private:
+
+		std::map<std::string,Source> mSources;
+		std::string mLanguage1;
+		std::string mLanguage2;
+		std::vector<std::string> mLocalizedExtensions;
+		bool mCompression;
+	};
+}
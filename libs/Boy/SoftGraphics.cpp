@@ -0,0 +1,542 @@
+#include "SoftGraphics.h"
+
+#include <assert.h>
+#include "BoyLib/BoyUtil.h"
+#include <chrono>
+#include "Environment.h"
+#include <math.h>
+#include "Png.h"
+#include "QuadMesh.h"
+#include "SoftImage.h"
+#include "SoftTriStrip.h"
+#include "Storage.h"
+#include <string.h>
+#include "WorkerPool.h"
+
+using namespace Boy;
+
+#include "BoyLib/CrtDbgNew.h"
+
+SoftGraphics::SoftGraphics(int width, int height) : HeadlessGraphics(width, height)
+{
+	mColorBuffer = new unsigned int[width * height];
+	for (int i=0 ; i<width*height ; i++)
+	{
+		mColorBuffer[i] = 0xff000000;
+	}
+
+	mTileCountX = (width + TILE_SIZE - 1) / TILE_SIZE;
+	mTileCountY = (height + TILE_SIZE - 1) / TILE_SIZE;
+	mTileCommands.resize(mTileCountX * mTileCountY);
+
+	mFrameClearColor = 0xff000000;
+	mFrameClearZ = 1;
+
+	mPrimitiveBucketCount = 0;
+
+	mPool = NULL;
+	mSpanPath = SoftSpanKernels::getBestPath();
+	setThreadCount(0);
+
+	mFramePixelCount = 0;
+	mTotalPixelCount = 0;
+}
+
+SoftGraphics::~SoftGraphics()
+{
+	delete mPool;
+	for (size_t i=0 ; i<mWorkers.size() ; i++)
+	{
+		delete mWorkers[i];
+	}
+	for (size_t i=0 ; i<mPrimitiveBuckets.size() ; i++)
+	{
+		delete mPrimitiveBuckets[i];
+	}
+	delete[] mColorBuffer;
+}
+
+void SoftGraphics::setSpanPath(SoftSpanKernels::Path path)
+{
+	if (!SoftSpanKernels::isSupported(path))
+	{
+		envDebugLog("WARNING: %s spans aren't supported on this cpu\n", SoftSpanKernels::getPathName(path));
+		path = SoftSpanKernels::PATH_SCALAR;
+	}
+	mSpanPath = path;
+	for (size_t i=0 ; i<mWorkers.size() ; i++)
+	{
+		mWorkers[i]->rasterizer.setKernel(SoftSpanKernels::getKernel(path));
+	}
+}
+
+void SoftGraphics::setThreadCount(int threadCount)
+{
+	delete mPool;
+	mPool = new WorkerPool(threadCount);
+
+	// one tile worker per thread:
+	while ((int)mWorkers.size() < mPool->getThreadCount())
+	{
+		TileWorker *worker = new TileWorker();
+		worker->rasterizer.setKernel(SoftSpanKernels::getKernel(mSpanPath));
+		mWorkers.push_back(worker);
+	}
+}
+
+int SoftGraphics::getThreadCount()
+{
+	return mPool->getThreadCount();
+}
+
+void SoftGraphics::initRenderState(SoftRenderState &state, SoftImage *img)
+{
+	if (img!=NULL)
+	{
+		state.texels = img->getPixels();
+		state.texWidth = img->getWidth();
+		state.texHeight = img->getHeight();
+	}
+	else
+	{
+		state.texels = NULL;
+		state.texWidth = 0;
+		state.texHeight = 0;
+	}
+
+	state.additive = mDrawMode==DRAWMODE_ADDITIVE;
+	state.alphaFunc = mAlphaTestEnabled ? mAlphaFunction : CMP_ALWAYS;
+	state.alphaRef = mAlphaReferenceValue;
+	state.zTest = mZTestEnabled;
+	state.zWrite = mZWriteEnabled;
+	state.zFunc = mZFunction;
+	state.clipMinX = mClipX;
+	state.clipMinY = mClipY;
+	state.clipMaxX = mClipX + mClipWidth;
+	state.clipMaxY = mClipY + mClipHeight;
+}
+
+void SoftGraphics::addCommand(Command::Type type, const SoftRenderState &state, const SoftVertex *verts, int count)
+{
+	// screen bounds (the max values are exclusive):
+	float minX = verts[0].x;
+	float minY = verts[0].y;
+	float maxX = minX;
+	float maxY = minY;
+	for (int i=1 ; i<count ; i++)
+	{
+		minX = verts[i].x < minX ? verts[i].x : minX;
+		minY = verts[i].y < minY ? verts[i].y : minY;
+		maxX = verts[i].x > maxX ? verts[i].x : maxX;
+		maxY = verts[i].y > maxY ? verts[i].y : maxY;
+	}
+	int x0 = state.clipMinX > 0 ? state.clipMinX : 0;
+	int y0 = state.clipMinY > 0 ? state.clipMinY : 0;
+	int x1 = state.clipMaxX < mWidth ? state.clipMaxX : mWidth;
+	int y1 = state.clipMaxY < mHeight ? state.clipMaxY : mHeight;
+	if (minX > x0) x0 = (int)floor(minX);
+	if (minY > y0) y0 = (int)floor(minY);
+	if (maxX + 1 < x1) x1 = (int)floor(maxX) + 1;
+	if (maxY + 1 < y1) y1 = (int)floor(maxY) + 1;
+	if (x0 >= x1 || y0 >= y1)
+	{
+		// nothing on screen:
+		return;
+	}
+
+	// record it:
+	Command cmd;
+	cmd.type = type;
+	cmd.state = state;
+	cmd.firstVert = (int)mVerts.size();
+	cmd.vertCount = count;
+	int index = (int)mCommands.size();
+	mCommands.push_back(cmd);
+	mVerts.insert(mVerts.end(), verts, verts + count);
+
+	// add it to every tile it touches (in submission order):
+	int tx1 = (x1 - 1) / TILE_SIZE;
+	int ty1 = (y1 - 1) / TILE_SIZE;
+	for (int ty=y0/TILE_SIZE ; ty<=ty1 ; ty++)
+	{
+		for (int tx=x0/TILE_SIZE ; tx<=tx1 ; tx++)
+		{
+			mTileCommands[ty * mTileCountX + tx].push_back(index);
+		}
+	}
+}
+
+void SoftGraphics::drawImage(Image *img)
+{
+	drawImage(img, 0, 0, img->getWidth(), img->getHeight());
+}
+
+void SoftGraphics::drawImage(Image *img, int subrectX, int subrectY, int subrectW, int subrectH)
+{
+	assert(img!=NULL);
+	mDrawCallCount++;
+
+	SoftImage *image = dynamic_cast<SoftImage*>(img);
+	if (image->getPixels()==NULL)
+	{
+		envDebugLog("WARNING: trying to draw image without pixels (%s)\n",image->getPath().c_str());
+		return;
+	}
+
+	float maxX = (float)subrectW / 2.0f;
+	float maxY = (float)subrectH / 2.0f;
+	float imgW = (float)image->getWidth();
+	float imgH = (float)image->getHeight();
+	float minU = subrectX / imgW;
+	float minV = subrectY / imgH;
+	float maxU = minU + subrectW / imgW;
+	float maxV = minV + subrectH / imgH;
+
+	float xs[4], ys[4];
+	mTransformStack.top().transformRect(-maxX, -maxY, maxX, maxY, xs, ys);
+
+	unsigned int color = mColorizationEnabled ? (unsigned int)mColor : 0xffffffff;
+	float depth = 1 - mZ;
+	SoftVertex verts[] = 
+	{
+		{xs[0], ys[0], depth, color, minU, minV}, // top left
+		{xs[1], ys[1], depth, color, maxU, minV}, // top right
+		{xs[2], ys[2], depth, color, minU, maxV}, // bottom left
+		{xs[3], ys[3], depth, color, maxU, maxV}  // bottom right
+	};
+
+	SoftRenderState state;
+	initRenderState(state, image);
+	addCommand(Command::TRI_STRIP, state, verts, 4);
+}
+
+void SoftGraphics::drawQuadMesh(Image *img, const QuadMesh *mesh)
+{
+	assert(img!=NULL && mesh!=NULL);
+	mDrawCallCount++;
+
+	SoftImage *image = dynamic_cast<SoftImage*>(img);
+	if (image->getPixels()==NULL)
+	{
+		envDebugLog("WARNING: trying to draw image without pixels (%s)\n",image->getPath().c_str());
+		return;
+	}
+
+	SoftRenderState state;
+	initRenderState(state, image);
+
+	float imgW = (float)image->getWidth();
+	float imgH = (float)image->getHeight();
+	unsigned int baseColor = mColorizationEnabled ? (unsigned int)mColor : 0xffffffff;
+	float depth = 1 - mZ;
+	const Transform2D &xform = mTransformStack.top();
+
+	// every quad is its own command so that it only
+	// lands in the tiles it actually covers:
+	int count = mesh->getQuadCount();
+	const QuadMesh::Quad *quads = mesh->getQuads();
+	for (int i=0 ; i<count ; i++)
+	{
+		const QuadMesh::Quad &q = quads[i];
+		float minU = q.subrectX / imgW;
+		float minV = q.subrectY / imgH;
+		float maxU = minU + q.subrectW / imgW;
+		float maxV = minV + q.subrectH / imgH;
+
+		float xs[4], ys[4];
+		xform.transformRect(q.minX, q.minY, q.maxX, q.maxY, xs, ys);
+
+		unsigned int color = (unsigned int)QuadMesh::modulate(baseColor, q.color);
+		SoftVertex verts[] = 
+		{
+			{xs[0], ys[0], depth, color, minU, minV}, // top left
+			{xs[1], ys[1], depth, color, maxU, minV}, // top right
+			{xs[2], ys[2], depth, color, minU, maxV}, // bottom left
+			{xs[3], ys[3], depth, color, maxU, maxV}  // bottom right
+		};
+		addCommand(Command::TRI_STRIP, state, verts, 4);
+	}
+}
+
+void SoftGraphics::drawLine(int x0, int y0, int x1, int y1)
+{
+	mDrawCallCount++;
+	addLine((float)x0, (float)y0, (float)x1, (float)y1);
+}
+
+void SoftGraphics::fillRect(int x0, int y0, int w, int h)
+{
+	mDrawCallCount++;
+
+	// rects are drawn in screen space:
+	float minX = (float)x0;
+	float minY = (float)y0;
+	float maxX = minX + w;
+	float maxY = minY + h;
+	unsigned int color = (unsigned int)mColor;
+	float depth = 1 - mZ;
+	SoftVertex verts[] = 
+	{
+		{minX, minY, depth, color, 0, 0}, // top left
+		{maxX, minY, depth, color, 0, 0}, // top right
+		{minX, maxY, depth, color, 0, 0}, // bottom left
+		{maxX, maxY, depth, color, 0, 0}  // bottom right
+	};
+
+	// (in order with the images, like WinGraphics):
+	SoftRenderState state;
+	initRenderState(state, NULL);
+	addCommand(Command::TRI_STRIP, state, verts, 4);
+}
+
+void SoftGraphics::drawRect(int x0, int y0, int w, int h)
+{
+	mDrawCallCount++;
+
+	float minX = (float)x0;
+	float minY = (float)y0;
+	float maxX = minX + w;
+	float maxY = minY + h;
+	addLine(minX, minY, maxX, minY);
+	addLine(maxX, minY, maxX, maxY);
+	addLine(maxX, maxY, minX, maxY);
+	addLine(minX, maxY, minX, minY);
+}
+
+void SoftGraphics::drawCircle(int x, int y, int radius)
+{
+	mDrawCallCount++;
+
+	// walk around the circle (same points as WinPrimitiveBatch):
+	int segments = getCircleSegmentCount((float)radius);
+	float step = 2 * GPI / segments;
+	float cx = (float)x;
+	float cy = (float)y;
+	float r = (float)radius;
+	float px = cx + r;
+	float py = cy;
+	for (int i=1 ; i<=segments ; i++)
+	{
+		float angle = i==segments ? 0 : i * step;
+		float nx = cx + r * cosf(angle);
+		float ny = cy + r * sinf(angle);
+		addLine(px, py, nx, ny);
+		px = nx;
+		py = ny;
+	}
+}
+
+void SoftGraphics::addLine(float x0, float y0, float x1, float y1)
+{
+	// lines are drawn in screen space at z=0:
+	unsigned int color = (unsigned int)mColor;
+	SoftVertex verts[] = 
+	{
+		{x0, y0, 1, color, 0, 0},
+		{x1, y1, 1, color, 0, 0}
+	};
+
+	std::vector<SoftVertex> &lineVerts = getPrimitiveBucket()->lineVerts;
+	lineVerts.insert(lineVerts.end(), verts, verts + 2);
+}
+
+SoftGraphics::PrimitiveBucket *SoftGraphics::getPrimitiveBucket()
+{
+	SoftRenderState state;
+	initRenderState(state, NULL);
+
+	// the buckets are few, just look for one with the same state:
+	for (int i=0 ; i<mPrimitiveBucketCount ; i++)
+	{
+		const SoftRenderState &s = mPrimitiveBuckets[i]->state;
+		if (s.additive==state.additive &&
+			s.alphaFunc==state.alphaFunc &&
+			s.alphaRef==state.alphaRef &&
+			s.zTest==state.zTest &&
+			s.zWrite==state.zWrite &&
+			s.zFunc==state.zFunc &&
+			s.clipMinX==state.clipMinX &&
+			s.clipMinY==state.clipMinY &&
+			s.clipMaxX==state.clipMaxX &&
+			s.clipMaxY==state.clipMaxY)
+		{
+			return mPrimitiveBuckets[i];
+		}
+	}
+
+	// start a new one:
+	if (mPrimitiveBucketCount==(int)mPrimitiveBuckets.size())
+	{
+		mPrimitiveBuckets.push_back(new PrimitiveBucket());
+	}
+	PrimitiveBucket *bucket = mPrimitiveBuckets[mPrimitiveBucketCount++];
+	bucket->state = state;
+	return bucket;
+}
+
+void SoftGraphics::addPrimitives()
+{
+	// one bucket at a time:
+	for (int i=0 ; i<mPrimitiveBucketCount ; i++)
+	{
+		PrimitiveBucket *bucket = mPrimitiveBuckets[i];
+		for (size_t j=0 ; j<bucket->lineVerts.size() ; j+=2)
+		{
+			addCommand(Command::LINE, bucket->state, &bucket->lineVerts[j], 2);
+		}
+		bucket->lineVerts.clear();
+	}
+	mPrimitiveBucketCount = 0;
+}
+
+void SoftGraphics::drawTriStrip(TriStrip *triStrip)
+{
+	assert(triStrip!=NULL);
+	mDrawCallCount++;
+
+	// strips are untextured and drawn in screen space, only
+	// their z has to be turned into a depth value:
+	SoftTriStrip *strip = dynamic_cast<SoftTriStrip*>(triStrip);
+	int count = strip->getVertexCount();
+	if (count < 3)
+	{
+		return;
+	}
+	mStripVerts.assign(strip->getVerts(), strip->getVerts() + count);
+	for (int i=0 ; i<count ; i++)
+	{
+		mStripVerts[i].z = 1 - mStripVerts[i].z;
+	}
+
+	SoftRenderState state;
+	initRenderState(state, NULL);
+	addCommand(Command::TRI_STRIP, state, &mStripVerts[0], count);
+}
+
+void SoftGraphics::beginFrame()
+{
+	HeadlessGraphics::beginFrame();
+
+	mCommands.clear();
+	mVerts.clear();
+	for (int i=0 ; i<mPrimitiveBucketCount ; i++)
+	{
+		mPrimitiveBuckets[i]->lineVerts.clear();
+	}
+	mPrimitiveBucketCount = 0;
+	for (size_t i=0 ; i<mTileCommands.size() ; i++)
+	{
+		mTileCommands[i].clear();
+	}
+
+	// the buffers get cleared to what's set when the frame starts
+	// (the frame buffer has no alpha):
+	mFrameClearColor = 0xff000000 | (unsigned int)mClearColor;
+	mFrameClearZ = mClearZ;
+}
+
+void SoftGraphics::endFrame()
+{
+	HeadlessGraphics::endFrame();
+
+	// the debug primitives go on top of everything else:
+	addPrimitives();
+
+	renderFrame();
+	mTotalPixelCount += mFramePixelCount;
+}
+
+void SoftGraphics::renderFrame()
+{
+	for (size_t i=0 ; i<mWorkers.size() ; i++)
+	{
+		mWorkers[i]->rasterizer.resetPixelCount();
+	}
+
+	mPool->run(mTileCountX * mTileCountY, renderTileProc, this);
+
+	mFramePixelCount = 0;
+	for (size_t i=0 ; i<mWorkers.size() ; i++)
+	{
+		mFramePixelCount += mWorkers[i]->rasterizer.getPixelCount();
+	}
+}
+
+void SoftGraphics::renderTileProc(void *context, int tile, int worker)
+{
+	SoftGraphics *graphics = (SoftGraphics*)context;
+	graphics->renderTile(tile, graphics->mWorkers[worker]);
+}
+
+void SoftGraphics::renderTile(int tile, TileWorker *worker)
+{
+	int x = (tile % mTileCountX) * TILE_SIZE;
+	int y = (tile / mTileCountX) * TILE_SIZE;
+	int w = mWidth - x < TILE_SIZE ? mWidth - x : TILE_SIZE;
+	int h = mHeight - y < TILE_SIZE ? mHeight - y : TILE_SIZE;
+
+	SoftRasterizer &rasterizer = worker->rasterizer;
+	rasterizer.setTarget(worker->color, worker->depth, TILE_SIZE, x, y, w, h);
+	rasterizer.clear(mFrameClearColor, mFrameClearZ);
+
+	// draw everything that touches the tile:
+	const std::vector<int> &commands = mTileCommands[tile];
+	for (size_t i=0 ; i<commands.size() ; i++)
+	{
+		const Command &cmd = mCommands[commands[i]];
+		const SoftVertex *verts = &mVerts[cmd.firstVert];
+		if (cmd.type == Command::LINE)
+		{
+			rasterizer.drawLine(cmd.state, verts[0], verts[1]);
+		}
+		else
+		{
+			rasterizer.drawTriStrip(cmd.state, verts, cmd.vertCount);
+		}
+	}
+
+	// copy the tile into the frame buffer:
+	for (int row=0 ; row<h ; row++)
+	{
+		memcpy(mColorBuffer + (y + row) * mWidth + x, worker->color + row * TILE_SIZE, w * sizeof(unsigned int));
+	}
+}
+
+double SoftGraphics::benchmark(int threadCount, int frames)
+{
+	int oldThreadCount = getThreadCount();
+	setThreadCount(threadCount);
+
+	std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+	for (int i=0 ; i<frames ; i++)
+	{
+		renderFrame();
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+	setThreadCount(oldThreadCount);
+	return frames > 0 ? seconds * 1000.0 / frames : 0;
+}
+
+bool SoftGraphics::saveScreenshot(const char *filename)
+{
+	unsigned char *data;
+	int size;
+	pngEncode(mColorBuffer, mWidth, mHeight, false, &data, &size);
+
+	Storage *storage = Environment::instance()->getStorage();
+	BoyFileHandle hFile;
+	bool ok = storage->FileOpen(filename, Storage::STORAGE_MODE_WRITE | Storage::STORAGE_OPEN_ALWAYS, &hFile)==Storage::STORAGE_OK;
+	if (ok)
+	{
+		ok = storage->FileWrite(hFile, data, size)==Storage::STORAGE_OK;
+		storage->FileClose(hFile);
+	}
+	delete[] data;
+
+	if (!ok)
+	{
+		envDebugLog("could not write screenshot: %s\n", filename);
+	}
+	return ok;
+}
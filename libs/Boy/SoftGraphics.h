@@ -0,0 +1,143 @@
+#pragma once
+
+#include "BoyLib/CrtDbgInc.h"
+
+#include "HeadlessGraphics.h"
+#include "SoftRasterizer.h"
+#include <vector>
+
+namespace Boy
+{
+	class SoftImage;
+	class WorkerPool;
+
+	/*
+	 * a graphics object that renders into a frame buffer in system
+	 * memory. it draws what WinGraphics draws (same transforms, blend
+	 * modes, alpha and z tests) so frames can be looked at and fill
+	 * rates measured on machines without a gpu.
+	 *
+	 * draw calls are only recorded during the frame. endFrame() sorts
+	 * them into screen tiles (keeping the order they were submitted in)
+	 * and then rasterizes the tiles in parallel, each one with its own
+	 * small color and z buffer.
+	 *
+	 * lines and outlines are held back until the end of the frame and
+	 * grouped by render state (clip rect included), the same way
+	 * WinGraphics batches them. filled rects are drawn in order.
+	 */
+	class SoftGraphics : public HeadlessGraphics
+	{
+	public:
+
+		enum { TILE_SIZE = 64 };
+
+		SoftGraphics(int width, int height);
+		virtual ~SoftGraphics();
+
+		virtual void drawImage(Image *img);
+		virtual void drawImage(Image *img, int subrectX, int subrectY, int subrectW, int subrectH);
+		virtual void drawQuadMesh(Image *img, const QuadMesh *mesh);
+
+		virtual void drawLine(int x0, int y0, int x1, int y1);
+		virtual void fillRect(int x0, int y0, int w, int h);
+		virtual void drawRect(int x0, int y0, int w, int h);
+		virtual void drawCircle(int x, int y, int radius);
+		virtual void drawTriStrip(TriStrip *strip);
+
+		virtual void beginFrame();
+		virtual void endFrame();
+
+		// picks the span kernels (the best one the cpu supports is the default):
+		void setSpanPath(SoftSpanKernels::Path path);
+		inline SoftSpanKernels::Path getSpanPath() { return mSpanPath; }
+
+		// number of threads that rasterize tiles (0 means one per core):
+		void setThreadCount(int threadCount);
+		int getThreadCount();
+
+		// the last frame (0xffRRGGBB, getWidth() pixels per row):
+		inline const unsigned int *getFrameBuffer() { return mColorBuffer; }
+
+		// writes the frame buffer to a png file:
+		bool saveScreenshot(const char *filename);
+
+		// fill rate counters:
+		inline unsigned long long getFramePixelCount() { return mFramePixelCount; }
+		inline unsigned long long getTotalPixelCount() { return mTotalPixelCount; }
+
+		// rasterizes the last frame again the given number of times with
+		// threadCount threads, returns the average milliseconds per frame:
+		double benchmark(int threadCount, int frames);
+
+	private:
+
+		// a recorded draw call:
+		struct Command
+		{
+			enum Type
+			{
+				TRI_STRIP,
+				LINE
+			};
+
+			Type type;
+			SoftRenderState state;
+			int firstVert;
+			int vertCount;
+		};
+
+		// debug primitives that share a render state:
+		struct PrimitiveBucket
+		{
+			SoftRenderState state;
+			std::vector<SoftVertex> lineVerts; // 2 per line
+		};
+
+		// what each thread needs to render a tile:
+		struct TileWorker
+		{
+			SoftRasterizer rasterizer;
+			unsigned int color[TILE_SIZE * TILE_SIZE];
+			float depth[TILE_SIZE * TILE_SIZE];
+		};
+
+		void initRenderState(SoftRenderState &state, SoftImage *img);
+		void addCommand(Command::Type type, const SoftRenderState &state, const SoftVertex *verts, int count);
+		PrimitiveBucket *getPrimitiveBucket();
+		void addLine(float x0, float y0, float x1, float y1);
+		void addPrimitives();
+		void renderFrame();
+		void renderTile(int tile, TileWorker *worker);
+		static void renderTileProc(void *context, int tile, int worker);
+
+	private:
+
+		unsigned int *mColorBuffer;
+
+		// the frame's draw calls and the tiles they touch:
+		std::vector<Command> mCommands;
+		std::vector<SoftVertex> mVerts;
+		std::vector< std::vector<int> > mTileCommands;
+
+		// the frame's debug primitives (buckets are reused from frame to frame):
+		std::vector<PrimitiveBucket*> mPrimitiveBuckets;
+		int mPrimitiveBucketCount;
+
+		// scratch space for tri strips in screen space:
+		std::vector<SoftVertex> mStripVerts;
+		int mTileCountX;
+		int mTileCountY;
+
+		// buffer clearing values for this frame:
+		unsigned int mFrameClearColor;
+		float mFrameClearZ;
+
+		WorkerPool *mPool;
+		std::vector<TileWorker*> mWorkers;
+		SoftSpanKernels::Path mSpanPath;
+
+		unsigned long long mFramePixelCount;
+		unsigned long long mTotalPixelCount;
+	};
+};
@@ -0,0 +1,53 @@
+#include "SoftImage.h"
+
+#include "ResourceLoader.h"
+
+using namespace Boy;
+
+#include "BoyLib/CrtDbgNew.h"
+
+SoftImage::SoftImage(ResourceLoader *loader, const std::string &path) : Image(loader,path)
+{
+	mPixels = NULL;
+	mWidth = -1;
+	mHeight = -1;
+}
+
+SoftImage::~SoftImage()
+{
+	delete[] mPixels;
+}
+
+int SoftImage::getWidth()
+{
+	return mWidth;
+}
+
+int SoftImage::getHeight()
+{
+	return mHeight;
+}
+
+int SoftImage::getMemoryUsage()
+{
+	return mPixels==NULL ? 0 : mWidth * mHeight * (int)sizeof(unsigned int);
+}
+
+bool SoftImage::init(bool includeSounds)
+{
+	return mLoader->load(this);
+}
+
+void SoftImage::destroy(bool includeSounds)
+{
+	delete[] mPixels;
+	mPixels = NULL;
+}
+
+void SoftImage::setPixels(unsigned int *pixels, int width, int height)
+{
+	delete[] mPixels;
+	mPixels = pixels;
+	mWidth = width;
+	mHeight = height;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "Image.h"
+
+namespace Boy
+{
+	/*
+	 * an image whose pixels live in system memory (0xAARRGGBB)
+	 */
+	class SoftImage : public Image
+	{
+	public:
+
+		SoftImage(ResourceLoader *loader, const std::string &path);
+		virtual ~SoftImage();
+
+		// takes ownership of the pixels (allocated with new[]):
+		void setPixels(unsigned int *pixels, int width, int height);
+		inline const unsigned int *getPixels() { return mPixels; }
+
+		const std::string &getPath() { return mPath; }
+
+		// implementation of Image:
+		virtual int getWidth();
+		virtual int getHeight();
+
+		// implementation of Resource:
+		virtual int getMemoryUsage();
+
+	private:
+
+		// implementation of Resource:
+		virtual bool init(bool includeSounds);
+		virtual void destroy(bool includeSounds);
+
+	private:
+
+		unsigned int *mPixels;
+		int mWidth;
+		int mHeight;
+	};
+};
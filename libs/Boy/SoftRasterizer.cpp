@@ -0,0 +1,496 @@
+#include "SoftRasterizer.h"
+
+#include <assert.h>
+#include "Graphics.h"
+#include <math.h>
+#include <stdlib.h>
+
+using namespace Boy;
+
+#include "BoyLib/CrtDbgNew.h"
+
+// vertex positions are snapped to 1/16th of a pixel:
+#define SUBPIXEL_BITS 4
+#define SUBPIXEL_ONE (1<<SUBPIXEL_BITS)
+#define SUBPIXEL_HALF (SUBPIXEL_ONE/2)
+
+// keeps the edge functions well within 64 bits:
+#define MAX_COORD 1000000.0f
+
+namespace
+{
+	long long toFixed(float v)
+	{
+		if (v > MAX_COORD) v = MAX_COORD;
+		if (v < -MAX_COORD) v = -MAX_COORD;
+		return (long long)floor(v * SUBPIXEL_ONE + 0.5f);
+	}
+
+	long long floorDiv(long long a, long long b)
+	{
+		assert(b>0);
+		return a>=0 ? a/b : -((-a+b-1)/b);
+	}
+
+	long long ceilDiv(long long a, long long b)
+	{
+		return -floorDiv(-a, b);
+	}
+
+	/*
+	 * edge function of the edge a->b: positive inside the triangle.
+	 * pixels exactly on the edge only count for top and left edges.
+	 */
+	struct Edge
+	{
+		long long value;
+		long long stepX;
+		long long stepY;
+		double invStepX;
+
+		void setup(long long ax, long long ay, long long bx, long long by, long long px, long long py)
+		{
+			long long dx = bx - ax;
+			long long dy = by - ay;
+			bool topLeft = (dy==0 && dx>0) || dy<0;
+			value = dx * (py - ay) - dy * (px - ax) - (topLeft ? 0 : 1);
+			stepX = -dy * SUBPIXEL_ONE;
+			stepY = dx * SUBPIXEL_ONE;
+			invStepX = stepX!=0 ? 1.0 / (double)stepX : 0;
+		}
+
+		// narrows [lo,hi] down to the pixels of the row that are inside
+		// (the crossing is estimated in floating point and then fixed up,
+		// which is a lot cheaper than a 64 bit division per row):
+		void clipRow(int &lo, int &hi) const
+		{
+			if (stepX > 0)
+			{
+				if (value < 0)
+				{
+					// first pixel with value + k * stepX >= 0:
+					double est = -(double)value * invStepX;
+					if (est > hi)
+					{
+						lo = hi+1;
+						return;
+					}
+					long long k = (long long)est;
+					while (value + k * stepX < 0) k++;
+					while (k > 0 && value + (k-1) * stepX >= 0) k--;
+					if (k > lo) lo = (int)k;
+				}
+			}
+			else if (stepX < 0)
+			{
+				if (value < 0)
+				{
+					hi = lo-1;
+				}
+				else
+				{
+					// last pixel with value + k * stepX >= 0:
+					double est = -(double)value * invStepX;
+					if (est >= hi)
+					{
+						return;
+					}
+					long long k = (long long)est;
+					while (k >= 0 && value + k * stepX < 0) k--;
+					while (value + (k+1) * stepX >= 0) k++;
+					if (k < hi) hi = (int)k;
+				}
+			}
+			else if (value < 0)
+			{
+				hi = lo-1;
+			}
+		}
+	};
+
+	/*
+	 * an attribute that varies linearly over the triangle
+	 */
+	struct Plane
+	{
+		float origin;
+		float dx;
+		float dy;
+
+		void setup(float a0, float a1, float a2, float dx1, float dy1, float dx2, float dy2, float invArea)
+		{
+			origin = a0;
+			dx = ((a1 - a0) * dy2 - (a2 - a0) * dy1) * invArea;
+			dy = ((a2 - a0) * dx1 - (a1 - a0) * dx2) * invArea;
+		}
+
+		inline float at(float ox, float oy) const
+		{
+			return origin + dx * ox + dy * oy;
+		}
+	};
+
+	int clampChannel(float v)
+	{
+		int c = (int)(v + 0.5f);
+		return c < 0 ? 0 : (c > 255 ? 255 : c);
+	}
+
+	// narrows the steps of a line down to the ones where p0 + d*s/steps
+	// is roughly within [min,max):
+	void narrowSteps(int p0, int d, int steps, int min, int max, int &first, int &last)
+	{
+		double a = (double)(min - 1 - p0) * steps / d;
+		double b = (double)(max + 1 - p0) * steps / d;
+		if (a > b)
+		{
+			double t = a;
+			a = b;
+			b = t;
+		}
+		if (a - 1 > first)
+		{
+			first = a - 1 > last ? last + 1 : (int)(a - 1);
+		}
+		if (b + 1 < last)
+		{
+			last = b + 1 < first ? first - 1 : (int)(b + 1);
+		}
+	}
+
+	int clampTexel(float t, int size)
+	{
+		if (t <= 0)
+		{
+			return 0;
+		}
+		if (t >= size)
+		{
+			return size-1;
+		}
+		return (int)t;
+	}
+}
+
+SoftRasterizer::SoftRasterizer()
+{
+	mColor = NULL;
+	mDepth = NULL;
+	mPitch = 0;
+	mTargetX = 0;
+	mTargetY = 0;
+	mTargetWidth = 0;
+	mTargetHeight = 0;
+	mTexels = NULL;
+	mColors = NULL;
+	mSpanCapacity = 0;
+	mKernel = SoftSpanKernels::getKernel(SoftSpanKernels::getBestPath());
+	mPixelCount = 0;
+}
+
+SoftRasterizer::~SoftRasterizer()
+{
+	delete[] mTexels;
+	delete[] mColors;
+}
+
+void SoftRasterizer::setTarget(unsigned int *color, float *depth, int pitch, int x, int y, int width, int height)
+{
+	mColor = color;
+	mDepth = depth;
+	mPitch = pitch;
+	mTargetX = x;
+	mTargetY = y;
+	mTargetWidth = width;
+	mTargetHeight = height;
+
+	// spans never get wider than the target:
+	if (width > mSpanCapacity)
+	{
+		delete[] mTexels;
+		delete[] mColors;
+		mSpanCapacity = width;
+		mTexels = new unsigned int[mSpanCapacity];
+		mColors = new unsigned int[mSpanCapacity];
+	}
+}
+
+void SoftRasterizer::setKernel(SoftSpanFunc kernel)
+{
+	assert(kernel!=NULL);
+	mKernel = kernel;
+}
+
+void SoftRasterizer::clear(unsigned int color, float depth)
+{
+	for (int y=0 ; y<mTargetHeight ; y++)
+	{
+		unsigned int *c = mColor + y * mPitch;
+		float *d = mDepth + y * mPitch;
+		for (int x=0 ; x<mTargetWidth ; x++)
+		{
+			c[x] = color;
+			d[x] = depth;
+		}
+	}
+}
+
+void SoftRasterizer::initSpan(const SoftRenderState &state, SoftSpan &span)
+{
+	span.count = 0;
+	span.dst = NULL;
+	span.depth = NULL;
+	span.texels = NULL;
+	span.colors = NULL;
+	span.color = 0xffffffff;
+	span.z = 0;
+	span.dz = 0;
+	span.alphaFunc = state.alphaFunc;
+	span.alphaRef = state.alphaRef;
+	span.zTest = state.zTest;
+	span.zWrite = state.zWrite;
+	span.zFunc = state.zFunc;
+	span.additive = state.additive;
+}
+
+void SoftRasterizer::drawTriangle(const SoftRenderState &state, const SoftVertex &v0, const SoftVertex &v1, const SoftVertex &v2)
+{
+	assert(mColor!=NULL);
+
+	long long x0 = toFixed(v0.x), y0 = toFixed(v0.y);
+	long long x1 = toFixed(v1.x), y1 = toFixed(v1.y);
+	long long x2 = toFixed(v2.x), y2 = toFixed(v2.y);
+
+	// skip degenerate and back facing triangles:
+	long long area = (x1 - x0) * (y2 - y0) - (x2 - x0) * (y1 - y0);
+	if (area <= 0)
+	{
+		return;
+	}
+
+	// pixels whose centers are inside the bounding box:
+	long long minFX = x0 < x1 ? (x0 < x2 ? x0 : x2) : (x1 < x2 ? x1 : x2);
+	long long maxFX = x0 > x1 ? (x0 > x2 ? x0 : x2) : (x1 > x2 ? x1 : x2);
+	long long minFY = y0 < y1 ? (y0 < y2 ? y0 : y2) : (y1 < y2 ? y1 : y2);
+	long long maxFY = y0 > y1 ? (y0 > y2 ? y0 : y2) : (y1 > y2 ? y1 : y2);
+	long long minX = ceilDiv(minFX - SUBPIXEL_HALF, SUBPIXEL_ONE);
+	long long maxX = floorDiv(maxFX - SUBPIXEL_HALF, SUBPIXEL_ONE);
+	long long minY = ceilDiv(minFY - SUBPIXEL_HALF, SUBPIXEL_ONE);
+	long long maxY = floorDiv(maxFY - SUBPIXEL_HALF, SUBPIXEL_ONE);
+
+	// clip against the clip rect and the target:
+	int clipMinX = state.clipMinX > mTargetX ? state.clipMinX : mTargetX;
+	int clipMinY = state.clipMinY > mTargetY ? state.clipMinY : mTargetY;
+	int clipMaxX = state.clipMaxX < mTargetX + mTargetWidth ? state.clipMaxX : mTargetX + mTargetWidth;
+	int clipMaxY = state.clipMaxY < mTargetY + mTargetHeight ? state.clipMaxY : mTargetY + mTargetHeight;
+	if (minX < clipMinX) minX = clipMinX;
+	if (minY < clipMinY) minY = clipMinY;
+	if (maxX > clipMaxX-1) maxX = clipMaxX-1;
+	if (maxY > clipMaxY-1) maxY = clipMaxY-1;
+	if (minX > maxX || minY > maxY)
+	{
+		return;
+	}
+
+	// edge functions at the center of the top left pixel:
+	long long px = minX * SUBPIXEL_ONE + SUBPIXEL_HALF;
+	long long py = minY * SUBPIXEL_ONE + SUBPIXEL_HALF;
+	Edge e0, e1, e2;
+	e0.setup(x1, y1, x2, y2, px, py);
+	e1.setup(x2, y2, x0, y0, px, py);
+	e2.setup(x0, y0, x1, y1, px, py);
+
+	// attribute planes (relative to the snapped first vertex):
+	float fx0 = (float)x0 / SUBPIXEL_ONE;
+	float fy0 = (float)y0 / SUBPIXEL_ONE;
+	float dx1 = (float)(x1 - x0) / SUBPIXEL_ONE;
+	float dy1 = (float)(y1 - y0) / SUBPIXEL_ONE;
+	float dx2 = (float)(x2 - x0) / SUBPIXEL_ONE;
+	float dy2 = (float)(y2 - y0) / SUBPIXEL_ONE;
+	float invArea = (float)((SUBPIXEL_ONE * SUBPIXEL_ONE) / (double)area);
+
+	Plane depth;
+	depth.setup(v0.z, v1.z, v2.z, dx1, dy1, dx2, dy2, invArea);
+
+	Plane u, v;
+	bool textured = state.texels!=NULL;
+	if (textured)
+	{
+		float w = (float)state.texWidth;
+		float h = (float)state.texHeight;
+		u.setup(v0.u * w, v1.u * w, v2.u * w, dx1, dy1, dx2, dy2, invArea);
+		v.setup(v0.v * h, v1.v * h, v2.v * h, dx1, dy1, dx2, dy2, invArea);
+	}
+
+	Plane channels[4];
+	bool gouraud = v0.color!=v1.color || v0.color!=v2.color;
+	if (gouraud)
+	{
+		for (int c=0 ; c<4 ; c++)
+		{
+			int shift = c * 8;
+			channels[c].setup(
+				(float)((v0.color >> shift) & 0xff),
+				(float)((v1.color >> shift) & 0xff),
+				(float)((v2.color >> shift) & 0xff),
+				dx1, dy1, dx2, dy2, invArea);
+		}
+	}
+
+	SoftSpan span;
+	initSpan(state, span);
+	span.color = v0.color;
+	span.dz = depth.dx;
+	if (textured)
+	{
+		span.texels = mTexels;
+	}
+	if (gouraud)
+	{
+		span.colors = mColors;
+	}
+
+	int lastPixel = (int)(maxX - minX);
+	for (int y=(int)minY ; y<=maxY ; y++)
+	{
+		// the part of the row that's inside all three edges:
+		int lo = 0;
+		int hi = lastPixel;
+		e0.clipRow(lo, hi);
+		e1.clipRow(lo, hi);
+		e2.clipRow(lo, hi);
+
+		if (lo <= hi)
+		{
+			int x = (int)minX + lo;
+			int count = hi - lo + 1;
+			float ox = x + 0.5f - fx0;
+			float oy = y + 0.5f - fy0;
+			int offset = (y - mTargetY) * mPitch + (x - mTargetX);
+
+			span.count = count;
+			span.dst = mColor + offset;
+			span.depth = mDepth + offset;
+			span.z = depth.at(ox, oy);
+
+			if (textured)
+			{
+				float su = u.at(ox, oy);
+				float sv = v.at(ox, oy);
+				const unsigned int *texels = state.texels;
+				int w = state.texWidth;
+				int h = state.texHeight;
+				if (v.dx == 0)
+				{
+					// axis aligned, the whole span reads from one row:
+					const unsigned int *row = texels + clampTexel(sv, h) * w;
+					for (int i=0 ; i<count ; i++)
+					{
+						mTexels[i] = row[clampTexel(su + u.dx * i, w)];
+					}
+				}
+				else
+				{
+					for (int i=0 ; i<count ; i++)
+					{
+						int tx = clampTexel(su + u.dx * i, w);
+						int ty = clampTexel(sv + v.dx * i, h);
+						mTexels[i] = texels[ty * w + tx];
+					}
+				}
+			}
+
+			if (gouraud)
+			{
+				float start[4];
+				for (int c=0 ; c<4 ; c++)
+				{
+					start[c] = channels[c].at(ox, oy);
+				}
+				for (int i=0 ; i<count ; i++)
+				{
+					mColors[i] =
+						clampChannel(start[0] + channels[0].dx * i) |
+						(clampChannel(start[1] + channels[1].dx * i) << 8) |
+						(clampChannel(start[2] + channels[2].dx * i) << 16) |
+						((unsigned int)clampChannel(start[3] + channels[3].dx * i) << 24);
+				}
+			}
+
+			mKernel(span);
+			mPixelCount += count;
+		}
+
+		e0.value += e0.stepY;
+		e1.value += e1.stepY;
+		e2.value += e2.stepY;
+	}
+}
+
+void SoftRasterizer::drawTriStrip(const SoftRenderState &state, const SoftVertex *verts, int count)
+{
+	// every other triangle of a strip is wound the other way around:
+	for (int i=0 ; i+2<count ; i++)
+	{
+		if (i & 1)
+		{
+			drawTriangle(state, verts[i+1], verts[i], verts[i+2]);
+		}
+		else
+		{
+			drawTriangle(state, verts[i], verts[i+1], verts[i+2]);
+		}
+	}
+}
+
+void SoftRasterizer::drawLine(const SoftRenderState &state, const SoftVertex &v0, const SoftVertex &v1)
+{
+	assert(mColor!=NULL);
+
+	int x0 = (int)floor(v0.x);
+	int y0 = (int)floor(v0.y);
+	int dx = (int)floor(v1.x) - x0;
+	int dy = (int)floor(v1.y) - y0;
+	int steps = abs(dx) > abs(dy) ? abs(dx) : abs(dy);
+
+	int clipMinX = state.clipMinX > mTargetX ? state.clipMinX : mTargetX;
+	int clipMinY = state.clipMinY > mTargetY ? state.clipMinY : mTargetY;
+	int clipMaxX = state.clipMaxX < mTargetX + mTargetWidth ? state.clipMaxX : mTargetX + mTargetWidth;
+	int clipMaxY = state.clipMaxY < mTargetY + mTargetHeight ? state.clipMaxY : mTargetY + mTargetHeight;
+
+	SoftSpan span;
+	initSpan(state, span);
+	span.count = 1;
+	span.color = v0.color;
+
+	// only walk the steps that can land inside the clip rect (with a
+	// pixel to spare on both ends, the exact test is done per pixel):
+	int first = 0;
+	int last = steps-1;
+	if (dx != 0)
+	{
+		narrowSteps(x0, dx, steps, clipMinX, clipMaxX, first, last);
+	}
+	if (dy != 0)
+	{
+		narrowSteps(y0, dy, steps, clipMinY, clipMaxY, first, last);
+	}
+
+	// the last pixel is left out, like d3d line lists do:
+	for (int s=first ; s<=last ; s++)
+	{
+		int x = x0 + (int)floorDiv(2LL * dx * s + steps, 2LL * steps);
+		int y = y0 + (int)floorDiv(2LL * dy * s + steps, 2LL * steps);
+		if (x < clipMinX || x >= clipMaxX || y < clipMinY || y >= clipMaxY)
+		{
+			continue;
+		}
+
+		int offset = (y - mTargetY) * mPitch + (x - mTargetX);
+		span.dst = mColor + offset;
+		span.depth = mDepth + offset;
+		span.z = v0.z + (v1.z - v0.z) * s / steps;
+		mKernel(span);
+		mPixelCount++;
+	}
+}
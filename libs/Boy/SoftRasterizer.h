@@ -0,0 +1,107 @@
+#pragma once
+
+#include "BoyLib/CrtDbgInc.h"
+
+#include "SoftSpanKernels.h"
+
+namespace Boy
+{
+	/*
+	 * a vertex in screen space. z is the depth buffer value (0 is
+	 * near, 1 is far) and the color is 0xAARRGGBB.
+	 */
+	struct SoftVertex
+	{
+		float x;
+		float y;
+		float z;
+		unsigned int color;
+		float u;
+		float v;
+	};
+
+	/*
+	 * everything that decides how a primitive ends up in the frame buffer
+	 */
+	struct SoftRenderState
+	{
+		// texture (NULL for untextured primitives):
+		const unsigned int *texels;
+		int texWidth;
+		int texHeight;
+
+		bool additive;
+
+		// alpha test (alphaFunc is CMP_ALWAYS when the test is off):
+		int alphaFunc;
+		int alphaRef;
+
+		// z buffer (nothing is read or written unless zTest is set):
+		bool zTest;
+		bool zWrite;
+		int zFunc;
+
+		// clip rect (the max values are exclusive):
+		int clipMinX;
+		int clipMinY;
+		int clipMaxX;
+		int clipMaxY;
+	};
+
+	/*
+	 * rasterizes triangles and lines into a 32 bit color buffer and a
+	 * float depth buffer. the target can be the whole screen or just a
+	 * part of it, in which case everything outside is clipped away.
+	 *
+	 * pixel centers are at +0.5, edges follow the top-left fill rule and
+	 * textures are point sampled with clamping. triangles that are wound
+	 * counter clockwise on screen are culled, like the d3d default.
+	 */
+	class SoftRasterizer
+	{
+	public:
+
+		SoftRasterizer();
+		virtual ~SoftRasterizer();
+
+		// color and depth hold the pixels of the screen rect (x,y,width,height),
+		// pitch is the distance between rows in pixels:
+		void setTarget(unsigned int *color, float *depth, int pitch, int x, int y, int width, int height);
+
+		void setKernel(SoftSpanFunc kernel);
+
+		void clear(unsigned int color, float depth);
+
+		void drawTriangle(const SoftRenderState &state, const SoftVertex &v0, const SoftVertex &v1, const SoftVertex &v2);
+		void drawTriStrip(const SoftRenderState &state, const SoftVertex *verts, int count);
+		void drawLine(const SoftRenderState &state, const SoftVertex &v0, const SoftVertex &v1);
+
+		// number of pixels that went through the span kernels:
+		inline unsigned long long getPixelCount() { return mPixelCount; }
+		inline void resetPixelCount() { mPixelCount = 0; }
+
+	private:
+
+		void initSpan(const SoftRenderState &state, SoftSpan &span);
+
+	private:
+
+		// target:
+		unsigned int *mColor;
+		float *mDepth;
+		int mPitch;
+		int mTargetX;
+		int mTargetY;
+		int mTargetWidth;
+		int mTargetHeight;
+
+		// per span scratch buffers:
+		unsigned int *mTexels;
+		unsigned int *mColors;
+		int mSpanCapacity;
+
+		SoftSpanFunc mKernel;
+
+		unsigned long long mPixelCount;
+	};
+}
@@ -0,0 +1,130 @@
+#include "SoftResourceLoader.h"
+
+#include "Environment.h"
+#include "Png.h"
+#include "SoftImage.h"
+#include "Storage.h"
+
+using namespace Boy;
+
+#include "BoyLib/CrtDbgNew.h"
+
+SoftResourceLoader::SoftResourceLoader(const std::string &language1, 
+									   const std::string &language2) 
+									   : HeadlessResourceLoader(language1,language2)
+{
+}
+
+SoftResourceLoader::~SoftResourceLoader()
+{
+}
+
+Image *SoftResourceLoader::createImage(const std::string &filename)
+{
+	return new SoftImage(this,filename);
+}
+
+// an image that was decoded on a loading worker:
+class PreparedPixels : public PreparedResource
+{
+public:
+
+	PreparedPixels(unsigned int *pixels, int width, int height) { mPixels = pixels; mWidth = width; mHeight = height; }
+	virtual ~PreparedPixels() { delete[] mPixels; }
+
+	unsigned int *mPixels;
+	int mWidth;
+	int mHeight;
+};
+
+PreparedResource *SoftResourceLoader::prepare(Image *image)
+{
+	SoftImage *img = dynamic_cast<SoftImage*>(image);
+
+	// (no warnings from here, load() tries again and reports it):
+	int width, height;
+	unsigned int *pixels = NULL;
+	if (!decode(img->getPath(), &pixels, &width, &height, false))
+	{
+		return NULL;
+	}
+	return new PreparedPixels(pixels, width, height);
+}
+
+PreparedResource *SoftResourceLoader::prepare(Image *image, const unsigned char *data, int size)
+{
+	int width, height;
+	unsigned int *pixels = NULL;
+	if (!pngDecode(data, size, &width, &height, &pixels))
+	{
+		return NULL;
+	}
+	return new PreparedPixels(pixels, width, height);
+}
+
+std::string SoftResourceLoader::getPrepareFile(Image *image)
+{
+	std::string fname;
+	return findLocalized(image->getPath(), ".png", fname) ? fname : "";
+}
+
+bool SoftResourceLoader::load(Image *image)
+{
+	SoftImage *img = dynamic_cast<SoftImage*>(image);
+
+	// use what a loading worker decoded if there is something:
+	PreparedPixels *prepared = dynamic_cast<PreparedPixels*>(takePrepared(image));
+	if (prepared!=NULL)
+	{
+		// (the image takes the pixels):
+		img->setPixels(prepared->mPixels, prepared->mWidth, prepared->mHeight);
+		prepared->mPixels = NULL;
+		delete prepared;
+		return true;
+	}
+
+	int width, height;
+	unsigned int *pixels = NULL;
+	if (!decode(img->getPath(), &pixels, &width, &height, true))
+	{
+		return false;
+	}
+
+	img->setPixels(pixels, width, height);
+
+	return true;
+}
+
+bool SoftResourceLoader::decode(const std::string &path, unsigned int **pixels, int *width, int *height, bool warn)
+{
+	std::string fname;
+	if (!findLocalized(path, ".png", fname))
+	{
+		if (warn) envDebugLog("could not load texture: %s.png\n",path.c_str());
+		return false;
+	}
+
+	// read the whole file:
+	Storage *storage = Environment::instance()->getStorage();
+	BoyFileHandle hFile;
+	if (storage->FileOpen(fname.c_str(), Storage::STORAGE_MODE_READ | Storage::STORAGE_MUST_EXIST, &hFile)!=Storage::STORAGE_OK)
+	{
+		if (warn) envDebugLog("could not load texture: %s\n",fname.c_str());
+		return false;
+	}
+	int size = storage->FileGetSize(hFile);
+	unsigned char *data = new unsigned char[size];
+	Storage::StorageResult result = storage->FileRead(hFile, data, size);
+	storage->FileClose(hFile);
+
+	// decode it:
+	bool ok = result==Storage::STORAGE_OK && pngDecode(data, size, width, height, pixels);
+	delete[] data;
+	if (!ok)
+	{
+		if (warn) envDebugLog("could not decode texture: %s\n",fname.c_str());
+		return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "BoyLib/CrtDbgInc.h"
+
+#include "HeadlessResourceLoader.h"
+
+namespace Boy
+{
+	/*
+	 * a headless resource loader that decodes the pixels of
+	 * images too, so the software renderer can draw them
+	 */
+	class SoftResourceLoader : public HeadlessResourceLoader
+	{
+	public:
+
+		SoftResourceLoader(const std::string &language1, const std::string &language2);
+		virtual ~SoftResourceLoader();
+
+		virtual bool load(Image *image);
+		virtual bool load(Sound *sound) { return HeadlessResourceLoader::load(sound); }
+		virtual Image *createImage(const std::string &filename);
+
+		// decodes images on the loading workers:
+		virtual PreparedResource *prepare(Image *image);
+		virtual PreparedResource *prepare(Image *image, const unsigned char *data, int size);
+		virtual std::string getPrepareFile(Image *image);
+
+	private:
+
+		bool decode(const std::string &path, unsigned int **pixels, int *width, int *height, bool warn);
+
+	};
+};
@@ -0,0 +1,420 @@
+#include "SoftSpanKernels.h"
+
+#include "CpuFeatures.h"
+
+#if defined(BOY_X86)
+	#include <immintrin.h>
+#endif
+
+using namespace Boy;
+
+#include "BoyLib/CrtDbgNew.h"
+
+/*
+ * shared definitions. everything is done in integers with an exact
+ * division by 255 so that all of the paths agree bit for bit:
+ *
+ *   src    = texel * color / 255 (per channel)
+ *   normal = (src * a + dst * (255 - a)) / 255
+ *   add    = min(dst + src * a / 255, 255)
+ *
+ * the frame buffer has no alpha channel, so the alpha that gets
+ * written is always 0xff.
+ */
+
+static inline unsigned int div255(unsigned int x)
+{
+	x += 128;
+	return (x + (x >> 8)) >> 8;
+}
+
+// compare funcs are a bit mask of less (1), equal (2) and greater (4):
+static inline bool compare(int func, bool less, bool equal, bool greater)
+{
+	return ((func & 1) && less) || ((func & 2) && equal) || ((func & 4) && greater);
+}
+
+static inline void shadePixel(const SoftSpan &span, int i)
+{
+	unsigned int c = span.colors!=NULL ? span.colors[i] : span.color;
+
+	// modulate:
+	unsigned int src = c;
+	if (span.texels!=NULL)
+	{
+		unsigned int t = span.texels[i];
+		src = 0;
+		for (int shift=0 ; shift<32 ; shift+=8)
+		{
+			src |= div255(((t >> shift) & 0xff) * ((c >> shift) & 0xff)) << shift;
+		}
+	}
+
+	// alpha test:
+	int a = (int)(src >> 24);
+	if (!compare(span.alphaFunc, a < span.alphaRef, a == span.alphaRef, a > span.alphaRef))
+	{
+		return;
+	}
+
+	// z test:
+	float z = span.z + (float)i * span.dz;
+	if (span.zTest)
+	{
+		float d = span.depth[i];
+		if (!compare(span.zFunc, z < d, z == d, z > d))
+		{
+			return;
+		}
+	}
+
+	// blend:
+	unsigned int dst = span.dst[i];
+	unsigned int out = 0xff000000;
+	for (int shift=0 ; shift<24 ; shift+=8)
+	{
+		unsigned int s = (src >> shift) & 0xff;
+		unsigned int d = (dst >> shift) & 0xff;
+		unsigned int v;
+		if (span.additive)
+		{
+			v = d + div255(s * a);
+			if (v > 255)
+			{
+				v = 255;
+			}
+		}
+		else
+		{
+			v = div255(s * a + d * (255 - a));
+		}
+		out |= v << shift;
+	}
+	span.dst[i] = out;
+
+	if (span.zTest && span.zWrite)
+	{
+		span.depth[i] = z;
+	}
+}
+
+static void spanScalar(const SoftSpan &span)
+{
+	for (int i=0 ; i<span.count ; i++)
+	{
+		shadePixel(span, i);
+	}
+}
+
+#if defined(BOY_X86)
+
+/*
+ * sse2: 4 pixels at a time
+ */
+
+BOY_TARGET("sse2") static inline __m128i div255x8(__m128i x)
+{
+	x = _mm_add_epi16(x, _mm_set1_epi16(128));
+	return _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+}
+
+BOY_TARGET("sse2") static inline __m128i modulate4(__m128i t, __m128i c)
+{
+	__m128i zero = _mm_setzero_si128();
+	__m128i lo = div255x8(_mm_mullo_epi16(_mm_unpacklo_epi8(t, zero), _mm_unpacklo_epi8(c, zero)));
+	__m128i hi = div255x8(_mm_mullo_epi16(_mm_unpackhi_epi8(t, zero), _mm_unpackhi_epi8(c, zero)));
+	return _mm_packus_epi16(lo, hi);
+}
+
+// blends two pixels that were widened to 16 bits per channel:
+BOY_TARGET("sse2") static inline __m128i blend2(__m128i s, __m128i d, bool additive)
+{
+	__m128i a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s, 0xff), 0xff);
+	__m128i sa = _mm_mullo_epi16(s, a);
+	if (additive)
+	{
+		return div255x8(sa);
+	}
+	__m128i da = _mm_mullo_epi16(d, _mm_sub_epi16(_mm_set1_epi16(255), a));
+	return div255x8(_mm_add_epi16(sa, da));
+}
+
+BOY_TARGET("sse2") static inline __m128i blend4(__m128i src, __m128i dst, bool additive)
+{
+	__m128i zero = _mm_setzero_si128();
+	__m128i lo = blend2(_mm_unpacklo_epi8(src, zero), _mm_unpacklo_epi8(dst, zero), additive);
+	__m128i hi = blend2(_mm_unpackhi_epi8(src, zero), _mm_unpackhi_epi8(dst, zero), additive);
+	__m128i out = _mm_packus_epi16(lo, hi);
+	if (additive)
+	{
+		out = _mm_adds_epu8(dst, out);
+	}
+	return _mm_or_si128(out, _mm_set1_epi32((int)0xff000000));
+}
+
+BOY_TARGET("sse2") static inline __m128i funcMask4(int func, int bit)
+{
+	return _mm_set1_epi32((func & bit) ? -1 : 0);
+}
+
+BOY_TARGET("sse2") static void spanSSE2(const SoftSpan &span)
+{
+	const bool alphaTest = span.alphaFunc != 7;
+	const bool zWrite = span.zTest && span.zWrite;
+
+	const __m128i color = _mm_set1_epi32((int)span.color);
+	const __m128i alphaRef = _mm_set1_epi32(span.alphaRef);
+	const __m128i aLess = funcMask4(span.alphaFunc, 1);
+	const __m128i aEqual = funcMask4(span.alphaFunc, 2);
+	const __m128i aGreater = funcMask4(span.alphaFunc, 4);
+	const __m128i zLess = funcMask4(span.zFunc, 1);
+	const __m128i zEqual = funcMask4(span.zFunc, 2);
+	const __m128i zGreater = funcMask4(span.zFunc, 4);
+	const __m128 z0 = _mm_set1_ps(span.z);
+	const __m128 dz = _mm_set1_ps(span.dz);
+	const __m128i lanes = _mm_setr_epi32(0, 1, 2, 3);
+
+	int i = 0;
+	for ( ; i+4<=span.count ; i+=4)
+	{
+		__m128i c = span.colors!=NULL ? _mm_loadu_si128((const __m128i*)(span.colors+i)) : color;
+		__m128i src = span.texels!=NULL ? modulate4(_mm_loadu_si128((const __m128i*)(span.texels+i)), c) : c;
+
+		__m128i pass = _mm_set1_epi32(-1);
+		if (alphaTest)
+		{
+			__m128i a = _mm_srli_epi32(src, 24);
+			pass = _mm_or_si128(
+				_mm_or_si128(
+					_mm_and_si128(_mm_cmplt_epi32(a, alphaRef), aLess),
+					_mm_and_si128(_mm_cmpeq_epi32(a, alphaRef), aEqual)),
+				_mm_and_si128(_mm_cmpgt_epi32(a, alphaRef), aGreater));
+		}
+
+		__m128 z = _mm_setzero_ps();
+		__m128 d = _mm_setzero_ps();
+		if (span.zTest)
+		{
+			z = _mm_add_ps(z0, _mm_mul_ps(_mm_cvtepi32_ps(_mm_add_epi32(_mm_set1_epi32(i), lanes)), dz));
+			d = _mm_loadu_ps(span.depth+i);
+			__m128i zpass = _mm_or_si128(
+				_mm_or_si128(
+					_mm_and_si128(_mm_castps_si128(_mm_cmplt_ps(z, d)), zLess),
+					_mm_and_si128(_mm_castps_si128(_mm_cmpeq_ps(z, d)), zEqual)),
+				_mm_and_si128(_mm_castps_si128(_mm_cmpgt_ps(z, d)), zGreater));
+			pass = _mm_and_si128(pass, zpass);
+		}
+
+		if (_mm_movemask_epi8(pass)==0)
+		{
+			continue;
+		}
+
+		__m128i dst = _mm_loadu_si128((const __m128i*)(span.dst+i));
+		__m128i out = blend4(src, dst, span.additive);
+		out = _mm_or_si128(_mm_and_si128(pass, out), _mm_andnot_si128(pass, dst));
+		_mm_storeu_si128((__m128i*)(span.dst+i), out);
+
+		if (zWrite)
+		{
+			__m128 passf = _mm_castsi128_ps(pass);
+			_mm_storeu_ps(span.depth+i, _mm_or_ps(_mm_and_ps(passf, z), _mm_andnot_ps(passf, d)));
+		}
+	}
+
+	// leftovers:
+	for ( ; i<span.count ; i++)
+	{
+		shadePixel(span, i);
+	}
+}
+
+/*
+ * avx2: 8 pixels at a time (same steps as the sse2 version)
+ */
+
+BOY_TARGET("avx2") static inline __m256i div255x16(__m256i x)
+{
+	x = _mm256_add_epi16(x, _mm256_set1_epi16(128));
+	return _mm256_srli_epi16(_mm256_add_epi16(x, _mm256_srli_epi16(x, 8)), 8);
+}
+
+BOY_TARGET("avx2") static inline __m256i modulate8(__m256i t, __m256i c)
+{
+	__m256i zero = _mm256_setzero_si256();
+	__m256i lo = div255x16(_mm256_mullo_epi16(_mm256_unpacklo_epi8(t, zero), _mm256_unpacklo_epi8(c, zero)));
+	__m256i hi = div255x16(_mm256_mullo_epi16(_mm256_unpackhi_epi8(t, zero), _mm256_unpackhi_epi8(c, zero)));
+	return _mm256_packus_epi16(lo, hi);
+}
+
+BOY_TARGET("avx2") static inline __m256i blend4x2(__m256i s, __m256i d, bool additive)
+{
+	__m256i a = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(s, 0xff), 0xff);
+	__m256i sa = _mm256_mullo_epi16(s, a);
+	if (additive)
+	{
+		return div255x16(sa);
+	}
+	__m256i da = _mm256_mullo_epi16(d, _mm256_sub_epi16(_mm256_set1_epi16(255), a));
+	return div255x16(_mm256_add_epi16(sa, da));
+}
+
+BOY_TARGET("avx2") static inline __m256i blend8(__m256i src, __m256i dst, bool additive)
+{
+	__m256i zero = _mm256_setzero_si256();
+	__m256i lo = blend4x2(_mm256_unpacklo_epi8(src, zero), _mm256_unpacklo_epi8(dst, zero), additive);
+	__m256i hi = blend4x2(_mm256_unpackhi_epi8(src, zero), _mm256_unpackhi_epi8(dst, zero), additive);
+	__m256i out = _mm256_packus_epi16(lo, hi);
+	if (additive)
+	{
+		out = _mm256_adds_epu8(dst, out);
+	}
+	return _mm256_or_si256(out, _mm256_set1_epi32((int)0xff000000));
+}
+
+BOY_TARGET("avx2") static inline __m256i funcMask8(int func, int bit)
+{
+	return _mm256_set1_epi32((func & bit) ? -1 : 0);
+}
+
+BOY_TARGET("avx2") static void spanAVX2(const SoftSpan &span)
+{
+	const bool alphaTest = span.alphaFunc != 7;
+	const bool zWrite = span.zTest && span.zWrite;
+
+	const __m256i color = _mm256_set1_epi32((int)span.color);
+	const __m256i alphaRef = _mm256_set1_epi32(span.alphaRef);
+	const __m256i aLess = funcMask8(span.alphaFunc, 1);
+	const __m256i aEqual = funcMask8(span.alphaFunc, 2);
+	const __m256i aGreater = funcMask8(span.alphaFunc, 4);
+	const __m256i zLess = funcMask8(span.zFunc, 1);
+	const __m256i zEqual = funcMask8(span.zFunc, 2);
+	const __m256i zGreater = funcMask8(span.zFunc, 4);
+	const __m256 z0 = _mm256_set1_ps(span.z);
+	const __m256 dz = _mm256_set1_ps(span.dz);
+	const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+
+	int i = 0;
+	for ( ; i+8<=span.count ; i+=8)
+	{
+		__m256i c = span.colors!=NULL ? _mm256_loadu_si256((const __m256i*)(span.colors+i)) : color;
+		__m256i src = span.texels!=NULL ? modulate8(_mm256_loadu_si256((const __m256i*)(span.texels+i)), c) : c;
+
+		__m256i pass = _mm256_set1_epi32(-1);
+		if (alphaTest)
+		{
+			__m256i a = _mm256_srli_epi32(src, 24);
+			pass = _mm256_or_si256(
+				_mm256_or_si256(
+					_mm256_and_si256(_mm256_cmpgt_epi32(alphaRef, a), aLess),
+					_mm256_and_si256(_mm256_cmpeq_epi32(a, alphaRef), aEqual)),
+				_mm256_and_si256(_mm256_cmpgt_epi32(a, alphaRef), aGreater));
+		}
+
+		__m256 z = _mm256_setzero_ps();
+		__m256 d = _mm256_setzero_ps();
+		if (span.zTest)
+		{
+			z = _mm256_add_ps(z0, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_add_epi32(_mm256_set1_epi32(i), lanes)), dz));
+			d = _mm256_loadu_ps(span.depth+i);
+			__m256i zpass = _mm256_or_si256(
+				_mm256_or_si256(
+					_mm256_and_si256(_mm256_castps_si256(_mm256_cmp_ps(z, d, _CMP_LT_OQ)), zLess),
+					_mm256_and_si256(_mm256_castps_si256(_mm256_cmp_ps(z, d, _CMP_EQ_OQ)), zEqual)),
+				_mm256_and_si256(_mm256_castps_si256(_mm256_cmp_ps(z, d, _CMP_GT_OQ)), zGreater));
+			pass = _mm256_and_si256(pass, zpass);
+		}
+
+		if (_mm256_movemask_epi8(pass)==0)
+		{
+			continue;
+		}
+
+		__m256i dst = _mm256_loadu_si256((const __m256i*)(span.dst+i));
+		__m256i out = blend8(src, dst, span.additive);
+		out = _mm256_blendv_epi8(dst, out, pass);
+		_mm256_storeu_si256((__m256i*)(span.dst+i), out);
+
+		if (zWrite)
+		{
+			_mm256_storeu_ps(span.depth+i, _mm256_blendv_ps(d, z, _mm256_castsi256_ps(pass)));
+		}
+	}
+
+	// the leftovers (and the caller) run sse code, which is slow
+	// while the upper halves of the ymm registers are dirty:
+	_mm256_zeroupper();
+
+	// leftovers:
+	for ( ; i<span.count ; i++)
+	{
+		shadePixel(span, i);
+	}
+}
+
+#endif
+
+SoftSpanKernels::Path SoftSpanKernels::getBestPath()
+{
+	if (isSupported(PATH_AVX2))
+	{
+		return PATH_AVX2;
+	}
+	if (isSupported(PATH_SSE2))
+	{
+		return PATH_SSE2;
+	}
+	return PATH_SCALAR;
+}
+
+bool SoftSpanKernels::isSupported(Path path)
+{
+	switch (path)
+	{
+	case PATH_SCALAR:
+		return true;
+#if defined(BOY_X86)
+	case PATH_SSE2:
+		return CpuFeatures::hasSSE2();
+	case PATH_AVX2:
+		return CpuFeatures::hasAVX2();
+#endif
+	default:
+		return false;
+	}
+}
+
+SoftSpanFunc SoftSpanKernels::getKernel(Path path)
+{
+	if (!isSupported(path))
+	{
+		return spanScalar;
+	}
+
+	switch (path)
+	{
+#if defined(BOY_X86)
+	case PATH_SSE2:
+		return spanSSE2;
+	case PATH_AVX2:
+		return spanAVX2;
+#endif
+	default:
+		return spanScalar;
+	}
+}
+
+const char *SoftSpanKernels::getPathName(Path path)
+{
+	switch (path)
+	{
+	case PATH_SCALAR:
+		return "scalar";
+	case PATH_SSE2:
+		return "sse2";
+	case PATH_AVX2:
+		return "avx2";
+	default:
+		return "unknown";
+	}
+}
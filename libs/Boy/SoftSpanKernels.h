@@ -0,0 +1,70 @@
+#pragma once
+
+#include "BoyLib/CrtDbgInc.h"
+
+namespace Boy
+{
+	/*
+	 * a horizontal run of pixels of one triangle, ready to be shaded
+	 * and blended into the frame buffer. colors are 0xAARRGGBB.
+	 */
+	struct SoftSpan
+	{
+		int count;
+
+		// destination (depth is only touched when the z test is on):
+		unsigned int *dst;
+		float *depth;
+
+		// source: texels (NULL for untextured spans) modulated by either
+		// a color per pixel or, if colors is NULL, a single color:
+		const unsigned int *texels;
+		const unsigned int *colors;
+		unsigned int color;
+
+		// depth of the first pixel and the step from pixel to pixel:
+		float z;
+		float dz;
+
+		// render state (compare funcs are Graphics::CompareFunc values,
+		// alphaFunc is CMP_ALWAYS when alpha testing is off):
+		int alphaFunc;
+		int alphaRef;
+		bool zTest;
+		bool zWrite;
+		int zFunc;
+		bool additive;
+	};
+
+	typedef void (*SoftSpanFunc)(const SoftSpan &span);
+
+	/*
+	 * the span shading kernels. every kernel produces exactly the same
+	 * pixels; the vectorized ones are just faster.
+	 */
+	class SoftSpanKernels
+	{
+	public:
+
+		enum Path
+		{
+			PATH_SCALAR,
+			PATH_SSE2,
+			PATH_AVX2,
+			PATH_COUNT
+		};
+
+		// the fastest path the cpu supports:
+		static Path getBestPath();
+
+		// whether a path can run on this cpu:
+		static bool isSupported(Path path);
+
+		static SoftSpanFunc getKernel(Path path);
+		static const char *getPathName(Path path);
+
+	private:
+
+		SoftSpanKernels() {}
+	};
+}
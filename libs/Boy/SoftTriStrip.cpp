@@ -0,0 +1,49 @@
+#include "SoftTriStrip.h"
+
+#include <assert.h>
+#include <string.h>
+
+using namespace Boy;
+
+#include "BoyLib/CrtDbgNew.h"
+
+SoftTriStrip::SoftTriStrip(int numVerts)
+{
+	mVertexCount = numVerts;
+	mVerts = new SoftVertex[numVerts];
+	memset(mVerts, 0, numVerts*sizeof(SoftVertex));
+}
+
+SoftTriStrip::~SoftTriStrip()
+{
+	delete[] mVerts;
+}
+
+void SoftTriStrip::setVertPos(int i, float x, float y, float z)
+{
+	assert(i>=0 && i<mVertexCount);
+	mVerts[i].x = x;
+	mVerts[i].y = y;
+	mVerts[i].z = z;
+}
+
+void SoftTriStrip::setVertTex(int i, float u, float v)
+{
+	assert(i>=0 && i<mVertexCount);
+	mVerts[i].u = u;
+	mVerts[i].v = v;
+}
+
+void SoftTriStrip::setVertColor(int i, Color color)
+{
+	assert(i>=0 && i<mVertexCount);
+	mVerts[i].color = (unsigned int)color;
+}
+
+void SoftTriStrip::setColor(Color color)
+{
+	for (int i=0 ; i<mVertexCount ; i++)
+	{
+		mVerts[i].color = (unsigned int)color;
+	}
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "SoftRasterizer.h"
+#include "TriStrip.h"
+
+namespace Boy
+{
+	/*
+	 * a tri strip for the software renderer. the vertices are kept
+	 * in world space, SoftGraphics maps them onto the screen.
+	 */
+	class SoftTriStrip : public TriStrip
+	{
+	public:
+
+		SoftTriStrip(int numVerts);
+		virtual ~SoftTriStrip();
+
+		virtual void setColor(Color color);
+
+		virtual void setVertPos(int i, float x, float y, float z);
+		virtual void setVertTex(int i, float u, float v);
+		virtual void setVertColor(int i, Color color);
+
+		inline int getVertexCount() { return mVertexCount; }
+		inline const SoftVertex *getVerts() { return mVerts; }
+
+	private:
+
+		int mVertexCount;
+		SoftVertex *mVerts;
+
+	};
+};
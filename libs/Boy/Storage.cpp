@@ -1,16 +1,86 @@
 
 #include "Storage.h"
 
+#include <assert.h>
+
 using namespace Boy;
 
 #include "BoyLib/CrtDbgNew.h"
 
-Storage::Storage()
+// the number of io threads behind ReadAsync():
+#define READ_THREAD_COUNT 2
+
+// set on an io thread while it's in a read callback:
+static thread_local bool gInReadCallback = false;
+
+Storage::Storage() :
+	mMapKey( 0 ),
+	mReadKey( 0 ),
+	mPrefetchesRunning( 0 ),
+	mReadQuit( false )
 {
 }
 
 Storage::~Storage()
 {
+	StopReads();
+
+	for( std::map<int,char*>::iterator i = mMapBuffers.begin(); i != mMapBuffers.end(); ++i )
+	{
+		delete [] i->second;
+	}
+	mMapBuffers.clear();
+}
+
+Storage::StorageResult Storage::FileMap( const char *pFilePathUtf8, BoyFileHandle *pMapHandleOut, const void **ppDataOut, int *pSizeBytesOut )
+{
+	StorageResult result = STORAGE_FAIL;
+
+	BoyFileHandle hFile;
+	if( pMapHandleOut && ppDataOut && pSizeBytesOut && FileOpen( pFilePathUtf8, STORAGE_MODE_READ | STORAGE_MUST_EXIST, &hFile ) == STORAGE_OK )
+	{
+		int size = FileGetSize( hFile );
+		if( size > 0 )
+		{
+			char *pData = new char[ size ];
+			if( FileRead( hFile, pData, size ) == STORAGE_OK )
+			{
+				std::lock_guard<std::mutex> lock( mMutex );
+				++mMapKey;
+				mMapBuffers[ mMapKey ] = pData;
+				*pMapHandleOut = (BoyFileHandle)mMapKey;
+				*ppDataOut = pData;
+				*pSizeBytesOut = size;
+				result = STORAGE_OK;
+			}
+			else
+			{
+				delete [] pData;
+			}
+		}
+		FileClose( hFile );
+	}
+
+	return result;
+}
+
+Storage::StorageResult Storage::FileUnmap( BoyFileHandle mapHandle )
+{
+	std::lock_guard<std::mutex> lock( mMutex );
+	std::map<int,char*>::iterator i = mMapBuffers.find( (int)mapHandle );
+	if( i == mMapBuffers.end() )
+	{
+		return STORAGE_FAIL;
+	}
+
+	delete [] i->second;
+	mMapBuffers.erase( i );
+	return STORAGE_OK;
+}
+
+Storage::StorageResult Storage::FileRename( const char *pFromPathUtf8, const char *pToPathUtf8 )
+{
+	return STORAGE_FAIL;
 }
 
 Storage::StorageResult Storage::FileGetSize( const char *pFilePath, int *pSizeBytesOut )
@@ -28,3 +98,177 @@ Storage::StorageResult Storage::FileGetSize( const char *pFilePath, int *pSizeBy
 
 	return result;
 }
+
+Storage::StorageResult Storage::FileSeek( BoyFileHandle fileHandle, int offset )
+{
+	return STORAGE_FAIL;
+}
+
+Storage::StorageResult Storage::FileReadAt( const char *pFilePathUtf8, int offset, int sizeBytes, void *pBuffer, int *pBytesReadOut )
+{
+	StorageResult result = STORAGE_FAIL;
+
+	BoyFileHandle hFile;
+	if( offset >= 0 && sizeBytes >= 0 && pBytesReadOut && FileOpen( pFilePathUtf8, STORAGE_MODE_READ | STORAGE_MUST_EXIST, &hFile ) == STORAGE_OK )
+	{
+		int size = FileGetSize( hFile );
+		int bytesRead = offset < size ? size - offset : 0;
+		bytesRead = bytesRead < sizeBytes ? bytesRead : sizeBytes;
+		if( size >= 0 && (bytesRead == 0 || ((offset == 0 || FileSeek( hFile, offset ) == STORAGE_OK) && FileRead( hFile, pBuffer, bytesRead ) == STORAGE_OK)) )
+		{
+			*pBytesReadOut = bytesRead;
+			result = STORAGE_OK;
+		}
+		FileClose( hFile );
+	}
+
+	return result;
+}
+
+Storage::ReadRequest Storage::ReadAsync( const char *pFilePathUtf8, int offset, int sizeBytes, void *pBuffer, ReadCallback callback, void *pContext, ReadPriority priority )
+{
+	if( !pFilePathUtf8 || offset < 0 || sizeBytes < 0 || (!pBuffer && sizeBytes > 0) || priority < 0 || priority >= READ_PRIORITY_COUNT )
+	{
+		return 0;
+	}
+
+	std::lock_guard<std::mutex> lock( mReadMutex );
+	if( mReadQuit )
+	{
+		return 0;
+	}
+
+	// the io threads start with the first read:
+	if( mReadThreads.empty() )
+	{
+		for( int i = 0; i < READ_THREAD_COUNT; i++ )
+		{
+			mReadThreads.push_back( std::thread( ReadProc, this ) );
+		}
+	}
+
+	AsyncRead read;
+	read.request = ++mReadKey;
+	read.path = pFilePathUtf8;
+	read.offset = offset;
+	read.sizeBytes = sizeBytes;
+	read.pBuffer = pBuffer;
+	read.callback = callback;
+	read.pContext = pContext;
+	read.priority = priority;
+	mReadQueues[ priority ].push_back( read );
+	mReadsPending.insert( read.request );
+	mReadCondition.notify_one();
+
+	return read.request;
+}
+
+bool Storage::ReadCancel( ReadRequest request )
+{
+	std::lock_guard<std::mutex> lock( mReadMutex );
+	for( int p = 0; p < READ_PRIORITY_COUNT; p++ )
+	{
+		std::deque<AsyncRead> &queue = mReadQueues[ p ];
+		for( std::deque<AsyncRead>::iterator i = queue.begin(); i != queue.end(); ++i )
+		{
+			if( i->request == request )
+			{
+				queue.erase( i );
+				mReadsPending.erase( request );
+				mReadDoneCondition.notify_all();
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
+
+void Storage::ReadWait( ReadRequest request )
+{
+	assert( !gInReadCallback );
+
+	std::unique_lock<std::mutex> lock( mReadMutex );
+	while( mReadsPending.find( request ) != mReadsPending.end() )
+	{
+		mReadDoneCondition.wait( lock );
+	}
+}
+
+void Storage::StopReads()
+{
+	{
+		std::lock_guard<std::mutex> lock( mReadMutex );
+		mReadQuit = true;
+		for( int p = 0; p < READ_PRIORITY_COUNT; p++ )
+		{
+			for( std::deque<AsyncRead>::iterator i = mReadQueues[ p ].begin(); i != mReadQueues[ p ].end(); ++i )
+			{
+				mReadsPending.erase( i->request );
+			}
+			mReadQueues[ p ].clear();
+		}
+		mReadCondition.notify_all();
+		mReadDoneCondition.notify_all();
+	}
+
+	for( size_t i = 0; i < mReadThreads.size(); i++ )
+	{
+		mReadThreads[ i ].join();
+	}
+	mReadThreads.clear();
+}
+
+void Storage::ReadProc( Storage *pStorage )
+{
+	std::unique_lock<std::mutex> lock( pStorage->mReadMutex );
+	while( true )
+	{
+		// the most urgent read (prefetches only if no other thread is
+		// prefetching):
+		std::deque<AsyncRead> *pQueue = NULL;
+		for( int p = 0; p < READ_PRIORITY_COUNT && !pQueue; p++ )
+		{
+			if( !pStorage->mReadQueues[ p ].empty() && (p != READ_PRIORITY_PREFETCH || pStorage->mPrefetchesRunning == 0) )
+			{
+				pQueue = &pStorage->mReadQueues[ p ];
+			}
+		}
+		if( !pQueue )
+		{
+			if( pStorage->mReadQuit )
+			{
+				return;
+			}
+			pStorage->mReadCondition.wait( lock );
+			continue;
+		}
+
+		AsyncRead read = pQueue->front();
+		pQueue->pop_front();
+		if( read.priority == READ_PRIORITY_PREFETCH )
+		{
+			pStorage->mPrefetchesRunning++;
+		}
+		lock.unlock();
+
+		int bytesRead = 0;
+		StorageResult result = pStorage->FileReadAt( read.path.c_str(), read.offset, read.sizeBytes, read.pBuffer, &bytesRead );
+		if( read.callback )
+		{
+			gInReadCallback = true;
+			read.callback( read.pContext, read.request, result, bytesRead );
+			gInReadCallback = false;
+		}
+
+		lock.lock();
+		if( read.priority == READ_PRIORITY_PREFETCH )
+		{
+			// (another prefetch can go now):
+			pStorage->mPrefetchesRunning--;
+			pStorage->mReadCondition.notify_all();
+		}
+		pStorage->mReadsPending.erase( read.request );
+		pStorage->mReadDoneCondition.notify_all();
+	}
+}
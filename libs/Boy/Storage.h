@@ -2,11 +2,20 @@
 #pragma once
 
 #include "Environment.h"
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
 
 namespace Boy
 {
 	/*
 	 * interface for a generic mass storage device that can read/write files
+	 * (any thread can use it, but a file handle belongs to one thread at a time)
 	 *
 	*/
 
@@ -31,6 +40,7 @@ namespace Boy
 
 				STORAGE_MUST_EXIST	= 0x0010,
 				STORAGE_OPEN_ALWAYS	= 0x0020,
+				STORAGE_APPEND		= 0x0040, // (writes go to the end, creates it if it's missing)
 				STORAGE_DISPO_MASK	= 0x00F0,
 			};
 
@@ -44,11 +54,96 @@ namespace Boy
 			virtual StorageResult FileClose( BoyFileHandle fileHandle ) = 0;
 			virtual int FileGetSize( BoyFileHandle openFileHandle ) = 0;
 
+			// moves the read/write position of an open file (offset from the
+			// start). the default implementation can't do it
+			virtual StorageResult FileSeek( BoyFileHandle fileHandle, int offset );
+
+			// read only memory mapped files (the data stays valid until FileUnmap()
+			// is called). the default implementation reads the whole file instead
+			virtual StorageResult FileMap( const char *pFilePathUtf8, BoyFileHandle *pMapHandleOut, const void **ppDataOut, int *pSizeBytesOut );
+			virtual StorageResult FileUnmap( BoyFileHandle mapHandle );
+
+			// replaces a file with another one (atomically where the file system
+			// can, so the destination is either all old or all new). the default
+			// implementation can't do it
+			virtual StorageResult FileRename( const char *pFromPathUtf8, const char *pToPathUtf8 );
+
+			// reads part of a file without an open handle, so any number of
+			// threads can read the same file at once. a read past the end is
+			// cut short (pBytesReadOut says how much there was). the default
+			// implementation opens the file, seeks and reads
+			virtual StorageResult FileReadAt( const char *pFilePathUtf8, int offset, int sizeBytes, void *pBuffer, int *pBytesReadOut );
+
+			// asynchronous reads: FileReadAt() on a couple of io threads. the
+			// callback is called on an io thread once the read is done (or
+			// has failed), and the buffer belongs to the storage until then.
+			// streaming reads go first, then level loading, then prefetching
+			// (which only ever gets one io thread, so the others stay free):
+			enum ReadPriority
+			{
+				READ_PRIORITY_STREAMING,
+				READ_PRIORITY_LOAD,
+				READ_PRIORITY_PREFETCH,
+				READ_PRIORITY_COUNT
+			};
+
+			typedef int ReadRequest; // (0 is never a request)
+			typedef void (*ReadCallback)( void *pContext, ReadRequest request, StorageResult result, int bytesRead );
+
+			ReadRequest ReadAsync( const char *pFilePathUtf8, int offset, int sizeBytes, void *pBuffer, ReadCallback callback, void *pContext, ReadPriority priority = READ_PRIORITY_LOAD );
+
+			// true if the read hadn't started yet (its callback won't be
+			// called). a read that has started can't be cancelled:
+			bool ReadCancel( ReadRequest request );
+
+			// returns once the read is done or cancelled. don't call it from a
+			// read callback (the io thread would wait on itself):
+			void ReadWait( ReadRequest request );
+
 			// helpers
 			StorageResult FileGetSize( const char *pFilePath, int *pSizeBytesOut );
 
 		protected:
 
+			// cancels the reads that are waiting and waits for the rest
+			// (implementations call it first thing in their destructor, the
+			// io threads call their FileReadAt()):
+			void StopReads();
+
+			// guards the handle tables:
+			std::mutex mMutex;
+
+			int mMapKey;
+
+		private:
+
+			struct AsyncRead
+			{
+				ReadRequest request;
+				std::string path;
+				int offset;
+				int sizeBytes;
+				void *pBuffer;
+				ReadCallback callback;
+				void *pContext;
+				ReadPriority priority;
+			};
+
+			static void ReadProc( Storage *pStorage );
+
+			std::map<int,char*> mMapBuffers;
+
+			// async reads (mReadMutex guards all of them):
+			std::mutex mReadMutex;
+			std::condition_variable mReadCondition;
+			std::condition_variable mReadDoneCondition;
+			std::vector<std::thread> mReadThreads;
+			std::deque<AsyncRead> mReadQueues[ READ_PRIORITY_COUNT ];
+			std::set<ReadRequest> mReadsPending; // queued or running
+			int mReadKey;
+			int mPrefetchesRunning;
+			bool mReadQuit;
+
 	};
 
 }
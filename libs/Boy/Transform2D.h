@@ -0,0 +1,123 @@
+#pragma once
+
+#include "BoyLib/CrtDbgInc.h"
+
+#include <math.h>
+
+#if defined(_M_X64) || defined(_M_AMD64) || (defined(_M_IX86_FP) && _M_IX86_FP>=1) || defined(__SSE__)
+	#define BOY_TRANSFORM2D_SSE
+	#include <xmmintrin.h>
+#endif
+
+namespace Boy
+{
+	/*
+	 * a 2d affine transform (2x2 linear part + translation). it follows
+	 * the same row vector convention as the d3dx matrices it replaces:
+	 *
+	 *   x' = a*x + c*y + tx
+	 *   y' = b*x + d*y + ty
+	 *
+	 * so 'm1 * m2' means m1 is applied first. the linear part is kept in
+	 * one 16 byte aligned row so four vertices can be transformed at once.
+	 */
+	class alignas(16) Transform2D
+	{
+	public:
+
+		inline void setIdentity()
+		{
+			a = 1; b = 0; c = 0; d = 1;
+			tx = 0; ty = 0;
+		}
+
+		inline void setScaling(float x, float y)
+		{
+			a = x; b = 0; c = 0; d = y;
+			tx = 0; ty = 0;
+		}
+
+		inline void setRotation(float rad)
+		{
+			float cs = cosf(rad);
+			float sn = sinf(rad);
+			a = cs; b = sn; c = -sn; d = cs;
+			tx = 0; ty = 0;
+		}
+
+		inline void setTranslation(float x, float y)
+		{
+			a = 1; b = 0; c = 0; d = 1;
+			tx = x; ty = y;
+		}
+
+		// this = this * m (m is applied after this transform):
+		inline void multiply(const Transform2D &m)
+		{
+			float na = a*m.a + b*m.c;
+			float nb = a*m.b + b*m.d;
+			float nc = c*m.a + d*m.c;
+			float nd = c*m.b + d*m.d;
+			float ntx = tx*m.a + ty*m.c + m.tx;
+			float nty = tx*m.b + ty*m.d + m.ty;
+			a = na; b = nb; c = nc; d = nd;
+			tx = ntx; ty = nty;
+		}
+
+		// this = m * this (m is applied before this transform):
+		inline void preMultiply(const Transform2D &m)
+		{
+			float na = m.a*a + m.b*c;
+			float nb = m.a*b + m.b*d;
+			float nc = m.c*a + m.d*c;
+			float nd = m.c*b + m.d*d;
+			float ntx = m.tx*a + m.ty*c + tx;
+			float nty = m.tx*b + m.ty*d + ty;
+			a = na; b = nb; c = nc; d = nd;
+			tx = ntx; ty = nty;
+		}
+
+		inline void transformPoint(float &x, float &y) const
+		{
+			float nx = a*x + c*y + tx;
+			y = b*x + d*y + ty;
+			x = nx;
+		}
+
+		/*
+		 * transforms the corners of an axis aligned rect, in
+		 * triangle strip order (tl, tr, bl, br)
+		 */
+		inline void transformRect(float minX, float minY, float maxX, float maxY, float *xs, float *ys) const
+		{
+#ifdef BOY_TRANSFORM2D_SSE
+			__m128 x = _mm_setr_ps(minX, maxX, minX, maxX);
+			__m128 y = _mm_setr_ps(minY, minY, maxY, maxY);
+			__m128 rx = _mm_add_ps(_mm_add_ps(
+				_mm_mul_ps(x, _mm_set1_ps(a)),
+				_mm_mul_ps(y, _mm_set1_ps(c))),
+				_mm_set1_ps(tx));
+			__m128 ry = _mm_add_ps(_mm_add_ps(
+				_mm_mul_ps(x, _mm_set1_ps(b)),
+				_mm_mul_ps(y, _mm_set1_ps(d))),
+				_mm_set1_ps(ty));
+			_mm_storeu_ps(xs, rx);
+			_mm_storeu_ps(ys, ry);
+#else
+			float axMin = a*minX, axMax = a*maxX;
+			float bxMin = b*minX, bxMax = b*maxX;
+			float cyMin = c*minY + tx, cyMax = c*maxY + tx;
+			float dyMin = d*minY + ty, dyMax = d*maxY + ty;
+			xs[0] = axMin + cyMin; ys[0] = bxMin + dyMin; // top left
+			xs[1] = axMax + cyMin; ys[1] = bxMax + dyMin; // top right
+			xs[2] = axMin + cyMax; ys[2] = bxMin + dyMax; // bottom left
+			xs[3] = axMax + cyMax; ys[3] = bxMax + dyMax; // bottom right
+#endif
+		}
+
+	public:
+
+		float a, b, c, d; // linear part
+		float tx, ty; // translation
+	};
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "BoyLib/CrtDbgInc.h"
+
+#include <assert.h>
+#include "Transform2D.h"
+#include <vector>
+
+namespace Boy
+{
+	/*
+	 * stack of 2d transforms. room for the usual nesting depth is
+	 * reserved up front, so pushing doesn't allocate unless it goes
+	 * deeper than that. it always holds at least one transform, which
+	 * starts out as the identity.
+	 */
+	class TransformStack
+	{
+	public:
+
+		enum { RESERVED = 64 };
+
+		TransformStack()
+		{
+			mStack.reserve(RESERVED);
+			mStack.resize(1);
+			mStack[0].setIdentity();
+		}
+
+		inline void push()
+		{
+			// (a copy, the top moves if the stack grows):
+			Transform2D xform = mStack.back();
+			mStack.push_back(xform);
+		}
+
+		inline void pop()
+		{
+			assert(mStack.size()>1);
+			mStack.pop_back();
+		}
+
+		inline Transform2D &top() { return mStack.back(); }
+		inline const Transform2D &top() const { return mStack.back(); }
+
+		inline int size() const { return (int)mStack.size(); }
+
+	private:
+
+		std::vector<Transform2D> mStack;
+	};
+}
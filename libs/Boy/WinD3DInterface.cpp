@@ -1,5 +1,6 @@
 #include "WinD3DInterface.h"
 
+#include <algorithm>
 #include <assert.h>
 #include "Boy/Mouse.h"
 #include "BoyLib/BoyUtil.h"
@@ -10,11 +11,16 @@
 #include <iostream>
 #include "Keyboard.h"
 #include "PersistenceLayer.h"
+#include "QuadMesh.h"
 #include "ResourceManager.h"
 #include <SDL3/SDL.h>
+#include "Storage.h"
 #include "WinEnvironment.h"
 #include "WinImage.h"
+#include "WinPrimitiveBatch.h"
+#include "WinSpriteBatch.h"
 #include "WinTriStrip.h"
+#include "WinTriStripPool.h"
 
 using namespace Boy;
 
@@ -25,6 +31,20 @@ using namespace Boy;
 
 #define DEFAULT_D3DFORMAT D3DFMT_X8R8G8B8
 
+// sprite batching parameters (max quads per draw call and how
+// many of those batches fit in the dynamic vertex buffer):
+#define SPRITE_BATCH_MAX_QUADS 2048
+#define SPRITE_BATCH_BUFFER_COUNT 4
+
+// size of the dynamic vertex buffer that debug primitives are streamed through:
+#define PRIMITIVE_BATCH_VERTEX_COUNT 0x10000
+
+// size of the vertex buffers that tri strips get their vertices from:
+#define TRI_STRIP_POOL_CHUNK_VERTEX_COUNT 0x8000
+
+// one past the highest D3DRENDERSTATETYPE value:
+#define RENDER_STATE_COUNT 256
+
 #include "BoyLib/CrtDbgNew.h"
 
 static int gAltDown = false;
@@ -176,11 +196,28 @@ WinD3DInterface::WinD3DInterface(Game *game, int width, int height, const char *
 		D3DCREATE_SOFTWARE_VERTEXPROCESSING | D3DCREATE_MULTITHREADED,
 		&pp,
 		&mD3D9Device);
+	mRenderStates = new DWORD[RENDER_STATE_COUNT];
+	mRenderStateKnown = new bool[RENDER_STATE_COUNT];
+	invalidateRenderStates();
 	initD3D();
 
-	// create the vertex buffer to be used 
-	// for drawing subrects of images:
-	mVertexBuffer = createVertexBuffer(4);
+	// create the sprite batcher that images are drawn through:
+	mSpriteBatch = new WinSpriteBatch(mD3D9Device, SPRITE_BATCH_MAX_QUADS, SPRITE_BATCH_BUFFER_COUNT);
+	mSpriteBatch->createBuffers();
+
+	// and the one that collects lines and rects for the end of the frame:
+	mPrimitiveBatch = new WinPrimitiveBatch(mD3D9Device, PRIMITIVE_BATCH_VERTEX_COUNT);
+	mPrimitiveBatch->createBuffers();
+
+	// and the pool that keeps tri strips on the device:
+	mTriStripPool = new WinTriStripPool(mD3D9Device, TRI_STRIP_POOL_CHUNK_VERTEX_COUNT);
+
+	// straight alpha unless the environment asks for premultiplied:
+	mPremultipliedAlpha = false;
+
+	// images are drawn in order until sorting is turned on:
+	mSorting = false;
+	mSortLayer = 0;
 
 	// clearing params:
 	mClearZ = PROJECTION_Z_FAR;
@@ -189,6 +226,11 @@ WinD3DInterface::WinD3DInterface(Game *game, int width, int height, const char *
 
 WinD3DInterface::~WinD3DInterface()
 {
+	delete mSpriteBatch;
+	delete mPrimitiveBatch;
+	mTriStripPool->release();
+	delete[] mRenderStates;
+	delete[] mRenderStateKnown;
 	mD3D9Device->Release();
 	mD3D9->Release();
 	SDL_DestroyWindow(mWindow);
@@ -280,20 +322,32 @@ bool WinD3DInterface::beginScene()
 
     mD3D9Device->SetTransform(D3DTS_PROJECTION, &matProjection);    // set the projection
 
-	// set some default state stuff:
-	mD3D9Device->SetRenderState(D3DRS_ALPHATESTENABLE, true);
-	mD3D9Device->SetRenderState(D3DRS_ALPHAREF, 1);
-	mD3D9Device->SetRenderState(D3DRS_ALPHABLENDENABLE, true);
-	mD3D9Device->SetRenderState(D3DRS_COLORVERTEX, true);
-	mD3D9Device->SetRenderState(D3DRS_BLENDOP,D3DBLENDOP_ADD);	
-	mD3D9Device->SetRenderState(D3DRS_SRCBLEND,D3DBLEND_SRCALPHA);
-	mD3D9Device->SetRenderState(D3DRS_DESTBLEND,D3DBLEND_INVSRCALPHA);
+	// set some default state stuff (only what the last frame changed
+	// actually reaches the device):
+	setRenderState(D3DRS_ALPHATESTENABLE, true);
+	setRenderState(D3DRS_ALPHAREF, 1);
+	setRenderState(D3DRS_ALPHABLENDENABLE, true);
+	setRenderState(D3DRS_COLORVERTEX, true);
+	setRenderState(D3DRS_BLENDOP,D3DBLENDOP_ADD);	
+	setRenderState(D3DRS_SRCBLEND,mPremultipliedAlpha?D3DBLEND_ONE:D3DBLEND_SRCALPHA);
+	setRenderState(D3DRS_DESTBLEND,D3DBLEND_INVSRCALPHA);
+
+	// start a new frame's worth of batches:
+	mSpriteBatch->beginFrame();
+	mPrimitiveBatch->beginFrame(this);
+	mTriStripPool->beginFrame();
 
 	return true;
 }
 
 void WinD3DInterface::endScene()
 {
+	// draw whatever is still queued (debug primitives go on top):
+	flushSortedSprites();
+	mSpriteBatch->endFrame();
+	mPrimitiveBatch->endFrame();
+	mTriStripPool->endFrame();
+
 	// reset the rendering flag:
 	mRendering = false;
 
@@ -328,30 +382,12 @@ void WinD3DInterface::handleError(HRESULT hr)
 	}
 }
 
-void WinD3DInterface::drawImage(IDirect3DTexture9 *tex)
-{
-	// make sure beginScene was called:
-	assert(mRendering);
-
-	// bind to image's vertex buffer:
-	HRESULT hr = mD3D9Device->SetStreamSource(0, mVertexBuffer, 0, sizeof(BoyVertex));
-	if(FAILED(hr)) return;
-
-	// set texture:
-	hr = mD3D9Device->SetTexture(0,tex);
-	if(FAILED(hr)) return;
-
-	// render from vertex buffer:
-	hr = mD3D9Device->DrawPrimitive(D3DPT_TRIANGLESTRIP, 0, 2);
-	if(FAILED(hr)) return;
-}
-
-void WinD3DInterface::drawImage(WinImage *image, DWORD color, float z)
+void WinD3DInterface::drawImage(WinImage *image, DWORD color, float z, const Transform2D &xform)
 {
-	drawImage(image, color, z, 0, 0, image->getWidth(), image->getHeight());
+	drawImage(image, color, z, xform, 0, 0, image->getWidth(), image->getHeight());
 }
 
-void WinD3DInterface::drawImage(WinImage *image, DWORD color, float z, int x, int y, int w, int h)
+void WinD3DInterface::drawImage(WinImage *image, DWORD color, float z, const Transform2D &xform, int x, int y, int w, int h)
 {
 	if (image->getTexture()==NULL)
 	{
@@ -381,46 +417,120 @@ void WinD3DInterface::drawImage(WinImage *image, DWORD color, float z, int x, in
 	}
 	else
 	{
+		// (the image may be somewhere on a shared atlas page):
 		float texW = (float)textureInfo.Width;
 		float texH = (float)textureInfo.Height;
-		minU = x / texW;
-		minV = y / texH;
+		minU = (image->getTextureX() + x) / texW;
+		minV = (image->getTextureY() + y) / texH;
 		maxU = minU + w / texW;
 		maxV = minV + h / texH;
 	}
-	int numVerts = 4;
+
+	// transform the corners on the cpu so that images with
+	// different transforms can still share a batch:
+	float xs[4], ys[4];
+	xform.transformRect(minX, minY, maxX, maxY, xs, ys);
+
 	BoyVertex data[] = 
 	{
-		{minX, minY, z, color, minU, minV}, // top left
-		{maxX, minY, z, color, maxU, minV}, // top right
-		{minX, maxY, z, color, minU, maxV}, // bottom left
-		{maxX, maxY, z, color, maxU, maxV}  // bottom right
+		{xs[0], ys[0], z, color, minU, minV}, // top left
+		{xs[1], ys[1], z, color, maxU, minV}, // top right
+		{xs[2], ys[2], z, color, minU, maxV}, // bottom left
+		{xs[3], ys[3], z, color, maxU, maxV}  // bottom right
 	};
 
-	// lock the vertex buffer:
-	void *vbData = NULL;
-	hr = mVertexBuffer->Lock(0, 0, &vbData, 0);
-	assert(!FAILED(hr));
+	// make sure beginScene was called:
+	assert(mRendering);
 
-	// copy the data into the buffer:
-	int byteCount = sizeof(BoyVertex) * numVerts;
-	memcpy(vbData, data, byteCount);
+	queueSprite(image->getTexture(), data);
+}
+
+void WinD3DInterface::drawQuadMesh(WinImage *image, DWORD color, float z, const Transform2D &xform, const QuadMesh *mesh)
+{
+	if (image->getTexture()==NULL)
+	{
+		envDebugLog("WARNING: trying to draw image with NULL texture (%s)\n",image->getPath().c_str());
+		return;
+	}
+
+	// make sure beginScene was called:
+	assert(mRendering);
+
+	// pixel to texture coordinate mapping (see drawImage):
+	float uScale, vScale, uOffset, vOffset;
+	if (image->isTextureScaled())
+	{
+		uScale = 1.0f / image->getWidth();
+		vScale = 1.0f / image->getHeight();
+		uOffset = 0;
+		vOffset = 0;
+	}
+	else
+	{
+		D3DSURFACE_DESC textureInfo;
+		HRESULT hr = image->getTexture()->GetLevelDesc(0,&textureInfo);
+		assert(!FAILED(hr));
+		uScale = 1.0f / textureInfo.Width;
+		vScale = 1.0f / textureInfo.Height;
+		uOffset = image->getTextureX() * uScale;
+		vOffset = image->getTextureY() * vScale;
+	}
+
+	// all quads share the texture, so they end up in one batch:
+	int count = mesh->getQuadCount();
+	const QuadMesh::Quad *quads = mesh->getQuads();
+	for (int i=0 ; i<count ; i++)
+	{
+		const QuadMesh::Quad &q = quads[i];
+		float minU = uOffset + q.subrectX * uScale;
+		float minV = vOffset + q.subrectY * vScale;
+		float maxU = minU + q.subrectW * uScale;
+		float maxV = minV + q.subrectH * vScale;
+
+		float xs[4], ys[4];
+		xform.transformRect(q.minX, q.minY, q.maxX, q.maxY, xs, ys);
+
+		// the mesh's colors are straight alpha too:
+		DWORD qcolor = mPremultipliedAlpha ? premultiplyColor(q.color) : q.color;
+		qcolor = QuadMesh::modulate(color, qcolor);
+
+		BoyVertex data[] = 
+		{
+			{xs[0], ys[0], z, qcolor, minU, minV}, // top left
+			{xs[1], ys[1], z, qcolor, maxU, minV}, // top right
+			{xs[2], ys[2], z, qcolor, minU, maxV}, // bottom left
+			{xs[3], ys[3], z, qcolor, maxU, maxV}  // bottom right
+		};
+		queueSprite(image->getTexture(), data);
+	}
+}
 
-	// unlock it:
-	mVertexBuffer->Unlock();
+void WinD3DInterface::queueSprite(IDirect3DTexture9 *texture, const BoyVertex *verts)
+{
+	// hold it back for sorting:
+	if (mSorting)
+	{
+		SortedSprite sprite;
+		sprite.layer = mSortLayer;
+		sprite.srcBlend = getRenderState(D3DRS_SRCBLEND);
+		sprite.destBlend = getRenderState(D3DRS_DESTBLEND);
+		sprite.texture = texture;
+		memcpy(sprite.verts, verts, sizeof(sprite.verts));
+		mSortedSprites.push_back(sprite);
+		return;
+	}
 
-	// draw the image:
-	drawImage(image->getTexture());
+	// queue the image:
+	mSpriteBatch->addQuad(texture, verts);
 }
 
-void WinD3DInterface::drawRect(int x, int y, int w, int h, float z, DWORD color)
+void WinD3DInterface::fillRect(int x, int y, int w, int h, float z, DWORD color)
 {
 	float minX = (float)x;
 	float minY = (float)y;
 	float maxX = minX + w;
 	float maxY = minY + h;
 
-	int numVerts = 4;
 	BoyVertex data[] = 
 	{
 		{minX, minY, z, color, 0, 0}, // top left
@@ -429,106 +539,69 @@ void WinD3DInterface::drawRect(int x, int y, int w, int h, float z, DWORD color)
 		{maxX, maxY, z, color, 0, 0}  // bottom right
 	};
 
-	// lock the vertex buffer:
-	void *vbData = NULL;
-	HRESULT hr = mVertexBuffer->Lock(0, 0, &vbData, 0);
-	handleError(hr);
+	// make sure beginScene was called:
+	assert(mRendering);
 
-	// copy the data into the buffer:
-	int byteCount = sizeof(BoyVertex) * numVerts;
-	memcpy(vbData, data, byteCount);
+	// queue the rect (untextured, in order with the sprites):
+	queueSprite(NULL, data);
+}
 
-	// unlock it:
-	mVertexBuffer->Unlock();
+void WinD3DInterface::drawRect(int x, int y, int w, int h, DWORD color)
+{
+	// make sure beginScene was called:
+	assert(mRendering);
 
-	// draw the image:
-	drawImage(NULL);
+	// outlines are lines, so they're drawn at z=0 as well:
+	mPrimitiveBatch->addRect((float)x, (float)y, (float)w, (float)h, 0, color);
 }
 
-void WinD3DInterface::drawTriStrip(WinTriStrip *strip)
+void WinD3DInterface::drawCircle(int x, int y, int radius, DWORD color)
 {
 	// make sure beginScene was called:
 	assert(mRendering);
 
-	// create a vertex buffer:
-	IDirect3DVertexBuffer9 *vb = createVertexBuffer(strip->mVertexCount);
-
-	// lock the vertex buffer:
-	void *vbData = NULL;
-	HRESULT hr = vb->Lock(0, 0, &vbData, 0);
-	handleError(hr);
+	mPrimitiveBatch->addCircle((float)x, (float)y, (float)radius, 0, color);
+}
 
-	// copy the data into the buffer:
-	int byteCount = sizeof(BoyVertex) * strip->mVertexCount;
-	memcpy(vbData, strip->mVerts, byteCount);
+void WinD3DInterface::drawTriStrip(WinTriStrip *strip)
+{
+	// make sure beginScene was called:
+	assert(mRendering);
 
-	// unlock it:
-	vb->Unlock();
+	if (strip->mVertexCount<3)
+	{
+		return;
+	}
 
-	// bind to tristrip's vertex buffer:
-	hr = mD3D9Device->SetStreamSource(0, vb, 0, sizeof(BoyVertex));
-	if(FAILED(hr)) return;
+	// queued sprites have to go out first:
+	flushSortedSprites();
+	mSpriteBatch->flush(WinSpriteBatch::FLUSH_PRIMITIVE);
 
 	// set texture to NULL:
-	hr = mD3D9Device->SetTexture(0,NULL);
+	HRESULT hr = mD3D9Device->SetTexture(0,NULL);
 	if(FAILED(hr)) return;
 
-	// render from vertex buffer:
-	hr = mD3D9Device->DrawPrimitive(D3DPT_TRIANGLESTRIP, 0, strip->mVertexCount-2);
-	if(FAILED(hr)) return;
+	// bring the strip's vertex buffer up to date:
+	if (!strip->prepare())
+	{
+		// it doesn't have one, draw straight from its vertices:
+		mD3D9Device->DrawPrimitiveUP(D3DPT_TRIANGLESTRIP, strip->mVertexCount-2, strip->mVerts, sizeof(BoyVertex));
+		return;
+	}
 
-	// release the vertex buffer:
-	vb->Release();
+	// render from the strip's part of the vertex buffer:
+	hr = mD3D9Device->SetStreamSource(0, strip->getBuffer(), 0, sizeof(BoyVertex));
+	if(FAILED(hr)) return;
+	mD3D9Device->DrawPrimitive(D3DPT_TRIANGLESTRIP, strip->getBufferOffset(), strip->mVertexCount-2);
 }
 
 void WinD3DInterface::drawLine(int x0, int y0, int x1, int y1, Color color)
 {
-	BoyVertex verts[2];
-	verts[0].x = (float)x0;
-	verts[0].y = (float)y0;
-	verts[0].z = 0;
-	verts[0].u = 0;
-	verts[0].v = 0;
-	verts[0].color = color;
-	verts[1].x = (float)x1;
-	verts[1].y = (float)y1;
-	verts[1].z = 0;
-	verts[1].u = 0;
-	verts[1].v = 0;
-	verts[1].color = color;
-
 	// make sure beginScene was called:
 	assert(mRendering);
 
-	// create a vertex buffer:
-	IDirect3DVertexBuffer9 *vb = createVertexBuffer(2);
-
-	// lock the vertex buffer:
-	void *vbData = NULL;
-	HRESULT hr = vb->Lock(0, 0, &vbData, 0);
-	handleError(hr);
-
-	// copy the data into the buffer:
-	int byteCount = sizeof(BoyVertex) * 2;
-	memcpy(vbData, verts, byteCount);
-
-	// unlock it:
-	vb->Unlock();
-
-	// bind to tristrip's vertex buffer:
-	hr = mD3D9Device->SetStreamSource(0, vb, 0, sizeof(BoyVertex));
-	if(FAILED(hr)) return;
-
-	// set texture to NULL:
-	hr = mD3D9Device->SetTexture(0,NULL);
-	if(FAILED(hr)) return;
-
-	// render from vertex buffer:
-	hr = mD3D9Device->DrawPrimitive(D3DPT_LINELIST, 0, 1);
-	if(FAILED(hr)) return;
-
-	// release the vertex buffer:
-	vb->Release();
+	// queue the line (at z=0):
+	mPrimitiveBatch->addLine((float)x0, (float)y0, (float)x1, (float)y1, 0, color);
 }
 
 #include <wchar.h>
@@ -552,13 +625,30 @@ IDirect3DTexture9 *WinD3DInterface::loadTexture(const char *filenameUtf8, D3DXIM
 	// declare some variables:
 	IDirect3DTexture9 *tex = NULL;
 
+	// map the file (it might be in a resource pack):
+	Storage *storage = Environment::instance()->getStorage();
+	BoyFileHandle hMap;
+	const void *data;
+	int size;
+	if (storage->FileMap(filenameUtf8, &hMap, &data, &size) != Storage::STORAGE_OK)
+	{
+		if (warn)
+		{
+			printf("WARNING: could not read '%s'\n",filenameUtf8);
+		}
+		return NULL;
+	}
+
 	// get image info:
-	UString filename(filenameUtf8);
-	HRESULT result = D3DXGetImageInfoFromFile(filename.wc_str(), imageInfo);
-	if (result != D3D_OK && warn)
+	HRESULT result = D3DXGetImageInfoFromFileInMemory(data, size, imageInfo);
+	if (result != D3D_OK)
 	{
-		printf("WARNING: D3DXGetImageInfoFromFile failed for '%s'\n",filename.toUtf8());
-		assertSuccess(result);
+		if (warn)
+		{
+			printf("WARNING: D3DXGetImageInfoFromFileInMemory failed for '%s'\n",filenameUtf8);
+			assertSuccess(result);
+		}
+		storage->FileUnmap(hMap);
 		return NULL;
 	}
 
@@ -600,9 +690,10 @@ IDirect3DTexture9 *WinD3DInterface::loadTexture(const char *filenameUtf8, D3DXIM
 	}
 
 	// load the texture:
-	HRESULT hr = D3DXCreateTextureFromFileEx(
+	HRESULT hr = D3DXCreateTextureFromFileInMemoryEx(
 		mD3D9Device, // device
-		filename.wc_str(), // file to load from
+		data, // file to load from
+		size, // file size
 		width, // width
 		height, // height
 		D3DX_DEFAULT, // mipmap level count
@@ -616,9 +707,11 @@ IDirect3DTexture9 *WinD3DInterface::loadTexture(const char *filenameUtf8, D3DXIM
 		NULL, // no palette
 		&tex); // the texture object to load the image into
 
+	storage->FileUnmap(hMap);
+
 	if (hr!=D3D_OK && warn)
 	{
-		printf("WARNING: D3DXCreateTextureFromFileEx failed for '%s'\n",filename.toUtf8());
+		printf("WARNING: D3DXCreateTextureFromFileInMemoryEx failed for '%s'\n",filenameUtf8);
 		printf("w=%d h=%d filter=0x%x colorKey=0x%x\n",width,height,filter,colorKey);
 		assertSuccess(hr);
 	}
@@ -629,6 +722,122 @@ IDirect3DTexture9 *WinD3DInterface::loadTexture(const char *filenameUtf8, D3DXIM
 	return tex;
 }
 
+void WinD3DInterface::premultiplyTexture(IDirect3DTexture9 *tex)
+{
+	// only textures with an alpha channel need it:
+	D3DSURFACE_DESC desc;
+	HRESULT hr = tex->GetLevelDesc(0,&desc);
+	if (FAILED(hr) || desc.Format!=D3DFMT_A8R8G8B8)
+	{
+		return;
+	}
+
+	// every mip level:
+	DWORD levels = tex->GetLevelCount();
+	for (DWORD level=0 ; level<levels ; level++)
+	{
+		tex->GetLevelDesc(level,&desc);
+		D3DLOCKED_RECT rect;
+		hr = tex->LockRect(level, &rect, NULL, 0);
+		if (FAILED(hr)) continue;
+		for (UINT y=0 ; y<desc.Height ; y++)
+		{
+			DWORD *row = (DWORD*)((unsigned char*)rect.pBits + y * rect.Pitch);
+			for (UINT x=0 ; x<desc.Width ; x++)
+			{
+				row[x] = premultiplyColor(row[x]);
+			}
+		}
+		tex->UnlockRect(level);
+	}
+}
+
+DWORD WinD3DInterface::premultiplyColor(DWORD color)
+{
+	DWORD a = color >> 24;
+	if (a==0xff)
+	{
+		return color;
+	}
+	DWORD r = (((color >> 16) & 0xff) * a + 127) / 255;
+	DWORD g = (((color >> 8) & 0xff) * a + 127) / 255;
+	DWORD b = ((color & 0xff) * a + 127) / 255;
+	return (a << 24) | (r << 16) | (g << 8) | b;
+}
+
+IDirect3DTexture9 *WinD3DInterface::createTexture(const unsigned int *pixels, int width, int height)
+{
+	// the image goes in the top left corner of a power of 2 texture,
+	// just like D3DXCreateTextureFromFileEx puts it there:
+	int texWidth = (int)findNextHigherPowerOf2(width);
+	int texHeight = (int)findNextHigherPowerOf2(height);
+	if (texWidth > (int)mMaxTextureWidth || texHeight > (int)mMaxTextureHeight)
+	{
+		return NULL;
+	}
+
+	IDirect3DTexture9 *tex = NULL;
+	HRESULT hr = mD3D9Device->CreateTexture(
+		texWidth,
+		texHeight,
+		0, // full mipmap chain
+		0, // usage
+		D3DFMT_A8R8G8B8,
+		D3DPOOL_MANAGED,
+		&tex,
+		NULL);
+	if(FAILED(hr)) return NULL;
+
+	D3DLOCKED_RECT rect;
+	hr = tex->LockRect(0, &rect, NULL, 0);
+	if (FAILED(hr))
+	{
+		tex->Release();
+		return NULL;
+	}
+	unsigned char *bits = (unsigned char*)rect.pBits;
+	for (int y=0 ; y<texHeight ; y++)
+	{
+		unsigned int *dst = (unsigned int*)(bits + y * rect.Pitch);
+		if (y>=height)
+		{
+			memset(dst, 0, texWidth * sizeof(unsigned int));
+			continue;
+		}
+
+		// map transparent white pixels to black like loadTexture does:
+		const unsigned int *src = pixels + y * width;
+		for (int x=0 ; x<width ; x++)
+		{
+			dst[x] = src[x]==0x00ffffff ? 0 : src[x];
+		}
+		memset(dst + width, 0, (texWidth - width) * sizeof(unsigned int));
+	}
+	tex->UnlockRect(0);
+
+	// fill in the smaller mip levels:
+	D3DXFilterTexture(tex, NULL, 0, D3DX_DEFAULT);
+
+	return tex;
+}
+
+IDirect3DTexture9 *WinD3DInterface::createTexture(int width, int height)
+{
+	IDirect3DTexture9 *tex = NULL;
+	HRESULT hr = mD3D9Device->CreateTexture(
+		width,
+		height,
+		1, // mipmap level count
+		0, // usage
+		D3DFMT_A8R8G8B8,
+		D3DPOOL_MANAGED,
+		&tex,
+		NULL);
+	if(FAILED(hr)) return NULL;
+
+	return tex;
+}
+
 IDirect3DVertexBuffer9 *WinD3DInterface::createVertexBuffer(int numVerts)
 {
 	// create the vertex buffer:
@@ -705,30 +914,143 @@ void WinD3DInterface::initD3D()
 
 void WinD3DInterface::setTransform(D3DXMATRIX &xform)
 {
+	// queued sprites were meant for the old transform:
+	flushSortedSprites();
+	mSpriteBatch->flush(WinSpriteBatch::FLUSH_TRANSFORM);
+
 	// set the new transform:
 	mD3D9Device->SetTransform(D3DTS_WORLD, &xform);
 }
 
 void WinD3DInterface::setSamplerState(D3DSAMPLERSTATETYPE state, DWORD value)
 {
+	flushSortedSprites();
+	mSpriteBatch->flush(WinSpriteBatch::FLUSH_RENDER_STATE);
 	mD3D9Device->SetSamplerState(0,state,value);
 }
 
 void WinD3DInterface::setRenderState(D3DRENDERSTATETYPE state, DWORD value)
 {
+	assert(state>=0 && state<RENDER_STATE_COUNT);
+
+	// nothing to do if the device already has it:
+	if (mRenderStateKnown[state] && mRenderStates[state]==value)
+	{
+		return;
+	}
+
+	// queued sprites were meant for the old state:
+	switch (state)
+	{
+	case D3DRS_SRCBLEND:
+	case D3DRS_DESTBLEND:
+		// sorted sprites remember their blend mode:
+		mSpriteBatch->flush(WinSpriteBatch::FLUSH_BLEND_MODE);
+		break;
+	case D3DRS_BLENDOP:
+		flushSortedSprites();
+		mSpriteBatch->flush(WinSpriteBatch::FLUSH_BLEND_MODE);
+		break;
+	case D3DRS_ZENABLE:
+	case D3DRS_ZWRITEENABLE:
+	case D3DRS_ZFUNC:
+		flushSortedSprites();
+		mSpriteBatch->flush(WinSpriteBatch::FLUSH_Z_STATE);
+		break;
+	default:
+		flushSortedSprites();
+		mSpriteBatch->flush(WinSpriteBatch::FLUSH_RENDER_STATE);
+		break;
+	}
+
+	// queued primitives get grouped by state:
+	mPrimitiveBatch->setRenderState(state,value);
+
 	HRESULT hr = mD3D9Device->SetRenderState(state,value);
 	assertSuccess(hr);
+	mRenderStates[state] = value;
+	mRenderStateKnown[state] = !FAILED(hr);
 }
 
 DWORD WinD3DInterface::getRenderState(D3DRENDERSTATETYPE state)
 {
-	DWORD value;
-	mD3D9Device->GetRenderState(state,&value);
-	return value;
+	assert(state>=0 && state<RENDER_STATE_COUNT);
+
+	// only ask the device about states that were never set:
+	if (!mRenderStateKnown[state])
+	{
+		mD3D9Device->GetRenderState(state,&mRenderStates[state]);
+		mRenderStateKnown[state] = true;
+	}
+	return mRenderStates[state];
+}
+
+void WinD3DInterface::invalidateRenderStates()
+{
+	for (int i=0 ; i<RENDER_STATE_COUNT ; i++)
+	{
+		mRenderStateKnown[i] = false;
+	}
+}
+
+void WinD3DInterface::setSortingEnabled(bool enabled)
+{
+	if (!enabled)
+	{
+		flushSortedSprites();
+	}
+	mSorting = enabled;
+}
+
+void WinD3DInterface::setSortLayer(int layer)
+{
+	mSortLayer = layer;
+}
+
+// sort key: layer, then blend mode, then texture (the sort is
+// stable, so sprites that share all three keep their order):
+static bool sortedSpriteLess(const WinD3DInterface::SortedSprite &a, const WinD3DInterface::SortedSprite &b)
+{
+	if (a.layer!=b.layer) return a.layer < b.layer;
+	if (a.srcBlend!=b.srcBlend) return a.srcBlend < b.srcBlend;
+	if (a.destBlend!=b.destBlend) return a.destBlend < b.destBlend;
+	return a.texture < b.texture;
+}
+
+void WinD3DInterface::flushSortedSprites()
+{
+	if (mSortedSprites.empty())
+	{
+		return;
+	}
+
+	std::stable_sort(mSortedSprites.begin(), mSortedSprites.end(), sortedSpriteLess);
+
+	// feed them to the sprite batch, switching blend modes as needed
+	// (blend changes don't flush the sorted sprites, so this is safe):
+	DWORD srcBlend = getRenderState(D3DRS_SRCBLEND);
+	DWORD destBlend = getRenderState(D3DRS_DESTBLEND);
+	for (size_t i=0 ; i<mSortedSprites.size() ; i++)
+	{
+		SortedSprite &sprite = mSortedSprites[i];
+		setRenderState(D3DRS_SRCBLEND, sprite.srcBlend);
+		setRenderState(D3DRS_DESTBLEND, sprite.destBlend);
+		mSpriteBatch->addQuad(sprite.texture, sprite.verts);
+	}
+	mSortedSprites.clear();
+
+	// back to the blend mode the game set last:
+	setRenderState(D3DRS_SRCBLEND, srcBlend);
+	setRenderState(D3DRS_DESTBLEND, destBlend);
 }
 
 void WinD3DInterface::setClipRect(int x, int y, int width, int height)
 {
+	// everything that's queued is drawn with the old clip rect:
+	flushSortedSprites();
+	mSpriteBatch->flush(WinSpriteBatch::FLUSH_CLIP_RECT);
+	mPrimitiveBatch->flush();
+
 	RECT rect;
 	rect.left = x;
 	rect.right = x+width;
@@ -874,7 +1196,8 @@ void WinD3DInterface::dumpInfo(std::ofstream &file)
 
 void WinD3DInterface::handleLostDevice()
 {
-	mVertexBuffer->Release();
+	mSpriteBatch->releaseBuffers();
+	mPrimitiveBatch->releaseBuffers();
 	ResourceManager *rm = Environment::instance()->getResourceManager();
 	if (rm!=NULL)
 	{
@@ -892,7 +1215,12 @@ void WinD3DInterface::handleResetDevice()
 	bool fullscreen = env->isFullScreen();
 	pl->putString("fullscreen",fullscreen?"true":"false",true);
 
-	mVertexBuffer = createVertexBuffer(4);
+	mSpriteBatch->createBuffers();
+	mPrimitiveBatch->createBuffers();
+
+	// a reset puts every render state back to its default:
+	invalidateRenderStates();
+
 	ResourceManager *rm = Environment::instance()->getResourceManager();
 	if (rm!=NULL)
 	{
@@ -5,7 +5,9 @@
 #include "SDL3/SDL.h"
 #include "Environment.h"
 #include "Graphics.h"
+#include "Transform2D.h"
 #include <string>
+#include <vector>
 
 namespace Boy
 {
@@ -19,8 +21,12 @@ namespace Boy
 	};
 
 	class Game;
+	class QuadMesh;
 	class WinImage;
+	class WinPrimitiveBatch;
+	class WinSpriteBatch;
 	class WinTriStrip;
+	class WinTriStripPool;
 
 	class WinD3DInterface
 	{
@@ -38,18 +44,44 @@ namespace Boy
 		// rendering methods:
 		bool beginScene();
 		void endScene();
-		void drawImage(WinImage *image, DWORD color, float z);
-		void drawImage(WinImage *image, DWORD color, float z, int x, int y, int w, int h);
-		void drawRect(int x, int y, int w, int h, float z, DWORD color);
+		void drawImage(WinImage *image, DWORD color, float z, const Transform2D &xform);
+		void drawImage(WinImage *image, DWORD color, float z, const Transform2D &xform, int x, int y, int w, int h);
+		void drawQuadMesh(WinImage *image, DWORD color, float z, const Transform2D &xform, const QuadMesh *mesh);
 		void drawTriStrip(WinTriStrip *strip);
+
+		// filled rects are drawn in order with the sprites:
+		void fillRect(int x, int y, int w, int h, float z, DWORD color);
+
+		// debug primitives (queued until endScene or the next clip rect
+		// change, see WinPrimitiveBatch):
+		void drawRect(int x, int y, int w, int h, DWORD color);
+		void drawCircle(int x, int y, int radius, DWORD color);
 		void drawLine(int x0, int y0, int x1, int y1, Color color);
 
-		// world transformation:
+		// world transformation (the graphics object transforms
+		// vertices itself and leaves this as the identity):
 		void setTransform(D3DXMATRIX &xform);
 
 		// texture loading:
 		IDirect3DTexture9 *loadTexture(const char *filenameUtf8, D3DXIMAGE_INFO *imageInfo, bool *scaled, bool warn=true);
 
+		// creates a texture (with mipmaps) from decoded argb pixels, the
+		// way loadTexture would from the file. returns NULL if the image
+		// would have to be scaled, which only loadTexture does:
+		IDirect3DTexture9 *createTexture(const unsigned int *pixels, int width, int height);
+
+		// premultiplied alpha mode (images are premultiplied when they
+		// load, so this has to be set before any are loaded):
+		inline void setPremultipliedAlpha(bool enabled) { mPremultipliedAlpha = enabled; }
+		inline bool isPremultipliedAlpha() { return mPremultipliedAlpha; }
+		void premultiplyTexture(IDirect3DTexture9 *tex);
+		static DWORD premultiplyColor(DWORD color);
+
+		// creates an empty 32 bit argb texture (one mip level, managed pool):
+		IDirect3DTexture9 *createTexture(int width, int height);
+		inline int getMaxTextureWidth() { return (int)mMaxTextureWidth; }
+		inline int getMaxTextureHeight() { return (int)mMaxTextureHeight; }
+
 		// vertex buffer creation:
 		IDirect3DVertexBuffer9 *createVertexBuffer(int numVerts);
 
@@ -57,14 +89,26 @@ namespace Boy
 		inline void setClearZ(float z) { mClearZ = z; }
 		inline void setClearColor(DWORD color) { mClearColor = color; }
 
-		// d3d state:
+		// d3d state (render states are shadowed, setting a state to the
+		// value it already has is free and queries never hit the device):
 		void setSamplerState(D3DSAMPLERSTATETYPE state, DWORD value);
 		void setRenderState(D3DRENDERSTATETYPE state, DWORD value);
 		DWORD getRenderState(D3DRENDERSTATETYPE state);
 
+		// image sorting (see Graphics::setSortingEnabled):
+		void setSortingEnabled(bool enabled);
+		void setSortLayer(int layer);
+
 		// clipping:
 		void setClipRect(int x, int y, int width, int height);
 
+		// sprite batching:
+		inline WinSpriteBatch *getSpriteBatch() { return mSpriteBatch; }
+		inline WinPrimitiveBatch *getPrimitiveBatch() { return mPrimitiveBatch; }
+
+		// where tri strips keep their vertices:
+		inline WinTriStripPool *getTriStripPool() { return mTriStripPool; }
+
 		// misc:
 		void dumpInfo(std::ofstream &file);
 		void handleLostDevice();
@@ -72,11 +116,23 @@ namespace Boy
 		IDirect3DDevice9* GetD3DDevice();
 		SDL_Window* GetSDLWindow();
 
+		// an image held back for sorting:
+		struct SortedSprite
+		{
+			int layer;
+			DWORD srcBlend;
+			DWORD destBlend;
+			IDirect3DTexture9 *texture;
+			BoyVertex verts[4];
+		};
+
 	private:
 
 		void initD3D();
+		void invalidateRenderStates();
+		void flushSortedSprites();
+		void queueSprite(IDirect3DTexture9 *texture, const BoyVertex *verts);
 		void assertSuccess(HRESULT hr);
-		void drawImage(IDirect3DTexture9 *tex);
 		void printDisplayModes(D3DFORMAT format, bool windowed);
 		void handleError(HRESULT hr);
 
@@ -95,7 +151,20 @@ namespace Boy
 
 		bool					mRendering;
 
-		IDirect3DVertexBuffer9	*mVertexBuffer;
+		WinSpriteBatch			*mSpriteBatch;
+		WinPrimitiveBatch		*mPrimitiveBatch;
+		WinTriStripPool			*mTriStripPool;
+
+		// shadow copy of the device's render states:
+		DWORD					*mRenderStates;
+		bool					*mRenderStateKnown;
+
+		// images waiting to be sorted:
+		bool					mSorting;
+		int						mSortLayer;
+		std::vector<SortedSprite> mSortedSprites;
+
+		bool					mPremultipliedAlpha;
 
 		float					mClearZ;
 		DWORD					mClearColor;
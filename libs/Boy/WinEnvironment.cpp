@@ -7,20 +7,30 @@
 #include "Game.h"
 #include "Keyboard.h"
 #include "Mouse.h"
+#include "PackStorage.h"
 #include "ResourceManager.h"
 #include "Util.h"
 #include "WinPersistenceLayer.h"
+#include "WinPrimitiveBatch.h"
 #include "WinGraphics.h"
 #include "WinD3DInterface.h"
 #include "WinResourceLoader.h"
 #include "WinSoundPlayer.h"
+#include "WinSpriteBatch.h"
 #include "WinTriStrip.h"
+#include "WinTriStripPool.h"
 #include "WinStorage.h"
 
 // the higher this number is, the lower the framerate will
 // drop before the game (simulation) starts to slow down:
 #define MAX_UPDATES_PER_DRAW 15
 
+// time per frame for finishing background loads (in milliseconds):
+#define DEFAULT_LOAD_BUDGET_MS 4
+
+// memory for resident (loaded and warm) resources (in megabytes):
+#define DEFAULT_RESOURCE_BUDGET_MB 128
+
 // uncomment this to get timing info for every update/draw call on the console
 // #define _VERBOSE_TIMING_STATS
 
@@ -80,6 +90,28 @@ void WinEnvironment::init(Game *game,
 	// load config:
 	loadConfig();
 
+	// resources can come from a pack (with the files on disk winning
+	// if the config asks for it, which is the default in debug builds):
+	std::string &packPath = mConfig["resource_pack"];
+	if (packPath.size() > 0)
+	{
+#ifdef _DEBUG
+		bool looseFiles = mConfig["pack_loose_files"] != "0";
+#else
+		bool looseFiles = mConfig["pack_loose_files"] == "1";
+#endif
+		PackStorage *pack = new PackStorage(mStorage, looseFiles);
+		mStorage = pack;
+		if (pack->Open(packPath.c_str()))
+		{
+			printf("resource pack '%s': %d files\n", packPath.c_str(), pack->GetPackFileCount());
+		}
+		else
+		{
+			printf("WARNING: could not open resource pack '%s'\n", packPath.c_str());
+		}
+	}
+
 	// sound:
 	mSoundPlayer = new WinSoundPlayer();
 	mLastVolume = -1;
@@ -97,6 +129,9 @@ void WinEnvironment::init(Game *game,
 		refreshRate = atoi(rrStr->second.c_str());
 	}
 	mPlatformInterface = new WinD3DInterface(game, screenWidth, screenHeight, windowTitle, windowed, refreshRate);
+
+	// premultiplied alpha lets normal and additive images share batches:
+	mPlatformInterface->setPremultipliedAlpha(mConfig["premultiplied_alpha"] == "1");
 	mLastKnownWindowSize.x = screenWidth;
 	mLastKnownWindowSize.y = screenHeight;
 
@@ -107,14 +142,31 @@ void WinEnvironment::init(Game *game,
 	{
 		langs.push_back("en");
 	}
-	mResourceLoader = new WinResourceLoader(langs[0],
+	WinResourceLoader *loader = new WinResourceLoader(langs[0],
 											langs.size() > 1 ? langs[1] : "",
 											mPlatformInterface);
 
+	// small images are packed into atlas pages unless the config says otherwise:
+	loader->setAtlasEnabled(mConfig["texture_atlas"] != "0");
+	mResourceLoader = loader;
+
+	// time each frame gets for handing background loaded resources to the device:
+	std::map<std::string, std::string>::iterator budgetStr = mConfig.find("load_budget_ms");
+	mLoadBudget = (budgetStr != mConfig.end() ? (float)atof(budgetStr->second.c_str()) : DEFAULT_LOAD_BUDGET_MS) / 1000.0f;
+
 	// resource manager:
 	mResourceManager = new ResourceManager(mResourceLoader, mpCryptoKey, langs[0],
 										   langs.size() > 1 ? langs[1] : "");
 
+	// released resources stay warm while they fit in this (0 turns it off):
+	std::map<std::string, std::string>::iterator residencyStr = mConfig.find("resource_budget_mb");
+	long long residencyBudget = residencyStr != mConfig.end() ? atoi(residencyStr->second.c_str()) : DEFAULT_RESOURCE_BUDGET_MB;
+	mResourceManager->getResidencyManager()->setBudget(residencyBudget * 1024 * 1024);
+
+	// resources that aren't loaded get loaded when they're first used:
+	std::map<std::string, std::string>::iterator demandStr = mConfig.find("demand_loading");
+	mResourceManager->setDemandLoading(demandStr != mConfig.end() && atoi(demandStr->second.c_str())!=0);
+
 	// graphics:
 	mGraphics = new WinGraphics(mPlatformInterface);
 
@@ -263,7 +315,7 @@ Wiimote *WinEnvironment::getWiimote(int i)
 
 TriStrip *WinEnvironment::createTriStrip(int numVerts)
 {
-	WinTriStrip *strip = new WinTriStrip(numVerts);
+	WinTriStrip *strip = new WinTriStrip(mPlatformInterface->getTriStripPool(), numVerts);
 	return strip;
 }
 
@@ -566,6 +618,9 @@ void WinEnvironment::startMainLoop()
 			DispatchMessage(&msg);
 		}
 
+		// finish some of the groups that are loading in the background:
+		mResourceManager->updateLoading(mLoadBudget);
+
 		// if we're not paused, update:
 		if (mPauseCount == 0)
 		{
@@ -631,6 +686,7 @@ void WinEnvironment::draw()
 	}
 
 	// draw:
+	mGraphics->beginFrame();
 	int s0 = mGraphics->getTransformStackSize();
 	mGame->draw(mGraphics);
 	int s1 = mGraphics->getTransformStackSize();
@@ -654,6 +710,31 @@ void WinEnvironment::printTimingStats()
 		mIntervalFrameCount = 0;
 
 		envDebugLog("fps=%3.0f\n", fps);
+
+		// report how well sprites batched in the last frame:
+		const WinSpriteBatch::Stats &stats = mPlatformInterface->getSpriteBatch()->getLastFrameStats();
+		envDebugLog("  sprite batches=%d quads=%d\n", stats.batches, stats.quads);
+		for (int i=0 ; i<WinSpriteBatch::FLUSH_REASON_COUNT ; i++)
+		{
+			if (stats.flushes[i]>0)
+			{
+				envDebugLog("    %s flushes=%d\n", WinSpriteBatch::getFlushReasonName((WinSpriteBatch::FlushReason)i), stats.flushes[i]);
+			}
+		}
+
+		// and how the debug primitives were drawn:
+		const WinPrimitiveBatch::Stats &primStats = mPlatformInterface->getPrimitiveBatch()->getLastFrameStats();
+		if (primStats.lines>0)
+		{
+			envDebugLog("  primitive batches=%d lines=%d\n", primStats.batches, primStats.lines);
+		}
+
+		// and how much tri strip data had to be sent to the device:
+		const WinTriStripPool::Stats &stripStats = mPlatformInterface->getTriStripPool()->getLastFrameStats();
+		if (stripStats.uploads>0)
+		{
+			envDebugLog("  tri strip uploads=%d vertices=%d\n", stripStats.uploads, stripStats.vertices);
+		}
 	}
 }
 
@@ -15,7 +15,6 @@ namespace Boy
 	class WinGraphics;
 	class WinD3DInterface;
 	class WinImage;
-	class WinStorage;
 
 	class WinEnvironment : public Environment
 	{
@@ -94,7 +93,7 @@ namespace Boy
 		ResourceLoader				*mResourceLoader;
 		WinGraphics					*mGraphics;
 		SoundPlayer					*mSoundPlayer;
-		WinStorage					*mStorage;
+		Storage						*mStorage;
 		std::map<std::string,std::string> mConfig;
 
 		// SDL interface:
@@ -133,6 +132,7 @@ namespace Boy
 		Uint32						mMinStepSize; // minimum delay between frames (in ms)
 		Uint32						mUpdateCount;
 		Uint32						mLastUpdate;
+		float						mLoadBudget; // time per frame for finishing background loads (in seconds)
 
 		Uint32						mIntervalFrameCount;
 		Uint32						mIntervalStartTime;
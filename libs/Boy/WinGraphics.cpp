@@ -2,6 +2,7 @@
 
 #include <assert.h>
 #include "BoyLib/BoyUtil.h"
+#include "QuadMesh.h"
 #include "WinImage.h"
 #include "WinD3DInterface.h"
 #include "WinTriStrip.h"
@@ -13,144 +14,136 @@ using namespace Boy;
 WinGraphics::WinGraphics(WinD3DInterface *platformInterface)
 {
 	mInterface = platformInterface;
-	mTransformUpToDate = false;
-	D3DXMATRIX identity;
-	D3DXMatrixIdentity(&identity);
-	mTransformStack.push(identity);
 //	mUseBilinearFiltering.push(false);
 	mColor = 0xffffffff;
 	mColorizationEnabled = false;
+	mDrawMode = DRAWMODE_NORMAL;
 	mZ = 0;
 }
 
 WinGraphics::~WinGraphics()
 {
-	while (mTransformStack.size()>0)
-	{
-		mTransformStack.pop();
-	}
-}
-
-
-void WinGraphics::updateTransform()
-{
-	if (!mTransformUpToDate)
-	{
-		mInterface->setTransform(mTransformStack.top());
-		mTransformUpToDate = true;
-	}
 }
 
 void WinGraphics::drawImage(Image *img)
 {
-	updateTransform();
 	mInterface->drawImage(
 		dynamic_cast<WinImage*>(img), 
-		mColorizationEnabled ? mColor : 0xffffffff,
-		mZ);
+		getVertexColor(mColorizationEnabled ? mColor : 0xffffffff),
+		mZ,
+		mTransformStack.top());
 }
 
 void WinGraphics::drawImage(Image *img, int subrectX, int subrectY, int subrectW, int subrectH)
 {
-	updateTransform();
 	mInterface->drawImage(
 		dynamic_cast<WinImage*>(img), 
-		mColorizationEnabled ? mColor : 0xffffffff,
+		getVertexColor(mColorizationEnabled ? mColor : 0xffffffff),
 		mZ,
+		mTransformStack.top(),
 		subrectX,
 		subrectY,
 		subrectW,
 		subrectH);
 }
 
+void WinGraphics::drawQuadMesh(Image *img, const QuadMesh *mesh)
+{
+	mInterface->drawQuadMesh(
+		dynamic_cast<WinImage*>(img), 
+		getVertexColor(mColorizationEnabled ? mColor : 0xffffffff),
+		mZ,
+		mTransformStack.top(),
+		mesh);
+}
+
 void WinGraphics::drawLine(int x0, int y0, int x1, int y1)
 {
-	mInterface->drawLine(x0,y0,x1,y1,mColor);
+	mInterface->drawLine(x0,y0,x1,y1,getVertexColor(mColor));
 }
 
 void WinGraphics::fillRect(int x0, int y0, int w, int h)
 {
-	pushTransform();
-		D3DXMATRIX identity;
-		D3DXMatrixIdentity(&identity);
-		mInterface->setTransform(identity);
-		mInterface->drawRect(x0,y0,w,h,mZ,mColor);
-	popTransform();
+	// rects are drawn in screen space (the device's
+	// world transform is always the identity):
+	mInterface->fillRect(x0,y0,w,h,mZ,getVertexColor(mColor));
+}
+
+void WinGraphics::drawRect(int x0, int y0, int w, int h)
+{
+	mInterface->drawRect(x0,y0,w,h,getVertexColor(mColor));
+}
+
+void WinGraphics::drawCircle(int x, int y, int radius)
+{
+	mInterface->drawCircle(x,y,radius,getVertexColor(mColor));
 }
 
 void WinGraphics::scale(float x, float y)
 {
-	D3DXMATRIX xform;
-	D3DXMatrixScaling(&xform, x, y, 1);
-	mTransformStack.top() *= xform;
+	Transform2D xform;
+	xform.setScaling(x, y);
+	mTransformStack.top().multiply(xform);
 //	mUseBilinearFiltering.top() = true;
-	mTransformUpToDate = false;
 }
 
 void WinGraphics::rotateDeg(float angle)
 {
-	D3DXMATRIX xform;
-	D3DXMatrixRotationZ(&xform, deg2rad(-angle));
-	mTransformStack.top() *= xform;
+	Transform2D xform;
+	xform.setRotation(deg2rad(-angle));
+	mTransformStack.top().multiply(xform);
 //	mUseBilinearFiltering.top() = true;
-	mTransformUpToDate = false;
 }
 
 void WinGraphics::rotateRad(float angle)
 {
-	D3DXMATRIX xform;
-	D3DXMatrixRotationZ(&xform, -angle);
-	mTransformStack.top() *= xform;
+	Transform2D xform;
+	xform.setRotation(-angle);
+	mTransformStack.top().multiply(xform);
 //	mUseBilinearFiltering.top() = true;
-	mTransformUpToDate = false;
 }
 
 void WinGraphics::translate(float x, float y)
 {
-	D3DXMATRIX xform;
-	D3DXMatrixTranslation(&xform, x, y, 0);
-	mTransformStack.top() *= xform;
-	mTransformUpToDate = false;
+	Transform2D xform;
+	xform.setTranslation(x, y);
+	mTransformStack.top().multiply(xform);
 }
 
 void WinGraphics::preScale(float x, float y)
 {
-	D3DXMATRIX xform;
-	D3DXMatrixScaling(&xform, x, y, 1);
-	mTransformStack.top() = xform * mTransformStack.top();
+	Transform2D xform;
+	xform.setScaling(x, y);
+	mTransformStack.top().preMultiply(xform);
 //	mUseBilinearFiltering.top() = true;
-	mTransformUpToDate = false;
 }
 
 void WinGraphics::preRotateDeg(float angle)
 {
-	D3DXMATRIX xform;
-	D3DXMatrixRotationZ(&xform, deg2rad(angle));
-	mTransformStack.top() = xform * mTransformStack.top();
+	Transform2D xform;
+	xform.setRotation(deg2rad(angle));
+	mTransformStack.top().preMultiply(xform);
 //	mUseBilinearFiltering.top() = true;
-	mTransformUpToDate = false;
 }
 
 void WinGraphics::preRotateRad(float angle)
 {
-	D3DXMATRIX xform;
-	D3DXMatrixRotationZ(&xform, angle);
-	mTransformStack.top() = xform * mTransformStack.top();
+	Transform2D xform;
+	xform.setRotation(angle);
+	mTransformStack.top().preMultiply(xform);
 //	mUseBilinearFiltering.top() = true;
-	mTransformUpToDate = false;
 }
 
 void WinGraphics::preTranslate(float x, float y)
 {
-	D3DXMATRIX xform;
-	D3DXMatrixTranslation(&xform, x, y, 0);
-	mTransformStack.top() = xform * mTransformStack.top();
-	mTransformUpToDate = false;
+	Transform2D xform;
+	xform.setTranslation(x, y);
+	mTransformStack.top().preMultiply(xform);
 }
 
 void WinGraphics::pushTransform()
 {
-	mTransformStack.push(D3DXMATRIX(mTransformStack.top()));
+	mTransformStack.push();
 //	mUseBilinearFiltering.push(mUseBilinearFiltering.top());
 }
 
@@ -251,6 +244,17 @@ void WinGraphics::setZFunction(CompareFunc func)
 
 void WinGraphics::setDrawMode(DrawMode mode)
 {
+	mDrawMode = mode;
+
+	// with premultiplied alpha both modes blend the same way,
+	// the difference is in the vertex color:
+	if (mInterface->isPremultipliedAlpha())
+	{
+		mInterface->setRenderState(D3DRS_SRCBLEND,D3DBLEND_ONE);
+		mInterface->setRenderState(D3DRS_DESTBLEND,D3DBLEND_INVSRCALPHA);
+		return;
+	}
+
 	switch (mode)
 	{
 	case DRAWMODE_NORMAL:
@@ -264,6 +268,16 @@ void WinGraphics::setDrawMode(DrawMode mode)
 	}
 }
 
+void WinGraphics::setSortingEnabled(bool enabled)
+{
+	mInterface->setSortingEnabled(enabled);
+}
+
+void WinGraphics::setSortLayer(int layer)
+{
+	mInterface->setSortLayer(layer);
+}
+
 void WinGraphics::setAlphaTestEnabled(bool enabled)
 {
 	mInterface->setRenderState(D3DRS_ALPHATESTENABLE, enabled);
@@ -324,12 +338,19 @@ void WinGraphics::setClipRect(int x, int y, int width, int height)
 void WinGraphics::drawTriStrip(TriStrip *strip)
 {
 	WinTriStrip *s = dynamic_cast<WinTriStrip*>(strip);
-	pushTransform();
-		D3DXMATRIX identity;
-		D3DXMatrixIdentity(&identity);
-		mInterface->setTransform(identity);
+	if (!mInterface->isPremultipliedAlpha())
+	{
 		mInterface->drawTriStrip(s);
-	popTransform();
+		return;
+	}
+
+	// strips have straight alpha vertex colors, so they're drawn
+	// with the straight alpha blend modes:
+	mInterface->setRenderState(D3DRS_SRCBLEND,D3DBLEND_SRCALPHA);
+	mInterface->setRenderState(D3DRS_DESTBLEND,mDrawMode==DRAWMODE_ADDITIVE?D3DBLEND_ONE:D3DBLEND_INVSRCALPHA);
+	mInterface->drawTriStrip(s);
+	mInterface->setRenderState(D3DRS_SRCBLEND,D3DBLEND_ONE);
+	mInterface->setRenderState(D3DRS_DESTBLEND,D3DBLEND_INVSRCALPHA);
 }
 
 int WinGraphics::getWidth()
@@ -352,6 +373,27 @@ void WinGraphics::setClearColor(Color color)
 	mInterface->setClearColor(color);
 }
 
+void WinGraphics::beginFrame()
+{
+	mDrawMode = DRAWMODE_NORMAL;
+}
+
+DWORD WinGraphics::getVertexColor(DWORD color)
+{
+	if (!mInterface->isPremultipliedAlpha())
+	{
+		return color;
+	}
+
+	// additive is premultiplied color that doesn't cover anything:
+	color = WinD3DInterface::premultiplyColor(color);
+	if (mDrawMode==DRAWMODE_ADDITIVE)
+	{
+		color &= 0x00ffffff;
+	}
+	return color;
+}
+
 void WinGraphics::dumpInfo(std::ofstream &file)
 {
 	mInterface->dumpInfo(file);
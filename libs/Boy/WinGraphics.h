@@ -4,9 +4,9 @@
 #include "d3d9.h"
 #include "d3dx9.h"
 #include "Graphics.h"
+#include "TransformStack.h"
 #include "TriStrip.h"
 #include <fstream>
-#include <stack>
 
 namespace Boy
 {
@@ -22,9 +22,12 @@ namespace Boy
 
 		virtual void drawImage(Image *img);
 		virtual void drawImage(Image *img, int subrectX, int subrectY, int subrectW, int subrectH);
+		virtual void drawQuadMesh(Image *img, const QuadMesh *mesh);
 
 		virtual void drawLine(int x0, int y0, int x1, int y1);
 		virtual void fillRect(int x0, int y0, int w, int h);
+		virtual void drawRect(int x0, int y0, int w, int h);
+		virtual void drawCircle(int x, int y, int radius);
 		virtual void drawTriStrip(TriStrip *strip);
 
 		virtual void scale(float x, float y);
@@ -60,6 +63,9 @@ namespace Boy
 
 		virtual void setDrawMode(DrawMode mode);
 
+		virtual void setSortingEnabled(bool enabled);
+		virtual void setSortLayer(int layer);
+
 		virtual void setClipRect(int x, int y, int width, int height);
 
 		virtual int getWidth();
@@ -70,19 +76,25 @@ namespace Boy
 
 		void dumpInfo(std::ofstream &file);
 
+		// resets the per-frame state (the device starts every frame
+		// with the normal draw mode):
+		void beginFrame();
+
 	private:
 
-		void updateTransform();
+		// the vertex color to draw with (in premultiplied alpha mode the
+		// color is premultiplied, additive draws get an alpha of 0):
+		DWORD getVertexColor(DWORD color);
 
 	private:
 
 		DWORD mColor;
+		DrawMode mDrawMode;
 		bool mColorizationEnabled;
 
 		float mZ;
 
-		std::stack<D3DXMATRIX> mTransformStack;
-		bool mTransformUpToDate;
+		TransformStack mTransformStack;
 
 		WinD3DInterface *mInterface;
 
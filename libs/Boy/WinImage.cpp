@@ -10,6 +10,10 @@ using namespace Boy;
 WinImage::WinImage(ResourceLoader *loader, const std::string &path) : Image(loader,path)
 {
 	mTexture = NULL;
+	mTextureX = 0;
+	mTextureY = 0;
+	mTextureShared = false;
+	mIsTextureScaled = false;
 	mWidth = -1;
 	mHeight = -1;
 }
@@ -29,8 +33,57 @@ int WinImage::getHeight()
 	return mHeight;
 }
 
+int WinImage::getMemoryUsage()
+{
+	if (mTexture==NULL)
+	{
+		return 0;
+	}
+	if (mTextureShared)
+	{
+		return mWidth * mHeight * 4;
+	}
+
+	// add up the mip levels:
+	int bytes = 0;
+	DWORD levels = mTexture->GetLevelCount();
+	for (DWORD i=0 ; i<levels ; i++)
+	{
+		D3DSURFACE_DESC desc;
+		if (FAILED(mTexture->GetLevelDesc(i, &desc)))
+		{
+			break;
+		}
+		int blocksW = (desc.Width + 3) / 4;
+		int blocksH = (desc.Height + 3) / 4;
+		switch (desc.Format)
+		{
+		case D3DFMT_DXT1:
+			bytes += blocksW * blocksH * 8;
+			break;
+		case D3DFMT_DXT2:
+		case D3DFMT_DXT3:
+		case D3DFMT_DXT4:
+		case D3DFMT_DXT5:
+			bytes += blocksW * blocksH * 16;
+			break;
+		case D3DFMT_R5G6B5:
+		case D3DFMT_A1R5G5B5:
+		case D3DFMT_A4R4G4B4:
+			bytes += desc.Width * desc.Height * 2;
+			break;
+		default:
+			bytes += desc.Width * desc.Height * 4;
+			break;
+		}
+	}
+	return bytes;
+}
+
 bool WinImage::init(bool includeSounds)
 {
+	// (drops the placeholder if there is one):
+	destroy(includeSounds);
 	return mLoader->load(this);
 }
 
@@ -49,8 +102,11 @@ void WinImage::setSize(int width, int height)
 	mHeight = height;
 }
 
-void WinImage::setTexture(IDirect3DTexture9 *tex, bool isScaled)
+void WinImage::setTexture(IDirect3DTexture9 *tex, bool isScaled, int x, int y, bool shared)
 {
 	mTexture = tex;
+	mTextureShared = shared;
 	mIsTextureScaled = isScaled;
+	mTextureX = x;
+	mTextureY = y;
 }
@@ -16,9 +16,13 @@ namespace Boy
 
 		const std::string &getPath() { return mPath; }
 
-		void setTexture(IDirect3DTexture9 *tex, bool isScaled);
+		// the image can be a part of the texture (x,y is its top left
+		// corner in texels), that's how atlas pages are shared:
+		void setTexture(IDirect3DTexture9 *tex, bool isScaled, int x=0, int y=0, bool shared=false);
 
 		inline IDirect3DTexture9 *getTexture() { return mTexture; }
+		inline int getTextureX() { return mTextureX; }
+		inline int getTextureY() { return mTextureY; }
 
 		inline bool isTextureScaled() { return mIsTextureScaled; }
 
@@ -26,6 +30,10 @@ namespace Boy
 		virtual int getWidth();
 		virtual int getHeight();
 
+		// implementation of Resource (images on an atlas page
+		// only count their part of it):
+		virtual int getMemoryUsage();
+
 	private:
 
 		// implementation of Resource:
@@ -35,6 +43,9 @@ namespace Boy
 	private:
 
 		IDirect3DTexture9 *mTexture;
+		int mTextureX;
+		int mTextureY;
+		bool mTextureShared;
 
 		int mWidth;
 		int mHeight;
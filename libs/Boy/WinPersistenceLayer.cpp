@@ -2,10 +2,13 @@
 
 #include <assert.h>
 #include "BoyLib/BoyUtil.h"
+#include <chrono>
 #include "Crypto.h"
 #include <iostream>
+#include "BoyLib/md5.h"
 #include <sstream>
 #include <fstream>
+#include <string.h>
 #include "WinStorage.h"
 
 #ifdef GOO_PLATFORM_WIN32
@@ -16,9 +19,56 @@ using namespace Boy;
 
 #include "BoyLib/CrtDbgNew.h"
 
+// persist() requests that come in this long after the first one (in
+// ms) are written along with it:
+#define PERSIST_COALESCE_MS 50
+
+// the journal is compacted once it's bigger than this and bigger than
+// the file:
+#define JOURNAL_COMPACT_BYTES (64*1024)
+
+// journal records:
+#define JOURNAL_MAGIC "BJNL"
+#define JOURNAL_HEADER_SIZE 32
+#define JOURNAL_RECORD_BASE 0 // the hash of the file the journal goes with
+#define JOURNAL_RECORD_CHANGES 1 // values that were set or removed
+
+static void hash(const char *data, int size, unsigned char *digest)
+{
+	md5_state_t state;
+	md5_init(&state);
+	md5_append(&state, (const md5_byte_t *)data, size);
+	md5_finish(&state, digest);
+}
+
+// (little endian, whatever the cpu):
+static unsigned int readUint32(const char *p)
+{
+	const unsigned char *b = (const unsigned char *)p;
+	return b[0] | (b[1]<<8) | (b[2]<<16) | ((unsigned int)b[3]<<24);
+}
+
+static void writeUint32(char *p, unsigned int x)
+{
+	p[0] = (char)x;
+	p[1] = (char)(x>>8);
+	p[2] = (char)(x>>16);
+	p[3] = (char)(x>>24);
+}
+
 WinPersistenceLayer::WinPersistenceLayer(const UString &filename, unsigned char *key)
 {
 	mKey = key;
+	mRequested = 0;
+	mWritten = 0;
+	mFlushing = false;
+	mWriterQuit = false;
+	mWriteFailed = false;
+	memset(&mStats, 0, sizeof(mStats));
+	memset(mSnapshotHash, 0, sizeof(mSnapshotHash));
+	mSnapshotBytes = 0;
+	mJournalBytes = 0;
+	mJournalValid = false;
 
 	wchar_t buf[MAX_PATH];
 	HRESULT result = SHGetFolderPathW(
@@ -34,27 +84,43 @@ WinPersistenceLayer::WinPersistenceLayer(const UString &filename, unsigned char
 	DWORD lastError = GetLastError();
 	assert(success==TRUE || lastError==ERROR_ALREADY_EXISTS);
 	mFileName.append(filename);
+	mJournalName = std::string(mFileName.toUtf8()) + ".journal";
 
 	load();
 }
 
 WinPersistenceLayer::~WinPersistenceLayer()
 {
+	// the writer finishes what's waiting before it quits:
+	{
+		std::lock_guard<std::mutex> lock(mWriteMutex);
+		mWriterQuit = true;
+		mWriteCondition.notify_all();
+	}
+	if (mWriterThread.joinable())
+	{
+		mWriterThread.join();
+	}
 }
 
 bool WinPersistenceLayer::remove(const std::string &name, bool persist)
 {
-	// find the name:
-	std::map<std::string,std::string>::iterator iter = mValues.find(name);
-
-	// if it doesn't exist
-	if (iter==mValues.end())
 	{
-		return false;
-	}
+		std::lock_guard<std::mutex> lock(mValuesMutex);
+
+		// find the name:
+		std::map<std::string,std::string>::iterator iter = mValues.find(name);
 
-	// erase it:
-	mValues.erase(iter);
+		// if it doesn't exist
+		if (iter==mValues.end())
+		{
+			return false;
+		}
+
+		// erase it:
+		mValues.erase(iter);
+		mDirtyKeys.insert(name);
+	}
 
 	if (persist)
 	{
@@ -68,18 +134,25 @@ bool WinPersistenceLayer::remove(const std::string &name, bool persist)
 void WinPersistenceLayer::putString(const std::string &name, const std::string &value, bool persist)
 {
 	assert(Trim(name).size()>0);
-	if (mValues[name]!=value)
+	bool changed = false;
 	{
-		mValues[name] = value;
-		if (persist)
+		std::lock_guard<std::mutex> lock(mValuesMutex);
+		if (mValues[name]!=value)
 		{
-			this->persist();
+			mValues[name] = value;
+			mDirtyKeys.insert(name);
+			changed = true;
 		}
 	}
+	if (changed && persist)
+	{
+		this->persist();
+	}
 }
 
 const std::string WinPersistenceLayer::getString(const std::string &name)
 {
+	std::lock_guard<std::mutex> lock(mValuesMutex);
 	std::map<std::string,std::string>::iterator iter = mValues.find(name);
 	if (iter!=mValues.end())
 	{
@@ -104,55 +177,278 @@ void WinPersistenceLayer::load()
 		assert( result == Storage::STORAGE_OK );
 		pStorage->FileClose( hFile );
 
-		char *decData;
-		int decDataSize;
-		Boy::aesDecrypt(mKey,data,size,&decData,&decDataSize);
+		// (the journal has to go with exactly these bytes):
+		hash(data,size,mSnapshotHash);
+		mSnapshotBytes = size;
+
+		// (decrypted in place):
+		Boy::aesDecrypt(mKey,data,data,size);
 
-		parse(decData,decDataSize);
+		parse(data,size);
 
 		delete[] data;
-		delete[] decData;
+
+		replayJournal();
+	}
+}
+
+void WinPersistenceLayer::replayJournal()
+{
+	BoyFileHandle hFile;
+	Storage *pStorage = Environment::instance()->getStorage();
+	if( pStorage->FileOpen( mJournalName.c_str(), Storage::STORAGE_MODE_READ | Storage::STORAGE_MUST_EXIST, &hFile ) != Storage::STORAGE_OK )
+	{
+		return;
+	}
+	int size = pStorage->FileGetSize( hFile );
+	char *data = new char [size];
+	Storage::StorageResult result = pStorage->FileRead( hFile, data, size );
+	pStorage->FileClose( hFile );
+	if( result != Storage::STORAGE_OK )
+	{
+		size = 0;
+	}
+
+	// each record is its encrypted size followed by the encrypted
+	// header and payload:
+	int pos = 0;
+	int recordCount = 0;
+	while (pos+4 <= size)
+	{
+		int recordSize = (int)readUint32(data+pos);
+		if (recordSize<JOURNAL_HEADER_SIZE || (recordSize&15)!=0 || recordSize>size-pos-4)
+		{
+			break;
+		}
+		char *record = data+pos+4;
+		Boy::aesDecrypt(mKey,record,record,recordSize);
+
+		unsigned int type = readUint32(record+4);
+		int payloadSize = (int)readUint32(record+8);
+		if (memcmp(record,JOURNAL_MAGIC,4)!=0 || payloadSize<0 || payloadSize>recordSize-JOURNAL_HEADER_SIZE)
+		{
+			break;
+		}
+		const char *payload = record+JOURNAL_HEADER_SIZE;
+		unsigned char payloadHash[16];
+		hash(payload,payloadSize,payloadHash);
+		if (memcmp(record+16,payloadHash,16)!=0)
+		{
+			break;
+		}
+
+		// the first record says which file the journal goes with:
+		if (recordCount==0)
+		{
+			if (type!=JOURNAL_RECORD_BASE || payloadSize!=16 || memcmp(payload,mSnapshotHash,16)!=0)
+			{
+				envDebugLog("ignoring %s (it goes with another file)\n",mJournalName.c_str());
+				break;
+			}
+		}
+		else if (type!=JOURNAL_RECORD_CHANGES || !parseChanges(payload,payloadSize))
+		{
+			break;
+		}
+
+		recordCount++;
+		pos += 4+recordSize;
+	}
+
+	// (anything that's left is a write that didn't finish, which the
+	// next write gets rid of by compacting):
+	mJournalValid = recordCount>0 && pos==size;
+	mJournalBytes = size;
+	if (recordCount>0)
+	{
+		envDebugLog("replayed %d journal records from %s\n",recordCount-1,mJournalName.c_str());
 	}
+
+	delete[] data;
 }
 
-void WinPersistenceLayer::save()
+bool WinPersistenceLayer::save(bool *compacted)
 {
+	// compact once the journal outgrows the file (or when there's no
+	// journal that goes with it):
+	bool compact = !mJournalValid ||
+		(mJournalBytes>JOURNAL_COMPACT_BYTES && mJournalBytes>mSnapshotBytes);
+	*compacted = compact;
+
+	// (the values are only locked while they're serialized):
 	envDebugLog("------------------------ persisting data ----------------------------\n");
 	std::ostringstream writeStr;
-	for (std::map<std::string,std::string>::iterator i=mValues.begin() ; i!=mValues.end() ; i++)
 	{
-		if (i->first.length()!=0) // skip null values
+		std::lock_guard<std::mutex> lock(mValuesMutex);
+		if (compact)
 		{
-			assert(i->first.length()>0);
-			writeStr << i->first.length() << "," << i->first;
-			writeStr << i->second.length() << "," << i->second;
-			envDebugLog("%s = %s\n",i->first.c_str(),i->second.c_str());
+			for (std::map<std::string,std::string>::iterator i=mValues.begin() ; i!=mValues.end() ; i++)
+			{
+				if (i->first.length()!=0) // skip null values
+				{
+					assert(i->first.length()>0);
+					writeStr << i->first.length() << "," << i->first;
+					writeStr << i->second.length() << "," << i->second;
+					envDebugLog("%s = %s\n",i->first.c_str(),i->second.c_str());
+				}
+			}
 		}
+		else
+		{
+			// just what changed ('S' for set, 'R' for removed):
+			for (std::set<std::string>::iterator i=mDirtyKeys.begin() ; i!=mDirtyKeys.end() ; i++)
+			{
+				if (i->length()==0)
+				{
+					continue;
+				}
+				std::map<std::string,std::string>::iterator value = mValues.find(*i);
+				if (value!=mValues.end())
+				{
+					writeStr << "S" << i->length() << "," << *i;
+					writeStr << value->second.length() << "," << value->second;
+					envDebugLog("%s = %s\n",i->c_str(),value->second.c_str());
+				}
+				else
+				{
+					writeStr << "R" << i->length() << "," << *i;
+					envDebugLog("%s removed\n",i->c_str());
+				}
+			}
+		}
+		mDirtyKeys.clear();
 	}
 	envDebugLog("---------------------------------------------------------------------\n");
 
+	if (!compact)
+	{
+		// (nothing changed since the last write, e.g. a value was put
+		// back the way it was):
+		std::string changes = writeStr.str();
+		if (changes.empty())
+		{
+			return true;
+		}
+
+		std::string records;
+		appendRecord(JOURNAL_RECORD_CHANGES,changes,&records);
+		if (!writeJournal(records,false))
+		{
+			// (the next write has to write everything):
+			mJournalValid = false;
+			return false;
+		}
+		return true;
+	}
+
 	// mark the end of the data:
 	writeStr << ",0.";
 
+	if (!writeSnapshot(writeStr.str()))
+	{
+		return false;
+	}
+
+	// start a journal that goes with the new file (if that fails the
+	// values are safe, the next write just compacts again):
+	std::string records;
+	appendRecord(JOURNAL_RECORD_BASE,std::string((const char*)mSnapshotHash,16),&records);
+	mJournalBytes = 0;
+	mJournalValid = writeJournal(records,true);
+	return true;
+}
+
+bool WinPersistenceLayer::writeSnapshot(const std::string &data)
+{
 	// decrypt data into output data buffer:
-	int dataSize = (int)writeStr.str().size();
 	int encryptedDataSize;
 	char *encryptedData;
 	Boy::aesEncrypt(mKey,
-		writeStr.str().c_str(), dataSize,
+		data.c_str(), (int)data.size(),
 		&encryptedData, &encryptedDataSize);
 
-	// write to file:
+	// write next to the file, then replace it (so a crash halfway through
+	// leaves the old file as it was):
+	std::string fileName = mFileName.toUtf8();
+	std::string tempName = fileName + ".tmp";
 	BoyFileHandle hFile;
 	Storage *pStorage = Environment::instance()->getStorage();
-	Storage::StorageResult result = pStorage->FileOpen( mFileName.toUtf8(), Storage::STORAGE_MODE_WRITE | Storage::STORAGE_OPEN_ALWAYS, &hFile );
-	assert( result == Storage::STORAGE_OK );
-	result = pStorage->FileWrite( hFile, encryptedData, encryptedDataSize);
-	assert( result == Storage::STORAGE_OK );
-	pStorage->FileClose( hFile );
+	Storage::StorageResult result = pStorage->FileOpen( tempName.c_str(), Storage::STORAGE_MODE_WRITE | Storage::STORAGE_OPEN_ALWAYS, &hFile );
+	if( result == Storage::STORAGE_OK )
+	{
+		result = pStorage->FileWrite( hFile, encryptedData, encryptedDataSize);
+		if( pStorage->FileClose( hFile ) != Storage::STORAGE_OK )
+		{
+			result = Storage::STORAGE_FAIL;
+		}
+	}
+	if( result == Storage::STORAGE_OK )
+	{
+		result = pStorage->FileRename( tempName.c_str(), fileName.c_str() );
+	}
+	if( result == Storage::STORAGE_OK )
+	{
+		hash(encryptedData,encryptedDataSize,mSnapshotHash);
+		mSnapshotBytes = encryptedDataSize;
+	}
+	else
+	{
+		envDebugLog("WARNING: could not write '%s'\n", fileName.c_str());
+	}
 
 	// deallocate buffers:
 	delete[] encryptedData;
+
+	return result == Storage::STORAGE_OK;
+}
+
+bool WinPersistenceLayer::writeJournal(const std::string &records, bool create)
+{
+	BoyFileHandle hFile;
+	Storage *pStorage = Environment::instance()->getStorage();
+	int modeFlags = Storage::STORAGE_MODE_WRITE | (create ? Storage::STORAGE_OPEN_ALWAYS : Storage::STORAGE_APPEND);
+	Storage::StorageResult result = pStorage->FileOpen( mJournalName.c_str(), modeFlags, &hFile );
+	if( result == Storage::STORAGE_OK )
+	{
+		result = pStorage->FileWrite( hFile, records.c_str(), (int)records.size() );
+		if( pStorage->FileClose( hFile ) != Storage::STORAGE_OK )
+		{
+			result = Storage::STORAGE_FAIL;
+		}
+	}
+	if( result != Storage::STORAGE_OK )
+	{
+		envDebugLog("WARNING: could not write '%s'\n", mJournalName.c_str());
+		return false;
+	}
+
+	mJournalBytes += (int)records.size();
+	return true;
+}
+
+void WinPersistenceLayer::appendRecord(int type, const std::string &payload, std::string *records)
+{
+	// header (magic, type, payload size, unused, payload hash), then the
+	// payload:
+	std::string plain(JOURNAL_HEADER_SIZE,'\0');
+	memcpy(&plain[0],JOURNAL_MAGIC,4);
+	writeUint32(&plain[4],(unsigned int)type);
+	writeUint32(&plain[8],(unsigned int)payload.size());
+	hash(payload.c_str(),(int)payload.size(),(unsigned char*)&plain[16]);
+	plain.append(payload);
+
+	int encryptedDataSize;
+	char *encryptedData;
+	Boy::aesEncrypt(mKey,
+		plain.c_str(), (int)plain.size(),
+		&encryptedData, &encryptedDataSize);
+
+	char size[4];
+	writeUint32(size,(unsigned int)encryptedDataSize);
+	records->append(size,4);
+	records->append(encryptedData,encryptedDataSize);
+
+	delete[] encryptedData;
 }
 
 void WinPersistenceLayer::parse(char *data, int size)
@@ -211,6 +507,54 @@ void WinPersistenceLayer::parse(char *data, int size)
 	envDebugLog("---------------------------------------------------------------------\n");
 }
 
+bool WinPersistenceLayer::parseChanges(const char *data, int size)
+{
+	// 'S' <name size> ',' <name> <value size> ',' <value>, or
+	// 'R' <name size> ',' <name>:
+	int pos = 0;
+	while (pos<size)
+	{
+		char op = data[pos++];
+		if (op!='S' && op!='R')
+		{
+			return false;
+		}
+
+		int lengths[2];
+		int starts[2];
+		int count = op=='S' ? 2 : 1;
+		for (int i=0 ; i<count ; i++)
+		{
+			int length = 0;
+			while (pos<size && data[pos]>='0' && data[pos]<='9' && length<size)
+			{
+				length = length*10 + (data[pos]-'0');
+				pos++;
+			}
+			if (pos>=size || data[pos]!=',' || length>size-pos-1)
+			{
+				return false;
+			}
+			pos++; // skip the comma
+			starts[i] = pos;
+			lengths[i] = length;
+			pos += length;
+		}
+
+		std::string name(data+starts[0],lengths[0]);
+		if (op=='S')
+		{
+			mValues[name] = std::string(data+starts[1],lengths[1]);
+		}
+		else
+		{
+			mValues.erase(name);
+		}
+	}
+
+	return true;
+}
+
 int WinPersistenceLayer::readInt(char *data, int *pos)
 {
 	int value = 0;
@@ -226,11 +570,13 @@ int WinPersistenceLayer::readInt(char *data, int *pos)
 
 int WinPersistenceLayer::getKeyCount()
 {
+	std::lock_guard<std::mutex> lock(mValuesMutex);
 	return (int)mValues.size();
 }
 
 const std::string WinPersistenceLayer::getKey(int i)
 {
+	std::lock_guard<std::mutex> lock(mValuesMutex);
 	std::map<std::string,std::string>::iterator iter = mValues.begin();
 	for (int x=0 ; x<i ; x++)
 	{
@@ -241,5 +587,81 @@ const std::string WinPersistenceLayer::getKey(int i)
 
 void WinPersistenceLayer::persist()
 {
-	save();
+	// the writer takes it from here:
+	std::lock_guard<std::mutex> lock(mWriteMutex);
+	mRequested++;
+	mStats.requests++;
+	if (!mWriterThread.joinable())
+	{
+		mWriterThread = std::thread(writerProc, this);
+	}
+	mWriteCondition.notify_all();
+}
+
+bool WinPersistenceLayer::flush()
+{
+	std::unique_lock<std::mutex> lock(mWriteMutex);
+	mFlushing = true;
+	mWriteCondition.notify_all();
+	while (mWritten!=mRequested)
+	{
+		mWrittenCondition.wait(lock);
+	}
+	mFlushing = false;
+	return !mWriteFailed;
+}
+
+WinPersistenceLayer::PersistStats WinPersistenceLayer::getPersistStats()
+{
+	std::lock_guard<std::mutex> lock(mWriteMutex);
+	return mStats;
+}
+
+void WinPersistenceLayer::writerProc(WinPersistenceLayer *layer)
+{
+	std::unique_lock<std::mutex> lock(layer->mWriteMutex);
+	while (true)
+	{
+		while (!layer->mWriterQuit && layer->mWritten==layer->mRequested)
+		{
+			layer->mWriteCondition.wait(lock);
+		}
+		if (layer->mWritten==layer->mRequested)
+		{
+			// quitting, and everything's written:
+			return;
+		}
+
+		// let the rest of the burst come in (unless somebody's waiting):
+		if (!layer->mFlushing && !layer->mWriterQuit)
+		{
+			std::chrono::steady_clock::time_point until = std::chrono::steady_clock::now() + std::chrono::milliseconds(PERSIST_COALESCE_MS);
+			while (!layer->mFlushing && !layer->mWriterQuit &&
+				layer->mWriteCondition.wait_until(lock, until)!=std::cv_status::timeout)
+			{
+			}
+		}
+
+		// (requests that come in while it's written get another write):
+		int request = layer->mRequested;
+		lock.unlock();
+		std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+		bool compacted;
+		bool written = layer->save(&compacted);
+		double ms = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count() * 1000.0;
+		lock.lock();
+
+		PersistStats &stats = layer->mStats;
+		envDebugLog("persisted requests %d..%d in %0.2fms (%s%s)\n", layer->mWritten+1, request, ms, compacted ? "compacted" : "journaled", written ? "" : ", failed");
+		stats.writes++;
+		stats.failures += written ? 0 : 1;
+		layer->mWriteFailed = !written;
+		stats.compactions += compacted ? 1 : 0;
+		stats.journalBytes = layer->mJournalBytes;
+		stats.lastWriteMs = ms;
+		stats.maxWriteMs = ms > stats.maxWriteMs ? ms : stats.maxWriteMs;
+		stats.totalWriteMs += ms;
+		layer->mWritten = request;
+		layer->mWrittenCondition.notify_all();
+	}
 }
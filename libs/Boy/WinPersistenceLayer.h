@@ -2,17 +2,48 @@
 
 #include "BoyLib/CrtDbgInc.h"
 
+#include <condition_variable>
 #include "PersistenceLayer.h"
 #include <map>
+#include <mutex>
+#include <set>
 #include <string>
+#include <thread>
 #include "BoyLib/UString.h"
 
 namespace Boy
 {
+	/*
+	 * the values live in an encrypted file in the user's local app data
+	 * folder. persist() doesn't write it, a writer thread does: requests
+	 * that come in a burst are written once, the file is written next to
+	 * the old one and then replaces it (so it's never half written), and
+	 * whatever is still waiting gets written before the layer goes away.
+	 *
+	 * a write only appends the values that changed to a journal next to
+	 * the file (<file>.journal). once the journal outgrows the file, the
+	 * writer compacts: it writes all the values to the file and starts
+	 * a new journal. the journal begins with a hash of the file it goes
+	 * with, so one that's left over from an older file is ignored, and
+	 * it's replayed up to the first record that doesn't check out.
+	 */
 	class WinPersistenceLayer : public PersistenceLayer
 	{
 	public:
 
+		// writer thread timing (in ms):
+		struct PersistStats
+		{
+			int requests; // persist() calls
+			int writes; // journal appends and compactions
+			int failures; // writes that didn't make it to disk
+			int compactions; // whole files written
+			int journalBytes; // the size of the journal
+			double lastWriteMs; // snapshot, encryption and file io
+			double maxWriteMs;
+			double totalWriteMs;
+		};
+
 		WinPersistenceLayer(const Boy::UString &filename, unsigned char *key);
 		virtual ~WinPersistenceLayer();
 
@@ -24,12 +55,21 @@ namespace Boy
 		virtual const std::string getKey(int i);
 
 		virtual void persist();
+		virtual bool flush();
+
+		PersistStats getPersistStats();
 
 	private:
 
+		static void writerProc(WinPersistenceLayer *layer);
 		void load();
-		void save();
+		void replayJournal();
+		bool save(bool *compacted); // false if the write failed
+		bool writeSnapshot(const std::string &data);
+		bool writeJournal(const std::string &records, bool create);
+		void appendRecord(int type, const std::string &payload, std::string *records);
 		void parse(char *data, int size);
+		bool parseChanges(const char *data, int size);
 		int readInt(char *data, int *pos); // pos will be modified!
 
 	private:
@@ -37,6 +77,28 @@ namespace Boy
 		unsigned char *mKey;
 		std::map<std::string,std::string> mValues;
 		UString mFileName;
+		std::string mJournalName;
+		std::set<std::string> mDirtyKeys; // changed since the last write (under mValuesMutex)
+
+		// the file and the journal (the writer's, once they're loaded):
+		unsigned char mSnapshotHash[16];
+		int mSnapshotBytes;
+		int mJournalBytes;
+		bool mJournalValid; // goes with the file, and can be appended to
+
+		// write behind (mValuesMutex guards the values, which the writer
+		// reads, mWriteMutex guards the rest):
+		std::mutex mValuesMutex;
+		std::mutex mWriteMutex;
+		std::condition_variable mWriteCondition;
+		std::condition_variable mWrittenCondition;
+		std::thread mWriterThread;
+		int mRequested; // the number of the last persist() request
+		int mWritten; // the last request that's been written
+		bool mFlushing;
+		bool mWriterQuit;
+		bool mWriteFailed; // the last write didn't make it to disk
+		PersistStats mStats;
 
 	};
 }
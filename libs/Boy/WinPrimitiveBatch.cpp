@@ -0,0 +1,286 @@
+#include "WinPrimitiveBatch.h"
+
+#include <assert.h>
+#include "BoyLib/BoyUtil.h"
+#include "Graphics.h"
+#include <math.h>
+#include <string.h>
+
+using namespace Boy;
+
+#include "BoyLib/CrtDbgNew.h"
+
+// the render states behind WinPrimitiveBatch::StateIndex:
+static const D3DRENDERSTATETYPE gStateTypes[] =
+{
+	D3DRS_SRCBLEND,
+	D3DRS_DESTBLEND,
+	D3DRS_BLENDOP,
+	D3DRS_ZENABLE,
+	D3DRS_ZWRITEENABLE,
+	D3DRS_ZFUNC,
+	D3DRS_ALPHATESTENABLE,
+	D3DRS_ALPHAREF,
+	D3DRS_ALPHAFUNC
+};
+
+WinPrimitiveBatch::WinPrimitiveBatch(IDirect3DDevice9 *device, int bufferVertexCount)
+{
+	assert(sizeof(gStateTypes)/sizeof(gStateTypes[0])==STATE_COUNT);
+	// room for at least one line:
+	assert(bufferVertexCount>=2);
+
+	mDevice = device;
+	mVertexBuffer = NULL;
+	mBufferVertexCount = bufferVertexCount;
+	mBufferVertexOffset = 0;
+
+	memset(mStates, 0, sizeof(mStates));
+	mBucketCount = 0;
+	mCurrentBucket = NULL;
+
+	memset(&mFrameStats, 0, sizeof(Stats));
+	memset(&mLastFrameStats, 0, sizeof(Stats));
+}
+
+WinPrimitiveBatch::~WinPrimitiveBatch()
+{
+	releaseBuffers();
+	for (size_t i=0 ; i<mBuckets.size() ; i++)
+	{
+		delete mBuckets[i];
+	}
+}
+
+bool WinPrimitiveBatch::createBuffers()
+{
+	assert(mVertexBuffer==NULL);
+
+	HRESULT hr = mDevice->CreateVertexBuffer(
+		mBufferVertexCount * sizeof(BoyVertex),
+		D3DUSAGE_DYNAMIC | D3DUSAGE_WRITEONLY,
+		BOYFVF,
+		D3DPOOL_DEFAULT,
+		&mVertexBuffer,
+		NULL);
+	if (FAILED(hr))
+	{
+		mVertexBuffer = NULL;
+		return false;
+	}
+	mBufferVertexOffset = 0;
+
+	return true;
+}
+
+void WinPrimitiveBatch::releaseBuffers()
+{
+	if (mVertexBuffer!=NULL)
+	{
+		mVertexBuffer->Release();
+		mVertexBuffer = NULL;
+	}
+}
+
+void WinPrimitiveBatch::beginFrame(WinD3DInterface *d3dInterface)
+{
+	// start with empty buckets:
+	for (int i=0 ; i<mBucketCount ; i++)
+	{
+		mBuckets[i]->lineVerts.clear();
+	}
+	mBucketCount = 0;
+	mCurrentBucket = NULL;
+
+	// pick up the states the frame starts with (from
+	// here on setRenderState() keeps them up to date):
+	for (int i=0 ; i<STATE_COUNT ; i++)
+	{
+		mStates[i] = d3dInterface->getRenderState(gStateTypes[i]);
+	}
+
+	memset(&mFrameStats, 0, sizeof(Stats));
+}
+
+void WinPrimitiveBatch::endFrame()
+{
+	flush();
+
+	mLastFrameStats = mFrameStats;
+}
+
+void WinPrimitiveBatch::flush()
+{
+	if (mBucketCount>0 && mVertexBuffer!=NULL)
+	{
+		HRESULT hr = mDevice->SetStreamSource(0, mVertexBuffer, 0, sizeof(BoyVertex));
+		if (SUCCEEDED(hr))
+		{
+			mDevice->SetTexture(0, NULL);
+
+			// one bucket at a time:
+			for (int i=0 ; i<mBucketCount ; i++)
+			{
+				Bucket *bucket = mBuckets[i];
+				applyStates(bucket->states);
+				draw(D3DPT_LINELIST, bucket->lineVerts, 2);
+			}
+
+			// put the device back the way it was:
+			applyStates(mStates);
+		}
+	}
+
+	// the buckets are consumed no matter what:
+	for (int i=0 ; i<mBucketCount ; i++)
+	{
+		mBuckets[i]->lineVerts.clear();
+	}
+	mBucketCount = 0;
+	mCurrentBucket = NULL;
+}
+
+void WinPrimitiveBatch::setRenderState(D3DRENDERSTATETYPE state, DWORD value)
+{
+	int index = getStateIndex(state);
+	if (index>=0 && mStates[index]!=value)
+	{
+		mStates[index] = value;
+		mCurrentBucket = NULL;
+	}
+}
+
+void WinPrimitiveBatch::addLine(float x0, float y0, float x1, float y1, float z, DWORD color)
+{
+	BoyVertex verts[] =
+	{
+		{x0, y0, z, color, 0, 0},
+		{x1, y1, z, color, 0, 0}
+	};
+
+	std::vector<BoyVertex> &lineVerts = getBucket()->lineVerts;
+	lineVerts.insert(lineVerts.end(), verts, verts + 2);
+	mFrameStats.lines++;
+}
+
+void WinPrimitiveBatch::addRect(float x, float y, float w, float h, float z, DWORD color)
+{
+	float maxX = x + w;
+	float maxY = y + h;
+	BoyVertex verts[] =
+	{
+		{x, y, z, color, 0, 0}, {maxX, y, z, color, 0, 0}, // top
+		{maxX, y, z, color, 0, 0}, {maxX, maxY, z, color, 0, 0}, // right
+		{maxX, maxY, z, color, 0, 0}, {x, maxY, z, color, 0, 0}, // bottom
+		{x, maxY, z, color, 0, 0}, {x, y, z, color, 0, 0} // left
+	};
+
+	std::vector<BoyVertex> &lineVerts = getBucket()->lineVerts;
+	lineVerts.insert(lineVerts.end(), verts, verts + 8);
+	mFrameStats.lines += 4;
+}
+
+void WinPrimitiveBatch::addCircle(float x, float y, float radius, float z, DWORD color)
+{
+	int segments = Graphics::getCircleSegmentCount(radius);
+	std::vector<BoyVertex> &lineVerts = getBucket()->lineVerts;
+	size_t first = lineVerts.size();
+	lineVerts.resize(first + segments*2);
+	BoyVertex *verts = &lineVerts[first];
+
+	// walk around the circle, every point ends one segment and starts the next:
+	float step = 2 * GPI / segments;
+	BoyVertex v = {x + radius, y, z, color, 0, 0};
+	for (int i=1 ; i<=segments ; i++)
+	{
+		*verts++ = v;
+		float angle = i==segments ? 0 : i * step;
+		v.x = x + radius * cosf(angle);
+		v.y = y + radius * sinf(angle);
+		*verts++ = v;
+	}
+	mFrameStats.lines += segments;
+}
+
+WinPrimitiveBatch::Bucket *WinPrimitiveBatch::getBucket()
+{
+	if (mCurrentBucket!=NULL)
+	{
+		return mCurrentBucket;
+	}
+
+	// the states changed, look for a bucket that already has them:
+	for (int i=0 ; i<mBucketCount ; i++)
+	{
+		if (memcmp(mBuckets[i]->states, mStates, sizeof(mStates))==0)
+		{
+			mCurrentBucket = mBuckets[i];
+			return mCurrentBucket;
+		}
+	}
+
+	// start a new one:
+	if (mBucketCount==(int)mBuckets.size())
+	{
+		mBuckets.push_back(new Bucket());
+	}
+	mCurrentBucket = mBuckets[mBucketCount++];
+	memcpy(mCurrentBucket->states, mStates, sizeof(mStates));
+	return mCurrentBucket;
+}
+
+void WinPrimitiveBatch::draw(D3DPRIMITIVETYPE type, const std::vector<BoyVertex> &verts, int vertsPerPrimitive)
+{
+	// stream the vertices through the buffer in pieces that fit:
+	int maxVerts = mBufferVertexCount - mBufferVertexCount % vertsPerPrimitive;
+	int count = (int)verts.size();
+	for (int first=0 ; first<count ; first+=maxVerts)
+	{
+		int numVerts = count - first < maxVerts ? count - first : maxVerts;
+
+		// append to the vertex buffer if there's room, otherwise
+		// start over with a fresh one:
+		DWORD lockFlags = D3DLOCK_NOOVERWRITE;
+		if (mBufferVertexOffset + numVerts > mBufferVertexCount)
+		{
+			mBufferVertexOffset = 0;
+			lockFlags = D3DLOCK_DISCARD;
+		}
+
+		void *vbData = NULL;
+		HRESULT hr = mVertexBuffer->Lock(
+			mBufferVertexOffset * sizeof(BoyVertex),
+			numVerts * sizeof(BoyVertex),
+			&vbData,
+			lockFlags);
+		if (FAILED(hr)) return;
+		memcpy(vbData, &verts[first], numVerts * sizeof(BoyVertex));
+		mVertexBuffer->Unlock();
+
+		hr = mDevice->DrawPrimitive(type, mBufferVertexOffset, numVerts / vertsPerPrimitive);
+		mBufferVertexOffset += numVerts;
+		if (FAILED(hr)) return;
+
+		mFrameStats.batches++;
+	}
+}
+
+void WinPrimitiveBatch::applyStates(const DWORD *states)
+{
+	for (int i=0 ; i<STATE_COUNT ; i++)
+	{
+		mDevice->SetRenderState(gStateTypes[i], states[i]);
+	}
+}
+
+int WinPrimitiveBatch::getStateIndex(D3DRENDERSTATETYPE state)
+{
+	for (int i=0 ; i<STATE_COUNT ; i++)
+	{
+		if (gStateTypes[i]==state)
+		{
+			return i;
+		}
+	}
+	return -1;
+}
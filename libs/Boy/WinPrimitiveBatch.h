@@ -0,0 +1,109 @@
+#pragma once
+
+#include "BoyLib/CrtDbgInc.h"
+
+#include "d3d9.h"
+#include <vector>
+#include "WinD3DInterface.h"
+
+namespace Boy
+{
+	/*
+	 * collects untextured lines for the whole frame and draws them
+	 * when the frame ends (or the clip rect changes), with one draw
+	 * call per group of lines that share the same render state
+	 * (blending, z and alpha testing). this is meant for debug overlays
+	 * that draw lots of lines: they end up on top of whatever was drawn
+	 * before them unless the z buffer says otherwise. filled rects
+	 * aren't batched here, they go through the sprite batch so they
+	 * stay in order with the sprites.
+	 */
+	class WinPrimitiveBatch
+	{
+	public:
+
+		struct Stats
+		{
+			int batches; // number of draw calls issued
+			int lines; // number of lines drawn
+		};
+
+		WinPrimitiveBatch(IDirect3DDevice9 *device, int bufferVertexCount);
+		virtual ~WinPrimitiveBatch();
+
+		// device buffers (these live in the default pool
+		// and must be released when the device is lost):
+		bool createBuffers();
+		void releaseBuffers();
+
+		// frame bracketing (endFrame draws everything):
+		void beginFrame(WinD3DInterface *d3dInterface);
+		void endFrame();
+
+		// draws what's queued so far (before the scissor rect changes):
+		void flush();
+
+		// must be told about every render state change:
+		void setRenderState(D3DRENDERSTATETYPE state, DWORD value);
+
+		// queue primitives (all in screen space):
+		void addLine(float x0, float y0, float x1, float y1, float z, DWORD color);
+		void addRect(float x, float y, float w, float h, float z, DWORD color);
+		void addCircle(float x, float y, float radius, float z, DWORD color);
+
+		// stats for the frame in progress and for the last complete frame:
+		inline const Stats &getFrameStats() { return mFrameStats; }
+		inline const Stats &getLastFrameStats() { return mLastFrameStats; }
+
+	private:
+
+		// the render states primitives are grouped by:
+		enum StateIndex
+		{
+			STATE_SRCBLEND,
+			STATE_DESTBLEND,
+			STATE_BLENDOP,
+			STATE_ZENABLE,
+			STATE_ZWRITEENABLE,
+			STATE_ZFUNC,
+			STATE_ALPHATESTENABLE,
+			STATE_ALPHAREF,
+			STATE_ALPHAFUNC,
+			STATE_COUNT
+		};
+
+		// everything queued with one set of render states:
+		struct Bucket
+		{
+			DWORD states[STATE_COUNT];
+			std::vector<BoyVertex> lineVerts; // line list
+		};
+
+		Bucket *getBucket();
+		void draw(D3DPRIMITIVETYPE type, const std::vector<BoyVertex> &verts, int vertsPerPrimitive);
+		void applyStates(const DWORD *states);
+		static int getStateIndex(D3DRENDERSTATETYPE state);
+
+	private:
+
+		IDirect3DDevice9 *mDevice;
+
+		// device buffer:
+		IDirect3DVertexBuffer9 *mVertexBuffer;
+		int mBufferVertexCount; // capacity of the vertex buffer
+		int mBufferVertexOffset; // first free vertex in the vertex buffer
+
+		// the device's current render states:
+		DWORD mStates[STATE_COUNT];
+
+		// the frame's buckets (they're kept around between frames
+		// so their vertex arrays don't have to grow again):
+		std::vector<Bucket*> mBuckets;
+		int mBucketCount;
+		Bucket *mCurrentBucket; // NULL if the states changed
+
+		// counters:
+		Stats mFrameStats;
+		Stats mLastFrameStats;
+	};
+}
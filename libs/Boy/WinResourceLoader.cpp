@@ -2,25 +2,138 @@
 
 #include <assert.h>
 #include "Environment.h"
+#include "Png.h"
+#include "Storage.h"
 #include "WinImage.h"
 #include "WinD3DInterface.h"
 #include "WinSound.h"
 #include "WinSoundPlayer.h"
+#include "WinTextureAtlas.h"
+#include <vector>
 
 using namespace Boy;
 
+// atlas pages are at most this big (in texels):
+#define ATLAS_PAGE_SIZE 1024
+
+// images that are bigger than this in either direction get their own texture:
+#define ATLAS_MAX_IMAGE_SIZE 256
+
+// what images look like while they're loading on demand (debug
+// builds make them stand out):
+#ifdef _DEBUG
+#define PLACEHOLDER_COLOR 0x80ff00ff
+#else
+#define PLACEHOLDER_COLOR 0x00000000
+#endif
+
+// the silence sounds play while they're loading on demand (in ms):
+#define SILENCE_LENGTH 100
+#define SILENCE_SAMPLE_RATE 22050
+
 #include "BoyLib/CrtDbgNew.h"
 
+// an image that was read and decoded on a loading worker:
+class PreparedImage : public PreparedResource
+{
+public:
+
+	PreparedImage(unsigned int *pixels, int width, int height) { mPixels = pixels; mWidth = width; mHeight = height; }
+	virtual ~PreparedImage() { delete[] mPixels; }
+
+	unsigned int *mPixels;
+	int mWidth;
+	int mHeight;
+};
+
 WinResourceLoader::WinResourceLoader(const std::string &language1, 
 									 const std::string &language2, 
 									 WinD3DInterface *sdld3dInterface) 
 									 : ResourceLoader(language1,language2)
 {
 	mInterface = sdld3dInterface;
+	mAtlas = NULL;
+	mAtlasEnabled = true;
+	mPlaceholderTexture = NULL;
+	mSilence = NULL;
 }
 
 WinResourceLoader::~WinResourceLoader()
 {
+	delete mAtlas;
+	if (mPlaceholderTexture!=NULL)
+	{
+		mPlaceholderTexture->Release();
+	}
+}
+
+void WinResourceLoader::beginGroup(const std::string &groupName)
+{
+	if (!mAtlasEnabled)
+	{
+		return;
+	}
+
+	// pages can't be bigger than the biggest texture:
+	int pageSize = ATLAS_PAGE_SIZE;
+	if (pageSize > mInterface->getMaxTextureWidth()) pageSize = mInterface->getMaxTextureWidth();
+	if (pageSize > mInterface->getMaxTextureHeight()) pageSize = mInterface->getMaxTextureHeight();
+
+	delete mAtlas;
+	mAtlas = new WinTextureAtlas(mInterface, pageSize);
+	mAtlasGroup = groupName;
+}
+
+void WinResourceLoader::endGroup()
+{
+	if (mAtlas==NULL)
+	{
+		return;
+	}
+
+	if (!mAtlas->isEmpty())
+	{
+		WinTextureAtlas::Stats stats;
+		mAtlas->build(stats);
+		envDebugLog("atlas '%s': %d images on %d pages (%.0f%% used), %d texture binds saved\n",
+			mAtlasGroup.c_str(), stats.images, stats.pages, stats.occupancy*100, stats.images - stats.pages);
+	}
+
+	delete mAtlas;
+	mAtlas = NULL;
+}
+
+bool WinResourceLoader::addToAtlas(WinImage *img, const std::string &fname)
+{
+	// read the whole file:
+	Storage *storage = Environment::instance()->getStorage();
+	BoyFileHandle hFile;
+	if (storage->FileOpen(fname.c_str(), Storage::STORAGE_MODE_READ | Storage::STORAGE_MUST_EXIST, &hFile)!=Storage::STORAGE_OK)
+	{
+		return false;
+	}
+	int size = storage->FileGetSize(hFile);
+	unsigned char *data = new unsigned char[size];
+	Storage::StorageResult result = storage->FileRead(hFile, data, size);
+	storage->FileClose(hFile);
+
+	// only small images go into the atlas:
+	int width, height;
+	unsigned int *pixels = NULL;
+	bool ok = result==Storage::STORAGE_OK &&
+		pngReadSize(data, size, &width, &height) &&
+		width<=ATLAS_MAX_IMAGE_SIZE && height<=ATLAS_MAX_IMAGE_SIZE &&
+		pngDecode(data, size, &width, &height, &pixels);
+	delete[] data;
+	if (!ok)
+	{
+		return false;
+	}
+
+	// the texture gets set when the group is done loading:
+	mAtlas->add(img, pixels, width, height);
+	img->setSize(width, height);
+	return true;
 }
 
 Image *WinResourceLoader::createImage(const std::string &filename)
@@ -33,41 +146,205 @@ Sound *WinResourceLoader::createSound(const std::string &filename)
 	return new WinSound(this,filename);
 }
 
-bool WinResourceLoader::load(Image *image)
+PreparedResource *WinResourceLoader::prepare(Image *image)
 {
 	WinImage *img = dynamic_cast<WinImage*>(image);
+	std::string fname = findImageFile(img);
 
-	// try to find a localized version:
-	D3DXIMAGE_INFO imageInfo;
-	bool scaled;
-	std::string fname = img->getPath()+"."+mLanguage1+".png";
-	FILE *f = fopen(fname.c_str(),"rb");
-	if (f==NULL)
+	// read the whole file:
+	Storage *storage = Environment::instance()->getStorage();
+	BoyFileHandle hFile;
+	if (storage->FileOpen(fname.c_str(), Storage::STORAGE_MODE_READ | Storage::STORAGE_MUST_EXIST, &hFile)!=Storage::STORAGE_OK)
 	{
-		if (mLanguage2.size()>0)
+		return NULL;
+	}
+	int size = storage->FileGetSize(hFile);
+	unsigned char *data = new unsigned char[size];
+	Storage::StorageResult result = storage->FileRead(hFile, data, size);
+	storage->FileClose(hFile);
+
+	PreparedResource *prepared = result==Storage::STORAGE_OK ? prepare(image, data, size) : NULL;
+	delete[] data;
+	return prepared;
+}
+
+PreparedResource *WinResourceLoader::prepare(Image *image, const unsigned char *data, int size)
+{
+	// decode it (load() falls back to d3dx for anything this can't do):
+	int width, height;
+	unsigned int *pixels = NULL;
+	if (!pngDecode(data, size, &width, &height, &pixels))
+	{
+		return NULL;
+	}
+
+	return new PreparedImage(pixels, width, height);
+}
+
+std::string WinResourceLoader::getPrepareFile(Image *image)
+{
+	return findImageFile(dynamic_cast<WinImage*>(image));
+}
+
+void WinResourceLoader::loadPlaceholder(Image *image)
+{
+	WinImage *img = dynamic_cast<WinImage*>(image);
+	if (img->getTexture()!=NULL)
+	{
+		return;
+	}
+
+	// the size comes from the file's header (it's all that's read):
+	if (img->getWidth()<0)
+	{
+		std::string fname = findImageFile(img);
+		Storage *storage = Environment::instance()->getStorage();
+		BoyFileHandle hMap;
+		const void *data;
+		int size;
+		if (storage->FileMap(fname.c_str(), &hMap, &data, &size)==Storage::STORAGE_OK)
 		{
-			// try backup language:
-			fname = img->getPath()+"."+mLanguage2+".png";
-			f = fopen(fname.c_str(),"rb");
-			if (f==NULL)
-			{
-				fname = img->getPath()+".png";
-			}
-			else
+			int width, height;
+			if (pngReadSize((const unsigned char*)data, size, &width, &height))
 			{
-				fclose(f);
+				img->setSize(width, height);
 			}
+			storage->FileUnmap(hMap);
 		}
-		else
+	}
+
+	// a single texel, stretched over the whole image:
+	if (mPlaceholderTexture==NULL)
+	{
+		unsigned int pixel = PLACEHOLDER_COLOR;
+		mPlaceholderTexture = mInterface->createTexture(&pixel, 1, 1);
+		if (mPlaceholderTexture==NULL)
 		{
-			fname = img->getPath()+".png";
+			return;
 		}
 	}
-	else
+	mPlaceholderTexture->AddRef();
+	img->setTexture(mPlaceholderTexture, false);
+}
+
+void WinResourceLoader::loadPlaceholder(Sound *sound)
+{
+	WinSound *snd = dynamic_cast<WinSound*>(sound);
+	if (snd->getISoundSource()!=NULL)
+	{
+		return;
+	}
+
+	if (mSilence==NULL)
+	{
+		SoundPlayer *sp = Environment::instance()->getSoundPlayer();
+		irrklang::ISoundEngine *engine = dynamic_cast<WinSoundPlayer*>(sp)->getEngine();
+		if (engine==NULL)
+		{
+			return;
+		}
+
+		irrklang::SAudioStreamFormat format;
+		format.ChannelCount = 1;
+		format.FrameCount = SILENCE_SAMPLE_RATE * SILENCE_LENGTH / 1000;
+		format.SampleRate = SILENCE_SAMPLE_RATE;
+		format.SampleFormat = irrklang::ESF_S16;
+		std::vector<short> samples(format.FrameCount, 0);
+		mSilence = engine->addSoundSourceFromPCMData(
+			&samples[0], // samples
+			(int)(samples.size() * sizeof(short)), // size
+			"boy_placeholder_silence", // name
+			format,
+			true); // copy the data
+		if (mSilence==NULL)
+		{
+			return;
+		}
+	}
+	snd->setPlaceholder(mSilence);
+}
+
+bool WinResourceLoader::loadPrepared(WinImage *img, PreparedResource *prepared)
+{
+	PreparedImage *pi = dynamic_cast<PreparedImage*>(prepared);
+	if (pi==NULL)
+	{
+		return false;
+	}
+
+	// small images of a group that's loading get packed:
+	if (mAtlas!=NULL && pi->mWidth<=ATLAS_MAX_IMAGE_SIZE && pi->mHeight<=ATLAS_MAX_IMAGE_SIZE)
+	{
+		// (the atlas takes the pixels):
+		mAtlas->add(img, pi->mPixels, pi->mWidth, pi->mHeight);
+		pi->mPixels = NULL;
+		img->setSize(pi->mWidth, pi->mHeight);
+		return true;
+	}
+
+	// images that would need scaling are left to loadTexture:
+	IDirect3DTexture9 *tex = mInterface->createTexture(pi->mPixels, pi->mWidth, pi->mHeight);
+	if (tex==NULL)
+	{
+		return false;
+	}
+
+	if (mInterface->isPremultipliedAlpha())
+	{
+		mInterface->premultiplyTexture(tex);
+	}
+
+	img->setTexture(tex, false);
+	img->setSize(pi->mWidth, pi->mHeight);
+	return true;
+}
+
+std::string WinResourceLoader::findImageFile(WinImage *img)
+{
+	// try to find a localized version (through storage, so that
+	// files in a resource pack don't cost a trip to the disk):
+	Storage *storage = Environment::instance()->getStorage();
+	int size;
+	std::string fname = img->getPath()+"."+mLanguage1+".png";
+	if (storage->FileGetSize(fname.c_str(), &size)==Storage::STORAGE_OK)
+	{
+		return fname;
+	}
+	if (mLanguage2.size()>0)
+	{
+		// try backup language:
+		fname = img->getPath()+"."+mLanguage2+".png";
+		if (storage->FileGetSize(fname.c_str(), &size)==Storage::STORAGE_OK)
+		{
+			return fname;
+		}
+	}
+	return img->getPath()+".png";
+}
+
+bool WinResourceLoader::load(Image *image)
+{
+	WinImage *img = dynamic_cast<WinImage*>(image);
+
+	// use what a loading worker decoded if there is something:
+	PreparedResource *prepared = takePrepared(image);
+	bool ok = loadPrepared(img, prepared);
+	delete prepared;
+	if (ok)
+	{
+		return true;
+	}
+
+	std::string fname = findImageFile(img);
+
+	// small images of a group that's loading get packed:
+	if (mAtlas!=NULL && addToAtlas(img, fname))
 	{
-		fclose(f);
+		return true;
 	}
 
+	D3DXIMAGE_INFO imageInfo;
+	bool scaled;
 	IDirect3DTexture9 *tex = mInterface->loadTexture(
 		fname.c_str(),
 		&imageInfo,
@@ -81,6 +358,11 @@ bool WinResourceLoader::load(Image *image)
 	// set the texture:
 	if (tex!=NULL)
 	{
+		if (mInterface->isPremultipliedAlpha())
+		{
+			mInterface->premultiplyTexture(tex);
+		}
+
 		img->setTexture(tex, scaled);
 
 		// remember the original image size:
@@ -156,11 +438,27 @@ irrklang::ISoundSource *WinResourceLoader::tryLoad(const std::string &filename)
 		return iss;
 	}
 
-	// let's try to load it:
-	iss = engine->addSoundSourceFromFile(
-		filename.c_str(), // filename
-		irrklang::ESM_NO_STREAMING, // no streaming
-		false); // no preload
+	// read it through storage (it might be in a resource pack):
+	Storage *storage = Environment::instance()->getStorage();
+	BoyFileHandle hMap;
+	const void *data;
+	int size;
+	if (storage->FileMap(filename.c_str(), &hMap, &data, &size)!=Storage::STORAGE_OK)
+	{
+		return NULL;
+	}
+
+	// let's try to load it (irrklang keeps a copy of the data):
+	iss = engine->addSoundSourceFromMemory(
+		(void*)data, // file data
+		size, // file size
+		filename.c_str(), // name
+		true); // copy the data
+	storage->FileUnmap(hMap);
+	if (iss==NULL)
+	{
+		return NULL;
+	}
 	iss->setForcedStreamingThreshold(-1);
 	unsigned int len = iss->getPlayLength();
 	if (len==0xffffffff)
@@ -2,12 +2,15 @@
 
 #include "BoyLib/CrtDbgInc.h"
 
+#include "d3d9.h"
 #include "irrKlang.h"
 #include "ResourceLoader.h"
 
 namespace Boy
 {
 	class WinD3DInterface;
+	class WinImage;
+	class WinTextureAtlas;
 
 	class WinResourceLoader : public ResourceLoader
 	{
@@ -21,13 +24,41 @@ namespace Boy
 		virtual Image *createImage(const std::string &filename);
 		virtual Sound *createSound(const std::string &filename);
 
+		// reads and decodes images on the loading workers (sounds are
+		// left to load(), irrKlang wants its sources made on one thread):
+		virtual PreparedResource *prepare(Image *image);
+		virtual PreparedResource *prepare(Image *image, const unsigned char *data, int size);
+		virtual std::string getPrepareFile(Image *image);
+
+		// on demand loading: images show a shared blank texture and
+		// sounds play silence until they're loaded:
+		virtual void loadPlaceholder(Image *image);
+		virtual void loadPlaceholder(Sound *sound);
+
+		// packs the small images of a group into shared textures:
+		virtual void beginGroup(const std::string &groupName);
+		virtual void endGroup();
+		inline void setAtlasEnabled(bool enabled) { mAtlasEnabled = enabled; }
+
 	private:
 
 		irrklang::ISoundSource *tryLoad(const std::string &filename);
+		std::string findImageFile(WinImage *img);
+		bool addToAtlas(WinImage *img, const std::string &fname);
+		bool loadPrepared(WinImage *img, PreparedResource *prepared);
 
 	private:
 
 		WinD3DInterface *mInterface;
 
+		// the atlas of the group being loaded (NULL if there's none):
+		WinTextureAtlas *mAtlas;
+		std::string mAtlasGroup;
+		bool mAtlasEnabled;
+
+		// placeholders (made the first time they're needed):
+		IDirect3DTexture9 *mPlaceholderTexture;
+		irrklang::ISoundSource *mSilence;
+
 	};
 };
@@ -12,6 +12,7 @@ using namespace Boy;
 WinSound::WinSound(ResourceLoader *loader, const std::string &path) : Sound(loader,path)
 {
 	mISoundSource = NULL;
+	mIsPlaceholder = false;
 	mISound = NULL;
 	mFadeStartTime = -1;
 	mFadeDuration = -1;
@@ -27,6 +28,11 @@ bool WinSound::init(bool includeSounds)
 {
 	if (includeSounds)
 	{
+		// (drops the placeholder if there is one):
+		if (mIsPlaceholder)
+		{
+			destroy(includeSounds);
+		}
 		return mLoader->load(this);
 	}
 	else
@@ -44,7 +50,7 @@ void WinSound::destroy(bool includeSounds)
 		{
 			sp->stopSound(this);			
 		}
-		if (mISoundSource!=NULL)
+		if (mISoundSource!=NULL && !mIsPlaceholder)
 		{
 			WinSoundPlayer *wsp = dynamic_cast<WinSoundPlayer*>(sp);
 			irrklang::ISoundEngine *eng = wsp->getEngine();
@@ -56,7 +62,18 @@ void WinSound::destroy(bool includeSounds)
 //		printf("WinSound::destroy() - setting isound to NULL (winsound=%p)\n",this);
 		mISound = NULL;
 		mISoundSource = NULL;
+		mIsPlaceholder = false;
+	}
+}
+
+int WinSound::getMemoryUsage()
+{
+	// (sounds are decoded when they're loaded):
+	if (mISoundSource==NULL || mIsPlaceholder || mISoundSource->getSampleData()==NULL)
+	{
+		return 0;
 	}
+	return mISoundSource->getAudioFormat().getSampleDataSize();
 }
 
 void WinSound::reload()
@@ -70,6 +87,13 @@ void WinSound::setISoundSource(irrklang::ISoundSource *iss)
 	mISoundSource = iss;
 }
 
+void WinSound::setPlaceholder(irrklang::ISoundSource *iss)
+{
+	assert(mISoundSource==NULL);
+	mISoundSource = iss;
+	mIsPlaceholder = true;
+}
+
 irrklang::ISoundSource *WinSound::getISoundSource()
 {
 	return mISoundSource;
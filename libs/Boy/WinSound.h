@@ -15,6 +15,10 @@ namespace Boy
 		const std::string &getPath() { return mPath; }
 
 		void setISoundSource(irrklang::ISoundSource *iss);
+
+		// a source the sound plays until it's loaded (it isn't the
+		// sound's, so it's left alone when the sound is destroyed):
+		void setPlaceholder(irrklang::ISoundSource *iss);
 		irrklang::ISoundSource *getISoundSource();
 		void setISound(irrklang::ISound *isound);
 		irrklang::ISound *getISound();
@@ -28,6 +32,7 @@ namespace Boy
 
 		// overrides:
 		virtual void reload();
+		virtual int getMemoryUsage();
 
 	protected:
 
@@ -37,6 +42,7 @@ namespace Boy
 	private:
 
 		irrklang::ISoundSource *mISoundSource;
+		bool mIsPlaceholder;
 		irrklang::ISound *mISound;
 
 		float mFadeStartTime;
@@ -0,0 +1,241 @@
+#include "WinSpriteBatch.h"
+
+#include <assert.h>
+#include <string.h>
+
+using namespace Boy;
+
+#include "BoyLib/CrtDbgNew.h"
+
+WinSpriteBatch::WinSpriteBatch(IDirect3DDevice9 *device, int maxQuadsPerBatch, int bufferedBatches)
+{
+	// indices are 16 bit and relative to the batch's base vertex:
+	assert(maxQuadsPerBatch*4 <= 0x10000);
+	assert(bufferedBatches>0);
+
+	mDevice = device;
+	mVertexBuffer = NULL;
+	mIndexBuffer = NULL;
+	mBufferVertexCount = maxQuadsPerBatch * 4 * bufferedBatches;
+	mBufferVertexOffset = 0;
+
+	mMaxQuads = maxQuadsPerBatch;
+	mVerts = new BoyVertex[mMaxQuads*4];
+	mQuadCount = 0;
+	mTexture = NULL;
+
+	resetStats(mFrameStats);
+	resetStats(mLastFrameStats);
+}
+
+WinSpriteBatch::~WinSpriteBatch()
+{
+	releaseBuffers();
+	delete[] mVerts;
+}
+
+bool WinSpriteBatch::createBuffers()
+{
+	assert(mVertexBuffer==NULL && mIndexBuffer==NULL);
+
+	// create the dynamic vertex buffer that batches get streamed into:
+	HRESULT hr = mDevice->CreateVertexBuffer(
+		mBufferVertexCount * sizeof(BoyVertex),
+		D3DUSAGE_DYNAMIC | D3DUSAGE_WRITEONLY,
+		BOYFVF,
+		D3DPOOL_DEFAULT,
+		&mVertexBuffer,
+		NULL);
+	if (FAILED(hr))
+	{
+		mVertexBuffer = NULL;
+		return false;
+	}
+	mBufferVertexOffset = 0;
+
+	// create the index buffer (it never changes, every
+	// quad is made of the same two triangles):
+	int numIndices = mMaxQuads * 6;
+	hr = mDevice->CreateIndexBuffer(
+		numIndices * sizeof(WORD),
+		D3DUSAGE_WRITEONLY,
+		D3DFMT_INDEX16,
+		D3DPOOL_DEFAULT,
+		&mIndexBuffer,
+		NULL);
+	if (FAILED(hr))
+	{
+		mIndexBuffer = NULL;
+		releaseBuffers();
+		return false;
+	}
+
+	// fill in the indices:
+	WORD *indices = NULL;
+	hr = mIndexBuffer->Lock(0, 0, (void**)&indices, 0);
+	if (FAILED(hr))
+	{
+		releaseBuffers();
+		return false;
+	}
+	for (int i=0 ; i<mMaxQuads ; i++)
+	{
+		WORD v = (WORD)(i*4);
+		*indices++ = v;		// top left
+		*indices++ = v+1;	// top right
+		*indices++ = v+2;	// bottom left
+		*indices++ = v+2;	// bottom left
+		*indices++ = v+1;	// top right
+		*indices++ = v+3;	// bottom right
+	}
+	mIndexBuffer->Unlock();
+
+	return true;
+}
+
+void WinSpriteBatch::releaseBuffers()
+{
+	// whatever's pending can't be drawn anymore:
+	mQuadCount = 0;
+	mTexture = NULL;
+
+	if (mVertexBuffer!=NULL)
+	{
+		mVertexBuffer->Release();
+		mVertexBuffer = NULL;
+	}
+	if (mIndexBuffer!=NULL)
+	{
+		mIndexBuffer->Release();
+		mIndexBuffer = NULL;
+	}
+}
+
+void WinSpriteBatch::beginFrame()
+{
+	assert(mQuadCount==0);
+	resetStats(mFrameStats);
+}
+
+void WinSpriteBatch::endFrame()
+{
+	flush(FLUSH_END_OF_FRAME);
+	mLastFrameStats = mFrameStats;
+}
+
+void WinSpriteBatch::addQuad(IDirect3DTexture9 *tex, const BoyVertex *verts)
+{
+	// a different texture means a different batch:
+	if (mQuadCount>0 && tex!=mTexture)
+	{
+		flush(FLUSH_TEXTURE);
+	}
+
+	// so does running out of room:
+	if (mQuadCount==mMaxQuads)
+	{
+		flush(FLUSH_BUFFER_FULL);
+	}
+
+	mTexture = tex;
+	memcpy(mVerts + mQuadCount*4, verts, 4*sizeof(BoyVertex));
+	mQuadCount++;
+}
+
+void WinSpriteBatch::flush(FlushReason reason)
+{
+	// nothing to do?
+	if (mQuadCount==0)
+	{
+		return;
+	}
+
+	int numVerts = mQuadCount * 4;
+	int numQuads = mQuadCount;
+	IDirect3DTexture9 *tex = mTexture;
+
+	// the batch is consumed no matter what happens below:
+	mQuadCount = 0;
+	mTexture = NULL;
+
+	if (mVertexBuffer==NULL || mIndexBuffer==NULL)
+	{
+		return;
+	}
+
+	// append to the vertex buffer if there's room, otherwise
+	// start over at the beginning with a fresh buffer (the
+	// driver keeps the old one alive until the gpu is done):
+	DWORD lockFlags = D3DLOCK_NOOVERWRITE;
+	if (mBufferVertexOffset + numVerts > mBufferVertexCount)
+	{
+		mBufferVertexOffset = 0;
+		lockFlags = D3DLOCK_DISCARD;
+	}
+
+	// copy the batch into the vertex buffer:
+	void *vbData = NULL;
+	HRESULT hr = mVertexBuffer->Lock(
+		mBufferVertexOffset * sizeof(BoyVertex),
+		numVerts * sizeof(BoyVertex),
+		&vbData,
+		lockFlags);
+	if (FAILED(hr)) return;
+	memcpy(vbData, mVerts, numVerts * sizeof(BoyVertex));
+	mVertexBuffer->Unlock();
+
+	// draw it:
+	hr = mDevice->SetStreamSource(0, mVertexBuffer, 0, sizeof(BoyVertex));
+	if (FAILED(hr)) return;
+	hr = mDevice->SetIndices(mIndexBuffer);
+	if (FAILED(hr)) return;
+	hr = mDevice->SetTexture(0, tex);
+	if (FAILED(hr)) return;
+	hr = mDevice->DrawIndexedPrimitive(
+		D3DPT_TRIANGLELIST,
+		mBufferVertexOffset, // base vertex
+		0, // min index
+		numVerts, // number of vertices used
+		0, // start index
+		numQuads*2); // primitive count
+	mBufferVertexOffset += numVerts;
+	if (FAILED(hr)) return;
+
+	// keep track of what happened:
+	mFrameStats.batches++;
+	mFrameStats.quads += numQuads;
+	mFrameStats.flushes[reason]++;
+}
+
+const char *WinSpriteBatch::getFlushReasonName(FlushReason reason)
+{
+	switch (reason)
+	{
+	case FLUSH_TEXTURE:
+		return "texture";
+	case FLUSH_BLEND_MODE:
+		return "blend";
+	case FLUSH_Z_STATE:
+		return "z";
+	case FLUSH_RENDER_STATE:
+		return "state";
+	case FLUSH_CLIP_RECT:
+		return "clip";
+	case FLUSH_TRANSFORM:
+		return "transform";
+	case FLUSH_PRIMITIVE:
+		return "primitive";
+	case FLUSH_BUFFER_FULL:
+		return "full";
+	case FLUSH_END_OF_FRAME:
+		return "frame";
+	default:
+		assert(false);
+		return "?";
+	}
+}
+
+void WinSpriteBatch::resetStats(Stats &stats)
+{
+	memset(&stats, 0, sizeof(Stats));
+}
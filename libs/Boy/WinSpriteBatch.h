@@ -0,0 +1,90 @@
+#pragma once
+
+#include "BoyLib/CrtDbgInc.h"
+
+#include "d3d9.h"
+#include "WinD3DInterface.h"
+
+namespace Boy
+{
+	/*
+	 * collects textured/colored quads into one large dynamic vertex
+	 * buffer and draws them with a single indexed draw call until
+	 * something that affects their rendering (texture, render state,
+	 * clip rect, transform...) changes.
+	 */
+	class WinSpriteBatch
+	{
+	public:
+
+		enum FlushReason
+		{
+			FLUSH_TEXTURE,
+			FLUSH_BLEND_MODE,
+			FLUSH_Z_STATE,
+			FLUSH_RENDER_STATE,
+			FLUSH_CLIP_RECT,
+			FLUSH_TRANSFORM,
+			FLUSH_PRIMITIVE,
+			FLUSH_BUFFER_FULL,
+			FLUSH_END_OF_FRAME,
+			FLUSH_REASON_COUNT
+		};
+
+		struct Stats
+		{
+			int batches; // number of draw calls issued
+			int quads; // number of quads drawn
+			int flushes[FLUSH_REASON_COUNT]; // number of flushes, by reason
+		};
+
+		WinSpriteBatch(IDirect3DDevice9 *device, int maxQuadsPerBatch, int bufferedBatches);
+		virtual ~WinSpriteBatch();
+
+		// device buffers (these live in the default pool
+		// and must be released when the device is lost):
+		bool createBuffers();
+		void releaseBuffers();
+
+		// frame bracketing (resets the per-frame counters):
+		void beginFrame();
+		void endFrame();
+
+		// queue a quad (vertices in triangle strip order: tl, tr, bl, br):
+		void addQuad(IDirect3DTexture9 *tex, const BoyVertex *verts);
+
+		// draw everything that's been queued so far:
+		void flush(FlushReason reason);
+
+		inline bool isEmpty() { return mQuadCount==0; }
+
+		// stats for the frame in progress and for the last complete frame:
+		inline const Stats &getFrameStats() { return mFrameStats; }
+		inline const Stats &getLastFrameStats() { return mLastFrameStats; }
+		static const char *getFlushReasonName(FlushReason reason);
+
+	private:
+
+		void resetStats(Stats &stats);
+
+	private:
+
+		IDirect3DDevice9 *mDevice;
+
+		// device buffers:
+		IDirect3DVertexBuffer9 *mVertexBuffer;
+		IDirect3DIndexBuffer9 *mIndexBuffer;
+		int mBufferVertexCount; // capacity of the vertex buffer
+		int mBufferVertexOffset; // first free vertex in the vertex buffer
+
+		// the batch currently being built:
+		BoyVertex *mVerts;
+		int mMaxQuads;
+		int mQuadCount;
+		IDirect3DTexture9 *mTexture;
+
+		// counters:
+		Stats mFrameStats;
+		Stats mLastFrameStats;
+	};
+}
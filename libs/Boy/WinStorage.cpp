@@ -2,6 +2,7 @@
 
 #include "BoyLib/UString.h"
 #include <stdio.h>
+#include <string.h>
 
 using namespace Boy;
 
@@ -14,6 +15,16 @@ WinStorage::WinStorage() :
 
 WinStorage::~WinStorage()
 {
+	// (the io threads read through this storage):
+	StopReads();
+
+	for( std::map<int,Mapping>::iterator i = mMappings.begin(); i != mMappings.end(); ++i )
+	{
+		UnmapViewOfFile( i->second.pView );
+		CloseHandle( i->second.hMapping );
+		CloseHandle( i->second.hFile );
+	}
+	mMappings.clear();
 }
 
 Storage::StorageResult WinStorage::FileOpen( const char *pFilePathUtf8, int modeFlags, BoyFileHandle *pFileHandleOut )
@@ -38,6 +49,10 @@ Storage::StorageResult WinStorage::FileOpen( const char *pFilePathUtf8, int mode
 			case STORAGE_MODE_WRITE | STORAGE_OPEN_ALWAYS:
 				pModeStr = L"w+b";
 				break;
+
+			case STORAGE_MODE_WRITE | STORAGE_APPEND:
+				pModeStr = L"ab";
+				break;
 		}
 
 		// check for bad flag combo
@@ -48,6 +63,7 @@ Storage::StorageResult WinStorage::FileOpen( const char *pFilePathUtf8, int mode
 			int openResult = _wfopen_s( &f, pFilePathUnicode.wc_str(), pModeStr );
 			if( openResult == 0 )
 			{
+				std::lock_guard<std::mutex> lock( mMutex );
 				++mFileKey;
 				mOpenFiles[ mFileKey ] = f;
 				*pFileHandleOut = (BoyFileHandle)mFileKey;
@@ -109,6 +125,7 @@ Storage::StorageResult WinStorage::FileClose( BoyFileHandle fileHandle )
 		if( closeResult != EOF )
 		{
 			int key = (int)fileHandle;
+			std::lock_guard<std::mutex> lock( mMutex );
 			mOpenFiles.erase( key );
 			result = STORAGE_OK;
 		}
@@ -134,11 +151,134 @@ int WinStorage::FileGetSize( BoyFileHandle openFileHandle )
 	return sizeBytes;
 }
 
+Storage::StorageResult WinStorage::FileSeek( BoyFileHandle fileHandle, int offset )
+{
+	StorageResult result = STORAGE_FAIL;
+
+	// validate file handle
+	FILE *f = GetFilePtr( fileHandle );
+	if( f && offset >= 0 && fseek( f, offset, SEEK_SET ) == 0 )
+	{
+		result = STORAGE_OK;
+	}
+
+	return result;
+}
+
+Storage::StorageResult WinStorage::FileMap( const char *pFilePathUtf8, BoyFileHandle *pMapHandleOut, const void **ppDataOut, int *pSizeBytesOut )
+{
+	StorageResult result = STORAGE_FAIL;
+
+	if( pMapHandleOut && ppDataOut && pSizeBytesOut )
+	{
+		Boy::UString pFilePathUnicode(pFilePathUtf8);
+		HANDLE hFile = CreateFileW( pFilePathUnicode.wc_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL );
+		if( hFile != INVALID_HANDLE_VALUE )
+		{
+			// (empty files can't be mapped)
+			DWORD sizeHigh = 0;
+			DWORD size = GetFileSize( hFile, &sizeHigh );
+			HANDLE hMapping = NULL;
+			const void *pView = NULL;
+			if( size > 0 && size <= 0x7fffffff && sizeHigh == 0 )
+			{
+				hMapping = CreateFileMappingW( hFile, NULL, PAGE_READONLY, 0, 0, NULL );
+			}
+			if( hMapping )
+			{
+				pView = MapViewOfFile( hMapping, FILE_MAP_READ, 0, 0, 0 );
+			}
+
+			if( pView )
+			{
+				Mapping m = { hFile, hMapping, pView };
+				std::lock_guard<std::mutex> lock( mMutex );
+				++mMapKey;
+				mMappings[ mMapKey ] = m;
+				*pMapHandleOut = (BoyFileHandle)mMapKey;
+				*ppDataOut = pView;
+				*pSizeBytesOut = (int)size;
+				result = STORAGE_OK;
+			}
+			else
+			{
+				if( hMapping ) CloseHandle( hMapping );
+				CloseHandle( hFile );
+			}
+		}
+	}
+
+	return result;
+}
+
+Storage::StorageResult WinStorage::FileUnmap( BoyFileHandle mapHandle )
+{
+	std::lock_guard<std::mutex> lock( mMutex );
+	std::map<int,Mapping>::iterator i = mMappings.find( (int)mapHandle );
+	if( i == mMappings.end() )
+	{
+		return STORAGE_FAIL;
+	}
+
+	UnmapViewOfFile( i->second.pView );
+	CloseHandle( i->second.hMapping );
+	CloseHandle( i->second.hFile );
+	mMappings.erase( i );
+	return STORAGE_OK;
+}
+
+Storage::StorageResult WinStorage::FileRename( const char *pFromPathUtf8, const char *pToPathUtf8 )
+{
+	StorageResult result = STORAGE_FAIL;
+
+	if( pFromPathUtf8 && pToPathUtf8 )
+	{
+		// (write through, so the rename doesn't get ahead of the data on disk)
+		Boy::UString fromUnicode(pFromPathUtf8);
+		Boy::UString toUnicode(pToPathUtf8);
+		if( MoveFileExW( fromUnicode.wc_str(), toUnicode.wc_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH ) )
+		{
+			result = STORAGE_OK;
+		}
+	}
+
+	return result;
+}
+
+Storage::StorageResult WinStorage::FileReadAt( const char *pFilePathUtf8, int offset, int sizeBytes, void *pBuffer, int *pBytesReadOut )
+{
+	StorageResult result = STORAGE_FAIL;
+
+	// (a read with an offset in the OVERLAPPED doesn't depend on a file
+	// position, so nothing is shared between reads)
+	if( pFilePathUtf8 && offset >= 0 && sizeBytes >= 0 && pBytesReadOut )
+	{
+		Boy::UString pFilePathUnicode(pFilePathUtf8);
+		HANDLE hFile = CreateFileW( pFilePathUnicode.wc_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL );
+		if( hFile != INVALID_HANDLE_VALUE )
+		{
+			OVERLAPPED overlapped;
+			memset( &overlapped, 0, sizeof(overlapped) );
+			overlapped.Offset = (DWORD)offset;
+			DWORD bytesRead = 0;
+			if( ReadFile( hFile, pBuffer, (DWORD)sizeBytes, &bytesRead, &overlapped ) || GetLastError() == ERROR_HANDLE_EOF )
+			{
+				*pBytesReadOut = (int)bytesRead;
+				result = STORAGE_OK;
+			}
+			CloseHandle( hFile );
+		}
+	}
+
+	return result;
+}
+
 FILE *WinStorage::GetFilePtr( BoyFileHandle hFile )
 {
 	FILE *pRet = NULL;
 
 	int key = (int)hFile;
+	std::lock_guard<std::mutex> lock( mMutex );
 	std::map<int,FILE*>::iterator i = mOpenFiles.find( key );
 	if( i != mOpenFiles.end() )
 	{
@@ -3,6 +3,7 @@
 
 #include "Storage.h"
 #include <map>
+#include <windows.h>
 
 namespace Boy
 {
@@ -21,13 +22,26 @@ namespace Boy
 			virtual StorageResult FileWrite( BoyFileHandle fileHandle, const void *pBuffer, int writeSizeBytes );
 			virtual StorageResult FileClose( BoyFileHandle fileHandle );
 			virtual int FileGetSize( BoyFileHandle openFileHandle );
+			virtual StorageResult FileSeek( BoyFileHandle fileHandle, int offset );
+			virtual StorageResult FileMap( const char *pFilePathUtf8, BoyFileHandle *pMapHandleOut, const void **ppDataOut, int *pSizeBytesOut );
+			virtual StorageResult FileUnmap( BoyFileHandle mapHandle );
+			virtual StorageResult FileRename( const char *pFromPathUtf8, const char *pToPathUtf8 );
+			virtual StorageResult FileReadAt( const char *pFilePathUtf8, int offset, int sizeBytes, void *pBuffer, int *pBytesReadOut );
 
 		private:
 
 			FILE *GetFilePtr( BoyFileHandle hFile );
 
+			struct Mapping
+			{
+				HANDLE hFile;
+				HANDLE hMapping;
+				const void *pView;
+			};
+
 			int mFileKey;
 			std::map<int,FILE*> mOpenFiles;
+			std::map<int,Mapping> mMappings;
 
 	};
 
@@ -0,0 +1,192 @@
+#include "WinTextureAtlas.h"
+
+#include <algorithm>
+#include <assert.h>
+#include "AtlasPacker.h"
+#include "Environment.h"
+#include <string.h>
+#include "WinD3DInterface.h"
+#include "WinImage.h"
+
+using namespace Boy;
+
+#include "BoyLib/CrtDbgNew.h"
+
+// empty pixels around every image (filled with copies of the image's
+// edge so that bilinear filtering doesn't pick up its neighbors):
+#define ATLAS_PADDING 1
+
+static int nextPowerOf2(int x)
+{
+	int p = 1;
+	while (p<x)
+	{
+		p <<= 1;
+	}
+	return p;
+}
+
+WinTextureAtlas::WinTextureAtlas(WinD3DInterface *d3dInterface, int pageSize)
+{
+	mInterface = d3dInterface;
+	mPageSize = pageSize;
+}
+
+WinTextureAtlas::~WinTextureAtlas()
+{
+	clear();
+}
+
+void WinTextureAtlas::add(WinImage *image, unsigned int *pixels, int width, int height)
+{
+	assert(width + 2*ATLAS_PADDING <= mPageSize && height + 2*ATLAS_PADDING <= mPageSize);
+
+	Entry e;
+	e.image = image;
+	e.pixels = pixels;
+	e.width = width;
+	e.height = height;
+	e.x = 0;
+	e.y = 0;
+	mEntries.push_back(e);
+}
+
+// tallest first (then widest) packs best:
+static bool entryTaller(const WinTextureAtlas::Entry *a, const WinTextureAtlas::Entry *b)
+{
+	if (a->height!=b->height) return a->height > b->height;
+	return a->width > b->width;
+}
+
+void WinTextureAtlas::build(Stats &stats)
+{
+	memset(&stats, 0, sizeof(Stats));
+
+	std::vector<Entry*> remaining;
+	for (size_t i=0 ; i<mEntries.size() ; i++)
+	{
+		remaining.push_back(&mEntries[i]);
+	}
+	std::stable_sort(remaining.begin(), remaining.end(), entryTaller);
+
+	long long imageArea = 0;
+	long long pageArea = 0;
+	while (!remaining.empty())
+	{
+		// fill a page with as many as fit:
+		AtlasPacker packer(mPageSize, mPageSize);
+		std::vector<Entry*> placed;
+		std::vector<Entry*> rest;
+		int usedWidth = 0;
+		int usedHeight = 0;
+		for (size_t i=0 ; i<remaining.size() ; i++)
+		{
+			Entry *e = remaining[i];
+			int x, y;
+			if (packer.insert(e->width + 2*ATLAS_PADDING, e->height + 2*ATLAS_PADDING, &x, &y))
+			{
+				e->x = x + ATLAS_PADDING;
+				e->y = y + ATLAS_PADDING;
+				usedWidth = std::max(usedWidth, x + e->width + 2*ATLAS_PADDING);
+				usedHeight = std::max(usedHeight, y + e->height + 2*ATLAS_PADDING);
+				placed.push_back(e);
+			}
+			else
+			{
+				rest.push_back(e);
+			}
+		}
+		assert(!placed.empty());
+		remaining.swap(rest);
+
+		// the last page is usually only partly used, so trim it:
+		int pageWidth = nextPowerOf2(usedWidth);
+		int pageHeight = nextPowerOf2(usedHeight);
+
+		IDirect3DTexture9 *page = createPage(pageWidth, pageHeight, &placed[0], (int)placed.size());
+		if (page==NULL)
+		{
+			envDebugLog("WARNING: could not create %dx%d atlas page\n", pageWidth, pageHeight);
+			continue;
+		}
+
+		// the images own the page now:
+		page->Release();
+
+		stats.pages++;
+		stats.images += (int)placed.size();
+		pageArea += (long long)pageWidth * pageHeight;
+		for (size_t i=0 ; i<placed.size() ; i++)
+		{
+			imageArea += (long long)placed[i]->width * placed[i]->height;
+		}
+	}
+
+	stats.occupancy = pageArea>0 ? (float)((double)imageArea / pageArea) : 0;
+
+	clear();
+}
+
+IDirect3DTexture9 *WinTextureAtlas::createPage(int width, int height, Entry **entries, int count)
+{
+	IDirect3DTexture9 *tex = mInterface->createTexture(width, height);
+	if (tex==NULL)
+	{
+		return NULL;
+	}
+
+	D3DLOCKED_RECT rect;
+	HRESULT hr = tex->LockRect(0, &rect, NULL, 0);
+	if (FAILED(hr))
+	{
+		tex->Release();
+		return NULL;
+	}
+
+	// start out transparent:
+	unsigned char *bits = (unsigned char*)rect.pBits;
+	for (int y=0 ; y<height ; y++)
+	{
+		memset(bits + y * rect.Pitch, 0, width * sizeof(unsigned int));
+	}
+
+	bool premultiply = mInterface->isPremultipliedAlpha();
+	for (int i=0 ; i<count ; i++)
+	{
+		Entry *e = entries[i];
+
+		// copy the image and repeat its edges into the padding:
+		for (int y=-ATLAS_PADDING ; y<e->height+ATLAS_PADDING ; y++)
+		{
+			int sy = y<0 ? 0 : (y>=e->height ? e->height-1 : y);
+			const unsigned int *src = e->pixels + sy * e->width;
+			unsigned int *dst = (unsigned int*)(bits + (e->y + y) * rect.Pitch) + e->x;
+			for (int x=-ATLAS_PADDING ; x<e->width+ATLAS_PADDING ; x++)
+			{
+				int sx = x<0 ? 0 : (x>=e->width ? e->width-1 : x);
+				unsigned int c = src[sx];
+
+				// map transparent white pixels to black like loadTexture
+				// does (this fixes the white fuzz at the edges of images):
+				c = c==0x00ffffff ? 0 : c;
+				dst[x] = premultiply ? WinD3DInterface::premultiplyColor(c) : c;
+			}
+		}
+
+		// every image keeps a reference to its page:
+		tex->AddRef();
+		e->image->setTexture(tex, false, e->x, e->y, true);
+	}
+
+	tex->UnlockRect(0);
+	return tex;
+}
+
+void WinTextureAtlas::clear()
+{
+	for (size_t i=0 ; i<mEntries.size() ; i++)
+	{
+		delete[] mEntries[i].pixels;
+	}
+	mEntries.clear();
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "BoyLib/CrtDbgInc.h"
+
+#include "d3d9.h"
+#include <vector>
+
+namespace Boy
+{
+	class WinD3DInterface;
+	class WinImage;
+
+	/*
+	 * packs the small images of a resource group into shared texture
+	 * pages so that drawing them doesn't need a texture switch each.
+	 * images are collected while the group loads and get their page
+	 * (and their position on it) when build() is called. each image
+	 * holds a reference to its page, so a page goes away with the
+	 * last of its images.
+	 */
+	class WinTextureAtlas
+	{
+	public:
+
+		struct Stats
+		{
+			int images; // number of images packed
+			int pages; // number of pages created
+			float occupancy; // fraction of the pages' area that's used
+		};
+
+		WinTextureAtlas(WinD3DInterface *d3dInterface, int pageSize);
+		virtual ~WinTextureAtlas();
+
+		// queues an image for packing (the atlas takes the pixels,
+		// which must have been allocated with new[]):
+		void add(WinImage *image, unsigned int *pixels, int width, int height);
+
+		inline bool isEmpty() { return mEntries.empty(); }
+
+		// packs everything that's queued and hands out the textures:
+		void build(Stats &stats);
+
+		// a queued image:
+		struct Entry
+		{
+			WinImage *image;
+			unsigned int *pixels;
+			int width;
+			int height;
+			int x;
+			int y;
+		};
+
+	private:
+
+		IDirect3DTexture9 *createPage(int width, int height, Entry **entries, int count);
+		void clear();
+
+	private:
+
+		WinD3DInterface *mInterface;
+		int mPageSize;
+		std::vector<Entry> mEntries;
+	};
+}
@@ -1,20 +1,35 @@
 #include "WinTriStrip.h"
 
 #include <assert.h>
+#include <string.h>
 
 using namespace Boy;
 
 #include "BoyLib/CrtDbgNew.h"
 
-WinTriStrip::WinTriStrip(int numVerts)
+WinTriStrip::WinTriStrip(WinTriStripPool *pool, int numVerts)
 {
 	mVertexCount = numVerts;
 	mVerts = new BoyVertex[numVerts];
 	memset(mVerts, 0, numVerts*sizeof(BoyVertex));
+
+	// grab a range of the pool's vertex buffers:
+	mPool = pool;
+	mPool->addRef();
+	if (numVerts<=0 || !mPool->allocate(numVerts, mAllocation))
+	{
+		mAllocation.chunk = -1;
+	}
+
+	// everything has to be uploaded:
+	mDirtyFirst = 0;
+	mDirtyLast = numVerts;
 }
 
 WinTriStrip::~WinTriStrip()
 {
+	mPool->free(mAllocation);
+	mPool->release();
 	delete[] mVerts;
 }
 
@@ -23,17 +38,20 @@ void WinTriStrip::setVertPos(int i, float x, float y, float z)
 	mVerts[i].x = x;
 	mVerts[i].y = y;
 	mVerts[i].z = z;
+	markDirty(i, i+1);
 }
 
 void WinTriStrip::setVertTex(int i, float u, float v)
 {
 	mVerts[i].u = u;
 	mVerts[i].v = v;
+	markDirty(i, i+1);
 }
 
 void WinTriStrip::setVertColor(int i, Color color)
 {
 	mVerts[i].color = (D3DCOLOR)color; // both are ARGB format
+	markDirty(i, i+1);
 }
 
 void WinTriStrip::setColor(Color color)
@@ -42,4 +60,26 @@ void WinTriStrip::setColor(Color color)
 	{
 		mVerts[i].color = (D3DCOLOR)color;
 	}
+	markDirty(0, mVertexCount);
+}
+
+bool WinTriStrip::prepare()
+{
+	if (mAllocation.chunk<0)
+	{
+		return false;
+	}
+
+	// send whatever changed:
+	if (mDirtyFirst<mDirtyLast)
+	{
+		if (!mPool->upload(mAllocation, mDirtyFirst, mVerts + mDirtyFirst, mDirtyLast - mDirtyFirst))
+		{
+			return false;
+		}
+		mDirtyFirst = mVertexCount;
+		mDirtyLast = 0;
+	}
+
+	return true;
 }
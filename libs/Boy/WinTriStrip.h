@@ -3,14 +3,21 @@
 #include "d3d9.h"
 #include "TriStrip.h"
 #include "WinD3DInterface.h"
+#include "WinTriStripPool.h"
 
 namespace Boy
 {
+	/*
+	 * a tri strip whose vertices live in a range of one of the pool's
+	 * vertex buffers. changes are collected in a dirty range and sent
+	 * to the device the next time the strip is drawn, so a strip that
+	 * doesn't change costs nothing but the draw call.
+	 */
 	class WinTriStrip : public TriStrip
 	{
 	public:
 
-		WinTriStrip(int numVerts);
+		WinTriStrip(WinTriStripPool *pool, int numVerts);
 		virtual ~WinTriStrip();
 
 		virtual void setColor(Color color);
@@ -19,10 +26,33 @@ namespace Boy
 		virtual void setVertTex(int i, float u, float v);
 		virtual void setVertColor(int i, Color color);
 
+		// uploads the dirty range, returns false if the strip
+		// has no device buffer (it has to be drawn from mVerts):
+		bool prepare();
+
+		inline IDirect3DVertexBuffer9 *getBuffer() { return mPool->getBuffer(mAllocation); }
+		inline int getBufferOffset() { return mAllocation.offset; }
+
+	private:
+
+		inline void markDirty(int first, int last)
+		{
+			if (first<mDirtyFirst) mDirtyFirst = first;
+			if (last>mDirtyLast) mDirtyLast = last;
+		}
+
 	public:
 
 		int mVertexCount;
 		BoyVertex *mVerts;
 
+	private:
+
+		WinTriStripPool *mPool;
+		WinTriStripPool::Allocation mAllocation;
+
+		// vertices that changed since the last upload (last is exclusive):
+		int mDirtyFirst;
+		int mDirtyLast;
 	};
 };
@@ -0,0 +1,180 @@
+#include "WinTriStripPool.h"
+
+#include <assert.h>
+#include <string.h>
+
+using namespace Boy;
+
+#include "BoyLib/CrtDbgNew.h"
+
+WinTriStripPool::WinTriStripPool(IDirect3DDevice9 *device, int chunkVertexCount)
+{
+	assert(chunkVertexCount>0);
+
+	mDevice = device;
+	mDevice->AddRef();
+	mRefCount = 1;
+	mChunkVertexCount = chunkVertexCount;
+
+	memset(&mFrameStats, 0, sizeof(Stats));
+	memset(&mLastFrameStats, 0, sizeof(Stats));
+}
+
+WinTriStripPool::~WinTriStripPool()
+{
+	for (size_t i=0 ; i<mChunks.size() ; i++)
+	{
+		mChunks[i]->buffer->Release();
+		delete mChunks[i];
+	}
+	mDevice->Release();
+}
+
+void WinTriStripPool::addRef()
+{
+	mRefCount++;
+}
+
+void WinTriStripPool::release()
+{
+	assert(mRefCount>0);
+	mRefCount--;
+	if (mRefCount==0)
+	{
+		delete this;
+	}
+}
+
+bool WinTriStripPool::allocate(int count, Allocation &alloc)
+{
+	assert(count>0);
+	alloc.chunk = -1;
+	alloc.offset = 0;
+	alloc.count = 0;
+
+	// look for room in the existing buffers:
+	for (int i=0 ; i<(int)mChunks.size() ; i++)
+	{
+		if (allocate(i, count, alloc))
+		{
+			return true;
+		}
+	}
+
+	// add another buffer (big strips get one of their own):
+	Chunk *chunk = new Chunk();
+	chunk->vertexCount = count > mChunkVertexCount ? count : mChunkVertexCount;
+	HRESULT hr = mDevice->CreateVertexBuffer(
+		chunk->vertexCount * sizeof(BoyVertex),
+		D3DUSAGE_WRITEONLY,
+		BOYFVF,
+		D3DPOOL_MANAGED,
+		&chunk->buffer,
+		NULL);
+	if (FAILED(hr))
+	{
+		delete chunk;
+		return false;
+	}
+	chunk->freeRanges[0] = chunk->vertexCount;
+	mChunks.push_back(chunk);
+
+	return allocate((int)mChunks.size()-1, count, alloc);
+}
+
+bool WinTriStripPool::allocate(int chunkIndex, int count, Allocation &alloc)
+{
+	// first fit:
+	std::map<int,int> &freeRanges = mChunks[chunkIndex]->freeRanges;
+	for (std::map<int,int>::iterator iter=freeRanges.begin() ; iter!=freeRanges.end() ; ++iter)
+	{
+		if (iter->second >= count)
+		{
+			int offset = iter->first;
+			int remaining = iter->second - count;
+			freeRanges.erase(iter);
+			if (remaining>0)
+			{
+				freeRanges[offset+count] = remaining;
+			}
+
+			alloc.chunk = chunkIndex;
+			alloc.offset = offset;
+			alloc.count = count;
+			return true;
+		}
+	}
+	return false;
+}
+
+void WinTriStripPool::free(Allocation &alloc)
+{
+	if (alloc.chunk<0)
+	{
+		return;
+	}
+
+	std::map<int,int> &freeRanges = mChunks[alloc.chunk]->freeRanges;
+	int offset = alloc.offset;
+	int count = alloc.count;
+
+	// merge with the free range that follows:
+	std::map<int,int>::iterator next = freeRanges.find(offset+count);
+	if (next!=freeRanges.end())
+	{
+		count += next->second;
+		freeRanges.erase(next);
+	}
+
+	// and with the one that comes before:
+	std::map<int,int>::iterator prev = freeRanges.lower_bound(offset);
+	if (prev!=freeRanges.begin())
+	{
+		--prev;
+		if (prev->first + prev->second == offset)
+		{
+			offset = prev->first;
+			count += prev->second;
+			freeRanges.erase(prev);
+		}
+	}
+
+	freeRanges[offset] = count;
+
+	alloc.chunk = -1;
+	alloc.offset = 0;
+	alloc.count = 0;
+}
+
+bool WinTriStripPool::upload(const Allocation &alloc, int first, const BoyVertex *verts, int count)
+{
+	assert(alloc.chunk>=0);
+	assert(first>=0 && count>0 && first+count<=alloc.count);
+
+	// only lock the range that changed (the runtime
+	// sends just the locked range to the device):
+	IDirect3DVertexBuffer9 *buffer = mChunks[alloc.chunk]->buffer;
+	void *vbData = NULL;
+	HRESULT hr = buffer->Lock(
+		(alloc.offset + first) * sizeof(BoyVertex),
+		count * sizeof(BoyVertex),
+		&vbData,
+		0);
+	if (FAILED(hr)) return false;
+	memcpy(vbData, verts, count * sizeof(BoyVertex));
+	buffer->Unlock();
+
+	mFrameStats.uploads++;
+	mFrameStats.vertices += count;
+	return true;
+}
+
+void WinTriStripPool::beginFrame()
+{
+	memset(&mFrameStats, 0, sizeof(Stats));
+}
+
+void WinTriStripPool::endFrame()
+{
+	mLastFrameStats = mFrameStats;
+}
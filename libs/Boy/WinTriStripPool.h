@@ -0,0 +1,86 @@
+#pragma once
+
+#include "BoyLib/CrtDbgInc.h"
+
+#include "d3d9.h"
+#include <map>
+#include <vector>
+#include "WinD3DInterface.h"
+
+namespace Boy
+{
+	/*
+	 * hands out ranges of vertices in a few large vertex buffers so
+	 * that tri strips can keep their vertices on the device between
+	 * frames. the buffers are in the managed pool, so they survive a
+	 * lost device and only the ranges that get locked are uploaded.
+	 *
+	 * strips keep a reference to the pool because they can outlive
+	 * the interface that created it.
+	 */
+	class WinTriStripPool
+	{
+	public:
+
+		// a range of vertices in one of the pool's buffers:
+		struct Allocation
+		{
+			int chunk; // -1 if nothing is allocated
+			int offset;
+			int count;
+		};
+
+		struct Stats
+		{
+			int uploads; // number of locks
+			int vertices; // number of vertices uploaded
+		};
+
+		WinTriStripPool(IDirect3DDevice9 *device, int chunkVertexCount);
+
+		void addRef();
+		void release();
+
+		bool allocate(int count, Allocation &alloc);
+		void free(Allocation &alloc);
+
+		// copies count vertices into the allocation, starting at its vertex first:
+		bool upload(const Allocation &alloc, int first, const BoyVertex *verts, int count);
+
+		inline IDirect3DVertexBuffer9 *getBuffer(const Allocation &alloc) { return mChunks[alloc.chunk]->buffer; }
+
+		// frame bracketing (resets the per-frame counters):
+		void beginFrame();
+		void endFrame();
+
+		// stats for the frame in progress and for the last complete frame:
+		inline const Stats &getFrameStats() { return mFrameStats; }
+		inline const Stats &getLastFrameStats() { return mLastFrameStats; }
+
+	private:
+
+		~WinTriStripPool();
+
+		// one vertex buffer and its free ranges (offset -> count):
+		struct Chunk
+		{
+			IDirect3DVertexBuffer9 *buffer;
+			int vertexCount;
+			std::map<int,int> freeRanges;
+		};
+
+		bool allocate(int chunk, int count, Allocation &alloc);
+
+	private:
+
+		IDirect3DDevice9 *mDevice;
+		int mRefCount;
+
+		std::vector<Chunk*> mChunks;
+		int mChunkVertexCount;
+
+		// counters:
+		Stats mFrameStats;
+		Stats mLastFrameStats;
+	};
+}
@@ -0,0 +1,131 @@
+#include "WorkerPool.h"
+
+#include <assert.h>
+
+using namespace Boy;
+
+#include "BoyLib/CrtDbgNew.h"
+
+WorkerPool::WorkerPool(int threadCount)
+{
+	if (threadCount <= 0)
+	{
+		threadCount = getHardwareThreadCount();
+	}
+
+	mBatch = 0;
+	mBusyCount = 0;
+	mQuit = false;
+	mFunc = NULL;
+	mContext = NULL;
+	mCount = 0;
+	mNext = 0;
+
+	// the caller is worker 0:
+	for (int i=1 ; i<threadCount ; i++)
+	{
+		mThreads.push_back(std::thread(workerProc, this, i));
+	}
+}
+
+WorkerPool::~WorkerPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mQuit = true;
+	}
+	mWakeCondition.notify_all();
+
+	for (size_t i=0 ; i<mThreads.size() ; i++)
+	{
+		mThreads[i].join();
+	}
+}
+
+int WorkerPool::getHardwareThreadCount()
+{
+	int count = (int)std::thread::hardware_concurrency();
+	return count > 0 ? count : 1;
+}
+
+void WorkerPool::run(int count, TaskFunc func, void *context)
+{
+	assert(func!=NULL);
+
+	if (mThreads.empty() || count <= 1)
+	{
+		for (int i=0 ; i<count ; i++)
+		{
+			func(context, i, 0);
+		}
+		return;
+	}
+
+	// hand out the batch:
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mFunc = func;
+		mContext = context;
+		mCount = count;
+		mNext = 0;
+		mBusyCount = (int)mThreads.size();
+		mBatch++;
+	}
+	mWakeCondition.notify_all();
+
+	// help out:
+	work(0);
+
+	// wait for the others to finish:
+	std::unique_lock<std::mutex> lock(mMutex);
+	while (mBusyCount > 0)
+	{
+		mDoneCondition.wait(lock);
+	}
+}
+
+void WorkerPool::workerProc(WorkerPool *pool, int worker)
+{
+	unsigned int batch = 0;
+	for (;;)
+	{
+		// wait for a new batch:
+		{
+			std::unique_lock<std::mutex> lock(pool->mMutex);
+			while (!pool->mQuit && pool->mBatch == batch)
+			{
+				pool->mWakeCondition.wait(lock);
+			}
+			if (pool->mQuit)
+			{
+				return;
+			}
+			batch = pool->mBatch;
+		}
+
+		pool->work(worker);
+
+		// let run() know this thread is done:
+		{
+			std::lock_guard<std::mutex> lock(pool->mMutex);
+			pool->mBusyCount--;
+			if (pool->mBusyCount == 0)
+			{
+				pool->mDoneCondition.notify_one();
+			}
+		}
+	}
+}
+
+void WorkerPool::work(int worker)
+{
+	for (;;)
+	{
+		int index = mNext++;
+		if (index >= mCount)
+		{
+			return;
+		}
+		mFunc(mContext, index, worker);
+	}
+}
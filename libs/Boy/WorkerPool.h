@@ -0,0 +1,58 @@
+#pragma once
+
+#include "BoyLib/CrtDbgInc.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Boy
+{
+	/*
+	 * a fixed set of threads that work through a batch of numbered
+	 * tasks together. the calling thread joins in as worker 0, so a
+	 * pool of one thread runs everything inline.
+	 */
+	class WorkerPool
+	{
+	public:
+
+		// called once per task (worker is in [0,getThreadCount())):
+		typedef void (*TaskFunc)(void *context, int index, int worker);
+
+		// threadCount includes the calling thread (0 means one per core):
+		WorkerPool(int threadCount);
+		virtual ~WorkerPool();
+
+		inline int getThreadCount() { return (int)mThreads.size() + 1; }
+
+		// runs tasks 0..count-1 and returns once they're all done:
+		void run(int count, TaskFunc func, void *context);
+
+		// the number of threads the hardware can run at once:
+		static int getHardwareThreadCount();
+
+	private:
+
+		static void workerProc(WorkerPool *pool, int worker);
+		void work(int worker);
+
+	private:
+
+		std::vector<std::thread> mThreads;
+		std::mutex mMutex;
+		std::condition_variable mWakeCondition;
+		std::condition_variable mDoneCondition;
+		unsigned int mBatch;
+		int mBusyCount;
+		bool mQuit;
+
+		// the current batch:
+		TaskFunc mFunc;
+		void *mContext;
+		int mCount;
+		std::atomic<int> mNext;
+	};
+}
@@ -0,0 +1,128 @@
+#include "Boy/ResourcePackBuilder.h"
+#include <filesystem>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+/*
+ * packres: builds a resource pack out of a game's resource directories.
+ *
+ *   packres [options] <pack file> <game dir> <dir or file>...
+ *
+ * files are named in the pack by their path relative to the game dir
+ * (which is what the game asks for), so for example
+ *
+ *   packres -lang fr,en -compress wog.pack . res properties
+ *
+ * options:
+ *   -lang lang1[,lang2]   pick language variants for these languages
+ *   -localized ext,...    extensions that have language variants (png,ogg)
+ *   -compress             compress files when that saves space
+ */
+
+static void split(const std::string &s, std::vector<std::string> &parts)
+{
+	size_t start = 0;
+	while (start <= s.size())
+	{
+		size_t end = s.find(',', start);
+		if (end == std::string::npos)
+		{
+			end = s.size();
+		}
+		if (end > start)
+		{
+			parts.push_back(s.substr(start, end - start));
+		}
+		start = end + 1;
+	}
+}
+
+static void usage()
+{
+	printf("usage: packres [-lang lang1[,lang2]] [-localized ext,...] [-compress] <pack file> <game dir> <dir or file>...\n");
+}
+
+int main(int argc, char* argv[])
+{
+	namespace fs = std::filesystem;
+
+	Boy::ResourcePackBuilder builder;
+	std::vector<std::string> args;
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "-lang") == 0 && i + 1 < argc)
+		{
+			std::vector<std::string> langs;
+			split(argv[++i], langs);
+			builder.setLanguages(langs.size() > 0 ? langs[0] : "", langs.size() > 1 ? langs[1] : "");
+		}
+		else if (strcmp(argv[i], "-localized") == 0 && i + 1 < argc)
+		{
+			std::vector<std::string> exts;
+			split(argv[++i], exts);
+			builder.setLocalizedExtensions(exts);
+		}
+		else if (strcmp(argv[i], "-compress") == 0)
+		{
+			builder.setCompression(true);
+		}
+		else if (argv[i][0] == '-')
+		{
+			usage();
+			return 1;
+		}
+		else
+		{
+			args.push_back(argv[i]);
+		}
+	}
+	if (args.size() < 3)
+	{
+		usage();
+		return 1;
+	}
+
+	// collect the files:
+	fs::path root(args[1]);
+	int count = 0;
+	for (size_t i = 2; i < args.size(); i++)
+	{
+		fs::path p = root / args[i];
+		std::error_code err;
+		if (fs::is_regular_file(p, err))
+		{
+			builder.addFile(fs::relative(p, root).generic_string(), p.string());
+			count++;
+			continue;
+		}
+		if (!fs::is_directory(p, err))
+		{
+			printf("ERROR: '%s' not found\n", p.string().c_str());
+			return 1;
+		}
+		for (fs::recursive_directory_iterator it(p, err), end; it != end; it.increment(err))
+		{
+			if (it->is_regular_file(err))
+			{
+				builder.addFile(fs::relative(it->path(), root).generic_string(), it->path().string());
+				count++;
+			}
+		}
+	}
+
+	// and pack them:
+	Boy::ResourcePackBuilder::Stats stats;
+	if (!builder.build(args[0].c_str(), stats))
+	{
+		return 1;
+	}
+
+	printf("%s: %d files (%d scanned, %d language variants resolved, %d dropped, %d compressed)\n",
+		args[0].c_str(), stats.files, count, stats.variantsResolved, stats.variantsDropped, stats.compressed);
+	printf("%lld bytes in, %lld bytes packed\n", stats.sourceBytes, stats.packBytes);
+
+	return 0;
+}